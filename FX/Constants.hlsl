@@ -28,6 +28,13 @@ cbuffer cbPerMesh : register(b2)
 	Material gMaterial;
 }
 
+//skinned meshes only, see GfxParamsSkin
+#define MAX_BONES 64
+cbuffer cbSkin : register(b3)
+{
+	float4x4 gBones[MAX_BONES];
+}
+
 // Nonnumeric values cannot be added to a cbuffer.
 Texture2D gDiffuseMap : register(t0);
 
@@ -41,6 +48,24 @@ struct VertexIn
 	float2 Tex		: TEXCOORD;
 };
 
+//compact version, see VertexPosNormTexQ
+struct VertexInQ
+{
+	float4 PosL		: POSITION;		//0-1 inside the mesh bounds, gWorld puts it back
+	float2 NormalOct: NORMAL;		//octahedral encoded
+	float2 Tex		: TEXCOORD;
+};
+
+//skinned version, see VertexPosNormTexSkin
+struct VertexInSkin
+{
+	float3 PosL		: POSITION;		//bind pose
+	float3 NormalL	: NORMAL;
+	float2 Tex		: TEXCOORD;
+	uint4 Bones		: BLENDINDICES;
+	float4 Weights	: BLENDWEIGHT;
+};
+
 struct VertexOut
 {
 	float4 PosH		: SV_POSITION;
@@ -0,0 +1,31 @@
+//see ParticleSystem
+
+#define MAX_PARTICLE_FRAMES 64
+
+cbuffer cbParticles : register(b0)
+{
+	float4x4 gViewProj;
+	float4 gCamRight;		//world space, w unused
+	float4 gCamUp;
+	float4 gFrames[MAX_PARTICLE_FRAMES];	//the emitter's atlas frames as uv left, top, right, bottom
+};
+
+Texture2D gParticleTex : register(t0);
+SamplerState samLinear : register(s0);
+
+//see ParticleSystem::Instance, one per particle
+struct ParticleIn
+{
+	float3 Pos		: POSITION;		//centre, world space
+	float Size		: SIZE;			//width and height in world units
+	float4 Colour	: COLOR;
+	uint Frame		: FRAME;
+	uint Corner		: SV_VertexID;
+};
+
+struct ParticleOut
+{
+	float4 PosH		: SV_POSITION;
+	float2 Tex		: TEXCOORD;
+	float4 Colour	: COLOR;
+};
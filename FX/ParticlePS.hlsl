@@ -0,0 +1,7 @@
+#include "ParticleConstants.hlsl"
+
+//tinted texel, the blend state decides whether it's layered or added on
+float4 main(ParticleOut pin) : SV_Target
+{
+	return gParticleTex.Sample(samLinear, pin.Tex) * pin.Colour;
+}
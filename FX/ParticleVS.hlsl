@@ -0,0 +1,19 @@
+#include "ParticleConstants.hlsl"
+
+//there's no vertex buffer, each particle is a 4 vertex strip facing the camera and the corner picks which
+ParticleOut main(ParticleIn vin)
+{
+	ParticleOut vout;
+
+	//top left, top right, bottom left, bottom right
+	float2 corner = float2(vin.Corner & 1, vin.Corner >> 1);
+	float2 offset = (corner - 0.5f) * vin.Size;
+	float3 pos = vin.Pos + gCamRight.xyz * offset.x - gCamUp.xyz * offset.y;
+
+	vout.PosH = mul(gViewProj, float4(pos, 1.0f));
+	float4 rect = gFrames[vin.Frame];
+	vout.Tex = lerp(rect.xy, rect.zw, corner);
+	vout.Colour = vin.Colour;
+
+	return vout;
+}
@@ -0,0 +1,39 @@
+
+//see SpriteRenderer, sprites don't use the 3D constants
+
+cbuffer cbSprites : register(b0)
+{
+	float4 gViewport;		//2/width, -2/height, -1, 1 - pixels to clip space
+};
+
+//an atlas frame, see SpriteRenderer::Frame
+struct Frame
+{
+	float4 Rect;			//left, top, right, bottom in texels
+	float2 InvDim;			//1/texture size
+	float2 Pad;
+};
+StructuredBuffer<Frame> gFrames : register(t1);	//vertex shader, t0 is the pixel shader's texture
+
+Texture2D gSpriteTex : register(t0);
+SamplerState samLinear : register(s0);
+
+//one per sprite, see SpriteRenderer::Instance
+struct SpriteIn
+{
+	float2 Pos		: POSITION;		//where the origin goes, pixels
+	float2 Scale	: SCALE;
+	float2 Origin	: ORIGIN;		//texels from the frame's top left
+	float Rotation	: ROTATION;
+	uint Frame		: FRAME;		//into gFrames
+	float4 Colour	: COLOR;
+	float Depth		: DEPTH;
+	uint Corner		: SV_VertexID;	//0-3, which corner of the quad
+};
+
+struct SpriteOut
+{
+	float4 PosH		: SV_POSITION;
+	float2 Tex		: TEXCOORD;
+	float4 Colour	: COLOR;
+};
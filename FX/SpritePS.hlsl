@@ -0,0 +1,7 @@
+#include "SpriteConstants.hlsl"
+
+//tinted texel, same as SpriteBatch
+float4 main(SpriteOut pin) : SV_Target
+{
+	return gSpriteTex.Sample(samLinear, pin.Tex) * pin.Colour;
+}
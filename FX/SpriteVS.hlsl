@@ -0,0 +1,24 @@
+#include "SpriteConstants.hlsl"
+
+//there's no vertex buffer, each sprite is drawn as a 4 vertex strip and the corner picks which
+SpriteOut main(SpriteIn vin)
+{
+	SpriteOut vout;
+
+	Frame frame = gFrames[vin.Frame];
+	//top left, top right, bottom left, bottom right
+	float2 corner = float2(vin.Corner & 1, vin.Corner >> 1);
+	float2 size = frame.Rect.zw - frame.Rect.xy;
+
+	//scale and rotate around the origin, the same way SpriteBatch does
+	float2 local = (corner * size - vin.Origin) * vin.Scale;
+	float s, c;
+	sincos(vin.Rotation, s, c);
+	float2 pos = vin.Pos + float2(local.x * c - local.y * s, local.x * s + local.y * c);
+
+	vout.PosH = float4(pos * gViewport.xy + gViewport.zw, vin.Depth, 1.0f);
+	vout.Tex = (frame.Rect.xy + corner * size) * frame.InvDim;
+	vout.Colour = vin.Colour;
+
+	return vout;
+}
@@ -0,0 +1,36 @@
+
+//see TextRenderer, text doesn't use the 3D constants
+
+cbuffer cbText : register(b0)
+{
+	float4 gViewport;		//2/width, -2/height, -1, 1 - pixels to clip space
+};
+
+//a glyph in the atlas, see TextRenderer::GlyphGPU
+struct Glyph
+{
+	float4 Rect;			//uv left, top, right, bottom
+	float2 Offset;			//top left of the quad from the pen, font pixels
+	float2 Size;			//font pixels
+};
+StructuredBuffer<Glyph> gGlyphs : register(t1);	//vertex shader, t0 is the pixel shader's atlas
+
+Texture2D gAtlas : register(t0);				//signed distance fields, 0.5 is on the outline
+SamplerState samLinear : register(s0);
+
+//one per glyph, see TextRenderer::Instance
+struct TextIn
+{
+	float2 Pos		: POSITION;		//pen position, pixels
+	float Scale		: SCALE;		//pixels per font pixel
+	uint Glyph		: GLYPH;		//into gGlyphs
+	float4 Colour	: COLOR;		//premultiplied
+	uint Corner		: SV_VertexID;	//0-3, which corner of the quad
+};
+
+struct TextOut
+{
+	float4 PosH		: SV_POSITION;
+	float2 Tex		: TEXCOORD;
+	float4 Colour	: COLOR;
+};
@@ -0,0 +1,10 @@
+#include "TextConstants.hlsl"
+
+//the edge is wherever the distance crosses 0.5, blurred over about a screen pixel whatever the scale
+float4 main(TextOut pin) : SV_Target
+{
+	float dist = gAtlas.Sample(samLinear, pin.Tex).r;
+	float width = max(fwidth(dist), 0.0001f);
+	float alpha = smoothstep(0.5f - width, 0.5f + width, dist);
+	return pin.Colour * alpha;
+}
@@ -0,0 +1,18 @@
+#include "TextConstants.hlsl"
+
+//no vertex buffer, like SpriteVS, each glyph is a 4 vertex strip and the corner picks which
+TextOut main(TextIn vin)
+{
+	TextOut vout;
+
+	Glyph glyph = gGlyphs[vin.Glyph];
+	//top left, top right, bottom left, bottom right
+	float2 corner = float2(vin.Corner & 1, vin.Corner >> 1);
+	float2 pos = vin.Pos + (glyph.Offset + corner * glyph.Size) * vin.Scale;
+
+	vout.PosH = float4(pos * gViewport.xy + gViewport.zw, 0.0f, 1.0f);
+	vout.Tex = lerp(glyph.Rect.xy, glyph.Rect.zw, corner);
+	vout.Colour = vin.Colour;
+
+	return vout;
+}
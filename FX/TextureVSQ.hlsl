@@ -0,0 +1,29 @@
+#include "Constants.hlsl"
+
+//unfold an octahedral encoded normal
+float3 OctDecode(float2 e)
+{
+	float3 n = float3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += (n.xy >= 0.0f) ? -t : t;
+	return normalize(n);
+}
+
+//same as TextureVS but for VertexPosNormTexQ, the mesh bounds are already 
+//in gWorld and gWorldViewProj so the position just goes straight in
+VertexOut main(VertexInQ vin)
+{
+	VertexOut vout;
+	
+	// Transform to world space space.
+	vout.PosW = mul(gWorld, float4(vin.PosL.xyz, 1.0f)).xyz;
+	vout.NormalW = mul((float3x3)gWorldInvTranspose, OctDecode(vin.NormalOct));
+		
+	// Transform to homogeneous clip space.
+	vout.PosH = mul(gWorldViewProj, float4(vin.PosL.xyz, 1.0f));
+
+	// Output vertex attributes for interpolation across triangle.
+	vout.Tex = mul(gTexTransform, float4(vin.Tex, 0.0f, 1.0f)).xy;
+
+	return vout;
+}
@@ -0,0 +1,25 @@
+#include "Constants.hlsl"
+
+//same as TextureVS but the vertex is moved by up to 4 bones first
+VertexOut main(VertexInSkin vin)
+{
+	VertexOut vout;
+
+	//blend the bone matrices, then it's an ordinary vertex
+	float4x4 skin = gBones[vin.Bones.x] * vin.Weights.x + gBones[vin.Bones.y] * vin.Weights.y +
+		gBones[vin.Bones.z] * vin.Weights.z + gBones[vin.Bones.w] * vin.Weights.w;
+	float4 posL = mul(skin, float4(vin.PosL, 1.0f));
+	float3 normalL = mul((float3x3)skin, vin.NormalL);
+
+	// Transform to world space space.
+	vout.PosW = mul(gWorld, posL).xyz;
+	vout.NormalW = normalize(mul((float3x3)gWorldInvTranspose, normalL));
+
+	// Transform to homogeneous clip space.
+	vout.PosH = mul(gWorldViewProj, posL);
+
+	// Output vertex attributes for interpolation across triangle.
+	vout.Tex = mul(gTexTransform, float4(vin.Tex, 0.0f, 1.0f)).xy;
+
+	return vout;
+}
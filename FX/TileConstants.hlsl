@@ -0,0 +1,30 @@
+
+//see Tilemap
+
+cbuffer cbTiles : register(b0)
+{
+	float4 gViewport;		//2/width, -2/height, -1, 1 - pixels to clip space
+	float2 gScroll;			//world pixels at the top left of the screen
+	float gTilePixels;		//size of a tile in world pixels
+	float gZoom;
+	float gTime;			//seconds, for animated tiles
+	float gTileU;			//width of a tile in the atlas, 0-1
+	float2 gPad;
+};
+
+Texture2D gTileTex : register(t0);
+SamplerState samPoint : register(s0);
+
+//see Tilemap::Vertex
+struct TileIn
+{
+	float2 Pos		: POSITION;		//world position in tiles
+	float2 Tex		: TEXCOORD;		//first frame
+	float2 Anim		: ANIM;			//number of frames and frames per second
+};
+
+struct TileOut
+{
+	float4 PosH		: SV_POSITION;
+	float2 Tex		: TEXCOORD;
+};
@@ -0,0 +1,6 @@
+#include "TileConstants.hlsl"
+
+float4 main(TileOut pin) : SV_Target
+{
+	return gTileTex.Sample(samPoint, pin.Tex);
+}
@@ -0,0 +1,15 @@
+#include "TileConstants.hlsl"
+
+TileOut main(TileIn vin)
+{
+	TileOut vout;
+
+	float2 pos = (vin.Pos * gTilePixels - gScroll) * gZoom;
+	vout.PosH = float4(pos * gViewport.xy + gViewport.zw, 0.0f, 1.0f);
+
+	//animated tiles move along the atlas row, so nothing is rebuilt
+	float frame = floor(fmod(gTime * vin.Anim.y, max(vin.Anim.x, 1.0f)));
+	vout.Tex = vin.Tex + float2(frame * gTileU, 0.0f);
+
+	return vout;
+}
@@ -0,0 +1,11 @@
+#include "ParticleSim.h"
+
+/*
+The CPU side benchmarks that don't need a window or a gpu, so they can be run off
+windows too. The game runs these and the rest from Game::RunBenchmarks.
+*/
+int main()
+{
+	ParticleSim::Benchmark(1000000, 120);
+	return 0;
+}
@@ -0,0 +1,359 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "Test.h"
+#include "GeoMip.h"
+
+using namespace std;
+using namespace GeoMip;
+
+//the indices a chunk draws with, the centre and the four edges picked by a mask of stitched edges
+static void GatherChunk(const vector<unsigned int>& indices, const Part parts[MAX_PARTS], int lod, int stitchMask, vector<unsigned int>& out)
+{
+	out.clear();
+	const Part& centre = parts[CentrePart(lod)];
+	out.insert(out.end(), indices.begin() + centre.startIndex, indices.begin() + centre.startIndex + centre.numIndices);
+	for (int e = 0; e < Edge::MAX_EDGES; ++e)
+	{
+		const Part& edge = parts[EdgePart(lod, e, (stitchMask >> e) & 1)];
+		out.insert(out.end(), indices.begin() + edge.startIndex, indices.begin() + edge.startIndex + edge.numIndices);
+	}
+}
+
+//is a vertex on a chunk edge, and where along it
+static bool OnEdge(int edge, int x, int z, int& along)
+{
+	switch (edge)
+	{
+	case Edge::NORTH:
+		along = x;
+		return z == CHUNK_CELLS;
+	case Edge::SOUTH:
+		along = x;
+		return z == 0;
+	case Edge::EAST:
+		along = z;
+		return x == CHUNK_CELLS;
+	default:
+		along = z;
+		return x == 0;
+	}
+}
+
+/*
+every LOD with every combination of stitched edges must cover the chunk exactly once,
+wind clockwise from above, only use that LOD's vertices, and on a stitched edge only the
+vertices the next LOD down uses, so neighbours meet without cracks
+*/
+static void TestBuildIndices()
+{
+	vector<unsigned int> indices, chunk;
+	Part parts[MAX_PARTS];
+	BuildIndices(indices, parts);
+	const int numVerts = CHUNK_VERTS * CHUNK_VERTS;
+
+	for (int p = 0; p < MAX_PARTS; ++p)
+	{
+		CHECK(parts[p].numIndices % 3 == 0);
+		CHECK(parts[p].startIndex >= 0 && parts[p].startIndex + parts[p].numIndices <= (int)indices.size());
+	}
+	CHECK(parts[CentrePart(NUM_LODS - 1)].numIndices == 0);
+
+	for (int lod = 0; lod < NUM_LODS; ++lod)
+	{
+		const int step = 1 << lod;
+		const int n = CHUNK_CELLS / step;
+		for (int mask = 0; mask < (1 << Edge::MAX_EDGES); ++mask)
+		{
+			GatherChunk(indices, parts, lod, mask, chunk);
+			bool inRange = true, onGrid = true, clockwise = true, edgesOnce = true, openOnBorder = true;
+			long long twiceArea = 0;
+			set<unsigned int> used;
+			map<pair<unsigned int, unsigned int>, int> directed;
+			for (size_t t = 0; t + 2 < chunk.size(); t += 3)
+			{
+				int x[3], z[3];
+				for (int c = 0; c < 3; ++c)
+				{
+					unsigned int v = chunk[t + c];
+					if (v >= (unsigned int)numVerts)
+					{
+						inRange = false;
+						v = 0;
+					}
+					x[c] = v % CHUNK_VERTS;
+					z[c] = v / CHUNK_VERTS;
+					if (x[c] % step || z[c] % step)
+						onGrid = false;
+					used.insert(v);
+					++directed[make_pair(chunk[t + c], chunk[t + (c + 1) % 3])];
+				}
+				//same sum as GeoMip's AddTri, positive is clockwise with +x east and +z north
+				int crossY = (z[1] - z[0]) * (x[2] - x[0]) - (x[1] - x[0]) * (z[2] - z[0]);
+				if (crossY <= 0)
+					clockwise = false;
+				twiceArea += crossY;
+			}
+			//every inside edge is used once each way, only the chunk's border is open
+			for (const auto& d : directed)
+			{
+				if (d.second > 1)
+					edgesOnce = false;
+				if (directed.count(make_pair(d.first.second, d.first.first)))
+					continue;
+				int ax = d.first.first % CHUNK_VERTS, az = d.first.first / CHUNK_VERTS;
+				int bx = d.first.second % CHUNK_VERTS, bz = d.first.second / CHUNK_VERTS;
+				bool border = (ax == bx && (ax == 0 || ax == CHUNK_CELLS)) || (az == bz && (az == 0 || az == CHUNK_CELLS));
+				if (!border)
+					openOnBorder = false;
+			}
+			CHECK(inRange);
+			CHECK(onGrid);
+			CHECK(clockwise);
+			CHECK(edgesOnce);
+			CHECK(openOnBorder);
+			CHECK(twiceArea == 2LL * CHUNK_CELLS * CHUNK_CELLS);
+
+			//all the LOD's vertices, less every other one along each stitched edge
+			int stitched = 0;
+			for (int e = 0; e < Edge::MAX_EDGES; ++e)
+				stitched += (mask >> e) & 1;
+			CHECK((int)used.size() == (n + 1) * (n + 1) - stitched * (n / 2));
+
+			//what's along each edge is exactly what the neighbour will have along its side
+			for (int e = 0; e < Edge::MAX_EDGES; ++e)
+			{
+				const bool isStitched = ((mask >> e) & 1) != 0;
+				const int edgeStep = isStitched ? step * 2 : step;
+				set<int> along, expected;
+				for (unsigned int v : used)
+				{
+					int a;
+					if (OnEdge(e, v % CHUNK_VERTS, v / CHUNK_VERTS, a))
+						along.insert(a);
+				}
+				for (int a = 0; a <= CHUNK_CELLS; a += edgeStep)
+					expected.insert(a);
+				CHECK(along == expected);
+			}
+		}
+	}
+}
+
+//full detail up to lodDistance then one LOD coarser every doubling, never past the last
+static void TestSelectLOD()
+{
+	const float d = 10;
+	CHECK(SelectLOD(0, d) == 0);
+	CHECK(SelectLOD(9.99f, d) == 0);
+	CHECK(SelectLOD(10, d) == 1);
+	CHECK(SelectLOD(19.99f, d) == 1);
+	CHECK(SelectLOD(20, d) == 2);
+	CHECK(SelectLOD(39.99f, d) == 2);
+	CHECK(SelectLOD(40, d) == 3);
+	CHECK(SelectLOD(80, d) == 4);
+	CHECK(SelectLOD(1e6f, d) == NUM_LODS - 1);
+	int last = 0;
+	bool rising = true, inRange = true;
+	for (float dist = 0; dist < 1000; dist += 0.5f)
+	{
+		int lod = SelectLOD(dist, d);
+		if (lod < last || lod > last + 1)
+			rising = false;
+		if (lod < 0 || lod >= NUM_LODS)
+			inRange = false;
+		last = lod;
+	}
+	CHECK(rising);
+	CHECK(inRange);
+}
+
+//neighbours no more than one apart, only ever made finer, and no finer than that needs
+static bool ClampedCorrectly(const vector<int>& before, const vector<int>& after, int w, int h)
+{
+	for (int z = 0; z < h; ++z)
+		for (int x = 0; x < w; ++x)
+		{
+			const int i = z * w + x;
+			int limit = before[i];
+			const int nx[4] = { x - 1, x + 1, x, x }, nz[4] = { z, z, z - 1, z + 1 };
+			for (int k = 0; k < 4; ++k)
+			{
+				if (nx[k] < 0 || nx[k] >= w || nz[k] < 0 || nz[k] >= h)
+					continue;
+				const int j = nz[k] * w + nx[k];
+				if (abs(after[i] - after[j]) > 1)
+					return false;
+				limit = min(limit, after[j] + 1);
+			}
+			if (after[i] != limit)
+				return false;
+		}
+	return true;
+}
+
+static void TestClampLODs()
+{
+	//one full detail chunk in a coarse grid spreads out as a diamond
+	const int w = 7, h = 7;
+	vector<int> lods(w * h, NUM_LODS - 1);
+	lods[3 * w + 3] = 0;
+	vector<int> before = lods;
+	ClampLODs(lods, w, h);
+	bool diamond = true;
+	for (int z = 0; z < h; ++z)
+		for (int x = 0; x < w; ++x)
+			if (lods[z * w + x] != min(NUM_LODS - 1, abs(x - 3) + abs(z - 3)))
+				diamond = false;
+	CHECK(diamond);
+	CHECK(ClampedCorrectly(before, lods, w, h));
+
+	//random grids, including single rows and columns
+	unsigned int seed = 12345;
+	const int sizes[][2] = { { 1, 1 }, { 9, 1 }, { 1, 9 }, { 8, 8 }, { 13, 5 }, { 32, 32 } };
+	for (const auto& size : sizes)
+		for (int repeat = 0; repeat < 20; ++repeat)
+		{
+			vector<int> grid(size[0] * size[1]);
+			for (int& lod : grid)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				lod = (seed >> 16) % NUM_LODS;
+			}
+			vector<int> original = grid;
+			ClampLODs(grid, size[0], size[1]);
+			CHECK(ClampedCorrectly(original, grid, size[0], size[1]));
+		}
+}
+
+/*
+chunks come and go as the camera moves - queued inside the load radius, kept until
+they're past the unload radius, and anything built but no longer wanted is refused
+*/
+static void TestStreamer()
+{
+	const int w = 8, h = 8;
+	const float size = 32, loadRadius = 70, unloadRadius = 100;
+	Streamer s;
+	s.Initialise(w, h, loadRadius, unloadRadius, 16);
+	for (int cz = 0; cz < h; ++cz)
+		for (int cx = 0; cx < w; ++cx)
+		{
+			const float boundsMin[3] = { cx * size, 0, cz * size }, boundsMax[3] = { (cx + 1) * size, 0, (cz + 1) * size };
+			s.SetBounds(cz * w + cx, boundsMin, boundsMax);
+		}
+	CHECK(s.GetNumChunks() == w * h);
+	CHECK(s.GetNumLoaded() == 0);
+
+	//distance from a camera on the ground to a chunk, worked out separately
+	auto distance = [&](int chunk, float camX, float camZ) {
+		const float x0 = (chunk % w) * size, z0 = (chunk / w) * size;
+		const float dx = max(0.f, max(x0 - camX, camX - (x0 + size)));
+		const float dz = max(0.f, max(z0 - camZ, camZ - (z0 + size)));
+		return sqrtf(dx * dx + dz * dz);
+	};
+	vector<int> dropped, wanted;
+
+	//in the middle, everything in range is queued nearest first
+	float cam[3] = { 128, 0, 128 };
+	s.Update(cam, dropped);
+	CHECK(dropped.empty());
+	bool queuedRight = true, distancesRight = true;
+	int numQueued = 0;
+	for (int i = 0; i < w * h; ++i)
+	{
+		const float d = distance(i, cam[0], cam[2]);
+		if (fabsf(s.GetDistance(i) - d) > 0.001f)
+			distancesRight = false;
+		if ((s.GetState(i) == Streamer::QUEUED) != (d < loadRadius))
+			queuedRight = false;
+		numQueued += s.GetState(i) == Streamer::QUEUED;
+	}
+	CHECK(distancesRight);
+	CHECK(queuedRight);
+	s.GetWanted(wanted);
+	CHECK((int)wanted.size() == numQueued && numQueued > 4);
+	bool nearestFirst = true;
+	for (size_t i = 1; i < wanted.size(); ++i)
+		if (s.GetDistance(wanted[i - 1]) > s.GetDistance(wanted[i]))
+			nearestFirst = false;
+	CHECK(nearestFirst);
+	CHECK(s.GetLODs()[4 * w + 4] == 0);
+
+	//a few get uploaded and one has to wait, none of them are asked for again
+	for (int i = 0; i < 3; ++i)
+		s.SetLoaded(wanted[i]);
+	s.SetBuilt(wanted[3]);
+	CHECK(s.GetNumLoaded() == 3);
+	CHECK(s.IsWanted(wanted[3]) && s.GetState(wanted[3]) == Streamer::BUILT);
+	CHECK(!s.IsWanted(wanted[0]));
+	s.Update(cam, dropped);
+	CHECK(dropped.empty());
+	CHECK(s.GetState(wanted[0]) == Streamer::LOADED && s.GetState(wanted[3]) == Streamer::BUILT);
+	vector<int> stillWanted;
+	s.GetWanted(stillWanted);
+	CHECK(stillWanted.size() == wanted.size() - 4);
+	for (int i = 3; i < (int)wanted.size(); ++i)
+		s.SetLoaded(wanted[i]);
+	CHECK(s.GetNumLoaded() == numQueued);
+
+	//move east, chunks between the two radii stay, those past the unload radius go
+	vector<Streamer::State> before(w * h);
+	for (int i = 0; i < w * h; ++i)
+		before[i] = s.GetState(i);
+	cam[0] = 168;
+	s.Update(cam, dropped);
+	bool droppedRight = true, keptRight = true, countRight = true;
+	int numKept = 0, numLoaded = 0;
+	for (int i = 0; i < w * h; ++i)
+	{
+		const float d = distance(i, cam[0], cam[2]);
+		const bool wasLoaded = before[i] == Streamer::LOADED;
+		const bool isDropped = find(dropped.begin(), dropped.end(), i) != dropped.end();
+		if (isDropped != (wasLoaded && d > unloadRadius))
+			droppedRight = false;
+		if (wasLoaded && d <= unloadRadius && s.GetState(i) != Streamer::LOADED)
+			keptRight = false;
+		if (wasLoaded && d >= loadRadius && d <= unloadRadius)
+			++numKept;
+		if (!wasLoaded && d < loadRadius && s.GetState(i) != Streamer::QUEUED)
+			keptRight = false;
+		numLoaded += s.GetState(i) == Streamer::LOADED;
+	}
+	countRight = numLoaded == s.GetNumLoaded();
+	CHECK(!dropped.empty());
+	CHECK(droppedRight);
+	CHECK(keptRight);
+	CHECK(numKept > 0);
+	CHECK(countRight);
+	bool droppedUnloaded = true;
+	for (int i : dropped)
+		if (s.GetState(i) != Streamer::UNLOADED)
+			droppedUnloaded = false;
+	CHECK(droppedUnloaded);
+
+	//a chunk still being built when the camera leaves isn't wanted when it turns up
+	s.GetWanted(wanted);
+	CHECK(!wanted.empty());
+	const int late = wanted.back();
+	cam[0] = cam[2] = 2000;
+	s.Update(cam, dropped);
+	CHECK(!s.IsWanted(late));
+	CHECK(s.GetState(late) == Streamer::UNLOADED);
+	CHECK((int)dropped.size() == numLoaded);
+	CHECK(s.GetNumLoaded() == 0);
+	s.GetWanted(wanted);
+	CHECK(wanted.empty());
+}
+
+void TestGeoMip()
+{
+	TestBuildIndices();
+	TestSelectLOD();
+	TestClampLODs();
+	TestStreamer();
+}
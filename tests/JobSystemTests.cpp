@@ -0,0 +1,164 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Test.h"
+#include "JobSystem.h"
+#include "Parallel.h"
+
+using namespace std;
+
+//more workers than the machine may have cores, so stealing and sleeping happen even on a small box
+static const int NUM_WORKERS = 7;
+
+//every index of a parallel loop is visited exactly once, for sizes around the chunking
+static void TestCoverage(JobSystem& js)
+{
+	const int sizes[] = { 1, 2, 7, 100, 1000, 12345, 100000 };
+	for (int count : sizes)
+	{
+		vector<atomic<int>> hits(count);
+		for (atomic<int>& h : hits)
+			h = 0;
+		ParallelFor(js, count, 1, [&](int begin, int end) {
+			for (int i = begin; i < end; ++i)
+				++hits[i];
+		});
+		bool once = true;
+		for (atomic<int>& h : hits)
+			once &= h == 1;
+		CHECK(once);
+	}
+}
+
+//a loop inside a loop's job, the inner Wait runs jobs rather than blocking so it can't deadlock
+static void TestNested(JobSystem& js)
+{
+	const int outer = 64, inner = 1000;
+	atomic<int> total{ 0 };
+	ParallelFor(js, outer, 1, [&](int begin, int end) {
+		for (int o = begin; o < end; ++o)
+			ParallelFor(js, inner, 16, [&](int b, int e) {
+				total += e - b;
+			});
+	});
+	CHECK(total == outer * inner);
+}
+
+//each stage only starts once the one before has finished every job
+static void TestDependencies(JobSystem& js)
+{
+	const int numStages = 50, jobsPerStage = 8;
+	struct Stage
+	{
+		atomic<int> finished{ 0 };
+		atomic<int>* pBefore = nullptr;
+		atomic<int> outOfOrder{ 0 };
+	};
+	vector<Stage> stages(numStages);
+	vector<JobSystem::Job> jobs(numStages * jobsPerStage);
+	vector<JobSystem::Counter> counters(numStages);
+	for (int s = 0; s < numStages; ++s)
+	{
+		stages[s].pBefore = s > 0 ? &stages[s - 1].finished : nullptr;
+		for (int j = 0; j < jobsPerStage; ++j)
+		{
+			JobSystem::Job& job = jobs[s * jobsPerStage + j];
+			job.data = &stages[s];
+			job.fn = [](void* data, int, int) {
+				Stage& stage = *(Stage*)data;
+				if (stage.pBefore && stage.pBefore->load() != jobsPerStage)
+					++stage.outOfOrder;
+				++stage.finished;
+			};
+		}
+		js.Run(&jobs[s * jobsPerStage], jobsPerStage, counters[s], s > 0 ? &counters[s - 1] : nullptr);
+	}
+	js.Wait(counters[numStages - 1]);
+	for (JobSystem::Counter& counter : counters)
+		js.Wait(counter);
+	int outOfOrder = 0, finished = 0;
+	for (Stage& s : stages)
+	{
+		outOfOrder += s.outOfOrder;
+		finished += s.finished;
+	}
+	CHECK(outOfOrder == 0);
+	CHECK(finished == numStages * jobsPerStage);
+}
+
+//more jobs than a queue holds, the extra run straight away
+static void TestOverflow(JobSystem& js)
+{
+	const int count = JobSystem::QUEUE_SIZE * 3;
+	atomic<int> ran{ 0 };
+	vector<JobSystem::Job> jobs(count);
+	for (JobSystem::Job& job : jobs)
+	{
+		job.data = &ran;
+		job.fn = [](void* data, int, int) {
+			++*(atomic<int>*)data;
+		};
+	}
+	JobSystem::Counter done;
+	js.Run(jobs.data(), count, done);
+	js.Wait(done);
+	CHECK(ran == count);
+}
+
+//threads that aren't the system's go through the shared queue, several at once
+static void TestOutsideThreads(JobSystem& js)
+{
+	const int numThreads = 4, perThread = 5000;
+	atomic<int> total{ 0 };
+	vector<thread> threads;
+	for (int t = 0; t < numThreads; ++t)
+		threads.emplace_back([&] {
+			ParallelFor(js, perThread, 10, [&](int begin, int end) {
+				total += end - begin;
+			});
+		});
+	for (thread& t : threads)
+		t.join();
+	CHECK(total == numThreads * perThread);
+}
+
+void TestJobSystem()
+{
+	JobSystem js(NUM_WORKERS);
+	CHECK(js.GetNumThreads() == NUM_WORKERS + 1);
+	TestCoverage(js);
+	TestNested(js);
+	TestDependencies(js);
+	TestOverflow(js);
+	TestOutsideThreads(js);
+
+	//every job counted against some thread
+	vector<JobSystem::ThreadStats> stats;
+	js.ResetStats();
+	TestOverflow(js);
+	js.GetStats(stats);
+	long long jobs = 0;
+	for (const JobSystem::ThreadStats& s : stats)
+		jobs += s.jobs;
+	CHECK((int)stats.size() == NUM_WORKERS + 1);
+	CHECK(jobs == JobSystem::QUEUE_SIZE * 3);
+
+	//restarted with a different number of workers
+	js.Start(2);
+	CHECK(js.GetNumThreads() == 3);
+	TestCoverage(js);
+	TestDependencies(js);
+
+	//no workers at all, the main thread does everything
+	js.Start(0);
+	CHECK(js.GetNumThreads() == 1);
+	TestCoverage(js);
+	TestNested(js);
+
+	//a second system alongside the shared one, neither disturbs the other
+	JobSystem other(3);
+	TestCoverage(other);
+	TestCoverage(JobSystem::Get());
+	TestNested(other);
+}
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <array>
+#include <random>
+#include <vector>
+
+#include "Test.h"
+#include "MeshOptimiser.h"
+
+using namespace std;
+using namespace MeshOpt;
+
+//cells on a side of the test grid
+static const int GRID = 40;
+
+//a flat grid of quads, two triangles each, positions 3 floats per vertex
+static void MakeGrid(vector<unsigned int>& indices, vector<float>& positions)
+{
+	const int side = GRID + 1;
+	positions.clear();
+	for (int z = 0; z < side; ++z)
+		for (int x = 0; x < side; ++x)
+		{
+			positions.push_back((float)x);
+			positions.push_back(0);
+			positions.push_back((float)z);
+		}
+	indices.clear();
+	for (int z = 0; z < GRID; ++z)
+		for (int x = 0; x < GRID; ++x)
+		{
+			unsigned int v = z * side + x;
+			const unsigned int quad[6] = { v, v + side, v + 1, v + 1, v + side, v + side + 1 };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+}
+
+//the triangles in a random order, each still wound the same way
+static void ShuffleTriangles(vector<unsigned int>& indices)
+{
+	vector<array<unsigned int, 3>> tris(indices.size() / 3);
+	for (size_t t = 0; t < tris.size(); ++t)
+		tris[t] = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+	mt19937 rng(1234);
+	shuffle(tris.begin(), tris.end(), rng);
+	for (size_t t = 0; t < tris.size(); ++t)
+		copy(tris[t].begin(), tris[t].end(), indices.begin() + t * 3);
+}
+
+//every triangle rotated to start at its lowest index (keeping its winding), then sorted
+static vector<array<unsigned int, 3>> SortedTriangles(const vector<unsigned int>& indices)
+{
+	vector<array<unsigned int, 3>> tris(indices.size() / 3);
+	for (size_t t = 0; t < tris.size(); ++t)
+	{
+		array<unsigned int, 3> tri = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+		rotate(tri.begin(), min_element(tri.begin(), tri.end()), tri.end());
+		tris[t] = tri;
+	}
+	sort(tris.begin(), tris.end());
+	return tris;
+}
+
+//reordering a shuffled grid for the cache gets it close to the best a strip order can do
+static void TestCacheImproves()
+{
+	vector<unsigned int> indices;
+	vector<float> positions;
+	MakeGrid(indices, positions);
+	ShuffleTriangles(indices);
+	const int numVerts = (int)positions.size() / 3;
+	vector<unsigned int> out(indices.size());
+	OptimiseVertexCache(indices.data(), (int)indices.size(), numVerts, out.data());
+
+	CacheStats before = AnalyseVertexCache(indices.data(), (int)indices.size(), numVerts);
+	CacheStats after = AnalyseVertexCache(out.data(), (int)out.size(), numVerts);
+	CHECK(before.acmr > 1.5f);
+	CHECK(after.acmr < 0.8f);
+	CHECK(after.atvr < before.atvr);
+	CHECK(after.atvr >= 1);
+}
+
+//the cache and overdraw passes only change the order of the triangles, never the triangles
+static void TestPermutation()
+{
+	vector<unsigned int> indices;
+	vector<float> positions;
+	MakeGrid(indices, positions);
+	ShuffleTriangles(indices);
+	const int numVerts = (int)positions.size() / 3;
+	vector<unsigned int> out(indices.size());
+	vector<int> clusters;
+	OptimiseVertexCache(indices.data(), (int)indices.size(), numVerts, out.data(), CACHE_SIZE, &clusters);
+	CHECK(SortedTriangles(out) == SortedTriangles(indices));
+	CHECK(!clusters.empty() && clusters[0] == 0);
+
+	OptimiseOverdraw(out.data(), (int)out.size(), positions.data(), 3 * sizeof(float), clusters);
+	CHECK(SortedTriangles(out) == SortedTriangles(indices));
+}
+
+//renumbering the vertices and moving them with the remap draws exactly the same triangles
+static void TestFetchRoundTrip()
+{
+	vector<unsigned int> indices;
+	vector<float> positions;
+	MakeGrid(indices, positions);
+	ShuffleTriangles(indices);
+	//one vertex nothing uses
+	positions.insert(positions.end(), { -1, -1, -1 });
+	const int numVerts = (int)positions.size() / 3;
+
+	vector<unsigned int> fetched = indices;
+	vector<int> remap;
+	int numUsed = OptimiseVertexFetch(fetched.data(), (int)fetched.size(), numVerts, remap);
+	CHECK(numUsed == numVerts - 1);
+	CHECK((int)remap.size() == numVerts && remap[numVerts - 1] == -1);
+
+	//numbered in the order they're first used
+	unsigned int next = 0;
+	bool inOrder = true;
+	for (unsigned int i : fetched)
+	{
+		inOrder &= i <= next;
+		if (i == next)
+			++next;
+	}
+	CHECK(inOrder);
+	CHECK((int)next == numUsed);
+
+	typedef array<float, 3> Pos;
+	vector<Pos> before(numVerts), after(numUsed);
+	for (int v = 0; v < numVerts; ++v)
+		before[v] = { positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2] };
+	RemapVertices(before.data(), numVerts, remap, after.data());
+	bool same = true;
+	for (size_t i = 0; i < indices.size(); ++i)
+		same &= after[fetched[i]] == before[indices[i]];
+	CHECK(same);
+}
+
+void TestMeshOptimiser()
+{
+	TestCacheImproves();
+	TestPermutation();
+	TestFetchRoundTrip();
+}
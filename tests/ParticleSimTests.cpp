@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "Test.h"
+#include "ParticleSim.h"
+
+using namespace std;
+
+static const float DTIME = 1 / 60.f;
+
+//an emitter that only spawns when told to
+static ParticleSim::Settings Quiet(int maxParticles)
+{
+	ParticleSim::Settings s;
+	s.maxParticles = maxParticles;
+	s.rate = 0;
+	s.minLife = s.maxLife = 1;
+	return s;
+}
+
+//bursts come out at the next update, capped at the maximum, and all die together at the end of their life
+static void TestLifetimes()
+{
+	ParticleSim sim;
+	int e = sim.AddEmitter(Quiet(100));
+	sim.Burst(e, 30);
+	CHECK(sim.GetNumParticles(e) == 0);
+	sim.Update(DTIME);
+	CHECK(sim.GetNumParticles(e) == 30);
+	sim.Burst(e, 500);
+	sim.Update(DTIME);
+	CHECK(sim.GetNumParticles(e) == 100);
+	for (int f = 0; f < 50; ++f)
+		sim.Update(DTIME);
+	CHECK(sim.GetNumParticles(e) == 100);
+	for (int f = 0; f < 20; ++f)
+		sim.Update(DTIME);
+	CHECK(sim.GetNumParticles(e) == 0);
+
+	sim.Burst(e, 10);
+	sim.Update(DTIME);
+	sim.Clear(e);
+	CHECK(sim.GetNumParticles() == 0);
+}
+
+//the rate spreads fractions of a particle over updates rather than losing them
+static void TestRate()
+{
+	ParticleSim sim;
+	ParticleSim::Settings s = Quiet(1000);
+	s.rate = 45;
+	s.minLife = s.maxLife = 100;
+	int e = sim.AddEmitter(s);
+	for (int f = 0; f < 60; ++f)
+		sim.Update(DTIME);
+	CHECK(abs(sim.GetNumParticles(e) - 45) <= 1);
+}
+
+//halfway through its life a particle is halfway between its start and end size, colour and frames
+static void TestLerp()
+{
+	ParticleSim sim;
+	ParticleSim::Settings s = Quiet(1);
+	s.numFrames = 4;
+	s.velocity[1] = 0;
+	s.gravity[1] = 0;
+	s.startSize = 1;
+	s.endSize = 3;
+	s.startColour[0] = 0;
+	s.endColour[0] = 1;
+	s.startColour[3] = 1;
+	s.endColour[3] = 0;
+	int e = sim.AddEmitter(s);
+	sim.Burst(e, 1);
+	for (int f = 0; f < 30; ++f)
+		sim.Update(DTIME);
+	const ParticleSim::Emitter& em = sim.GetEmitter(e);
+	CHECK(em.numParticles == 1);
+	CHECK(fabsf(em.size[0] - 2) < 0.05f);
+	CHECK(abs((int)(em.colour[0] & 0xff) - 128) <= 3);
+	CHECK(abs((int)(em.colour[0] >> 24) - 128) <= 3);
+	CHECK(em.frame[0] == 2);
+	CHECK(em.pos[1][0] == 0);
+}
+
+//lots of particles over a few emitters, enough for several blocks each
+static void AddSprays(ParticleSim& sim)
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		ParticleSim::Settings s = ParticleSim::BenchmarkFountain(i, 150000);
+		s.rate = 30000;
+		sim.AddEmitter(s);
+	}
+}
+
+//the blocks being spread over the cores makes no difference, and AVX2 only differs by rounding
+static void TestSameResults()
+{
+	ParticleSim one, many, avx2;
+	AddSprays(one);
+	AddSprays(many);
+	AddSprays(avx2);
+	for (int f = 0; f < 150; ++f)
+	{
+		one.Update(DTIME, false, false);
+		many.Update(DTIME, false, true);
+		avx2.Update(DTIME, true, false);
+	}
+	CHECK(one.GetNumParticles() > 2 * ParticleSim::BLOCK_SIZE);
+	bool same = true, close = true;
+	for (int i = 0; i < one.GetNumEmitters(); ++i)
+	{
+		const ParticleSim::Emitter& a = one.GetEmitter(i);
+		const ParticleSim::Emitter& b = many.GetEmitter(i);
+		const ParticleSim::Emitter& c = avx2.GetEmitter(i);
+		same &= a.numParticles == b.numParticles;
+		close &= a.numParticles == c.numParticles;
+		for (int p = 0; p < min(a.numParticles, min(b.numParticles, c.numParticles)); ++p)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				same &= a.pos[k][p] == b.pos[k][p] && a.vel[k][p] == b.vel[k][p];
+				close &= fabsf(a.pos[k][p] - c.pos[k][p]) < 1e-3f;
+			}
+			same &= a.colour[p] == b.colour[p] && a.frame[p] == b.frame[p];
+			for (int k = 0; k < 4; ++k)
+				close &= abs((int)((a.colour[p] >> (k * 8)) & 0xff) - (int)((c.colour[p] >> (k * 8)) & 0xff)) <= 1;
+			close &= abs((int)a.frame[p] - (int)c.frame[p]) <= 1;
+		}
+	}
+	CHECK(same);
+	//without AVX2 this compares plain with plain
+	CHECK(close);
+}
+
+void TestParticleSim()
+{
+	TestLifetimes();
+	TestRate();
+	TestLerp();
+	TestSameResults();
+}
@@ -0,0 +1,28 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <cstdio>
+
+/*
+The bare minimum to check CPU side code without a window or a gpu. A failed CHECK
+prints where it was and carries on, main returns how many failed so the build
+(see the post build step) stops if anything did.
+*/
+extern int gNumChecks, gNumFailed;
+
+#define CHECK(cond) \
+	do { \
+		++gNumChecks; \
+		if (!(cond)) { \
+			++gNumFailed; \
+			printf("%s(%d): FAILED %s\n", __FILE__, __LINE__, #cond); \
+		} \
+	} while (0)
+
+//one per area of the code, each runs all its checks
+void TestGeoMip();
+void TestJobSystem();
+void TestMeshOptimiser();
+void TestParticleSim();
+
+#endif
@@ -0,0 +1,13 @@
+#include "Test.h"
+
+int gNumChecks = 0, gNumFailed = 0;
+
+int main()
+{
+	TestGeoMip();
+	TestJobSystem();
+	TestMeshOptimiser();
+	TestParticleSim();
+	printf("%d checks, %d failed\n", gNumChecks, gNumFailed);
+	return gNumFailed;
+}
@@ -0,0 +1,405 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include "CompressedClip.h"
+#include "D3DUtil.h"
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+//tracks per bone and how many components each has
+static const int CHANNELS = 3;
+static const int CHANNEL_COMPONENTS[CHANNELS] = { 3, 4, 3 };
+//a segment's keys are read with 8 byte loads, so the data needs this much slack on the end
+static const int READ_PADDING = 8;
+
+//interpolate keys the same way for compressing and sampling
+static Vector4 LerpChannel(int channel, const Vector4& a, const Vector4& b, float t)
+{
+	if (channel != 1)
+		return Vector4::Lerp(a, b, t);
+	Quaternion q = Quaternion::Lerp(Quaternion(a), Quaternion(b), t);
+	return Vector4(q.x, q.y, q.z, q.w);
+}
+
+/*
+* angle between two rotations, from the distance between the quaternions - acos of their
+* dot product can't tell small angles apart, it's no better than about 0.001 radians
+*/
+static float RotationError(Quaternion a, Quaternion b)
+{
+	a.Normalize();
+	b.Normalize();
+	if (a.Dot(b) < 0)
+		b = -b;
+	Vector4 d(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
+	return 4 * asinf(std::min(d.Length() * 0.5f, 1.f));
+}
+
+//how far apart, angle for rotations, largest component difference otherwise
+static float ChannelError(int channel, const Vector4& a, const Vector4& b)
+{
+	if (channel == 1)
+		return RotationError(Quaternion(a), Quaternion(b));
+	return std::max(fabsf(a.x - b.x), std::max(fabsf(a.y - b.y), fabsf(a.z - b.z)));
+}
+
+static unsigned int Quantise(float v, float min, float extent, int bits)
+{
+	if (extent <= 0)
+		return 0;
+	float maxQ = (float)((1 << bits) - 1);
+	float q = (v - min) / extent * maxQ + 0.5f;
+	return (unsigned int)std::min(std::max(q, 0.f), maxQ);
+}
+
+static float Dequantise(unsigned int q, float min, float extent, int bits)
+{
+	return min + q * extent / (float)((1 << bits) - 1);
+}
+
+//little endian, reads up to 8 bytes past the value so the buffer has to be padded
+static unsigned int ReadBits(const unsigned char* pData, unsigned int bitPos, int bits)
+{
+	unsigned long long v;
+	memcpy(&v, pData + (bitPos >> 3), sizeof(v));
+	return (unsigned int)(v >> (bitPos & 7)) & ((1u << bits) - 1);
+}
+
+static void WriteBits(std::vector<unsigned char>& data, size_t start, unsigned int bitPos, unsigned int value, int bits)
+{
+	for (int i = 0; i < bits; ++i, ++bitPos)
+		if (value & (1u << i))
+			data[start + (bitPos >> 3)] |= (unsigned char)(1 << (bitPos & 7));
+}
+
+void CompressedClip::Compress(const AnimClip& clip, const Skeleton& skel, const Settings& settings)
+{
+	assert(settings.segmentFrames >= 1 && settings.segmentFrames <= 255 && settings.sampleRate > 0);
+	mName = clip.GetName();
+	mDuration = clip.GetDuration();
+	mNumBones = skel.GetNumBones();
+	mSegmentFrames = settings.segmentFrames;
+	mNumFrames = std::max(2, (int)ceilf(mDuration * settings.sampleRate - 0.001f) + 1);
+	mSampleRate = (mDuration > 0) ? (mNumFrames - 1) / mDuration : settings.sampleRate;
+	const float tolerance[CHANNELS] = { settings.posError, settings.rotError, settings.scaleError };
+
+	//resample every track, 4 components each
+	const int numTracks = mNumBones * CHANNELS;
+	std::vector<Vector4> raw(numTracks * mNumFrames);
+	Pose pose;
+	for (int f = 0; f < mNumFrames; ++f)
+	{
+		clip.Sample(skel, f / mSampleRate, false, pose);
+		for (int b = 0; b < mNumBones; ++b)
+		{
+			const BoneTransform& bt = pose[b];
+			raw[(b * CHANNELS + 0) * mNumFrames + f] = Vector4(bt.translation.x, bt.translation.y, bt.translation.z, 0);
+			raw[(b * CHANNELS + 1) * mNumFrames + f] = Vector4(bt.rotation.x, bt.rotation.y, bt.rotation.z, bt.rotation.w);
+			raw[(b * CHANNELS + 2) * mNumFrames + f] = Vector4(bt.scale.x, bt.scale.y, bt.scale.z, 0);
+		}
+	}
+
+	//what each track needs
+	mTracks.assign(numTracks, TrackInfo());
+	mConstants.clear();
+	mNumAnimated = 0;
+	std::vector<int> animated;		//track of each animated track
+	std::vector<Vector4> decoded(raw.size());
+	for (int t = 0; t < numTracks; ++t)
+	{
+		const int channel = t % CHANNELS, comps = CHANNEL_COMPONENTS[channel];
+		Vector4* pRaw = &raw[t * mNumFrames];
+		if (channel == 1)
+		{
+			//q and -q are the same rotation, keep neighbours on the same side so the ranges stay small
+			for (int f = 1; f < mNumFrames; ++f)
+				if (pRaw[f].Dot(pRaw[f - 1]) < 0)
+					pRaw[f] = -pRaw[f];
+		}
+		const BoneTransform& bind = skel.GetBindPose()[t / CHANNELS];
+		Vector4 bindValue = (channel == 0) ? Vector4(bind.translation.x, bind.translation.y, bind.translation.z, 0) :
+			(channel == 1) ? Vector4(bind.rotation.x, bind.rotation.y, bind.rotation.z, bind.rotation.w) :
+			Vector4(bind.scale.x, bind.scale.y, bind.scale.z, 0);
+		bool isBind = true, isConstant = true;
+		for (int f = 0; f < mNumFrames; ++f)
+		{
+			isBind = isBind && ChannelError(channel, pRaw[f], bindValue) <= tolerance[channel];
+			isConstant = isConstant && ChannelError(channel, pRaw[f], pRaw[0]) <= tolerance[channel];
+		}
+		TrackInfo& info = mTracks[t];
+		if (isBind)
+		{
+			info.type = BIND;
+			continue;
+		}
+		if (isConstant)
+		{
+			info.type = CONSTANT;
+			info.index = (unsigned short)mConstants.size();
+			mConstants.push_back(pRaw[0]);
+			continue;
+		}
+
+		//the range of each component, then the fewest bits that use up no more than half the error
+		info.type = ANIMATED;
+		info.index = (unsigned short)mNumAnimated++;
+		animated.push_back(t);
+		for (int c = 0; c < 4; ++c)
+		{
+			float lo = (&pRaw[0].x)[c], hi = lo;
+			for (int f = 1; f < mNumFrames; ++f)
+			{
+				lo = std::min(lo, (&pRaw[f].x)[c]);
+				hi = std::max(hi, (&pRaw[f].x)[c]);
+			}
+			info.rangeMin[c] = lo;
+			info.rangeExtent[c] = (c < comps) ? hi - lo : 0;
+		}
+		Vector4* pDecoded = &decoded[t * mNumFrames];
+		for (info.bits = 3; info.bits < 16; ++info.bits)
+		{
+			float worst = 0;
+			for (int f = 0; f < mNumFrames; ++f)
+			{
+				for (int c = 0; c < 4; ++c)
+					(&pDecoded[f].x)[c] = Dequantise(Quantise((&pRaw[f].x)[c], info.rangeMin[c], info.rangeExtent[c], info.bits),
+						info.rangeMin[c], info.rangeExtent[c], info.bits);
+				worst = std::max(worst, ChannelError(channel, pDecoded[f], pRaw[f]));
+			}
+			if (worst <= tolerance[channel] * 0.5f)
+				break;
+		}
+		if (info.bits == 16)
+			for (int f = 0; f < mNumFrames; ++f)
+				for (int c = 0; c < 4; ++c)
+					(&pDecoded[f].x)[c] = Dequantise(Quantise((&pRaw[f].x)[c], info.rangeMin[c], info.rangeExtent[c], 16),
+						info.rangeMin[c], info.rangeExtent[c], 16);
+	}
+
+	//segments, each track keeps its ends plus whatever interpolation can't rebuild
+	const int numSegments = std::max(1, (mNumFrames - 1 + mSegmentFrames - 1) / mSegmentFrames);
+	mSegmentOffsets.resize(numSegments);
+	mData.clear();
+	std::vector<int> keys;
+	for (int s = 0; s < numSegments; ++s)
+	{
+		const int first = s * mSegmentFrames, last = std::min(first + mSegmentFrames, mNumFrames - 1);
+		//segments start 4 byte aligned so the table can be read directly
+		size_t start = (mData.size() + 3) & ~(size_t)3;
+		mSegmentOffsets[s] = (unsigned int)start;
+		size_t size = mNumAnimated * sizeof(SegmentTrack);
+		mData.resize(start + size, 0);
+		for (int a = 0; a < mNumAnimated; ++a)
+		{
+			const int t = animated[a], channel = t % CHANNELS, comps = CHANNEL_COMPONENTS[channel];
+			const Vector4* pRaw = &raw[t * mNumFrames];
+			const Vector4* pDecoded = &decoded[t * mNumFrames];
+			const TrackInfo& info = mTracks[t];
+			//from each key reach as far as possible before the error gets too big
+			keys.assign(1, first);
+			while (keys.back() < last)
+			{
+				int from = keys.back(), to = from + 1;
+				for (int next = to + 1; next <= last; ++next)
+				{
+					bool ok = true;
+					for (int f = from + 1; f < next && ok; ++f)
+						ok = ChannelError(channel, LerpChannel(channel, pDecoded[from], pDecoded[next], (float)(f - from) / (next - from)),
+							pRaw[f]) <= tolerance[channel];
+					if (!ok)
+						break;
+					to = next;
+				}
+				keys.push_back(to);
+			}
+
+			SegmentTrack st;
+			st.offset = (unsigned short)(mData.size() - start);
+			st.numKeys = (unsigned char)keys.size();
+			st.pad = 0;
+			assert(mData.size() - start < 65536);
+			memcpy(&mData[start + a * sizeof(SegmentTrack)], &st, sizeof(st));
+			for (int k : keys)
+				mData.push_back((unsigned char)(k - first));
+			//packed values, comps components of info.bits each
+			size_t bitsStart = mData.size();
+			mData.resize(bitsStart + (keys.size() * comps * info.bits + 7) / 8, 0);
+			unsigned int bitPos = 0;
+			for (int k : keys)
+				for (int c = 0; c < comps; ++c, bitPos += info.bits)
+					WriteBits(mData, bitsStart, bitPos, Quantise((&pRaw[k].x)[c], info.rangeMin[c], info.rangeExtent[c], info.bits), info.bits);
+		}
+	}
+	mData.resize(mData.size() + READ_PADDING, 0);
+}
+
+void CompressedClip::Sample(const Skeleton& skel, float time, bool loop, Pose& pose) const
+{
+	assert(skel.GetNumBones() == mNumBones && !mTracks.empty());
+	if (loop && mDuration > 0)
+	{
+		time = fmodf(time, mDuration);
+		if (time < 0)
+			time += mDuration;
+	}
+	//which segment and how far into it
+	float frame = std::min(std::max(time * mSampleRate, 0.f), (float)(mNumFrames - 1));
+	int seg = std::min((int)frame / mSegmentFrames, (int)mSegmentOffsets.size() - 1);
+	float local = frame - seg * mSegmentFrames;
+	const unsigned char* pSeg = mData.data() + mSegmentOffsets[seg];
+	const SegmentTrack* pSegTracks = (const SegmentTrack*)pSeg;
+
+	const Pose& bind = skel.GetBindPose();
+	pose.resize(mNumBones);
+	for (int b = 0; b < mNumBones; ++b)
+	{
+		BoneTransform& out = pose[b];
+		for (int channel = 0; channel < CHANNELS; ++channel)
+		{
+			const TrackInfo& info = mTracks[b * CHANNELS + channel];
+			Vector4 v;
+			if (info.type == BIND)
+			{
+				if (channel == 0)
+					out.translation = bind[b].translation;
+				else if (channel == 1)
+					out.rotation = bind[b].rotation;
+				else
+					out.scale = bind[b].scale;
+				continue;
+			}
+			if (info.type == CONSTANT)
+				v = mConstants[info.index];
+			else
+			{
+				//find the keys either side, there are only a few in a segment
+				const SegmentTrack& st = pSegTracks[info.index];
+				const unsigned char* pFrames = pSeg + st.offset;
+				int k = 0;
+				while (k + 2 < st.numKeys && pFrames[k + 1] <= local)
+					++k;
+				const int comps = CHANNEL_COMPONENTS[channel], bits = info.bits;
+				const unsigned char* pBits = pFrames + st.numKeys;
+				Vector4 a, c;
+				unsigned int bitPos = k * comps * bits;
+				for (int i = 0; i < comps; ++i, bitPos += bits)
+				{
+					(&a.x)[i] = Dequantise(ReadBits(pBits, bitPos, bits), info.rangeMin[i], info.rangeExtent[i], bits);
+					(&c.x)[i] = Dequantise(ReadBits(pBits, bitPos + comps * bits, bits), info.rangeMin[i], info.rangeExtent[i], bits);
+				}
+				float t = (local - pFrames[k]) / (float)(pFrames[k + 1] - pFrames[k]);
+				v = LerpChannel(channel, a, c, std::min(std::max(t, 0.f), 1.f));
+			}
+			if (channel == 0)
+				out.translation = Vector3(v.x, v.y, v.z);
+			else if (channel == 1)
+				out.rotation = Quaternion(v);
+			else
+				out.scale = Vector3(v.x, v.y, v.z);
+		}
+	}
+}
+
+size_t CompressedClip::GetMemoryUsed() const
+{
+	return sizeof(*this) + mName.capacity() + mTracks.size() * sizeof(TrackInfo) + mConstants.size() * sizeof(Vector4) +
+		mSegmentOffsets.size() * sizeof(unsigned int) + mData.size();
+}
+
+void CompressedClip::GetTrackStats(int& numAnimated, int& numConstant, int& numBind) const
+{
+	numAnimated = numConstant = numBind = 0;
+	for (const TrackInfo& info : mTracks)
+	{
+		numAnimated += info.type == ANIMATED;
+		numConstant += info.type == CONSTANT;
+		numBind += info.type == BIND;
+	}
+}
+
+double CompressedClip::Benchmark(int numBones, float duration)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	//a chain, the root moves about and the rest swing
+	Skeleton skel;
+	for (int b = 0; b < numBones; ++b)
+	{
+		BoneTransform bt;
+		bt.translation = Vector3(0, (b == 0) ? 0.f : 0.5f, 0);
+		skel.AddBone("bone" + std::to_string(b), b - 1, bt);
+	}
+	skel.Finalise();
+	AnimClip sway = Anim::MakeSwingClip(skel, "sway", duration, Vector3(0, 0, 1), 0.3f, 5);
+	AnimClip curl = Anim::MakeSwingClip(skel, "curl", duration / 3, Vector3(1, 0, 0), 0.2f, 5, 0.25f);
+
+	//baked at 30fps with every channel keyed, like most exported animation
+	const int numKeys = (int)(duration * 30) + 1;
+	AnimClip baked("baked", duration, numBones);
+	Pose a, b;
+	for (int k = 0; k < numKeys; ++k)
+	{
+		float time = std::min(k / 30.f, duration);
+		sway.Sample(skel, time, true, a);
+		curl.Sample(skel, time, true, b);
+		for (int bone = 0; bone < numBones; ++bone)
+		{
+			BoneTrack& track = baked.GetTrack(bone);
+			Vector3 pos = a[bone].translation;
+			if (bone == 0)
+				pos += Vector3(0.2f * sinf(time * 3), 0.05f * sinf(time * 7), 0);
+			track.posTimes.push_back(time);
+			track.positions.push_back(pos);
+			track.rotTimes.push_back(time);
+			track.rotations.push_back(a[bone].rotation * b[bone].rotation);
+			track.scaleTimes.push_back(time);
+			track.scales.push_back(a[bone].scale);
+		}
+	}
+	CompressedClip packed;
+	Clock::time_point t0 = Clock::now();
+	packed.Compress(baked, skel, Settings());
+	Clock::time_point t1 = Clock::now();
+
+	//worst error over lots of random times, and the time per track to sample at them
+	const int numSamples = 20000;
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> when(0, duration);
+	std::vector<float> times(numSamples);
+	for (float& t : times)
+		t = when(rng);
+	float posErr = 0, rotErr = 0;
+	Clock::time_point t2 = Clock::now();
+	for (float t : times)
+		baked.Sample(skel, t, true, a);
+	Clock::time_point t3 = Clock::now();
+	for (float t : times)
+		packed.Sample(skel, t, true, b);
+	Clock::time_point t4 = Clock::now();
+	for (int i = 0; i < numSamples; i += 10)
+	{
+		baked.Sample(skel, times[i], true, a);
+		packed.Sample(skel, times[i], true, b);
+		for (int bone = 0; bone < numBones; ++bone)
+		{
+			posErr = std::max(posErr, (a[bone].translation - b[bone].translation).Length());
+			rotErr = std::max(rotErr, RotationError(a[bone].rotation, b[bone].rotation));
+		}
+	}
+
+	size_t rawBytes = baked.GetMemoryUsed(), packedBytes = packed.GetMemoryUsed();
+	int numAnimated, numConstant, numBind;
+	packed.GetTrackStats(numAnimated, numConstant, numBind);
+	const double tracks = (double)numSamples * numBones * CHANNELS;
+	std::chrono::duration<double, std::milli> compress = t1 - t0;
+	std::chrono::duration<double, std::nano> rawNs = t3 - t2, packedNs = t4 - t3;
+	double ratio = (double)rawBytes / packedBytes;
+	DBOUT("Clip compression, " << numBones << " bones x " << duration << "s at 30fps: " << rawBytes << " -> " << packedBytes
+		<< " bytes (" << ratio << ":1) in " << compress.count() << "ms, tracks " << numAnimated << " animated " << numConstant
+		<< " constant " << numBind << " bind, worst error " << posErr << " units " << rotErr << " radians, sampling "
+		<< rawNs.count() / tracks << "ns per track raw, " << packedNs.count() / tracks << "ns compressed");
+	return ratio;
+}
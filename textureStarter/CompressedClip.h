@@ -0,0 +1,92 @@
+#ifndef COMPRESSEDCLIP_H
+#define COMPRESSEDCLIP_H
+
+#include <string>
+#include <vector>
+
+#include "Skeleton.h"
+
+/*
+An AnimClip packed down for keeping lots of animations in memory. Each bone
+has 3 tracks (position, rotation, scale):
+- a track that never moves from the bind pose stores nothing
+- one that never moves at all stores a single value
+- the rest are resampled at a fixed rate, quantised to as few bits as the error
+  allows (per track, against its own range) and keys that interpolation can
+  rebuild within the error are dropped
+The frames are cut into segments that each hold every animated track's keys
+for that stretch of time, back to back, so sampling at any time only reads the
+small track table and one segment. Segments share their end frames.
+*/
+class CompressedClip
+{
+public:
+	//how much error is allowed, in the bone's local space
+	struct Settings
+	{
+		float posError = 0.0005f;		//units
+		float rotError = 0.0005f;		//radians
+		float scaleError = 0.0005f;
+		float sampleRate = 30;			//frames per second to resample at
+		int segmentFrames = 16;			//frames per segment, up to 255
+	};
+	/*
+	* build from an uncompressed clip, replacing anything there before
+	* clip - IN the clip to pack
+	* skel - IN the skeleton it's for, tracks that stay in its bind pose are dropped
+	* settings - IN error limits and layout, Settings() for the defaults
+	*/
+	void Compress(const AnimClip& clip, const Skeleton& skel, const Settings& settings);
+	//as AnimClip::Sample
+	void Sample(const Skeleton& skel, float time, bool loop, Pose& pose) const;
+
+	//getters
+	const std::string& GetName() const {
+		return mName;
+	}
+	float GetDuration() const {
+		return mDuration;
+	}
+	//bytes for everything, tables and all
+	size_t GetMemoryUsed() const;
+	//how many tracks are animated, constant or left in the bind pose
+	void GetTrackStats(int& animated, int& constant, int& bind) const;
+
+	/*
+	* compress a clip baked at 30fps for every bone and channel (like an imported one), then
+	* compare size, error and sampling time against the original. Results go to DBOUT.
+	* numBones - IN a chain, swinging and bobbing
+	* duration - IN seconds
+	* returns - compression ratio
+	*/
+	static double Benchmark(int numBones, float duration);
+
+private:
+	typedef enum { BIND = 0, CONSTANT = 1, ANIMATED = 2 } TrackType;
+	//what's known about one track whatever the time, a small table read on every sample
+	struct TrackInfo
+	{
+		unsigned char type;			//TrackType
+		unsigned char bits;			//per component when animated
+		unsigned short index;		//into mConstants, or which animated track
+		float rangeMin[4];			//quantised values are 0->1 across the range
+		float rangeExtent[4];
+	};
+	//where one animated track's keys are inside a segment
+	struct SegmentTrack
+	{
+		unsigned short offset;		//from the segment start, key frames (one byte each) then the packed values
+		unsigned char numKeys;
+		unsigned char pad;
+	};
+	std::string mName;
+	float mDuration = 0;
+	float mSampleRate = 30;				//frames per second, adjusted so the last frame is on the end
+	int mNumFrames = 0, mSegmentFrames = 16, mNumBones = 0, mNumAnimated = 0;
+	std::vector<TrackInfo> mTracks;		//3 per bone - position, rotation, scale
+	std::vector<DirectX::SimpleMath::Vector4> mConstants;
+	std::vector<unsigned int> mSegmentOffsets;	//into mData
+	std::vector<unsigned char> mData;	//every segment, padded so bits can be read 8 bytes at a time
+};
+
+#endif
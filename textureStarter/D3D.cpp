@@ -29,14 +29,33 @@ void MyD3D::EndRender()
 	HR(mpSwapChain->Present(0, 0));
 }
 
-void MyD3D::InitInputAssembler(ID3D11InputLayout* pInputLayout, ID3D11Buffer* pVBuffer, UINT szVertex, ID3D11Buffer* pIBuffer, D3D_PRIMITIVE_TOPOLOGY topology)
+void MyD3D::InitInputAssembler(ID3D11InputLayout* pInputLayout, ID3D11Buffer* pVBuffer, UINT szVertex, ID3D11Buffer* pIBuffer, D3D_PRIMITIVE_TOPOLOGY topology,
+	DXGI_FORMAT indexFormat)
 {
 	UINT offset = 0;
 	assert(mpd3dImmediateContext);
-	mpd3dImmediateContext->IASetVertexBuffers(0, 1, &pVBuffer, &szVertex, &offset);
-	mpd3dImmediateContext->IASetInputLayout(pInputLayout);
-	mpd3dImmediateContext->IASetIndexBuffer(pIBuffer, DXGI_FORMAT_R32_UINT, 0);
-	mpd3dImmediateContext->IASetPrimitiveTopology(topology);
+	if (pVBuffer != mIA.pVB || szVertex != mIA.szVertex)
+	{
+		mpd3dImmediateContext->IASetVertexBuffers(0, 1, &pVBuffer, &szVertex, &offset);
+		mIA.pVB = pVBuffer;
+		mIA.szVertex = szVertex;
+	}
+	if (pInputLayout != mIA.pInputLayout)
+	{
+		mpd3dImmediateContext->IASetInputLayout(pInputLayout);
+		mIA.pInputLayout = pInputLayout;
+	}
+	if (pIBuffer != mIA.pIB || indexFormat != mIA.indexFormat)
+	{
+		mpd3dImmediateContext->IASetIndexBuffer(pIBuffer, indexFormat, 0);
+		mIA.pIB = pIBuffer;
+		mIA.indexFormat = indexFormat;
+	}
+	if (topology != mIA.topology)
+	{
+		mpd3dImmediateContext->IASetPrimitiveTopology(topology);
+		mIA.topology = topology;
+	}
 }
 
 
@@ -5,6 +5,7 @@
 #include "SimpleMath.h"
 #include "TexCache.h"
 #include "Mesh.h"
+#include "TransformStore.h"
 #include "FX.h"
 
 /*
@@ -60,6 +61,7 @@ public:
 	}
 	FX::MyFX& GetFX() { return mFX; }
 	MeshMgr& GetMeshMgr() { return mMeshMgr; }
+	TransformStore& GetTransforms() { return mTransforms; }
 
 
 	//see mpOnResize - just checks it's not null before calling it
@@ -80,9 +82,16 @@ public:
 	* szVertex - size of a vertex
 	* pIBuffer - index buffer
 	* topology - what do these buffers refer to? Lines, points, triangle lists?
+	* indexFormat - 16 or 32bit indices
+	* Anything that is already set is skipped, meshes share buffers so most draws change nothing
 	*/
 	void InitInputAssembler(ID3D11InputLayout* pInputLayout, ID3D11Buffer* pVBuffer, UINT szVertex, ID3D11Buffer* pIBuffer, 
-								D3D_PRIMITIVE_TOPOLOGY topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+								D3D_PRIMITIVE_TOPOLOGY topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+								DXGI_FORMAT indexFormat = DXGI_FORMAT_R32_UINT);
+	//forget what the input assembler has set, call if something else (e.g. SpriteBatch) may have changed it
+	void InvalidateInputAssembler() {
+		mIA = IAState();
+	}
 
 
 private:
@@ -90,6 +99,8 @@ private:
 	TexCache mTexCache;
 	//a library of geometry, only load one of each once, never duplicate
 	MeshMgr mMeshMgr;
+	//where every model is, and its matrices
+	TransformStore mTransforms;
 	//it manages the shaders
 	FX::MyFX mFX;
 	//what type of gpu have we got - hopefully a hardware one
@@ -119,6 +130,17 @@ private:
 	void(*mpOnResize)(int, int, MyD3D&) = nullptr;
 	//D3D object to configure wrapping when sampling a texture
 	ID3D11SamplerState* mpWrapSampler = nullptr;
+	//what the input assembler currently has set
+	struct IAState
+	{
+		ID3D11InputLayout* pInputLayout = nullptr;
+		ID3D11Buffer* pVB = nullptr;
+		UINT szVertex = 0;
+		ID3D11Buffer* pIB = nullptr;
+		DXGI_FORMAT indexFormat = DXGI_FORMAT_UNKNOWN;
+		D3D_PRIMITIVE_TOPOLOGY topology = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	};
+	IAState mIA;
    
 	//heavy lifting to start D3D11
 	void CreateD3D(D3D_FEATURE_LEVEL desiredFeatureLevel = D3D_FEATURE_LEVEL_11_0);
@@ -63,6 +63,18 @@ void CreateIndexBuffer(ID3D11Device& d3dDevice, UINT bufferSize, const void *pSo
 	HR(d3dDevice.CreateBuffer(&ibd, &iinitData, &pIB));
 }
 
+void CreateDefaultBuffer(ID3D11Device& d3dDevice, UINT bufferSize, UINT bindFlags, ID3D11Buffer* &pBuffer)
+{
+	D3D11_BUFFER_DESC bd;
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = bufferSize;
+	bd.BindFlags = bindFlags;
+	bd.CPUAccessFlags = 0;
+	bd.MiscFlags = 0;
+	bd.StructureByteStride = 0;
+	HR(d3dDevice.CreateBuffer(&bd, nullptr, &pBuffer));
+}
+
 
 Matrix InverseTranspose(const Matrix& m)
 {
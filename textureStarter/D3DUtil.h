@@ -6,6 +6,7 @@
 #include <cassert>
 
 #include "SimpleMath.h"
+#include "DebugOut.h"
  
 /*
 Convenience macro for releasing COM objects (also known as resources).
@@ -17,18 +18,6 @@ This macro just saves typing and therefore reduces silly bugs
 #define ReleaseCOM(x) \
 {	if(x){	x->Release();	x = 0;	} }							
 
-/*
-Gives us a way to pass messages to the output window in Visual Studio
-while the game is running. This means you don't have to halt the app
-if you don't want to (with an assert).
-*/
-#define DBOUT( s )            \
-{                             \
-   std::ostringstream os_;    \
-   os_ << s << "\n";                   \
-   OutputDebugString( os_.str().c_str() );  \
-}
-
 #define WDBOUT(s)				\
 {								\
    std::wostringstream os_;		\
@@ -135,6 +124,10 @@ void CreateVertexBuffer(ID3D11Device& d3dDevice, UINT bufferSize, const void *pS
 //create an index buffer to index into a vertex buffer
 void CreateIndexBuffer(ID3D11Device& d3dDevice, UINT bufferSize, const void *pSourceData, ID3D11Buffer* &pIB);
 
+//create an empty buffer the gpu reads, bits of it can be filled in later with UpdateSubresource
+//bindFlags - IN e.g. D3D11_BIND_VERTEX_BUFFER or D3D11_BIND_INDEX_BUFFER
+void CreateDefaultBuffer(ID3D11Device& d3dDevice, UINT bufferSize, UINT bindFlags, ID3D11Buffer* &pBuffer);
+
 //I want to reverse a transformation
 DirectX::SimpleMath::Matrix InverseTranspose(const DirectX::SimpleMath::Matrix& m);
 
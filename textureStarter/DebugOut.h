@@ -0,0 +1,31 @@
+#ifndef DEBUGOUT_H
+#define DEBUGOUT_H
+
+#include <sstream>
+
+/*
+Gives us a way to pass messages to the output window in Visual Studio
+while the game is running. This means you don't have to halt the app
+if you don't want to (with an assert).
+It needs nothing from D3D, so code that only wants to report something
+builds anywhere - off windows (e.g. the tests on Linux) it goes to stdout.
+*/
+#ifdef _WIN32
+#include <windows.h>
+#define DBOUT( s )            \
+{                             \
+   std::ostringstream os_;    \
+   os_ << s << "\n";                   \
+   OutputDebugString( os_.str().c_str() );  \
+}
+#else
+#include <cstdio>
+#define DBOUT( s )            \
+{                             \
+   std::ostringstream os_;    \
+   os_ << s << "\n";                   \
+   fputs( os_.str().c_str(), stdout );  \
+}
+#endif
+
+#endif
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cstring>
+
+#include "DynamicBuffers.h"
+#include "D3DUtil.h"
+
+void InstanceRing::Init(ID3D11Device& device, int stride, int maxInstances)
+{
+	assert(stride > 0 && maxInstances > 0);
+	Release();
+	D3D11_BUFFER_DESC bd;
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.ByteWidth = maxInstances * stride;
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bd.MiscFlags = 0;
+	bd.StructureByteStride = 0;
+	HR(device.CreateBuffer(&bd, nullptr, &mpBuf));
+	mStride = stride;
+	mMaxInstances = maxInstances;
+	//full, so the first Map starts with a discard
+	mRingPos = maxInstances;
+}
+
+void InstanceRing::Release()
+{
+	ReleaseCOM(mpBuf);
+	mStride = mMaxInstances = mRingPos = mMapped = 0;
+}
+
+void InstanceRing::Bind(ID3D11DeviceContext& ctx)
+{
+	assert(mpBuf);
+	UINT stride = mStride, offset = 0;
+	ctx.IASetVertexBuffers(0, 1, &mpBuf, &stride, &offset);
+}
+
+void* InstanceRing::Map(ID3D11DeviceContext& ctx, int count)
+{
+	assert(mpBuf && count > 0 && count <= mMaxInstances && mMapped == 0);
+	//append after what the GPU may still be reading, only start again when it's full
+	D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (mRingPos + count > mMaxInstances)
+	{
+		mapType = D3D11_MAP_WRITE_DISCARD;
+		mRingPos = 0;
+	}
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	HR(ctx.Map(mpBuf, 0, mapType, 0, &mapped));
+	mMapped = count;
+	return (char*)mapped.pData + mRingPos * mStride;
+}
+
+int InstanceRing::Unmap(ID3D11DeviceContext& ctx)
+{
+	assert(mMapped > 0);
+	ctx.Unmap(mpBuf, 0);
+	int start = mRingPos;
+	mRingPos += mMapped;
+	mMapped = 0;
+	return start;
+}
+
+void InstanceRing::Draw(ID3D11DeviceContext& ctx, const void* pInstances, int count, int vertsPerInstance)
+{
+	const char* pSrc = (const char*)pInstances;
+	for (int first = 0; first < count; first += mMaxInstances)
+	{
+		int n = std::min(count - first, mMaxInstances);
+		memcpy(Map(ctx, n), pSrc + first * mStride, n * mStride);
+		ctx.DrawInstanced(vertsPerInstance, n, 0, Unmap(ctx));
+	}
+}
+
+void StructuredTable::Release()
+{
+	ReleaseCOM(mpSRV);
+	ReleaseCOM(mpBuf);
+	mCapacity = 0;
+}
+
+void* StructuredTable::Map(ID3D11DeviceContext& ctx, int count, int stride)
+{
+	assert(count > 0 && stride > 0);
+	if (count > mCapacity)
+	{
+		//grow in big steps so it's rarely recreated
+		ReleaseCOM(mpSRV);
+		ReleaseCOM(mpBuf);
+		mCapacity = std::max(256, mCapacity);
+		while (mCapacity < count)
+			mCapacity *= 2;
+		ID3D11Device* pDevice = nullptr;
+		ctx.GetDevice(&pDevice);
+		D3D11_BUFFER_DESC bd;
+		bd.Usage = D3D11_USAGE_DYNAMIC;
+		bd.ByteWidth = mCapacity * stride;
+		bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		bd.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		bd.StructureByteStride = stride;
+		HR(pDevice->CreateBuffer(&bd, nullptr, &mpBuf));
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+		ZeroMemory(&srvDesc, sizeof(srvDesc));
+		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		srvDesc.Buffer.FirstElement = 0;
+		srvDesc.Buffer.NumElements = mCapacity;
+		HR(pDevice->CreateShaderResourceView(mpBuf, &srvDesc, &mpSRV));
+		pDevice->Release();
+	}
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	HR(ctx.Map(mpBuf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+	return mapped.pData;
+}
+
+void StructuredTable::Unmap(ID3D11DeviceContext& ctx)
+{
+	ctx.Unmap(mpBuf, 0);
+}
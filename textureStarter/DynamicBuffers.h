@@ -0,0 +1,83 @@
+#ifndef DYNAMICBUFFERS_H
+#define DYNAMICBUFFERS_H
+
+#include <d3d11.h>
+
+/*
+Per instance data for instanced drawing, rewritten every frame. It's a ring - each
+Map appends after what the GPU may still be reading with NO_OVERWRITE, and only when
+it won't fit is the whole buffer discarded and filling starts again at the front, so
+lots of small batches don't each cost a discard (and the driver a fresh buffer).
+*/
+class InstanceRing
+{
+public:
+	~InstanceRing() {
+		Release();
+	}
+	/*
+	* stride - IN bytes per instance
+	* maxInstances - IN most that can be mapped at once
+	*/
+	void Init(ID3D11Device& device, int stride, int maxInstances);
+	void Release();
+	//as vertex buffer 0
+	void Bind(ID3D11DeviceContext& ctx);
+	/*
+	* make room for some instances
+	* count - IN how many, no more than GetMaxInstances
+	* returns - where to write them
+	*/
+	void* Map(ID3D11DeviceContext& ctx, int count);
+	//returns - the start instance location to draw what was just written with
+	int Unmap(ID3D11DeviceContext& ctx);
+	/*
+	* copy instances in and draw them, in pieces if there are more than fit
+	* vertsPerInstance - IN e.g. 4 for a quad drawn as a triangle strip
+	*/
+	void Draw(ID3D11DeviceContext& ctx, const void* pInstances, int count, int vertsPerInstance);
+
+	int GetMaxInstances() const {
+		return mMaxInstances;
+	}
+
+private:
+	ID3D11Buffer* mpBuf = nullptr;
+	int mStride = 0;
+	int mMaxInstances = 0;
+	int mRingPos = 0;		//next free instance
+	int mMapped = 0;		//instances in the current Map
+};
+
+/*
+An array of structs a shader reads by index (StructuredBuffer), rewritten whole
+when it changes. It grows in big steps so it's rarely recreated.
+*/
+class StructuredTable
+{
+public:
+	~StructuredTable() {
+		Release();
+	}
+	void Release();
+	/*
+	* discard what was there and make room for a new table
+	* count - IN how many structs
+	* stride - IN bytes in each, the same every time
+	* returns - where to write them
+	*/
+	void* Map(ID3D11DeviceContext& ctx, int count, int stride);
+	void Unmap(ID3D11DeviceContext& ctx);
+
+	//nullptr until the first Map
+	ID3D11ShaderResourceView* GetSRV() const {
+		return mpSRV;
+	}
+
+private:
+	ID3D11Buffer* mpBuf = nullptr;
+	ID3D11ShaderResourceView* mpSRV = nullptr;
+	int mCapacity = 0;
+};
+
+#endif
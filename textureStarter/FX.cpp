@@ -1,11 +1,16 @@
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
 
 #include "D3D.h"
 #include "D3DUtil.h"
 #include "FX.h"
 #include "WindowUtils.h"
 #include "Model.h"
+#include "Mesh.h"
 
 using namespace std;
 using namespace DirectX;
@@ -20,6 +25,7 @@ namespace FX
 		CreateConstantBuffer(mD3D.GetDevice(),sizeof(GfxParamsPerFrame), &mpGfxPerFrame);
 		CreateConstantBuffer(mD3D.GetDevice(),sizeof(GfxParamsPerObj), &mpGfxPerObj);
 		CreateConstantBuffer(mD3D.GetDevice(),sizeof(GfxParamsPerMesh), &mpGfxPerMesh);
+		CreateConstantBuffer(mD3D.GetDevice(),sizeof(GfxParamsSkin), &mpGfxSkin);
 	}
 
 	void MyFX::ReleaseConstantBuffers()
@@ -27,6 +33,7 @@ namespace FX
 		ReleaseCOM(mpGfxPerFrame);
 		ReleaseCOM(mpGfxPerObj);
 		ReleaseCOM(mpGfxPerMesh);
+		ReleaseCOM(mpGfxSkin);
 	}
 
 	void MyFX::SetPerObjConsts(ID3D11DeviceContext& d3dContext, DirectX::SimpleMath::Matrix& world)
@@ -38,11 +45,209 @@ namespace FX
 		d3dContext.UpdateSubresource(mpGfxPerObj, 0, nullptr, &mGfxPerObj, 0, 0);
 	}
 
+	void MyFX::SetPerObjConsts(ID3D11DeviceContext& d3dContext, const GfxParamsPerObj& consts)
+	{
+		d3dContext.UpdateSubresource(mpGfxPerObj, 0, nullptr, &consts, 0, 0);
+	}
+
+	void MyFX::SetSkinConsts(const Matrix* pPalette, int numBones)
+	{
+		//the palette is only read once the frame is drawn, so the same pointer means the same matrices
+		assert(pPalette && numBones > 0 && numBones <= MAX_BONES);
+		if (pPalette == mpLastPalette)
+			return;
+		memcpy(mGfxSkin.bones, pPalette, numBones * sizeof(Matrix));
+		ID3D11DeviceContext& dc = mD3D.GetDeviceCtx();
+		dc.UpdateSubresource(mpGfxSkin, 0, nullptr, &mGfxSkin, 0, 0);
+		dc.VSSetConstantBuffers(3, 1, &mpGfxSkin);
+		mpLastPalette = pPalette;
+	}
+
 	void MyFX::SetPerFrameConsts(ID3D11DeviceContext& d3DContext, const Vector3& eyePos)
 	{
 		mGfxPerFrame.eyePosW = Vector4(eyePos.x, eyePos.y, eyePos.z, 0);
+		mEyePos = eyePos;
 		d3DContext.UpdateSubresource(mpGfxPerFrame, 0, nullptr, &mGfxPerFrame, 0, 0);
+		//anything could have happened to the pipeline since last frame
+		InvalidatePSO();
+		mD3D.InvalidateInputAssembler();
+	}
+
+	unsigned int MakePSOKey(const Material& mat, TexCache& cache, int vertexFormat)
+	{
+		assert(vertexFormat >= 0 && vertexFormat < VertexFormat::MAX_FORMATS);
+		unsigned int key = (mat.flags & PSOKey::MATERIAL_MASK) | (vertexFormat << PSOKey::FORMAT_SHIFT);
+		if (mat.pTextureRV)
+		{
+			key |= PSOKey::TEXTURED;
+			const TexCache::Data* pData = cache.Find(mat.pTextureRV);
+			if (pData && pData->alphaMode == DDS_ALPHA_MODE_OPAQUE)
+				key |= PSOKey::OPAQUE_TEX;
+		}
+		return key;
+	}
+
+	const PipelineState& MyFX::GetPSO(unsigned int key)
+	{
+		PSOCache::iterator it = mPSOCache.find(key);
+		if (it != mPSOCache.end())
+			return (*it).second;
+
+		//new combination, work out the states once and remember them
+		PipelineState pso;
+		pso.key = key;
+		int vertexFormat = (key & PSOKey::FORMAT_MASK) >> PSOKey::FORMAT_SHIFT;
+		pso.pVS = mpVS[vertexFormat];
+		pso.pInputLayout = mpInputLayout[vertexFormat];
+
+		//should we cull?
+		bool wire = (key&Material::TFlags::WIRE_FRAME) != 0;
+		if ((key&Material::TFlags::CULL) == 0)
+			pso.pRaster = mpRasterStates[wire ? RasterType::NOCULL_WIRE : RasterType::NOCULL_FILLED];
+		else if ((key&Material::TFlags::CCW_WINDING) != 0)
+			pso.pRaster = mpRasterStates[wire ? RasterType::CCW_WIRE : RasterType::CCW_FILLED];
+		else
+			pso.pRaster = mpRasterStates[wire ? RasterType::CW_WIRE : RasterType::CW_FILLED];
+
+		if ((key&PSOKey::DEPTH_ONLY) != 0)
+		{
+			//just lay down depth, no pixel shader, no blending
+			pso.pDepth = mpDepthStates[DepthType::LESS_WRITE];
+			pso.id = (int)mPSOCache.size();
+			return mPSOCache.insert(PSOCache::value_type(key, pso)).first->second;
+		}
+
+		pso.textured = (key & PSOKey::TEXTURED) != 0;
+		//select pixel shader to use
+		if ((key&Material::TFlags::LIT) != 0)
+			pso.pPS = (pso.textured) ? mpPSLitTex : mpPSLit;
+		else
+			pso.pPS = (pso.textured) ? mpPSUnlitTex : mpPSUnlit;
+
+		//how is it blended? texture alpha is ignored if the texture says it's meaningless
+		if ((key&Material::TFlags::TRANSPARENCY) != 0)
+		{
+			pso.pBlend = mpBlendTransparent;
+			pso.useBlendFactors = true;
+			pso.transparent = true;
+		}
+		else if ((key&Material::TFlags::ALPHA_TRANSPARENCY) != 0 && (key&PSOKey::OPAQUE_TEX) == 0)
+		{
+			pso.pBlend = mpBlendAlphaTrans;
+			pso.transparent = true;
+		}
+
+		if (pso.transparent)
+			pso.pDepth = mpDepthStates[DepthType::LESS_READONLY];
+		else if ((key&PSOKey::DEPTH_EQUAL) != 0)
+			pso.pDepth = mpDepthStates[DepthType::EQUAL];
+		else
+		{
+			//opaques need variants for the depth pre-pass, the depth only one is shared by
+			//everything with the same raster state
+			pso.pDepth = mpDepthStates[DepthType::LESS_WRITE];
+			unsigned int rasterKey = key & (Material::TFlags::CULL | Material::TFlags::CCW_WINDING | Material::TFlags::WIRE_FRAME | PSOKey::FORMAT_MASK);
+			pso.pDepthOnly = &GetPSO(rasterKey | PSOKey::DEPTH_ONLY);
+			pso.pDepthEqual = &GetPSO(key | PSOKey::DEPTH_EQUAL);
+		}
+
+		pso.id = (int)mPSOCache.size();
+		return mPSOCache.insert(PSOCache::value_type(key, pso)).first->second;
+	}
+
+	void MyFX::CompileMaterial(Material& mat, int vertexFormat)
+	{
+		mat.psoKey = MakePSOKey(mat, mD3D.GetCache(), vertexFormat);
+		mat.pPSO = &GetPSO(mat.psoKey);
+		mat.pPSOTex = mat.pTextureRV;
+	}
+
+	double MyFX::BenchmarkMaterials(int numMaterials, int numFrames)
+	{
+		//a level's worth of materials, random state flags, half textured, on every vertex format
+		ID3D11ShaderResourceView* pTex = mD3D.GetCache().LoadTexture(&mD3D.GetDevice(), "cross.dds");
+		mt19937 rng(1234);
+		vector<Material> mats(numMaterials);
+		vector<int> formats(numMaterials);
+		for (int i = 0; i < numMaterials; ++i)
+		{
+			mats[i].flags = Material::TFlags::APPEND_PATH | (rng() & PSOKey::MATERIAL_MASK);
+			mats[i].pTextureRV = (rng() & 1) ? pTex : nullptr;
+			formats[i] = rng() % VertexFormat::MAX_FORMATS;
+		}
+		typedef chrono::high_resolution_clock Clock;
+		typedef chrono::duration<double> Secs;
+
+		//the first time some states will be new, the second every one is a cache hit
+		const int cachedBefore = (int)mPSOCache.size();
+		double compileSecs[2];
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			Clock::time_point start = Clock::now();
+			for (int i = 0; i < numMaterials; ++i)
+				CompileMaterial(mats[i], formats[i]);
+			compileSecs[pass] = Secs(Clock::now() - start).count();
+		}
+		const int numNew = (int)mPSOCache.size() - cachedBefore;
+
+		//every material bound once a frame, as submitted then grouped by state
+		vector<int> order(numMaterials);
+		for (int i = 0; i < numMaterials; ++i)
+			order[i] = i;
+		double bindSecs[2];
+		int binds[2];
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			if (pass == 1)
+				sort(order.begin(), order.end(), [&mats](int a, int b) {
+					return mats[a].pPSO->id < mats[b].pPSO->id;
+				});
+			ResetPSOStats();
+			Clock::time_point start = Clock::now();
+			for (int f = 0; f < numFrames; ++f)
+			{
+				InvalidatePSO();
+				for (int i : order)
+				{
+					ValidateMaterial(mats[i], formats[i]);
+					BindPSO(*mats[i].pPSO, mats[i].blendFactors);
+				}
+			}
+			bindSecs[pass] = Secs(Clock::now() - start).count() / numFrames;
+			binds[pass] = mPSOBinds / numFrames;
+		}
+		ResetPSOStats();
+		InvalidatePSO();
+
+		DBOUT("PSO cache, " << numMaterials << " materials: compiled in " << compileSecs[0] * 1e6 << "us (" << numNew << " new states, "
+			<< mPSOCache.size() << " in the cache), again all cached " << compileSecs[1] * 1e6 << "us");
+		DBOUT("  binding per frame as submitted " << binds[0] << " binds " << bindSecs[0] * 1000 << "ms, sorted by state "
+			<< binds[1] << " binds " << bindSecs[1] * 1000 << "ms");
+		return (double)binds[0] / max(1, binds[1]);
+	}
+
+	void MyFX::BindPSO(const PipelineState& pso, const float blendFactors[4])
+	{
+		ID3D11DeviceContext& dc = mD3D.GetDeviceCtx();
+		if (&pso == mpLastPSO)
+		{
+			//same states, but the blend factors can still differ per material
+			if (pso.useBlendFactors)
+				dc.OMSetBlendState(pso.pBlend, blendFactors, 0xffffffff);
+			++mPSOSkips;
+			return;
+		}
 
+		dc.VSSetShader(pso.pVS, nullptr, 0);
+		dc.PSSetShader(pso.pPS, nullptr, 0);
+		if (pso.textured)
+			dc.PSSetSamplers(0, 1, &mpSamAnisotropic);
+		float b[] = { 1, 1, 1, 1 };
+		dc.OMSetBlendState(pso.pBlend, (pso.useBlendFactors) ? blendFactors : b, 0xffffffff);
+		dc.RSSetState(pso.pRaster);
+		dc.OMSetDepthStencilState(pso.pDepth, 1);
+		mpLastPSO = &pso;
+		++mPSOBinds;
 	}
 
 	void CreateRasterStates(ID3D11Device &device, ID3D11RasterizerState *pStates[RasterType::MAX_STATES])
@@ -71,6 +276,26 @@ namespace FX
 		HR(device.CreateRasterizerState(&desc, &pStates[RasterType::NOCULL_FILLED]));
 	}
 
+	void CreateDepthStates(ID3D11Device& d3dDevice, ID3D11DepthStencilState *pStates[DepthType::MAX_STATES])
+	{
+		D3D11_DEPTH_STENCIL_DESC desc;
+		ZeroMemory(&desc, sizeof(D3D11_DEPTH_STENCIL_DESC));
+		desc.DepthEnable = true;
+		desc.StencilEnable = false;
+		desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+		desc.DepthFunc = D3D11_COMPARISON_LESS;
+		HR(d3dDevice.CreateDepthStencilState(&desc, &pStates[DepthType::LESS_WRITE]));
+
+		//depth is already there from the pre-pass, only shade the pixel that won
+		desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+		desc.DepthFunc = D3D11_COMPARISON_EQUAL;
+		HR(d3dDevice.CreateDepthStencilState(&desc, &pStates[DepthType::EQUAL]));
+
+		//transparent things are hidden behind opaques, but shouldn't hide each other
+		desc.DepthFunc = D3D11_COMPARISON_LESS;
+		HR(d3dDevice.CreateDepthStencilState(&desc, &pStates[DepthType::LESS_READONLY]));
+	}
+
 
 	void CreateTransparentBlendState(ID3D11Device& d3dDevice, ID3D11BlendState* &pTransparent)
 	{
@@ -125,6 +350,76 @@ namespace FX
 		HR(d3dDevice.CreateBlendState(&blendDesc, &pBlend));
 	}
 
+	void CreateAdditiveBlendState(ID3D11Device& d3dDevice, ID3D11BlendState* &pBlend)
+	{
+		D3D11_BLEND_DESC blendDesc;
+		ZeroMemory(&blendDesc, sizeof(blendDesc));
+
+		D3D11_RENDER_TARGET_BLEND_DESC rtbd;
+		ZeroMemory(&rtbd, sizeof(rtbd));
+
+		rtbd.BlendEnable = true;
+		rtbd.SrcBlend = D3D11_BLEND_SRC_ALPHA;
+		rtbd.DestBlend = D3D11_BLEND_ONE;
+		rtbd.BlendOp = D3D11_BLEND_OP_ADD;
+
+		rtbd.SrcBlendAlpha = D3D11_BLEND_ZERO;
+		rtbd.DestBlendAlpha = D3D11_BLEND_ONE;
+		rtbd.BlendOpAlpha = D3D11_BLEND_OP_ADD;
+		rtbd.RenderTargetWriteMask = D3D10_COLOR_WRITE_ENABLE_ALL;
+		blendDesc.RenderTarget[0] = rtbd;
+
+		blendDesc.AlphaToCoverageEnable = false;
+
+		HR(d3dDevice.CreateBlendState(&blendDesc, &pBlend));
+	}
+
+	void CreatePremultipliedBlendState(ID3D11Device& d3dDevice, ID3D11BlendState* &pBlend)
+	{
+		D3D11_BLEND_DESC blendDesc;
+		ZeroMemory(&blendDesc, sizeof(blendDesc));
+
+		D3D11_RENDER_TARGET_BLEND_DESC& rtbd = blendDesc.RenderTarget[0];
+		rtbd.BlendEnable = true;
+		rtbd.SrcBlend = rtbd.SrcBlendAlpha = D3D11_BLEND_ONE;
+		rtbd.DestBlend = rtbd.DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
+		rtbd.BlendOp = rtbd.BlendOpAlpha = D3D11_BLEND_OP_ADD;
+		rtbd.RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+
+		HR(d3dDevice.CreateBlendState(&blendDesc, &pBlend));
+	}
+
+	void CreateNoCullRasterState(ID3D11Device& d3dDevice, ID3D11RasterizerState* &pRaster)
+	{
+		D3D11_RASTERIZER_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.FillMode = D3D11_FILL_SOLID;
+		desc.CullMode = D3D11_CULL_NONE;
+		desc.DepthClipEnable = true;
+		HR(d3dDevice.CreateRasterizerState(&desc, &pRaster));
+	}
+
+	void Create2DStates(ID3D11Device& d3dDevice, ID3D11DepthStencilState* &pDepth, ID3D11RasterizerState* &pRaster,
+		ID3D11SamplerState* &pSampler, bool pointSample)
+	{
+		D3D11_DEPTH_STENCIL_DESC depthDesc;
+		ZeroMemory(&depthDesc, sizeof(depthDesc));
+		depthDesc.DepthEnable = false;
+		depthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+		depthDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+		HR(d3dDevice.CreateDepthStencilState(&depthDesc, &pDepth));
+
+		CreateNoCullRasterState(d3dDevice, pRaster);
+
+		D3D11_SAMPLER_DESC sampDesc;
+		ZeroMemory(&sampDesc, sizeof(sampDesc));
+		sampDesc.Filter = pointSample ? D3D11_FILTER_MIN_MAG_MIP_POINT : D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+		sampDesc.AddressU = sampDesc.AddressV = sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+		sampDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+		sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+		HR(d3dDevice.CreateSamplerState(&sampDesc, &pSampler));
+	}
+
 
 	void MyFX::SetupDirectionalLight(int lightIdx, bool enable, const Vector3 &direction,
 		const Vector3& diffuse, const Vector3& ambient, const Vector3& specular)
@@ -312,13 +607,19 @@ namespace FX
 		CheckShaderModel5Supported(mD3D.GetDevice());
 		CreateSampler(mD3D.GetDevice(),mpSamAnisotropic);
 		CreateRasterStates(mD3D.GetDevice(), mpRasterStates);
+		CreateDepthStates(mD3D.GetDevice(), mpDepthStates);
 
 		char* pBuff = nullptr;
 		unsigned int bytes = 0;
-		pBuff = ReadAndAllocate("../bin/data/TextureVS.cso", bytes);
-		CreateVertexShader(mD3D.GetDevice(),pBuff, bytes, mpVS);
-		CreateInputLayout(mD3D.GetDevice(), VertexPosNormTex::sVertexDesc, 3, pBuff, bytes, &mpInputLayout);
-		delete[] pBuff;
+		//a vertex shader and input layout for each vertex format
+		for (int i = 0; i < VertexFormat::MAX_FORMATS; ++i)
+		{
+			const VertexFormatInfo& fmt = gVertexFormats[i];
+			pBuff = ReadAndAllocate(fmt.pVSFile, bytes);
+			CreateVertexShader(mD3D.GetDevice(), pBuff, bytes, mpVS[i]);
+			CreateInputLayout(mD3D.GetDevice(), fmt.pDesc, fmt.numElements, pBuff, bytes, &mpInputLayout[i]);
+			delete[] pBuff;
+		}
 
 		pBuff = ReadAndAllocate("../bin/data/PSLitNoTex.cso", bytes);
 		CreatePixelShader(mD3D.GetDevice(), pBuff, bytes, mpPSLit);
@@ -345,36 +646,51 @@ namespace FX
 
 	void MyFX::Release()
 	{
-		ReleaseCOM(mpVS);
+		for (int i = 0; i < VertexFormat::MAX_FORMATS; ++i)
+		{
+			ReleaseCOM(mpVS[i]);
+			ReleaseCOM(mpInputLayout[i]);
+		}
 		ReleaseCOM(mpPSLit);
 		ReleaseCOM(mpPSUnlit);
 		ReleaseCOM(mpPSLitTex);
 		ReleaseCOM(mpPSUnlitTex);
-		ReleaseCOM(mpInputLayout);
 		ReleaseCOM(mpSamAnisotropic);
 		ReleaseCOM(mpBlendTransparent);
 		ReleaseCOM(mpBlendAlphaTrans);
 		ReleaseConstantBuffers();
 		for (int i = 0; i < RasterType::MAX_STATES; ++i)
 			ReleaseCOM(mpRasterStates[i]);
+		for (int i = 0; i < DepthType::MAX_STATES; ++i)
+			ReleaseCOM(mpDepthStates[i]);
+		mPSOCache.clear();
+		mOpaqueQ.clear();
+		mTransparentQ.clear();
+		InvalidatePSO();
 	}
 
 	void MyFX::Render(Model& model, Material* pOverrideMat)
 	{
-		//setup shaders
-		mD3D.GetDeviceCtx().VSSetShader(mpVS, nullptr, 0);
-
-		Matrix w;
-		model.GetWorldMatrix(w);
-		SetPerObjConsts(mD3D.GetDeviceCtx(), w);
-
-		Mesh& mesh = model.GetMesh();
+		//a stale handle means the mesh was released, nothing to draw
+		Mesh* pMesh = mD3D.GetMeshMgr().GetMesh(model.GetMeshHandle());
+		if (!pMesh)
+			return;
+		Mesh& mesh = *pMesh;
+		GfxParamsPerObj consts;
+		MakePerObjConsts(mD3D.GetTransforms().GetMatrices(model.GetTransform()), mesh, consts);
+		SetPerObjConsts(mD3D.GetDeviceCtx(), consts);
+		if (mesh.GetVertexFormat() == VertexFormat::SKINNED)
+			SetSkinConsts(model.GetPalette(), model.GetNumBones());
+
+		//every submesh is a range in the same buffers, so bind them once and draw each range
+		SubMesh& first = mesh.GetSubMesh(0);
+		mD3D.InitInputAssembler(mpInputLayout[mesh.GetVertexFormat()], first.mpVB, first.mVertexSize, first.mpIB, 
+			D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST, first.mIndexFormat);
 		for (int i = 0; i < mesh.GetNumSubMeshes(); ++i)
 		{
 			//update material
 			SubMesh& sm = mesh.GetSubMesh(i);
 
-			mD3D.InitInputAssembler(mpInputLayout, sm.mpVB, sizeof(VertexPosNormTex), sm.mpIB);
 			Material *pM;
 			if (pOverrideMat)
 				pM = pOverrideMat;
@@ -383,15 +699,118 @@ namespace FX
 			else
 				pM = &sm.material;
 
+			ValidateMaterial(*pM, mesh.GetVertexFormat());
+			PreRenderObj(*pM, *pM->pPSO);
+			assert(sm.mpVB == first.mpVB && sm.mpIB == first.mpIB);
+			mD3D.GetDeviceCtx().DrawIndexed(sm.mNumIndices, sm.mStartIndex, sm.mBaseVertex);
+		}
+	}
+
+	void MyFX::MakePerObjConsts(const GfxParamsPerObj& transform, const Mesh& mesh, GfxParamsPerObj& consts)
+	{
+		//normals are decoded in local space so only the real world matrix affects them
+		consts = transform;
+		if (mesh.GetVertexFormat() != VertexFormat::FULL)
+		{
+			consts.world = mesh.GetDequantise() * transform.world;
+			consts.worldViewProj = mesh.GetDequantise() * transform.worldViewProj;
+		}
+	}
+
+	void MyFX::Submit(Model& model, Material* pOverrideMat)
+	{
+		if (Mesh* pMesh = mD3D.GetMeshMgr().GetMesh(model.GetMeshHandle()))
+			Submit(model, nullptr, pMesh->GetNumSubMeshes(), pOverrideMat);
+	}
+
+	void MyFX::Submit(Model& model, const int subMeshes[], int numSubMeshes, Material* pOverrideMat)
+	{
+		Mesh* pMesh = mD3D.GetMeshMgr().GetMesh(model.GetMeshHandle());
+		if (!pMesh)
+			return;
+		Mesh& mesh = *pMesh;
+		DrawItem item;
+		const GfxParamsPerObj& transform = mD3D.GetTransforms().GetMatrices(model.GetTransform());
+		MakePerObjConsts(transform, mesh, item.objConsts);
+		item.distSq = (transform.world.Translation() - mEyePos).LengthSquared();
+		item.pPalette = nullptr;
+		item.numBones = 0;
+		if (mesh.GetVertexFormat() == VertexFormat::SKINNED)
+		{
+			assert(model.GetPalette());
+			item.pPalette = model.GetPalette();
+			item.numBones = model.GetNumBones();
+		}
+
+		for (int i = 0; i < numSubMeshes; ++i)
+		{
+			SubMesh& sm = mesh.GetSubMesh(subMeshes ? subMeshes[i] : i);
+			if (sm.mNumIndices == 0)
+				continue;
+			Material *pM;
+			if (pOverrideMat)
+				pM = pOverrideMat;
+			else if (model.HasOverrideMat())
+				pM = model.HasOverrideMat();
+			else
+				pM = &sm.material;
+			ValidateMaterial(*pM, mesh.GetVertexFormat());
 
-			PreRenderObj(*pM);
-			mD3D.GetDeviceCtx().DrawIndexed(sm.mNumIndices, 0, 0);
+			item.pSubMesh = &sm;
+			item.pMat = pM;
+			item.pPSO = pM->pPSO;
+			if (pM->pPSO->transparent)
+				mTransparentQ.push_back(item);
+			else
+				mOpaqueQ.push_back(item);
+		}
+	}
 
+	void MyFX::RenderQueue()
+	{
+		//opaques grouped by pipeline state then buffers then geometry, transparents back to front
+		sort(mOpaqueQ.begin(), mOpaqueQ.end(), [](const DrawItem& a, const DrawItem& b) {
+			if (a.pPSO->id != b.pPSO->id)
+				return a.pPSO->id < b.pPSO->id;
+			if (a.pSubMesh->mpVB != b.pSubMesh->mpVB)
+				return a.pSubMesh->mpVB < b.pSubMesh->mpVB;
+			return a.pSubMesh->mStartIndex < b.pSubMesh->mStartIndex;
+		});
+		sort(mTransparentQ.begin(), mTransparentQ.end(), [](const DrawItem& a, const DrawItem& b) {
+			return a.distSq > b.distSq;
+		});
+
+		if (mDepthPrePass)
+		{
+			for (DrawItem& item : mOpaqueQ)
+				RenderItem(item, *item.pPSO->pDepthOnly);
+			for (DrawItem& item : mOpaqueQ)
+				RenderItem(item, *item.pPSO->pDepthEqual);
 		}
-		mD3D.GetDeviceCtx().OMSetBlendState(0, 0, 0xffffffff);
+		else
+		{
+			for (DrawItem& item : mOpaqueQ)
+				RenderItem(item, *item.pPSO);
+		}
+		for (DrawItem& item : mTransparentQ)
+			RenderItem(item, *item.pPSO);
+
+		mOpaqueQ.clear();
+		mTransparentQ.clear();
+	}
+
+	void MyFX::RenderItem(DrawItem& item, const PipelineState& pso)
+	{
+		SetPerObjConsts(mD3D.GetDeviceCtx(), item.objConsts);
+		if (item.pPalette)
+			SetSkinConsts(item.pPalette, item.numBones);
+		PreRenderObj(*item.pMat, pso);
+		SubMesh& sm = *item.pSubMesh;
+		mD3D.InitInputAssembler(pso.pInputLayout, sm.mpVB, sm.mVertexSize, sm.mpIB, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST, sm.mIndexFormat);
+		mD3D.GetDeviceCtx().DrawIndexed(sm.mNumIndices, sm.mStartIndex, sm.mBaseVertex);
 	}
 
-	void MyFX::PreRenderObj(Material& mat)
+	void MyFX::PreRenderObj(Material& mat, const PipelineState& pso)
 	{
 		//texture transform
 		mGfxPerMesh.material = mat.gfxData;
@@ -410,56 +829,14 @@ namespace FX
 		dc.PSSetConstantBuffers(1, 1, &mpGfxPerObj);
 		dc.PSSetConstantBuffers(2, 1, &mpGfxPerMesh);
 
-		//select pixel shader to use
-		ID3D11PixelShader* p;
-		if ((mat.flags&Material::TFlags::LIT) != 0)
-		{
-			if (mat.pTextureRV)
-				p = mpPSLitTex;
-			else
-				p = mpPSLit;
-		}
-		else
-		{
-			if (mat.pTextureRV)
-				p = mpPSUnlitTex;
-			else
-				p = mpPSUnlit;
-		}
+		//shaders, blending, culling, depth
+		BindPSO(pso, mat.blendFactors);
+
 		//do we have a texture
-		if (mat.pTextureRV)
+		if (pso.textured && mat.pTextureRV != mpLastTex)
 		{
-			dc.PSSetSamplers(0, 1, &mpSamAnisotropic);
 			dc.PSSetShaderResources(0, 1, &mat.pTextureRV);
+			mpLastTex = mat.pTextureRV;
 		}
-		dc.PSSetShader(p, nullptr, 0);
-
-		//how is it blended?
-		if ((mat.flags&Material::TFlags::TRANSPARENCY) != 0)
-			dc.OMSetBlendState(mpBlendTransparent, mat.blendFactors, 0xffffffff);
-		else if ((mat.flags&Material::TFlags::ALPHA_TRANSPARENCY) != 0)
-		{
-			float b[] = { 1, 1, 1, 1 };
-			dc.OMSetBlendState(mpBlendAlphaTrans, b, 0xffffffff);
-		}
-
-		//should we cull?
-		if ((mat.flags&Material::TFlags::CULL) == 0)
-			if ((mat.flags&Material::TFlags::WIRE_FRAME) != 0)
-				dc.RSSetState(mpRasterStates[RasterType::NOCULL_WIRE]);
-			else
-				dc.RSSetState(mpRasterStates[RasterType::NOCULL_FILLED]);
-		else if ((mat.flags&Material::TFlags::CCW_WINDING) != 0)
-			if ((mat.flags&Material::TFlags::WIRE_FRAME) != 0)
-				dc.RSSetState(mpRasterStates[RasterType::CCW_WIRE]);
-			else
-				dc.RSSetState(mpRasterStates[RasterType::CCW_FILLED]);
-		else
-			if ((mat.flags&Material::TFlags::WIRE_FRAME) != 0)
-				dc.RSSetState(mpRasterStates[RasterType::CW_WIRE]);
-			else
-				dc.RSSetState(mpRasterStates[RasterType::CW_FILLED]);
-
-		dc.OMSetDepthStencilState(nullptr, 1);
 	}
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #define FX_H
 
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <d3d11.h>
 
 #include "D3DUtil.h"
@@ -9,11 +11,59 @@
 
 class MyD3D;
 class Model;
+class SubMesh;
+class Mesh;
+class TexCache;
 
 namespace FX
 {
 	//design pattern - how do we get a 'class enum' safe enumeration where we cna still use the elements as numbers 
 	namespace RasterType { enum { CCW_FILLED = 0, CCW_WIRE = 1, CW_FILLED = 2, CW_WIRE = 3, NOCULL_WIRE = 4, NOCULL_FILLED = 5, MAX_STATES = 6 }; }
+	//normal depth test+write, only draw where depth matches (after a depth pre-pass), test but don't write (transparent)
+	namespace DepthType { enum { LESS_WRITE = 0, EQUAL = 1, LESS_READONLY = 2, MAX_STATES = 3 }; }
+
+	/*
+	* A pipeline state key packs everything that decides which d3d state objects a material needs
+	* into one number. The low bits are the Material::TFlags that affect state, higher bits are
+	* extra facts about the material (e.g. does it have a texture).
+	*/
+	namespace PSOKey {
+		enum {
+			MATERIAL_MASK = Material::TFlags::TRANSPARENCY | Material::TFlags::LIT | Material::TFlags::ALPHA_TRANSPARENCY |
+							Material::TFlags::CULL | Material::TFlags::CCW_WINDING | Material::TFlags::WIRE_FRAME,
+			TEXTURED = 1 << 8,		//material has a texture so needs a textured pixel shader
+			OPAQUE_TEX = 1 << 9,	//the texture says its alpha channel means nothing (DDS_ALPHA_MODE_OPAQUE)
+			DEPTH_ONLY = 1 << 10,	//variant for the depth pre-pass, no pixel shader
+			DEPTH_EQUAL = 1 << 11,	//variant for opaques drawn after the depth pre-pass
+			FORMAT_SHIFT = 12,		//VertexFormat of the mesh, decides vertex shader and input layout
+			FORMAT_MASK = 0xf << FORMAT_SHIFT
+		};
+	}
+	//build the key for this material on a mesh with the given VertexFormat
+	//the texture cache knows what the texture alpha means
+	unsigned int MakePSOKey(const Material& mat, TexCache& cache, int vertexFormat);
+
+	/*
+	* An immutable bundle of all the shaders and state objects needed to draw a surface.
+	* There is only ever one for each unique key, materials just point at it, so binding
+	* can be skipped with a simple pointer comparison against the last one bound.
+	*/
+	struct PipelineState
+	{
+		ID3D11VertexShader* pVS = nullptr;
+		ID3D11PixelShader* pPS = nullptr;
+		ID3D11InputLayout* pInputLayout = nullptr;
+		ID3D11RasterizerState* pRaster = nullptr;
+		ID3D11BlendState* pBlend = nullptr;				//nullptr = default, no blending
+		ID3D11DepthStencilState* pDepth = nullptr;		//nullptr = default depth test
+		bool useBlendFactors = false;	//blend factors come from the material, so must be set per draw
+		bool textured = false;			//a texture and sampler need binding
+		bool transparent = false;		//draw after opaques, sorted back to front
+		unsigned int key = 0;			//the key it was built from
+		int id = 0;						//unique and small, handy for sorting draws by state
+		const PipelineState* pDepthOnly = nullptr;	//opaques only - variant for the depth pre-pass
+		const PipelineState* pDepthEqual = nullptr;	//opaques only - variant to use after the depth pre-pass
+	};
 
 	/*we've loaded in a "blob" of compiled shader code, it needs to be set up on the gpu as a pixel shader
 	* d3dDevice - IN the gpu device to hold this pixel shader
@@ -58,10 +108,25 @@ namespace FX
 	void CreateRasterStates(ID3D11Device& d3dDevice, ID3D11RasterizerState *pStates[RasterType::MAX_STATES]);
 	//a sampler takes samples of the texture i.e. looks up texels
 	void CreateSampler(ID3D11Device& d3dDevice, ID3D11SamplerState* &pSampler);
+	//depth stencil states for normal, pre-passed and transparent drawing, see DepthType
+	void CreateDepthStates(ID3D11Device& d3dDevice, ID3D11DepthStencilState *pStates[DepthType::MAX_STATES]);
 	//there can be many blend states, this one uses the blend factors to directly control transparency
 	void CreateTransparentBlendState(ID3D11Device& d3dDevice, ID3D11BlendState* &pTransparent);
 	//this one uses the texture alpha to control the transparency
 	void CreateAlphaTransparentBlendState(ID3D11Device& d3dDevice, ID3D11BlendState* &pBlend);
+	//this one adds the colour on top, scaled by the texture alpha, for things that glow (fire, sparks)
+	void CreateAdditiveBlendState(ID3D11Device& d3dDevice, ID3D11BlendState* &pBlend);
+	//this one is SpriteBatch's default, the colour has already been multiplied by the alpha
+	void CreatePremultipliedBlendState(ID3D11Device& d3dDevice, ID3D11BlendState* &pBlend);
+	//filled and nothing culled, for things that are only ever seen from the front
+	void CreateNoCullRasterState(ID3D11Device& d3dDevice, ID3D11RasterizerState* &pRaster);
+	/*
+	* the other states 2D drawing wants, as SpriteBatch sets them - no depth, no culling and clamped sampling
+	* pDepth, pRaster, pSampler - OUT
+	* pointSample - IN no filtering (e.g. so neighbouring tiles in an atlas don't bleed in), otherwise linear
+	*/
+	void Create2DStates(ID3D11Device& d3dDevice, ID3D11DepthStencilState* &pDepth, ID3D11RasterizerState* &pRaster,
+		ID3D11SamplerState* &pSampler, bool pointSample = false);
 
 
 
@@ -86,15 +151,75 @@ namespace FX
 		*				pass one in to use instead, so we can make the model look different without altering it
 		*/
 		void Render(Model& model, Material* pOverrideMat = nullptr);
+		/*
+		* Rather than drawing straight away, queue the model for this frame. The world matrix is
+		* captured now, so the model can be moved and submitted again (e.g. one quad as many walls).
+		* The queue is drawn with RenderQueue, opaques first, then transparents back to front.
+		* model - IN model to draw, don't create or release meshes before RenderQueue, that moves them
+		* pOverrideMat - IN as Render, must stay alive until RenderQueue
+		*/
+		void Submit(Model& model, Material* pOverrideMat = nullptr);
+		/*
+		* as above but only some of the submeshes, e.g. picking a LOD's parts of an index buffer
+		* subMeshes - IN which ones, nullptr for the first numSubMeshes. Empty submeshes are skipped.
+		* numSubMeshes - IN how many
+		*/
+		void Submit(Model& model, const int subMeshes[], int numSubMeshes, Material* pOverrideMat = nullptr);
+		/*
+		* Draw everything submitted this frame and empty the queue
+		* Optional depth pre-pass fills the depth buffer with opaque geometry and no pixel shader,
+		* then opaques are drawn with an EQUAL depth test so each pixel is only shaded once,
+		* last of all transparent geometry is sorted back to front and drawn without writing depth
+		*/
+		void RenderQueue();
+		//switch the depth pre-pass on/off, it costs an extra vertex pass so measure it per scene
+		void SetDepthPrePass(bool on) {
+			mDepthPrePass = on;
+		}
+		bool GetDepthPrePass() const {
+			return mDepthPrePass;
+		}
 
 		//getters
 		DirectX::SimpleMath::Matrix& GetProjectionMatrix() { return mProj; }
 		DirectX::SimpleMath::Matrix& GetViewMatrix() { return mView; }
 		//set the constants that change per object
 		void SetPerObjConsts(ID3D11DeviceContext& ctx, DirectX::SimpleMath::Matrix &world);
+		//as above but the world matrices have already been worked out
+		void SetPerObjConsts(ID3D11DeviceContext& ctx, const GfxParamsPerObj& consts);
 		//set the constants that change each update
 		void SetPerFrameConsts(ID3D11DeviceContext& ctx, const DirectX::SimpleMath::Vector3& eyePos);
 		/*
+		* Turn a material into a pipeline state, do it once when the material is created
+		* the state is looked up in a cache so identical materials share one
+		* mat - IN/OUT the material to compile, pPSO and psoKey are filled in
+		* vertexFormat - IN the VertexFormat of the mesh it's used with
+		*/
+		void CompileMaterial(Material& mat, int vertexFormat = VertexFormat::FULL);
+		//find or create the pipeline state for this key
+		const PipelineState& GetPSO(unsigned int key);
+		//forget what is bound, call if something else (e.g. SpriteBatch) has changed d3d state
+		void InvalidatePSO() {
+			mpLastPSO = nullptr;
+			mpLastTex = nullptr;
+			mpLastPalette = nullptr;
+		}
+		//how many pipeline state binds were done or skipped because it was already bound
+		void GetPSOStats(int& binds, int& skips) const {
+			binds = mPSOBinds;
+			skips = mPSOSkips;
+		}
+		void ResetPSOStats() {
+			mPSOBinds = mPSOSkips = 0;
+		}
+		/*
+		* time compiling numMaterials random materials (CompileMaterial/GetPSO) then binding their
+		* states for numFrames frames, in the order given and sorted by state as RenderQueue does.
+		* Nothing is drawn, any new states stay in the cache. Results go to DBOUT.
+		* returns - how many times fewer binds sorting by state needs
+		*/
+		double BenchmarkMaterials(int numMaterials, int numFrames);
+		/*
 		* A directional light - like the sun
 		* lightIdx - IN we pass an array of light info to the gpu, which array element is this one using
 		* enable - IN true if we are turning it on
@@ -141,25 +266,66 @@ namespace FX
 		GfxParamsPerObj mGfxPerObj;					//world matrices for transformation
 		GfxParamsPerFrame mGfxPerFrame;				//lights and camera position
 		GfxParamsPerMesh mGfxPerMesh;				//texture transform matrix and basic material properties
+		GfxParamsSkin mGfxSkin;						//bone matrices for skinned meshes
 		ID3D11Buffer *mpGfxPerObj = nullptr, *mpGfxPerFrame = nullptr, *mpGfxPerMesh = nullptr;	//DX equivalent data structures for passing to gpu
+		ID3D11Buffer *mpGfxSkin = nullptr;
+		const DirectX::SimpleMath::Matrix* mpLastPalette = nullptr;	//what bone matrices are in mpGfxSkin
+		//upload a model's bone matrices unless they're already there, only skinned meshes use them
+		void SetSkinConsts(const DirectX::SimpleMath::Matrix* pPalette, int numBones);
 		 
 		//when passing data to the gpu it goes in constant buffers
 		void CreateConstantBuffers();
 		void ReleaseConstantBuffers();
-		//called before rendering anything	
-		void PreRenderObj(Material& mat);
-		//mapping between vertex/index buffers and gpu
-		ID3D11InputLayout* mpInputLayout = nullptr;
+		//called before rendering anything, the pipeline state is the material's or a variant of it
+		void PreRenderObj(Material& mat, const PipelineState& pso);
+		//make sure the material's pipeline state is up to date and right for this vertex format
+		//a material shared by meshes with different formats will get recompiled (a cache lookup) each time
+		void ValidateMaterial(Material& mat, int vertexFormat) {
+			if (!mat.pPSO || mat.pPSOTex != mat.pTextureRV || (mat.psoKey&PSOKey::MATERIAL_MASK) != (mat.flags&PSOKey::MATERIAL_MASK) ||
+				(int)((mat.psoKey&PSOKey::FORMAT_MASK) >> PSOKey::FORMAT_SHIFT) != vertexFormat)
+				CompileMaterial(mat, vertexFormat);
+		}
+		//per object constants from a model's matrices (see TransformStore), with compact vertices the mesh bounds get folded in
+		void MakePerObjConsts(const GfxParamsPerObj& transform, const Mesh& mesh, GfxParamsPerObj& consts);
+		//set the shaders and states in a pipeline state object, unless it's already set
+		void BindPSO(const PipelineState& pso, const float blendFactors[4]);
+		//every unique pipeline state, looked up by key, never moves once created
+		typedef std::unordered_map<unsigned int, PipelineState> PSOCache;
+		PSOCache mPSOCache;
+		const PipelineState* mpLastPSO = nullptr;	//what is currently bound
+		ID3D11ShaderResourceView* mpLastTex = nullptr;	//what texture is currently bound
+		int mPSOBinds = 0, mPSOSkips = 0;				//stats
+
+		//one sub-mesh waiting to be drawn
+		struct DrawItem
+		{
+			GfxParamsPerObj objConsts;	//world matrices captured when submitted
+			SubMesh* pSubMesh;
+			Material* pMat;
+			const PipelineState* pPSO;	//the material's state when submitted
+			float distSq;				//from the camera, for sorting transparents
+			const DirectX::SimpleMath::Matrix* pPalette;	//skinned meshes only, the model's bone matrices
+			int numBones;
+		};
+		std::vector<DrawItem> mOpaqueQ, mTransparentQ;
+		bool mDepthPrePass = true;
+		DirectX::SimpleMath::Vector3 mEyePos;	//camera position this frame
+		//draw one item from the queue
+		void RenderItem(DrawItem& item, const PipelineState& pso);
+		//mapping between vertex/index buffers and gpu, one for each VertexFormat
+		ID3D11InputLayout* mpInputLayout[VertexFormat::MAX_FORMATS]{ nullptr };
 		//a smapler to read the texture
 		ID3D11SamplerState *mpSamAnisotropic = nullptr;
-		//vertex and pixel shaders
-		ID3D11VertexShader* mpVS = nullptr;
+		//vertex and pixel shaders, a vertex shader for each VertexFormat
+		ID3D11VertexShader* mpVS[VertexFormat::MAX_FORMATS]{ nullptr };
 		//a complicated one if it's lit, a simple one if it isn't, also a textured option now (lit and unlit)
 		ID3D11PixelShader* mpPSLit = nullptr, *mpPSUnlit = nullptr, *mpPSLitTex = nullptr, *mpPSUnlitTex = nullptr;
 		//transparency means controlling the blend states beyond default settings
 		ID3D11BlendState *mpBlendTransparent = nullptr, *mpBlendAlphaTrans = nullptr;
 		//multiple raster states should be available
 		ID3D11RasterizerState* mpRasterStates[RasterType::MAX_STATES]{ nullptr };
+		//normal, equal and read only depth testing
+		ID3D11DepthStencilState* mpDepthStates[DepthType::MAX_STATES]{ nullptr };
 	};
 
 }
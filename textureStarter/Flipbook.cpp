@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#include "Flipbook.h"
+#include "D3DUtil.h"
+#include "Parallel.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+void FlipbookClip::Create(const vector<RECTF>& atlas, const int frames[], const float durations[], int numFrames, float frameTime, Mode mode)
+{
+	assert(numFrames > 0 && (durations || frameTime > 0));
+	mMode = mode;
+	mEnds.clear();
+	mFrames.clear();
+	mRects.clear();
+	//ping-pong goes there and back without showing the end frames twice
+	vector<int> order;
+	for (int i = 0; i < numFrames; ++i)
+		order.push_back(i);
+	if (mode == PING_PONG)
+		for (int i = numFrames - 2; i > 0; --i)
+			order.push_back(i);
+
+	mLength = 0;
+	bool uniform = true;
+	for (int i : order)
+	{
+		int frame = frames[i];
+		assert(frame >= 0 && frame < (int)atlas.size());
+		float duration = durations ? durations[i] : frameTime;
+		assert(duration > 0);
+		uniform = uniform && duration == (durations ? durations[0] : frameTime);
+		mLength += duration;
+		mEnds.push_back(mLength);
+		mFrames.push_back(frame);
+		const RECTF& r = atlas[frame];
+		mRects.push_back(RECT{ (LONG)r.left, (LONG)r.top, (LONG)r.right, (LONG)r.bottom });
+	}
+	mStepsPerSec = uniform ? mFrames.size() / mLength : 0;
+}
+
+void FlipbookClip::Create(const vector<RECTF>& atlas, int first, int last, float fps, Mode mode)
+{
+	assert(last >= first && fps > 0);
+	vector<int> frames;
+	for (int i = first; i <= last; ++i)
+		frames.push_back(i);
+	Create(atlas, frames.data(), nullptr, (int)frames.size(), 1 / fps, mode);
+}
+
+float FlipbookClip::Wrap(float time) const
+{
+	if (mLength <= 0)
+		return 0;
+	if (mMode == ONCE)
+		return std::max(0.f, std::min(time, mLength));
+	//works backwards too, for negative speeds
+	return time - mLength * floorf(time / mLength);
+}
+
+int FlipbookClip::GetStep(float time) const
+{
+	int last = GetNumSteps() - 1;
+	int step;
+	if (mStepsPerSec > 0)
+		step = (int)(time * mStepsPerSec);
+	else
+		step = (int)(upper_bound(mEnds.begin(), mEnds.end(), time) - mEnds.begin());
+	return std::max(0, std::min(step, last));
+}
+
+void Flipbook::Play(const FlipbookClip& clip, float speed)
+{
+	assert(clip.GetNumSteps() > 0);
+	mpClip = &clip;
+	mSpeed = speed;
+	mTime = 0;
+	mStep = 0;
+	mChanged = true;
+}
+
+void Flipbook::SetTime(float time)
+{
+	assert(mpClip);
+	mTime = mpClip->Wrap(time);
+	mStep = mpClip->GetStep(mTime);
+	mChanged = true;
+}
+
+void Flipbook::Update(float dTime)
+{
+	if (!mpClip)
+	{
+		mChanged = false;
+		return;
+	}
+	mTime = mpClip->Wrap(mTime + dTime * mSpeed);
+	int step = mpClip->GetStep(mTime);
+	mChanged = step != mStep;
+	mStep = step;
+}
+
+void Flipbook::UpdateMany(Flipbook flipbooks[], int count, float dTime)
+{
+	//each one only touches itself, the clips are read only
+	ParallelFor(count, 4096, [=](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+			flipbooks[i].Update(dTime);
+	});
+}
+
+double Flipbook::Benchmark(int numFlipbooks, int numFrames)
+{
+	//an 8 frame strip, one clip with every frame the same length and one with a long pause on the last
+	vector<RECTF> atlas;
+	for (int f = 0; f < 8; ++f)
+		atlas.push_back(RECTF{ f * 32.f, 0, f * 32.f + 32, 32 });
+	FlipbookClip uniform, uneven;
+	uniform.Create(atlas, 0, 7, 12, FlipbookClip::LOOP);
+	const int frames[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+	const float durations[] = { 0.1f, 0.05f, 0.05f, 0.05f, 0.1f, 0.05f, 0.05f, 0.5f };
+	uneven.Create(atlas, frames, durations, 8, 0, FlipbookClip::PING_PONG);
+
+	mt19937 rng(1234);
+	uniform_real_distribution<float> unit(0, 1);
+	vector<Flipbook> flipbooks(numFlipbooks);
+	for (int i = 0; i < numFlipbooks; ++i)
+		flipbooks[i].Play((i & 1) ? uneven : uniform, 0.5f + unit(rng));
+	vector<float> dTimes(numFrames);
+	float total = 0;
+	for (float& dt : dTimes)
+	{
+		dt = (1 / 60.f) * (0.5f + 2 * unit(rng));
+		total += dt;
+	}
+
+	typedef chrono::high_resolution_clock Clock;
+	Clock::time_point start = Clock::now();
+	for (float dt : dTimes)
+		UpdateMany(flipbooks.data(), numFlipbooks, dt);
+	double secs = chrono::duration<double>(Clock::now() - start).count();
+
+	//how far the old stepping gets behind playing 24fps through the same frame times
+	const float fps = 24;
+	float elapsed = 0;
+	int oldFrames = 0;
+	for (float dt : dTimes)
+	{
+		elapsed += dt;
+		if (elapsed > 1 / fps)
+		{
+			elapsed = 0;
+			++oldFrames;
+		}
+	}
+	double updates = (double)numFlipbooks * numFrames;
+	DBOUT("Flipbook benchmark, " << numFlipbooks << " flipbooks x " << numFrames << " uneven frames: "
+		<< secs * 1e9 / updates << "ns per update");
+	DBOUT("  after " << total << "s a 24fps clip should have shown " << (int)(total * fps) << " frames, stepping one at a time showed "
+		<< oldFrames);
+	return updates / secs;
+}
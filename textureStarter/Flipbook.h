@@ -0,0 +1,142 @@
+#ifndef FLIPBOOK_H
+#define FLIPBOOK_H
+
+#include <vector>
+
+#include "TexCache.h"
+
+/*
+A flipbook animation - atlas frames in the order they're shown, how long each one
+stays up and what happens at the end. Everything is worked out when it's made:
+ping-pong is unrolled into one there-and-back cycle, and each step of the cycle has
+its end time and texture rectangle in a table. So any time turns straight into a
+frame without stepping through the ones before it, a long update can skip frames and
+time left over from one frame carries on into the next - nothing drifts however
+uneven the frame rate is.
+*/
+class FlipbookClip
+{
+public:
+	//what happens at the end
+	typedef enum {
+		LOOP,		//start again
+		ONCE,		//stay on the last frame
+		PING_PONG	//play backwards to the start, then forwards again, and so on
+	} Mode;
+
+	/*
+	* atlas - IN the texture's frames (see TexCache::Data), the ones used are copied
+	* frames - IN atlas frame numbers, in the order they're shown
+	* durations - IN seconds each is shown, nullptr for all of them frameTime
+	* numFrames - IN how many
+	* frameTime - IN seconds per frame if there are no durations
+	* mode - IN see Mode
+	*/
+	void Create(const std::vector<RECTF>& atlas, const int frames[], const float durations[], int numFrames, float frameTime, Mode mode);
+	//a run of atlas frames first to last inclusive, fps a second
+	void Create(const std::vector<RECTF>& atlas, int first, int last, float fps, Mode mode);
+
+	//a playhead kept inside one cycle (or clamped to the end for ONCE), so it doesn't lose precision
+	float Wrap(float time) const;
+	//which step a wrapped time is on, steps go 0 to GetNumSteps()-1
+	int GetStep(float time) const;
+	//the atlas frame and texture rectangle of a step
+	int GetFrame(int step) const {
+		return mFrames[step];
+	}
+	const RECT& GetRect(int step) const {
+		return mRects[step];
+	}
+	//steps in a cycle, ping-pong counts there and back
+	int GetNumSteps() const {
+		return (int)mFrames.size();
+	}
+	//seconds in a cycle
+	float GetLength() const {
+		return mLength;
+	}
+	Mode GetMode() const {
+		return mMode;
+	}
+
+private:
+	std::vector<float> mEnds;		//when each step finishes
+	std::vector<int> mFrames;		//atlas frame of each step
+	std::vector<RECT> mRects;		//and where it is in the texture
+	float mLength = 0;
+	float mStepsPerSec = 0;			//if every step is the same length, no searching needed
+	Mode mMode = LOOP;
+};
+
+/*
+Plays a FlipbookClip. Update it once a frame and if the frame changed show GetRect.
+The clip must outlive it.
+*/
+class Flipbook
+{
+public:
+	/*
+	* start a clip from the beginning
+	* clip - IN not copied, it can be shared by any number of flipbooks
+	* speed - IN 1 as the clip says, 2 twice as fast, 0 paused
+	*/
+	void Play(const FlipbookClip& clip, float speed = 1);
+	//stop playing, GetRect returns nullptr
+	void Stop() {
+		mpClip = nullptr;
+	}
+	void SetSpeed(float speed) {
+		mSpeed = speed;
+	}
+	//jump to a time in the clip
+	void SetTime(float time);
+	//move the clock on
+	void Update(float dTime);
+	//update lots at once, spread over the cores
+	static void UpdateMany(Flipbook flipbooks[], int count, float dTime);
+
+	//getters
+	const FlipbookClip* GetClip() const {
+		return mpClip;
+	}
+	float GetTime() const {
+		return mTime;
+	}
+	float GetSpeed() const {
+		return mSpeed;
+	}
+	//atlas frame showing, -1 if nothing's playing
+	int GetFrame() const {
+		return mpClip ? mpClip->GetFrame(mStep) : -1;
+	}
+	//the part of the texture to show, nullptr if nothing's playing
+	const RECT* GetRect() const {
+		return mpClip ? &mpClip->GetRect(mStep) : nullptr;
+	}
+	//did the last Update change frame
+	bool HasChanged() const {
+		return mChanged;
+	}
+	//a ONCE clip that's got to the end
+	bool IsFinished() const {
+		return mpClip && mpClip->GetMode() == FlipbookClip::ONCE && mTime >= mpClip->GetLength();
+	}
+
+	/*
+	* time updating lots of flipbooks with uneven frame times, and how far behind the old
+	* way of stepping (one frame at most per update, dropping the time left over) ends up.
+	* Doesn't need a device. Results go to DBOUT.
+	* numFlipbooks - IN how many
+	* numFrames - IN how many updates
+	* returns - flipbooks updated per second
+	*/
+	static double Benchmark(int numFlipbooks, int numFrames);
+
+private:
+	const FlipbookClip* mpClip = nullptr;
+	float mTime = 0, mSpeed = 1;
+	int mStep = 0;
+	bool mChanged = false;
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "FramePacer.h"
+#include "D3DUtil.h"
+
+using namespace std;
+
+void FramePacer::Init(float step, float maxFPS, int maxSteps)
+{
+	assert(step > 0 && maxSteps > 0);
+	mStep = step;
+	mMaxSteps = maxSteps;
+	SetMaxFPS(maxFPS);
+	Reset();
+}
+
+void FramePacer::SetMaxFPS(float maxFPS)
+{
+	assert(maxFPS >= 0);
+	mFramePeriod = maxFPS > 0 ? 1.0 / maxFPS : 0;
+}
+
+void FramePacer::Reset()
+{
+	mStarted = false;
+	mAccumulator = 0;
+	mStepsLeft = 0;
+	mHistoryPos = mHistoryCount = 0;
+	mRawDelta = mSmoothDelta = 0;
+}
+
+void FramePacer::BeginFrame()
+{
+	Clock::time_point now = Clock::now();
+	if (!mStarted)
+	{
+		//nothing to measure yet
+		mStarted = true;
+		mFrameStart = mDeadline = now;
+		mStepsLeft = 0;
+		return;
+	}
+	mRawDelta = std::min((float)Secs(now - mFrameStart).count(), MAX_FRAME_SECS);
+	mFrameStart = now;
+
+	//a moving average adds up to the same total time as the raw frames, it's just spread more evenly
+	mHistory[mHistoryPos] = mRawDelta;
+	mHistoryPos = (mHistoryPos + 1) % SMOOTH_FRAMES;
+	mHistoryCount = std::min(mHistoryCount + 1, SMOOTH_FRAMES);
+	float total = 0;
+	for (int i = 0; i < mHistoryCount; ++i)
+		total += mHistory[i];
+	mSmoothDelta = total / mHistoryCount;
+
+	mAccumulator += mSmoothDelta;
+	int steps = (int)(mAccumulator / mStep);
+	if (steps > mMaxSteps)
+	{
+		//can't keep up, let the game run slow rather than fall further behind
+		mAccumulator -= (steps - mMaxSteps) * mStep;
+		steps = mMaxSteps;
+	}
+	mStepsLeft = steps;
+}
+
+bool FramePacer::Step()
+{
+	if (mStepsLeft <= 0)
+		return false;
+	--mStepsLeft;
+	mAccumulator = std::max(0.f, mAccumulator - mStep);
+	return true;
+}
+
+void FramePacer::EndFrame()
+{
+	if (mFramePeriod <= 0 || !mStarted)
+		return;
+	const Clock::duration period = chrono::duration_cast<Clock::duration>(Secs(mFramePeriod));
+	//frames are spaced from where the last one should have ended, not where it did, so lateness
+	//doesn't build up. If it's a whole frame behind, start again from now.
+	Clock::time_point now = Clock::now();
+	mDeadline += period;
+	if (mDeadline + period < now)
+		mDeadline = now;
+	WaitUntil(mDeadline);
+}
+
+void FramePacer::WaitUntil(Clock::time_point until)
+{
+	if (mWaitMode != SPIN)
+	{
+		Clock::time_point now = Clock::now();
+		const double margin = mWaitMode == HYBRID ? mSpinSecs : 0;
+		double remaining = Secs(until - now).count();
+		if (remaining > margin)
+		{
+			double want = remaining - margin;
+			this_thread::sleep_for(Secs(want));
+			//jump up to however late it woke, then creep back down in case that was a one off
+			double late = Secs(Clock::now() - now).count() - want;
+			float spin = std::max(mSpinSecs * 0.99f, (float)late * 1.25f);
+			mSpinSecs = std::min(std::max(spin, 0.0002f), 0.02f);
+		}
+		if (mWaitMode == SLEEP)
+			return;
+	}
+	//the last little bit exactly
+	while (Clock::now() < until)
+		this_thread::yield();
+}
+
+double FramePacer::Benchmark(float fps, int numFrames)
+{
+	assert(fps > 0 && numFrames > 1);
+	const char* names[] = { "sleeping", "spinning", "sleeping then spinning" };
+	DBOUT("Frame pacing benchmark, capped at " << fps << "fps (" << 1000 / fps << "ms), " << numFrames << " frames each way:");
+	double hybridJitter = 0;
+	float spinSecs = 0;
+	for (int mode = SLEEP; mode <= HYBRID; ++mode)
+	{
+		FramePacer pacer;
+		pacer.Init(1 / 60.f, fps);
+		pacer.mWaitMode = (WaitMode)mode;
+		vector<double> times;
+		double waiting = 0;
+		Clock::time_point last;
+		for (int f = 0; f <= numFrames; ++f)
+		{
+			pacer.BeginFrame();
+			Clock::time_point now = Clock::now();
+			if (f > 0)
+				times.push_back(Secs(now - last).count());
+			last = now;
+			//a bit of made up work so the frames aren't empty
+			volatile float x = 0;
+			for (int i = 0; i < 20000; ++i)
+				x = x + sqrtf((float)i);
+			Clock::time_point waitStart = Clock::now();
+			pacer.EndFrame();
+			waiting += Secs(Clock::now() - waitStart).count();
+		}
+		double mean = 0, worst = 0;
+		for (double t : times)
+		{
+			mean += t;
+			worst = std::max(worst, fabs(t - 1 / fps));
+		}
+		mean /= times.size();
+		double var = 0;
+		for (double t : times)
+			var += (t - mean) * (t - mean);
+		double jitter = sqrt(var / times.size()) * 1000;
+		if (mode == HYBRID)
+		{
+			hybridJitter = jitter;
+			spinSecs = pacer.GetSpinSecs();
+		}
+		DBOUT("  " << names[mode] << ": average " << mean * 1000 << "ms, jitter " << jitter << "ms, worst "
+			<< worst * 1000 << "ms off, " << waiting * 1000 / numFrames << "ms a frame waiting");
+	}
+	DBOUT("  sleep was waking up to " << spinSecs * 1000 << "ms late, so that's how long it spun for");
+	return hybridJitter;
+}
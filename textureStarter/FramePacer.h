@@ -0,0 +1,102 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <chrono>
+
+/*
+Keeps time for the main loop. The game is updated in fixed steps - however long a frame
+took, that much time goes into an accumulator and as many whole steps are run as it
+holds, so physics and animation behave the same at any frame rate. What's left over
+(GetAlpha) says how far between the last two steps the frame is, so rendering can blend
+last step's transforms with this one's and movement stays smooth.
+Frame times are averaged over a few frames first, the odd long or short frame would
+otherwise mean two steps one frame and none the next.
+Frames can be capped. Sleeping is cheap but wakes up late by an amount that depends on
+the OS, spinning is exact but keeps a core busy - so it sleeps until it's close and
+spins the rest, and learns how late sleep tends to be to know how close is close.
+Typical use
+	pacer.BeginFrame();
+	while (pacer.Step())
+		Update(pacer.GetStep());
+	Render(pacer.GetAlpha());
+	pacer.EndFrame();
+*/
+class FramePacer
+{
+public:
+	//frame times are averaged over this many frames
+	static constexpr int SMOOTH_FRAMES = 8;
+	//a frame longer than this (e.g. stopped in the debugger) counts as this long
+	static constexpr float MAX_FRAME_SECS = 0.25f;
+
+	/*
+	* step - IN seconds per update
+	* maxFPS - IN frame cap, 0 for none
+	* maxSteps - IN most updates in one frame, if the game can't keep up it slows down rather than falling further behind
+	*/
+	void Init(float step = 1 / 60.f, float maxFPS = 0, int maxSteps = 8);
+	void SetMaxFPS(float maxFPS);
+	//forget how long it's been, e.g. after a pause, so nothing tries to catch up
+	void Reset();
+
+	//start a frame, measures how long the last one took
+	void BeginFrame();
+	//true while there's a step to run this frame
+	bool Step();
+	//between the previous step (0) and the latest (1), for blending transforms when rendering
+	float GetAlpha() const {
+		return mAccumulator / mStep;
+	}
+	//wait out the rest of the frame if it's capped
+	void EndFrame();
+
+	float GetStep() const {
+		return mStep;
+	}
+	//how long the last frame took as measured, not smoothed, at most MAX_FRAME_SECS
+	float GetRawDelta() const {
+		return mRawDelta;
+	}
+	float GetSmoothDelta() const {
+		return mSmoothDelta;
+	}
+	//how late a sleep has been waking up, it spins for this long at the end of a frame
+	float GetSpinSecs() const {
+		return mSpinSecs;
+	}
+
+	/*
+	* how evenly frames are paced - capped frames waited out by sleeping alone, by spinning
+	* alone and by sleeping then spinning. Takes about numFrames/fps seconds each. Results go to DBOUT.
+	* fps - IN the cap
+	* numFrames - IN frames to time each way
+	* returns - frame time jitter (standard deviation) sleeping then spinning, in milliseconds
+	*/
+	static double Benchmark(float fps, int numFrames);
+
+private:
+	typedef std::chrono::steady_clock Clock;
+	typedef std::chrono::duration<double> Secs;
+	//how the end of a frame is waited for
+	typedef enum { SLEEP, SPIN, HYBRID } WaitMode;
+
+	float mStep = 1 / 60.f;
+	int mMaxSteps = 8;
+	double mFramePeriod = 0;			//seconds, 0 uncapped
+	float mAccumulator = 0;				//time not yet stepped
+	int mStepsLeft = 0;					//this frame
+	Clock::time_point mFrameStart;		//of the current frame
+	Clock::time_point mDeadline;		//when the current frame should end
+	bool mStarted = false;
+	float mHistory[SMOOTH_FRAMES];
+	int mHistoryPos = 0;
+	int mHistoryCount = 0;
+	float mRawDelta = 0, mSmoothDelta = 0;
+	float mSpinSecs = 0.002f;
+	WaitMode mWaitMode = HYBRID;
+
+	//wait until then
+	void WaitUntil(Clock::time_point until);
+};
+
+#endif
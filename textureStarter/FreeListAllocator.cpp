@@ -0,0 +1,79 @@
+#include <cassert>
+
+#include "FreeListAllocator.h"
+
+void FreeListAllocator::Init(unsigned int capacity)
+{
+	mFree.clear();
+	mCapacity = mNumFree = capacity;
+	if (capacity > 0)
+		mFree[0] = capacity;
+}
+
+bool FreeListAllocator::Allocate(unsigned int count, unsigned int& offset)
+{
+	assert(count > 0);
+	for (FreeRanges::iterator it = mFree.begin(); it != mFree.end(); ++it)
+	{
+		if ((*it).second < count)
+			continue;
+		offset = (*it).first;
+		unsigned int left = (*it).second - count;
+		mFree.erase(it);
+		//put back what we didn't use
+		if (left > 0)
+			mFree[offset + count] = left;
+		mNumFree -= count;
+		return true;
+	}
+	return false;
+}
+
+void FreeListAllocator::Free(unsigned int offset, unsigned int count)
+{
+	assert(count > 0 && offset + count <= mCapacity);
+	FreeRanges::iterator next = mFree.lower_bound(offset);
+	assert(next == mFree.end() || (*next).first >= offset + count);
+
+	//merge with the range before?
+	if (next != mFree.begin())
+	{
+		FreeRanges::iterator prev = next;
+		--prev;
+		assert((*prev).first + (*prev).second <= offset);
+		if ((*prev).first + (*prev).second == offset)
+		{
+			offset = (*prev).first;
+			count += (*prev).second;
+			mNumFree -= (*prev).second;
+			mFree.erase(prev);
+		}
+	}
+	//merge with the range after?
+	if (next != mFree.end() && (*next).first == offset + count)
+	{
+		count += (*next).second;
+		mNumFree -= (*next).second;
+		mFree.erase(next);
+	}
+	mFree[offset] = count;
+	mNumFree += count;
+}
+
+void FreeListAllocator::Grow(unsigned int capacity)
+{
+	assert(capacity >= mCapacity);
+	unsigned int start = mCapacity;
+	mCapacity = capacity;
+	if (capacity > start)
+		Free(start, capacity - start);
+}
+
+unsigned int FreeListAllocator::GetLargestFree() const
+{
+	unsigned int largest = 0;
+	for (const FreeRanges::value_type& r : mFree)
+		if (r.second > largest)
+			largest = r.second;
+	return largest;
+}
@@ -0,0 +1,59 @@
+#ifndef FREELISTALLOCATOR_H
+#define FREELISTALLOCATOR_H
+
+#include <map>
+
+/*
+Hands out ranges of a fixed size block (e.g. a big vertex buffer) measured in
+elements (e.g. vertices). Free ranges are kept in order of offset so that when
+something is given back it can be merged with its neighbours, that stops the
+block getting chopped up into lots of small useless pieces.
+No memory is touched, it just does the book keeping.
+*/
+class FreeListAllocator
+{
+public:
+	FreeListAllocator() {}
+	FreeListAllocator(unsigned int capacity) {
+		Init(capacity);
+	}
+	//start again with everything free
+	void Init(unsigned int capacity);
+	/*
+	* find room for some elements, first fit
+	* count - IN how many elements needed
+	* offset - OUT where they start
+	* returns - false if there isn't a big enough gap
+	*/
+	bool Allocate(unsigned int count, unsigned int& offset);
+	/*
+	* give back a range that was allocated earlier
+	* offset, count - IN exactly what Allocate gave out
+	*/
+	void Free(unsigned int offset, unsigned int count);
+	//make room for more elements on the end, what's allocated already stays put
+	void Grow(unsigned int capacity);
+
+	//getters
+	unsigned int GetCapacity() const {
+		return mCapacity;
+	}
+	unsigned int GetNumFree() const {
+		return mNumFree;
+	}
+	//biggest single allocation that would work right now
+	unsigned int GetLargestFree() const;
+	//how many separate gaps, more than a few means fragmentation
+	int GetNumFreeRanges() const {
+		return (int)mFree.size();
+	}
+
+private:
+	//offset -> size of each free range
+	typedef std::map<unsigned int, unsigned int> FreeRanges;
+	FreeRanges mFree;
+	unsigned int mCapacity = 0;
+	unsigned int mNumFree = 0;
+};
+
+#endif
@@ -2,6 +2,15 @@
 #include "D3D.h"
 #include "Game.h"
 #include "GeometryBuilder.h"
+#include "Level.h"
+#include "MeshImport.h"
+#include "SpriteRenderer.h"
+#include "SpriteSystem.h"
+#include "Flipbook.h"
+#include "Tilemap.h"
+#include "SpatialHash.h"
+#include "JobSystem.h"
+#include "FramePacer.h"
 
 using namespace std;
 using namespace DirectX;
@@ -12,6 +21,8 @@ using namespace DirectX::SimpleMath;
 void Game::Initialise()
 {
 	MyD3D& d3d = WinUtil::Get().GetD3D();
+	//half size vertices, plenty accurate for these shapes
+	d3d.GetMeshMgr().SetVertexFormat(VertexFormat::COMPACT);
 	//wood floor
 	mQuad.Initialise(BuildQuad(d3d.GetMeshMgr()));
 	
@@ -20,12 +31,89 @@ void Game::Initialise()
 	matQ.gfxData.Set(Vector4(1.f, 1.f, 1.f, 1), Vector4(1.f, 1.f, 1.f, 1), Vector4(0.9f, 0.8f, 0.8f, 1));
 	matQ.pTextureRV = d3d.GetCache().LoadTexture(&d3d.GetDevice(), "floor.dds");
 	matQ.texture = "floor.dds";
+	//texture changed so the pipeline state it needs has too
+	d3d.GetFX().CompileMaterial(matQ, mQuad.GetMesh().GetVertexFormat());
+
+	//rolling hills below the floor, streamed in around the camera
+	Heightmap map;
+	map.Generate(513, 513, 1234);
+	Terrain::Settings ts;
+	ts.heightScale = 20;
+	ts.material = matQ;
+	mTerrain.Initialise(map, ts, Vector3(-256, -1 - ts.heightScale, -256));
 
 	//pandoras box
 	mBox.Initialise(BuildCube(d3d.GetMeshMgr()));
 	//change the default material inside the mesh
 	Material& matB = mBox.GetMesh().GetSubMesh(0).material;
 	matB.gfxData.Set(Vector4(1.0f, 0.01f, 0.01f, 1), Vector4(0.9f, 0.1f, 0.1f, 1), Vector4(0.9f, 0.1f, 0.1f, 1));
+	//and its moon, the same mesh in yellow
+	mMoon.Initialise(mBox.GetMesh());
+	Material matM = matB;
+	matM.gfxData.Set(Vector4(1.0f, 0.9f, 0.1f, 1), Vector4(0.9f, 0.8f, 0.1f, 1), Vector4(0.9f, 0.8f, 0.1f, 1));
+	mMoon.SetOverrideMat(&matM);
+	mBoxNode = mScene.Add(NodeHandle(), mBox.GetTransform());
+	mMoonNode = mScene.Add(mBoxNode, mMoon.GetTransform());
+	mScene.SetPosition(mMoonNode, Vector3(2, 0.5f, 0));
+	mScene.SetScale(mMoonNode, Vector3(0.3f, 0.3f, 0.3f));
+	mScene.SetBounds(mBoxNode, mBox.GetMesh().GetBoundsMin(), mBox.GetMesh().GetBoundsMax());
+	mScene.SetBounds(mMoonNode, mBox.GetMesh().GetBoundsMin(), mBox.GetMesh().GetBoundsMax());
+
+	//two capsules bending about, the same animation skinned by the gpu (left) and the cpu (right)
+	vector<unsigned int> skinIndices;
+	BuildSkinnedCapsule(6, 24, 6, 3, mSkeleton, mSkinVerts, skinIndices);
+	SubMeshDesc desc;
+	desc.numIndices = (int)skinIndices.size();
+	desc.material = Material::default;
+	desc.material.gfxData.Set(Vector4(0.1f, 0.8f, 0.2f, 1), Vector4(0.1f, 0.3f, 0.1f, 1), Vector4(0.5f, 0.5f, 0.5f, 20));
+	Mesh& gpuMesh = d3d.GetMeshMgr().CreateMesh("skinned_capsule_gpu");
+	gpuMesh.CreateFrom(mSkinVerts.data(), (int)mSkinVerts.size(), skinIndices.data(), (int)skinIndices.size(), &desc, 1);
+	mSkinGPU.Initialise(gpuMesh);
+	Mesh& cpuMesh = d3d.GetMeshMgr().CreateMesh("skinned_capsule_cpu");
+	cpuMesh.CreateFrom(mSkinVerts.data(), (int)mSkinVerts.size(), skinIndices.data(), (int)skinIndices.size(), &desc, 1, true);
+	mSkinCPU.Initialise(cpuMesh);
+	//5 units tall, stand them on the floor
+	mSkinGPU.SetScale(Vector3(0.3f, 0.3f, 0.3f));
+	mSkinCPU.SetScale(Vector3(0.3f, 0.3f, 0.3f));
+	mSkinGPU.SetPosition(Vector3(-2, -0.25f, 1.5f));
+	mSkinCPU.SetPosition(Vector3(2, -0.25f, 1.5f));
+
+	//the animators point at the clips, so no reallocating
+	mClips.reserve(2);
+	mClips.push_back(Anim::MakeSwingClip(mSkeleton, "sway", 2, Vector3(0, 0, 1), 0.25f));
+	mClips.push_back(Anim::MakeSwingClip(mSkeleton, "curl", 1.5f, Vector3(1, 0, 0), 0.35f));
+	mPacked.resize(mClips.size());
+	for (size_t i = 0; i < mClips.size(); ++i)
+		mPacked[i].Compress(mClips[i], mSkeleton, CompressedClip::Settings());
+	for (Animator& anim : mAnimators)
+	{
+		anim.Initialise(mSkeleton);
+		anim.Play(mPacked[0]);
+	}
+	mSkinGPU.SetPalette(mAnimators[0].GetPalette(), mAnimators[0].GetNumBones());
+	mBones.resize(mSkeleton.GetNumBones());
+	mSkinned.resize(mSkinVerts.size());
+
+	//a fountain of sparks, added on so they glow
+	mParticles.Init(d3d.GetDevice());
+	ParticleSystem::Settings sparks;
+	sparks.pTex = d3d.GetCache().LoadTexture(&d3d.GetDevice(), "cross.dds");
+	sparks.pos = Vector3(0, -0.9f, 1.5f);
+	sparks.posSpread = Vector3(0.05f, 0, 0.05f);
+	sparks.rate = 400;
+	sparks.velocity = Vector3(0, 4, 0);
+	sparks.velSpread = Vector3(0.8f, 0.5f, 0.8f);
+	sparks.minLife = 0.8f;
+	sparks.maxLife = 1.4f;
+	sparks.drag = 0.3f;
+	sparks.startColour = Vector4(1, 0.9f, 0.4f, 1);
+	sparks.endColour = Vector4(1, 0.2f, 0, 0);
+	sparks.startSize = 0.08f;
+	sparks.endSize = 0.02f;
+	mParticles.AddEmitter(sparks);
+
+	mText.Init(d3d.GetDevice());
+	mFont = mText.AddFont(L"Arial");
 
 	//the sun						 LightLDX, bl_enable, Direction, Diffusion, Ambient, Specular
 	d3d.GetFX().SetupDirectionalLight(0, true, Vector3(-0.7f, -0.7f, 0.7f), Vector3(0.47f, 0.47f, 0.47f), Vector3(0.15f, 0.15f, 0.15f), Vector3(0.25f, 0.25f, 0.25f));
@@ -34,47 +122,112 @@ void Game::Initialise()
 //tidy up
 void Game::Release()
 {
+	mTerrain.Release();
+	mParticles.Release();
+	mText.Release();
 }
 
 void Game::Update(float dTime)
 {
-	//spin the box
+	//spin the box, its moon goes round with it (the scene is posed in Render, between this step and the last)
+	mPrevAngle = gAngle;
 	gAngle += dTime * 0.5f;
-	mBox.GetRotation().y = gAngle;
+	mTerrain.Update(mCamPos);
+
+	//crossfade to the other clip every few seconds
+	mClipTimer += dTime;
+	if (mClipTimer > 4)
+	{
+		mClipTimer = 0;
+		const CompressedClip& next = (mAnimators[0].GetCompressedClip() == &mPacked[0]) ? mPacked[1] : mPacked[0];
+		for (Animator& anim : mAnimators)
+			anim.Play(next, 0.5f);
+	}
+	Animator::UpdateMany(mAnimators, 2, dTime);
+	//the gpu one just needs the palette, the cpu one has its vertices rebuilt
+	Skinning::ToBoneMatrices(mAnimators[1].GetPalette(), mAnimators[1].GetNumBones(), mBones.data());
+	Skinning::SkinVertices(mSkinVerts.data(), (int)mSkinVerts.size(), mBones.data(), mSkinned.data());
+	WinUtil::Get().GetD3D().GetMeshMgr().UpdateVertices(mSkinCPU.GetMesh(), mSkinned.data());
+	mParticles.Update(dTime);
 }
 
-void Game::Render(float dTime)
+void Game::Render(float alpha)
 {
 	MyD3D& d3d = WinUtil::Get().GetD3D();
 	d3d.BeginRender(Colours::Blue);
 
-	float alpha = 0.5f + sinf(gAngle * 2)*0.5f;
+	//updates come in fixed steps, so pose the box and moon part way between the last two or they'd judder
+	float angle = mPrevAngle + (gAngle - mPrevAngle) * alpha;
+	mScene.SetRotation(mBoxNode, TransformStore::FromEuler(Vector3(0, angle, 0)));
+	mScene.SetRotation(mMoonNode, TransformStore::FromEuler(Vector3(angle * 3, 0, 0)));
+	mScene.Update(&d3d.GetTransforms());
+
+	//only change the label twice a second, an unchanged string reuses its layout. Frames are
+	//counted here, there can be more or fewer updates than frames.
+	++mFPSFrames;
+	mFPSTimer += WinUtil::Get().GetPacer().GetRawDelta();
+	if (mFPSTimer >= 0.5f)
+	{
+		mFPSText = "FPS " + to_string((int)(mFPSFrames / mFPSTimer + 0.5f));
+		mFPSFrames = 0;
+		mFPSTimer = 0;
+	}
+
 	//setup the shaders, camera and projection
 	d3d.GetFX().SetPerFrameConsts(d3d.GetDeviceCtx(), mCamPos);
 	CreateViewMatrix(d3d.GetFX().GetViewMatrix(), mCamPos, Vector3(0, 0, 0), Vector3(0, 1, 0));
 	CreateProjectionMatrix(d3d.GetFX().GetProjectionMatrix(), 0.25f*PI, WinUtil::Get().GetAspectRatio(), 1, 1000.f);
+	//rebuild the matrices of everything that moved, all together
+	Matrix viewProj = d3d.GetFX().GetViewMatrix() * d3d.GetFX().GetProjectionMatrix();
+	d3d.GetTransforms().Update(viewProj);
 
-	//main cube 
-	d3d.GetFX().Render(mBox);
+	//main cube and its moon, if they can be seen
+	mScene.Cull(viewProj);
+	if (mScene.IsVisible(mBoxNode))
+		d3d.GetFX().Submit(mBox);
+	if (mScene.IsVisible(mMoonNode))
+		d3d.GetFX().Submit(mMoon);
 
 	//floor
-	mQuad.GetRotation() = Vector3(0, 0, 0);
-	mQuad.GetScale() = Vector3(3, 1, 3);
-	mQuad.GetPosition() = Vector3(0, -1, 0);
-	d3d.GetFX().Render(mQuad);
+	mQuad.SetRotation(Vector3(0, 0, 0));
+	mQuad.SetScale(Vector3(3, 1, 3));
+	mQuad.SetPosition(Vector3(0, -1, 0));
+	d3d.GetFX().Submit(mQuad);
 
+	mTerrain.Submit(d3d.GetFX());
+
+	//skinned capsules
+	d3d.GetFX().Submit(mSkinGPU);
+	d3d.GetFX().Submit(mSkinCPU);
 
 	//walls
-	/*mQuad.GetRotation() = Vector3(0, 0, 0);
-	mQuad.GetScale() = Vector3(3, 1, 3);
-	mQuad.GetPosition() = Vector3(0, 1, 0);
+	/*mQuad.SetRotation(Vector3(0, 0, 0));
+	mQuad.SetScale(Vector3(3, 1, 3));
+	mQuad.SetPosition(Vector3(0, 1, 0));
 	d3d.GetFX().Render(mQuad);
 
-	mQuad.GetRotation() = Vector3(0, 0, 0);
-	mQuad.GetScale() = Vector3(3, 1, 3);
-	mQuad.GetPosition() = Vector3(0, 2, 0);
-	d3d.GetFX().Render(mQuad);*/
+	mQuad.SetRotation(Vector3(0, 0, 0));
+	mQuad.SetScale(Vector3(3, 1, 3));
+	mQuad.SetPosition(Vector3(0, 2, 0));
+	d3d.GetFX().Submit(mQuad);*/
 	
+	//opaques (optionally depth pre-passed) then transparents
+	d3d.GetFX().RenderQueue();
+
+	//particles last, they read the depth buffer but don't write it
+	mParticles.Draw(d3d.GetDeviceCtx(), d3d.GetFX().GetViewMatrix(), d3d.GetFX().GetProjectionMatrix());
+	d3d.InvalidateInputAssembler();
+	d3d.GetFX().InvalidatePSO();
+
+	//text over everything
+	if (mFont >= 0)
+	{
+		mText.Begin();
+		mText.DrawString(mFont, mFPSText, Vector2(10, 10), 24, Vector4(1, 1, 0, 1));
+		mText.End(d3d.GetDeviceCtx());
+		d3d.InvalidateInputAssembler();
+		d3d.GetFX().InvalidatePSO();
+	}
 
 	d3d.EndRender();
 }
@@ -116,9 +269,48 @@ LRESULT Game::WindowsMssgHandler(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPar
 		case ' ':
 			mCamPos = mDefCamPos;
 			break;
+		case 'p':
+		{
+			//toggle the depth pre-pass to see what it costs in this scene
+			FX::MyFX& fx = WinUtil::Get().GetD3D().GetFX();
+			fx.SetDepthPrePass(!fx.GetDepthPrePass());
+			DBOUT("Depth pre-pass " << (fx.GetDepthPrePass() ? "on" : "off"));
+		}
+			break;
+		case 'b':
+			//time every system, slow
+			RunBenchmarks();
+			break;
 		}
 	}
 	//default message handling (resize window, full screen, etc)
 	return WinUtil::Get().DefaultMssgHandler(hwnd, msg, wParam, lParam);
 }
 
+void Game::RunBenchmarks()
+{
+	//animation
+	Anim::BenchmarkPoses(1000, 32, 60);
+	Skinning::Benchmark(300, 4000, 10);
+	CompressedClip::Benchmark(32, 4);
+	//rendering
+	WinUtil::Get().GetD3D().GetFX().BenchmarkMaterials(1000, 60);
+	//objects and loading
+	TransformStore::Benchmark(10000, 60);
+	SceneGraph::Benchmark(100000, 20);
+	Level::Benchmark(100000);
+	MeshImport::BenchmarkOBJ(500);
+	MeshMgr::BenchmarkStorage(100000);
+	WinUtil::Get().GetD3D().GetMeshMgr().BenchmarkLoading(300);
+	//2D
+	SpriteSystem::Benchmark(100000, 60);
+	SpriteRenderer::Benchmark(100000, 30);
+	Flipbook::Benchmark(10000, 600);
+	Tilemap::Benchmark(4096, 300);
+	ParticleSystem::Benchmark(1000000, 120);
+	TextRenderer::Benchmark(5000, 60);
+	SpatialHash::Benchmark(100000, 60);
+	//threads and timing
+	JobSystem::Benchmark(4000000, 20);
+	FramePacer::Benchmark(120, 240);
+}
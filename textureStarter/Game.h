@@ -3,6 +3,13 @@
 
 #include "Mesh.h"
 #include "Model.h"
+#include "Terrain.h"
+#include "Skeleton.h"
+#include "Skinning.h"
+#include "CompressedClip.h"
+#include "SceneGraph.h"
+#include "ParticleSystem.h"
+#include "TextRenderer.h"
 #include "singleton.h"
 
 //spin some models around
@@ -13,22 +20,54 @@ public:
 	~Game() {
 		Release();
 	}
+	//one fixed step
 	void Update(float dTime);
-	void Render(float dTime);
+	//alpha - IN how far between the last two updates to draw things, see FramePacer::GetAlpha
+	void Render(float alpha);
 	void Initialise();
 	void Release();
 	LRESULT WindowsMssgHandler(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+	//time each system on its own, results go to DBOUT. The b key, or start with -benchmark.
+	static void RunBenchmarks();
 	//push a camera around the scene
 	const DirectX::SimpleMath::Vector3 mDefCamPos = DirectX::SimpleMath::Vector3(0, 2, -5);
 	DirectX::SimpleMath::Vector3 mCamPos = DirectX::SimpleMath::Vector3(0, 4, -12);
 
 	//a couple of models
 	Model mBox, mQuad;
+	//a little box going round the big one, they're attached in the scene graph
+	Model mMoon;
+	SceneGraph mScene;
+	NodeHandle mBoxNode, mMoonNode;
+	//hills all around
+	Terrain mTerrain;
+	//two bendy capsules, skinned by the gpu and by the cpu
+	Model mSkinGPU, mSkinCPU;
+	Skeleton mSkeleton;
+	std::vector<AnimClip> mClips;
+	std::vector<CompressedClip> mPacked;	//what's actually played, packed from mClips
+	Animator mAnimators[2];			//gpu then cpu
+	//sparks fountaining up between the capsules
+	ParticleSystem mParticles;
+	//frame rate in the corner
+	TextRenderer mText;
+	int mFont = -1;
 
 private:
 
-	//spin the box
+	//spin the box, the angle now and one update ago
 	float gAngle = 0;
+	float mPrevAngle = 0;
+	//swap animation every so often
+	float mClipTimer = 0;
+	//the cpu skinned capsule's bind pose, bone matrices and skinned result
+	std::vector<VertexPosNormTexSkin> mSkinVerts;
+	std::vector<Skinning::BoneMatrix> mBones;
+	std::vector<VertexPosNormTex> mSkinned;
+	//frames and time since the frame rate label last changed, and what it says
+	int mFPSFrames = 0;
+	float mFPSTimer = 0;
+	std::string mFPSText = "FPS";
 };
 
 #endif
@@ -0,0 +1,213 @@
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+#include "GeoMip.h"
+
+using namespace std;
+
+namespace GeoMip
+{
+	//a vertex of the chunk
+	struct Coord
+	{
+		int x, z;
+	};
+
+	//add a triangle wound clockwise seen from above, whatever order the corners come in
+	static void AddTri(vector<unsigned int>& indices, Coord a, Coord b, Coord c)
+	{
+		//y of cross(b-a, c-a) is positive when clockwise (+x east, +z north)
+		int crossY = (b.z - a.z) * (c.x - a.x) - (b.x - a.x) * (c.z - a.z);
+		assert(crossY != 0);
+		if (crossY < 0)
+			swap(b, c);
+		indices.push_back(a.z * CHUNK_VERTS + a.x);
+		indices.push_back(b.z * CHUNK_VERTS + b.x);
+		indices.push_back(c.z * CHUNK_VERTS + c.x);
+	}
+
+	//an edge strip is built along the south edge then turned to face the right way
+	static Coord EdgeToChunk(int edge, int along, int depth)
+	{
+		switch (edge)
+		{
+		case Edge::SOUTH:
+			return Coord{ along, depth };
+		case Edge::NORTH:
+			return Coord{ along, CHUNK_CELLS - depth };
+		case Edge::WEST:
+			return Coord{ depth, along };
+		default:
+			return Coord{ CHUNK_CELLS - depth, along };
+		}
+	}
+
+	/*
+	* zip the outer row of vertices (the chunk edge) to the first inner row, the strip is
+	* a trapezoid so the centre and the four edges fit together at the corners
+	*/
+	static void AddEdge(vector<unsigned int>& indices, int edge, int step, bool stitched)
+	{
+		const int outerStep = stitched ? step * 2 : step;
+		int outer = 0, inner = step;
+		const int lastInner = CHUNK_CELLS - step;
+		while (outer < CHUNK_CELLS || inner < lastInner)
+		{
+			//move along whichever row is behind, each triangle has a side on one row and a point on the other
+			if (inner >= lastInner || (outer < CHUNK_CELLS && outer + outerStep <= inner + step))
+			{
+				AddTri(indices, EdgeToChunk(edge, outer, 0), EdgeToChunk(edge, outer + outerStep, 0), EdgeToChunk(edge, inner, step));
+				outer += outerStep;
+			}
+			else
+			{
+				AddTri(indices, EdgeToChunk(edge, outer, 0), EdgeToChunk(edge, inner, step), EdgeToChunk(edge, inner + step, step));
+				inner += step;
+			}
+		}
+	}
+
+	void BuildIndices(vector<unsigned int>& indices, Part parts[MAX_PARTS])
+	{
+		static_assert((CHUNK_CELLS >> (NUM_LODS - 1)) >= 2, "the coarsest LOD needs a centre vertex");
+		indices.clear();
+		for (int lod = 0; lod < NUM_LODS; ++lod)
+		{
+			const int step = 1 << lod;
+			Part& centre = parts[CentrePart(lod)];
+			centre.startIndex = (int)indices.size();
+			for (int z = step; z < CHUNK_CELLS - step; z += step)
+				for (int x = step; x < CHUNK_CELLS - step; x += step)
+				{
+					Coord a{ x, z }, b{ x + step, z }, c{ x, z + step }, d{ x + step, z + step };
+					AddTri(indices, a, c, d);
+					AddTri(indices, a, d, b);
+				}
+			centre.numIndices = (int)indices.size() - centre.startIndex;
+
+			for (int edge = 0; edge < Edge::MAX_EDGES; ++edge)
+				for (int stitched = 0; stitched < 2; ++stitched)
+				{
+					Part& part = parts[EdgePart(lod, edge, stitched != 0)];
+					part.startIndex = (int)indices.size();
+					AddEdge(indices, edge, step, stitched != 0);
+					part.numIndices = (int)indices.size() - part.startIndex;
+				}
+		}
+	}
+
+	int SelectLOD(float distance, float lodDistance)
+	{
+		assert(lodDistance > 0);
+		if (distance < lodDistance)
+			return 0;
+		int lod = 1 + (int)floorf(log2f(distance / lodDistance));
+		return min(lod, NUM_LODS - 1);
+	}
+
+	void ClampLODs(vector<int>& lods, int chunksX, int chunksZ)
+	{
+		assert((int)lods.size() == chunksX * chunksZ);
+		//a chamfer distance transform - one pass forward, one back, is enough for a 4 neighbour grid
+		for (int z = 0; z < chunksZ; ++z)
+			for (int x = 0; x < chunksX; ++x)
+			{
+				int& lod = lods[z * chunksX + x];
+				if (x > 0)
+					lod = min(lod, lods[z * chunksX + x - 1] + 1);
+				if (z > 0)
+					lod = min(lod, lods[(z - 1) * chunksX + x] + 1);
+			}
+		for (int z = chunksZ - 1; z >= 0; --z)
+			for (int x = chunksX - 1; x >= 0; --x)
+			{
+				int& lod = lods[z * chunksX + x];
+				if (x < chunksX - 1)
+					lod = min(lod, lods[z * chunksX + x + 1] + 1);
+				if (z < chunksZ - 1)
+					lod = min(lod, lods[(z + 1) * chunksX + x] + 1);
+			}
+	}
+
+	void Streamer::Initialise(int chunksX, int chunksZ, float loadRadius, float unloadRadius, float lodDistance)
+	{
+		assert(chunksX >= 0 && chunksZ >= 0);
+		assert(unloadRadius > loadRadius && lodDistance > 0);
+		mChunksX = chunksX;
+		mChunksZ = chunksZ;
+		mLoadRadius = loadRadius;
+		mUnloadRadius = unloadRadius;
+		mLODDistance = lodDistance;
+		mChunks.clear();
+		mChunks.resize(chunksX * chunksZ);
+		mLODs.assign(mChunks.size(), NUM_LODS - 1);
+		mNumLoaded = 0;
+	}
+
+	void Streamer::SetBounds(int chunk, const float boundsMin[3], const float boundsMax[3])
+	{
+		Chunk& c = mChunks[chunk];
+		for (int i = 0; i < 3; ++i)
+		{
+			c.boundsMin[i] = boundsMin[i];
+			c.boundsMax[i] = boundsMax[i];
+		}
+	}
+
+	void Streamer::Update(const float camPos[3], vector<int>& dropped)
+	{
+		dropped.clear();
+		for (int i = 0; i < (int)mChunks.size(); ++i)
+		{
+			Chunk& c = mChunks[i];
+			float dist2 = 0;
+			for (int a = 0; a < 3; ++a)
+			{
+				float d = camPos[a] - max(c.boundsMin[a], min(camPos[a], c.boundsMax[a]));
+				dist2 += d * d;
+			}
+			c.distance = sqrtf(dist2);
+			mLODs[i] = SelectLOD(c.distance, mLODDistance);
+
+			if (c.state == LOADED)
+			{
+				if (c.distance > mUnloadRadius)
+				{
+					c.state = UNLOADED;
+					--mNumLoaded;
+					dropped.push_back(i);
+				}
+			}
+			else if (c.distance >= mLoadRadius)
+				c.state = UNLOADED;
+			else if (c.state == UNLOADED)
+				c.state = QUEUED;
+		}
+		ClampLODs(mLODs, mChunksX, mChunksZ);
+	}
+
+	void Streamer::GetWanted(vector<int>& wanted) const
+	{
+		wanted.clear();
+		for (int i = 0; i < (int)mChunks.size(); ++i)
+			if (mChunks[i].state == QUEUED)
+				wanted.push_back(i);
+		sort(wanted.begin(), wanted.end(), [this](int a, int b) {
+			return mChunks[a].distance < mChunks[b].distance;
+		});
+	}
+
+	void Streamer::SetBuilt(int chunk)
+	{
+		assert(IsWanted(chunk));
+		mChunks[chunk].state = BUILT;
+	}
+
+	void Streamer::SetLoaded(int chunk)
+	{
+		assert(IsWanted(chunk));
+		mChunks[chunk].state = LOADED;
+		++mNumLoaded;
+	}
+}
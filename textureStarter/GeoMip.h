@@ -0,0 +1,136 @@
+#ifndef GEOMIP_H
+#define GEOMIP_H
+
+#include <vector>
+
+/*
+Geomipmapping (de Boer 2000) - terrain is cut into square chunks that all share
+one vertex layout, CHUNK_VERTS*CHUNK_VERTS vertices. Further away chunks skip vertices,
+so LOD n only uses every 2^n'th one. The index buffer is split into parts so each
+chunk can pick its own LOD:
+- a centre part that never touches the chunk's edges
+- four edge strips, each in two versions. A stitched edge only uses every other
+  outer vertex, so it lines up with a neighbour one LOD coarser and there are no cracks.
+Neighbours never differ by more than one LOD, see ClampLODs.
+Nothing here knows about d3d, it's all just indices.
+*/
+namespace GeoMip
+{
+	const int CHUNK_CELLS = 32;					//squares along a chunk's side, a power of 2
+	const int CHUNK_VERTS = CHUNK_CELLS + 1;	//vertices along a side, chunks share their edge vertices
+	const int NUM_LODS = 5;						//LOD NUM_LODS-1 is 2x2 squares per chunk
+
+	namespace Edge { enum { NORTH = 0, EAST = 1, SOUTH = 2, WEST = 3, MAX_EDGES = 4 }; }
+	//index buffer parts per LOD - the centre then two versions of each edge
+	const int PARTS_PER_LOD = 1 + Edge::MAX_EDGES * 2;
+	const int MAX_PARTS = PARTS_PER_LOD * NUM_LODS;
+
+	//where to find the parts in the index buffer
+	inline int CentrePart(int lod) {
+		return lod * PARTS_PER_LOD;
+	}
+	inline int EdgePart(int lod, int edge, bool stitched) {
+		return lod * PARTS_PER_LOD + 1 + edge * 2 + (stitched ? 1 : 0);
+	}
+
+	//a part's range of the index buffer, the centre of the coarsest LOD is empty
+	struct Part
+	{
+		int startIndex = 0;
+		int numIndices = 0;
+	};
+
+	/*
+	* make the index buffer every chunk uses, triangles are clockwise seen from above (+y)
+	* vertex (x,z) is number z*CHUNK_VERTS+x, +x is east and +z is north
+	* indices - OUT all the parts one after another
+	* parts - OUT see CentrePart and EdgePart
+	*/
+	void BuildIndices(std::vector<unsigned int>& indices, Part parts[MAX_PARTS]);
+
+	/*
+	* pick a LOD, each doubling of distance past lodDistance halves the detail
+	* distance - IN from the camera to the chunk
+	* lodDistance - IN full detail up to here
+	*/
+	int SelectLOD(float distance, float lodDistance);
+
+	/*
+	* make detail go up where it has to so no two neighbours differ by more than one LOD
+	* lods - IN/OUT one per chunk, row by row
+	* chunksX, chunksZ - IN size of the grid
+	*/
+	void ClampLODs(std::vector<int>& lods, int chunksX, int chunksZ);
+
+	/*
+	Which chunks should exist and at what LOD, as the camera moves. Chunks nearer than
+	the load radius are queued to be built, once built they wait their turn to be
+	uploaded, and loaded ones further than the unload radius are dropped again. The gap
+	between the two stops border chunks flickering in and out.
+	It only keeps the books, building and uploading meshes is up to its owner (see Terrain).
+	*/
+	class Streamer
+	{
+	public:
+		//what's happening to a chunk
+		typedef enum { UNLOADED, QUEUED, BUILT, LOADED } State;	//BUILT = waiting its turn to upload
+
+		/*
+		* chunksX, chunksZ - IN size of the grid, everything starts UNLOADED
+		* loadRadius - IN chunks closer than this are wanted
+		* unloadRadius - IN loaded chunks further than this are dropped, must be more than loadRadius
+		* lodDistance - IN see SelectLOD
+		*/
+		void Initialise(int chunksX, int chunksZ, float loadRadius, float unloadRadius, float lodDistance);
+		//a chunk's world space box, distances are measured to its nearest point
+		void SetBounds(int chunk, const float boundsMin[3], const float boundsMax[3]);
+		/*
+		* measure every chunk against the camera, pick LODs and decide what's wanted
+		* camPos - IN x,y,z
+		* dropped - OUT loaded chunks now too far away, they're UNLOADED and their meshes should go
+		*/
+		void Update(const float camPos[3], std::vector<int>& dropped);
+		//QUEUED chunks, nearest first, i.e. what to build next
+		void GetWanted(std::vector<int>& wanted) const;
+		//a chunk that's been built is only any use if it's still QUEUED or BUILT
+		bool IsWanted(int chunk) const {
+			return mChunks[chunk].state == QUEUED || mChunks[chunk].state == BUILT;
+		}
+		//built, but no upload left this frame
+		void SetBuilt(int chunk);
+		//uploaded
+		void SetLoaded(int chunk);
+
+		State GetState(int chunk) const {
+			return mChunks[chunk].state;
+		}
+		//one per chunk, row by row, neighbours never more than one apart
+		const std::vector<int>& GetLODs() const {
+			return mLODs;
+		}
+		float GetDistance(int chunk) const {
+			return mChunks[chunk].distance;
+		}
+		int GetNumChunks() const {
+			return (int)mChunks.size();
+		}
+		int GetNumLoaded() const {
+			return mNumLoaded;
+		}
+
+	private:
+		struct Chunk
+		{
+			State state = UNLOADED;
+			float boundsMin[3] = {}, boundsMax[3] = {};
+			float distance = 0;		//to the camera at the last Update
+		};
+		std::vector<Chunk> mChunks;
+		std::vector<int> mLODs;
+		int mChunksX = 0, mChunksZ = 0;
+		float mLoadRadius = 0, mUnloadRadius = 0, mLODDistance = 1;
+		int mNumLoaded = 0;
+	};
+}
+
+#endif
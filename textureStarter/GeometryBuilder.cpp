@@ -1,15 +1,22 @@
 
+#include <sstream>
+#include <iomanip>
+
 #include "ShaderTypes.h"
 #include "GeometryBuilder.h"
 #include "Mesh.h"
 #include "Model.h"
 #include "D3DUtil.h"
+#include "Parallel.h"
+#include "Skeleton.h"
 
 using namespace DirectX;
 using namespace DirectX::SimpleMath;
 
 Mesh& BuildQuad(MeshMgr& mgr)
 {
+	if (Mesh* pMesh = mgr.FindMesh("quad"))
+		return *pMesh;
 	// Create vertex buffer
 	VertexPosNormTex vertices[] =
 	{	//quad in the XZ plane
@@ -37,6 +44,8 @@ Mesh& BuildQuad(MeshMgr& mgr)
 
 Mesh& BuildPyramid(MeshMgr& mgr)
 {
+	if (Mesh* pMesh = mgr.FindMesh("pyramid"))
+		return *pMesh;
 	// Create vertex buffer
 	VertexPosNormTex vertices[] =
 	{	//front
@@ -87,6 +96,8 @@ Mesh& BuildPyramid(MeshMgr& mgr)
 
 Mesh& BuildCube(MeshMgr& mgr)
 {
+	if (Mesh* pMesh = mgr.FindMesh("box"))
+		return *pMesh;
 	// Create vertex buffer
 	VertexPosNormTex vertices[] =
 	{	//front
@@ -152,97 +163,334 @@ Mesh& BuildCube(MeshMgr& mgr)
 	return mesh;
 }
 
-Mesh& BuildSphere(MeshMgr& mgr, int LatLines, int LongLines)
+//procedural meshes are cached under a name made from their parameters, so the same request shares geometry
+static std::string MakeKey(const char* shape, std::initializer_list<float> params)
 {
-	int NumSphereVertices = ((LatLines - 2) * LongLines) + 2;
-	int NumSphereFaces = ((LatLines - 3)*(LongLines)* 2) + (LongLines * 2);
+	std::ostringstream os;
+	os << shape << std::setprecision(9);
+	for (float p : params)
+		os << '_' << p;
+	return os.str();
+}
 
-	float sphereYaw = 0.0f;
-	float spherePitch = 0.0f;
+//the same plain white surface the other shapes use
+static Material ShapeMaterial()
+{
+	Material mat = Material::default;
+	mat.gfxData.Diffuse = Vector4(1, 1, 1, 1);
+	mat.gfxData.Ambient = Vector4(0.1f, 0.1f, 0.1f, 1);
+	mat.gfxData.Specular = Vector4(1, 1, 1, 10);
+	return mat;
+}
 
-	std::vector<VertexPosNormTex> vertices(NumSphereVertices);
-	Vector3 currVertPos(0.0f, 0.0f, 1.0f);
-	vertices[0].Pos = Vector3(0, 0, 1);
+static Mesh& CreateShape(MeshMgr& mgr, const std::string& key, const std::vector<VertexPosNormTex>& verts, const std::vector<unsigned int>& indices)
+{
+	Mesh& mesh = mgr.CreateMesh(key);
+	mesh.CreateFrom(verts.data(), (int)verts.size(), indices.data(), (int)indices.size(), ShapeMaterial(), 0, (int)indices.size());
+	return mesh;
+}
 
-	for (int i = 0; i < LatLines - 2; ++i)
+/*
+* sin and cos of start, start+step, start+2*step... four at a time
+* count - IN how many angles
+* sins, coss - OUT the results, padded to a multiple of 4
+*/
+static void SinCosTable(int count, float start, float step, std::vector<float>& sins, std::vector<float>& coss)
+{
+	int padded = (count + 3) & ~3;
+	sins.resize(padded);
+	coss.resize(padded);
+	XMVECTOR offsets = XMVectorSet(0, 1, 2, 3);
+	XMVECTOR vStep = XMVectorReplicate(step), vStart = XMVectorReplicate(start);
+	for (int i = 0; i < padded; i += 4)
 	{
-		spherePitch = (i + 1) * (PI / (LatLines - 1));
-		Matrix Rotationx = Matrix::CreateRotationX(spherePitch);
-		for (int j = 0; j < LongLines; ++j)
-		{
-			sphereYaw = j * ((2*PI) / (LongLines));
-			Matrix Rotationy = Matrix::CreateRotationZ(sphereYaw);
-			currVertPos = Vector3::TransformNormal(Vector3(0, 0, 1), Rotationx * Rotationy);
-			currVertPos.Normalize();
-			int idx = i*LongLines + j + 1;
-			vertices[idx].Pos = currVertPos;
-			vertices[idx].Norm = currVertPos;
-			vertices[idx].Norm.Normalize();
-		}
+		XMVECTOR angles = XMVectorMultiplyAdd(XMVectorAdd(XMVectorReplicate((float)i), offsets), vStep, vStart);
+		XMVECTOR s, c;
+		XMVectorSinCos(&s, &c, angles);
+		XMStoreFloat4((XMFLOAT4*)&sins[i], s);
+		XMStoreFloat4((XMFLOAT4*)&coss[i], c);
 	}
+}
 
-	vertices[NumSphereVertices - 1].Pos = Vector3(0, 0, -1);
+//one ring of a surface of revolution, going down the outside of the shape
+struct ProfilePoint
+{
+	float radius, y;			//distance from the y axis and height
+	float normRadius, normY;	//normal in the same terms
+	float v;					//texture coordinate down the profile
+};
 
+/*
+* spin a profile round the y axis, the seam is duplicated so u can go 0->1
+* profile - IN rings from top to bottom (as seen from outside)
+* slices - IN how many segments around
+* verts, indices - IN/OUT added to, front faces are clockwise like the other shapes
+*/
+static void Revolve(const std::vector<ProfilePoint>& profile, int slices, std::vector<VertexPosNormTex>& verts, std::vector<unsigned int>& indices)
+{
+	std::vector<float> sins, coss;
+	SinCosTable(slices + 1, 0, 2 * PI / slices, sins, coss);
+	sins[slices] = sins[0];
+	coss[slices] = coss[0];
 
-	std::vector<unsigned int> indices(NumSphereFaces * 3);
+	int rows = (int)profile.size();
+	int row = slices + 1;
+	int firstVert = (int)verts.size();
+	verts.resize(firstVert + rows * row);
+	ParallelFor(rows, 64, [&](int begin, int end) {
+		for (int r = begin; r < end; ++r)
+		{
+			const ProfilePoint& p = profile[r];
+			VertexPosNormTex* pV = &verts[firstVert + r * row];
+			for (int j = 0; j <= slices; ++j)
+			{
+				pV[j].Pos = Vector3(p.radius * coss[j], p.y, p.radius * sins[j]);
+				pV[j].Norm = Vector3(p.normRadius * coss[j], p.normY, p.normRadius * sins[j]);
+				pV[j].Tex = Vector2((float)j / slices, p.v);
+			}
+		}
+	});
 
-	int k = 0;
-	for (int l = 0; l < LongLines - 1; ++l)
+	//rings with no radius (poles) would make one triangle of each quad a sliver, skip them
+	std::vector<int> rowStart(rows, 0);
+	int numIndices = 0;
+	for (int r = 0; r < rows - 1; ++r)
 	{
-		indices[k] = 0;
-		indices[k + 2] = l + 1;
-		indices[k + 1] = l + 2;
-		k += 3;
+		rowStart[r] = numIndices;
+		numIndices += slices * 3 * ((profile[r].radius > 0) + (profile[r + 1].radius > 0));
 	}
+	int firstIndex = (int)indices.size();
+	indices.resize(firstIndex + numIndices);
+	ParallelFor(rows - 1, 64, [&](int begin, int end) {
+		for (int r = begin; r < end; ++r)
+		{
+			unsigned int* pI = &indices[firstIndex + rowStart[r]];
+			bool top = profile[r].radius > 0, bottom = profile[r + 1].radius > 0;
+			for (int j = 0; j < slices; ++j)
+			{
+				unsigned int a = firstVert + r * row + j, b = a + 1, c = a + row, d = c + 1;
+				if (top)
+				{
+					*pI++ = a; *pI++ = b; *pI++ = c;
+				}
+				if (bottom)
+				{
+					*pI++ = b; *pI++ = d; *pI++ = c;
+				}
+			}
+		}
+	});
+}
 
-	indices[k] = 0;
-	indices[k + 2] = LongLines;
-	indices[k + 1] = 1;
-	k += 3;
-
-	for (int i = 0; i < LatLines - 3; ++i)
+/*
+* flat disc facing up or down, closes the end of a cylinder
+* y - IN height
+* up - IN which way it faces
+*/
+static void Disc(float y, bool up, int slices, std::vector<VertexPosNormTex>& verts, std::vector<unsigned int>& indices)
+{
+	std::vector<float> sins, coss;
+	SinCosTable(slices + 1, 0, 2 * PI / slices, sins, coss);
+	Vector3 norm(0, up ? 1.f : -1.f, 0);
+	unsigned int centre = (unsigned int)verts.size();
+	verts.push_back(VertexPosNormTex{ Vector3(0, y, 0), norm, Vector2(0.5f, 0.5f) });
+	for (int j = 0; j < slices; ++j)
+		verts.push_back(VertexPosNormTex{ Vector3(coss[j], y, sins[j]), norm, Vector2(0.5f + 0.5f * coss[j], 0.5f - 0.5f * sins[j]) });
+	for (int j = 0; j < slices; ++j)
 	{
-		for (int j = 0; j < LongLines - 1; ++j)
-		{
-			indices[k] = i*LongLines + j + 1;
-			indices[k + 1] = i*LongLines + j + 2;
-			indices[k + 2] = (i + 1)*LongLines + j + 1;
+		unsigned int a = centre + 1 + j, b = centre + 1 + (j + 1) % slices;
+		indices.push_back(centre);
+		indices.push_back(up ? b : a);
+		indices.push_back(up ? a : b);
+	}
+}
 
-			indices[k + 3] = (i + 1)*LongLines + j + 1;
-			indices[k + 4] = i*LongLines + j + 2;
-			indices[k + 5] = (i + 1)*LongLines + j + 2;
+//profile for a ring of a sphere, angle down from the top
+static ProfilePoint SphereRing(float s, float c, float yOffset, float v)
+{
+	//sin(0) isn't quite 0 after the table, make the poles exact
+	if (fabsf(s) < 1e-6f)
+		s = 0;
+	return ProfilePoint{ s, c + yOffset, s, c, v };
+}
 
-			k += 6; // next quad
-		}
+Mesh& BuildSphere(MeshMgr& mgr, int latLines, int longLines)
+{
+	assert(latLines >= 3 && longLines >= 3);
+	std::string key = MakeKey("sphere", { (float)latLines, (float)longLines });
+	if (Mesh* pMesh = mgr.FindMesh(key))
+		return *pMesh;
 
-		indices[k] = (i*LongLines) + LongLines;
-		indices[k + 1] = (i*LongLines) + 1;
-		indices[k + 2] = ((i + 1)*LongLines) + LongLines;
+	//latLines rings including the two poles
+	int rings = latLines - 1;
+	std::vector<float> sins, coss;
+	SinCosTable(rings + 1, 0, PI / rings, sins, coss);
+	std::vector<ProfilePoint> profile(rings + 1);
+	for (int i = 0; i <= rings; ++i)
+		profile[i] = SphereRing(sins[i], coss[i], 0, (float)i / rings);
+	profile[rings].y = profile[rings].normY = -1;
 
-		indices[k + 3] = ((i + 1)*LongLines) + LongLines;
-		indices[k + 4] = (i*LongLines) + 1;
-		indices[k + 5] = ((i + 1)*LongLines) + 1;
+	std::vector<VertexPosNormTex> verts;
+	std::vector<unsigned int> indices;
+	Revolve(profile, longLines, verts, indices);
+	return CreateShape(mgr, key, verts, indices);
+}
+
+Mesh& BuildCylinder(MeshMgr& mgr, int slices, int stacks, float height)
+{
+	assert(slices >= 3 && stacks >= 1 && height > 0);
+	std::string key = MakeKey("cylinder", { (float)slices, (float)stacks, height });
+	if (Mesh* pMesh = mgr.FindMesh(key))
+		return *pMesh;
+
+	std::vector<ProfilePoint> profile(stacks + 1);
+	for (int i = 0; i <= stacks; ++i)
+		profile[i] = ProfilePoint{ 1, height * (0.5f - (float)i / stacks), 1, 0, (float)i / stacks };
+
+	std::vector<VertexPosNormTex> verts;
+	std::vector<unsigned int> indices;
+	Revolve(profile, slices, verts, indices);
+	Disc(height * 0.5f, true, slices, verts, indices);
+	Disc(-height * 0.5f, false, slices, verts, indices);
+	return CreateShape(mgr, key, verts, indices);
+}
+
+Mesh& BuildTorus(MeshMgr& mgr, int rings, int sides, float tubeRadius)
+{
+	assert(rings >= 3 && sides >= 3 && tubeRadius > 0 && tubeRadius < 1);
+	std::string key = MakeKey("torus", { (float)rings, (float)sides, tubeRadius });
+	if (Mesh* pMesh = mgr.FindMesh(key))
+		return *pMesh;
+
+	//round the tube, starting on the outside edge and heading down
+	std::vector<float> sins, coss;
+	SinCosTable(sides + 1, 0, 2 * PI / sides, sins, coss);
+	sins[sides] = sins[0];
+	coss[sides] = coss[0];
+	std::vector<ProfilePoint> profile(sides + 1);
+	for (int i = 0; i <= sides; ++i)
+		profile[i] = ProfilePoint{ 1 + tubeRadius * coss[i], -tubeRadius * sins[i], coss[i], -sins[i], (float)i / sides };
+
+	std::vector<VertexPosNormTex> verts;
+	std::vector<unsigned int> indices;
+	Revolve(profile, rings, verts, indices);
+	return CreateShape(mgr, key, verts, indices);
+}
+
+/*
+* the outline of a capsule, top to bottom
+* hemiStacks, height - IN as BuildCapsule
+* bodyStacks - IN rings along the straight part, more than 1 if it needs to bend
+* profile - OUT the rings
+*/
+static void CapsuleProfile(int hemiStacks, float height, int bodyStacks, std::vector<ProfilePoint>& profile)
+{
+	//two half spheres, the gap between the equators makes the cylinder
+	std::vector<float> sins, coss;
+	SinCosTable(hemiStacks + 1, 0, PI * 0.5f / hemiStacks, sins, coss);
+	float total = height + PI;		//length of the profile, for v
+	profile.clear();
+	profile.reserve(hemiStacks * 2 + bodyStacks + 1);
+	for (int i = 0; i < hemiStacks; ++i)
+		profile.push_back(SphereRing(sins[i], coss[i], height * 0.5f, (PI * 0.5f * i / hemiStacks) / total));
+	//the equators are exactly round
+	for (int i = 0; i <= bodyStacks; ++i)
+	{
+		float t = (float)i / bodyStacks;
+		profile.push_back(ProfilePoint{ 1, height * (0.5f - t), 1, 0, (PI * 0.5f + height * t) / total });
+	}
+	for (int i = hemiStacks - 1; i >= 0; --i)
+		profile.push_back(SphereRing(sins[i], -coss[i], -height * 0.5f, (PI * 0.5f * (2 * hemiStacks - i) / hemiStacks + height) / total));
+}
+
+Mesh& BuildCapsule(MeshMgr& mgr, int slices, int hemiStacks, float height)
+{
+	assert(slices >= 3 && hemiStacks >= 1 && height >= 0);
+	std::string key = MakeKey("capsule", { (float)slices, (float)hemiStacks, height });
+	if (Mesh* pMesh = mgr.FindMesh(key))
+		return *pMesh;
+
+	std::vector<ProfilePoint> profile;
+	CapsuleProfile(hemiStacks, height, 1, profile);
+	std::vector<VertexPosNormTex> verts;
+	std::vector<unsigned int> indices;
+	Revolve(profile, slices, verts, indices);
+	return CreateShape(mgr, key, verts, indices);
+}
+
+void BuildSkinnedCapsule(int numBones, int slices, int hemiStacks, float height, Skeleton& skel,
+	std::vector<VertexPosNormTexSkin>& verts, std::vector<unsigned int>& indices)
+{
+	assert(numBones >= 1 && numBones <= MAX_BONES && slices >= 3 && hemiStacks >= 1 && height > 0);
+	std::vector<ProfilePoint> profile;
+	CapsuleProfile(hemiStacks, height, numBones * 4, profile);
+	std::vector<VertexPosNormTex> plain;
+	indices.clear();
+	Revolve(profile, slices, plain, indices);
 
-		k += 6;
+	//a chain of bones from the bottom to the top, each one the next bone's parent
+	const float bottom = -(height * 0.5f + 1), length = (height + 2) / numBones;
+	skel = Skeleton();
+	for (int b = 0; b < numBones; ++b)
+	{
+		BoneTransform bind;
+		bind.translation = Vector3(0, (b == 0) ? bottom : length, 0);
+		skel.AddBone("bone" + std::to_string(b), b - 1, bind);
 	}
+	skel.Finalise();
 
-	for (int l = 0; l < LongLines - 1; ++l)
+	//blend between the two bones whose middles are either side, the ends just follow the end bones
+	verts.resize(plain.size());
+	for (size_t i = 0; i < plain.size(); ++i)
 	{
-		indices[k] = NumSphereVertices - 1;
-		indices[k + 2] = (NumSphereVertices - 1) - (l + 1);
-		indices[k + 1] = (NumSphereVertices - 1) - (l + 2);
-		k += 3;
+		VertexPosNormTexSkin& v = verts[i];
+		v.Pos = plain[i].Pos;
+		v.Norm = plain[i].Norm;
+		v.Tex = plain[i].Tex;
+		float along = (v.Pos.y - bottom) / length - 0.5f;
+		along = std::min(std::max(along, 0.f), (float)(numBones - 1));
+		int b0 = std::min((int)along, numBones - 1);
+		int b1 = std::min(b0 + 1, numBones - 1);
+		unsigned char w1 = (unsigned char)((along - b0) * 255 + 0.5f);
+		v.Bones[0] = (unsigned char)b0;
+		v.Bones[1] = (unsigned char)b1;
+		v.Bones[2] = v.Bones[3] = 0;
+		v.Weights[0] = 255 - w1;
+		v.Weights[1] = w1;
+		v.Weights[2] = v.Weights[3] = 0;
 	}
+}
 
-	indices[k] = NumSphereVertices - 1;
-	indices[k + 2] = (NumSphereVertices - 1) - LongLines;
-	indices[k + 1] = NumSphereVertices - 2;
+Mesh& BuildGrid(MeshMgr& mgr, int cellsX, int cellsZ)
+{
+	assert(cellsX >= 1 && cellsZ >= 1);
+	std::string key = MakeKey("grid", { (float)cellsX, (float)cellsZ });
+	if (Mesh* pMesh = mgr.FindMesh(key))
+		return *pMesh;
 
-	Mesh &mesh = mgr.CreateMesh("sphere");
-	Material mat = Material::default;
-	mat.gfxData.Diffuse = Vector4(0.1f, 0.1f, 0.1f, 1);
-	mat.gfxData.Specular = Vector4(1,1,1,10);
-	mat.flags &= ~Material::TFlags::CCW_WINDING;
-	mesh.CreateFrom(&vertices[0], NumSphereVertices, &indices[0], NumSphereFaces * 3, mat, 0, NumSphereFaces * 3);
-	return mesh;
+	//in the XZ plane like the quad
+	int row = cellsX + 1;
+	std::vector<VertexPosNormTex> verts(row * (cellsZ + 1));
+	std::vector<unsigned int> indices(cellsX * cellsZ * 6);
+	ParallelFor(cellsZ + 1, 64, [&](int begin, int end) {
+		for (int z = begin; z < end; ++z)
+			for (int x = 0; x <= cellsX; ++x)
+			{
+				float u = (float)x / cellsX, v = (float)z / cellsZ;
+				verts[z * row + x] = VertexPosNormTex{ Vector3(u * 2 - 1, 0, v * 2 - 1), Vector3(0, 1, 0), Vector2(u, 1 - v) };
+			}
+	});
+	ParallelFor(cellsZ, 64, [&](int begin, int end) {
+		for (int z = begin; z < end; ++z)
+		{
+			unsigned int* pI = &indices[z * cellsX * 6];
+			for (int x = 0; x < cellsX; ++x)
+			{
+				unsigned int a = z * row + x, b = a + 1, c = a + row, d = c + 1;
+				*pI++ = a; *pI++ = c; *pI++ = d;
+				*pI++ = a; *pI++ = d; *pI++ = b;
+			}
+		}
+	});
+	return CreateShape(mgr, key, verts, indices);
 }
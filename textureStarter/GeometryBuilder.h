@@ -1,17 +1,42 @@
 #ifndef GEOMETRYBUILDER_H
 #define GEOMETRYBUILDER_H
 
+#include <vector>
+
 class MeshMgr;
 class Model;
 class Mesh;
+class Skeleton;
+struct VertexPosNormTexSkin;
 
 /*
 * build the geometry for some common shapes and store in the MeshMgr library
-* only one of each allowed, identified by text name
+* each one is named after its parameters ("sphere_16_32"), asking for the same
+* shape twice just returns the one already built
+* the shapes are about 2 units across, centred on the origin, with uvs and normals
 */
 Mesh& BuildQuad(MeshMgr& mgr);
 Mesh& BuildPyramid(MeshMgr& mgr);
 Mesh& BuildCube(MeshMgr& mgr);
-Mesh& BuildSphere(MeshMgr& mgr, int LatLines, int LongLines);
+//latLines - rings top to bottom including the poles, longLines - segments around
+Mesh& BuildSphere(MeshMgr& mgr, int latLines, int longLines);
+//capped, radius 1, stacks - segments along the height
+Mesh& BuildCylinder(MeshMgr& mgr, int slices, int stacks, float height = 2);
+//round the y axis, rings - segments round the middle, sides - segments round the tube, tubeRadius - as a fraction of the radius
+Mesh& BuildTorus(MeshMgr& mgr, int rings, int sides, float tubeRadius = 0.25f);
+//radius 1, height - of the straight part between the two half spheres, hemiStacks - rings in each half sphere
+Mesh& BuildCapsule(MeshMgr& mgr, int slices, int hemiStacks, float height = 2);
+/*
+* a capsule that bends, for trying out skinning. It isn't put in the MeshMgr, the caller decides
+* whether the gpu or the cpu skins it, see Mesh::CreateFrom
+* numBones - IN a chain up the y axis, the root is at the bottom
+* slices, hemiStacks, height - IN as BuildCapsule, the straight part gets 4 rings per bone so it bends smoothly
+* skel - OUT the bones, finalised
+* verts, indices - OUT the geometry, each vertex weighted between the two nearest bones
+*/
+void BuildSkinnedCapsule(int numBones, int slices, int hemiStacks, float height, Skeleton& skel,
+	std::vector<VertexPosNormTexSkin>& verts, std::vector<unsigned int>& indices);
+//subdivided quad in the XZ plane
+Mesh& BuildGrid(MeshMgr& mgr, int cellsX, int cellsZ);
 
 #endif
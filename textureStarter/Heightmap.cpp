@@ -0,0 +1,81 @@
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+
+#include "Heightmap.h"
+
+using namespace std;
+
+bool Heightmap::LoadRaw16(const string& fileName, int width, int depth)
+{
+	ifstream fs(fileName, ios::binary | ios::ate);
+	if (!fs || width <= 1 || depth <= 1 || (size_t)fs.tellg() != (size_t)width * depth * sizeof(unsigned short))
+		return false;
+	fs.seekg(0);
+	mHeights.resize((size_t)width * depth);
+	fs.read((char*)mHeights.data(), mHeights.size() * sizeof(unsigned short));
+	if (!fs)
+	{
+		mHeights.clear();
+		return false;
+	}
+	mWidth = width;
+	mDepth = depth;
+	return true;
+}
+
+//repeatable random number 0->1 for a lattice point
+static float Lattice(int x, int z, unsigned int seed)
+{
+	unsigned int h = (unsigned int)x * 374761393u + (unsigned int)z * 668265263u + seed * 2246822519u;
+	h = (h ^ (h >> 13)) * 1274126177u;
+	h ^= h >> 16;
+	return (h & 0xffffff) * (1.f / 0xffffff);
+}
+
+//smoothly blended lattice values
+static float ValueNoise(float x, float z, unsigned int seed)
+{
+	int ix = (int)floorf(x), iz = (int)floorf(z);
+	float fx = x - ix, fz = z - iz;
+	fx = fx * fx * (3 - 2 * fx);
+	fz = fz * fz * (3 - 2 * fz);
+	float a = Lattice(ix, iz, seed), b = Lattice(ix + 1, iz, seed);
+	float c = Lattice(ix, iz + 1, seed), d = Lattice(ix + 1, iz + 1, seed);
+	return (a + (b - a) * fx) + ((c + (d - c) * fx) - (a + (b - a) * fx)) * fz;
+}
+
+void Heightmap::Generate(int width, int depth, unsigned int seed, float featureSize, int octaves)
+{
+	mWidth = width;
+	mDepth = depth;
+	mHeights.resize((size_t)width * depth);
+	//add up the octaves, then stretch to use the whole 16bit range
+	vector<float> h((size_t)width * depth);
+	float lo = 1e9f, hi = -1e9f;
+	for (int z = 0; z < depth; ++z)
+		for (int x = 0; x < width; ++x)
+		{
+			float sum = 0, amp = 1, freq = 1 / featureSize;
+			for (int o = 0; o < octaves; ++o)
+			{
+				sum += ValueNoise(x * freq, z * freq, seed + o) * amp;
+				amp *= 0.5f;
+				freq *= 2;
+			}
+			h[z * width + x] = sum;
+			lo = min(lo, sum);
+			hi = max(hi, sum);
+		}
+	float scale = (hi > lo) ? 65535.f / (hi - lo) : 0;
+	for (size_t i = 0; i < h.size(); ++i)
+		mHeights[i] = (unsigned short)((h[i] - lo) * scale + 0.5f);
+}
+
+float Heightmap::Sample(float x, float z) const
+{
+	int ix = (int)floorf(x), iz = (int)floorf(z);
+	float fx = x - ix, fz = z - iz;
+	float a = Get(ix, iz), b = Get(ix + 1, iz), c = Get(ix, iz + 1), d = Get(ix + 1, iz + 1);
+	return (a + (b - a) * fx) + ((c + (d - c) * fx) - (a + (b - a) * fx)) * fz;
+}
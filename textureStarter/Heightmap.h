@@ -0,0 +1,50 @@
+#ifndef HEIGHTMAP_H
+#define HEIGHTMAP_H
+
+#include <string>
+#include <vector>
+
+/*
+A grid of heights 0->1 stored as 16bit values, the same as a
+16bit greyscale raw file. Read only once it's set up, so it's
+safe to sample from more than one thread.
+*/
+class Heightmap
+{
+public:
+	/*
+	* load a headerless 16bit little endian raw file (e.g. exported from a terrain editor)
+	* width, depth - IN samples in x and z
+	* returns - false if the file is missing or the wrong size
+	*/
+	bool LoadRaw16(const std::string& fileName, int width, int depth);
+	/*
+	* make up some hills - fractal value noise, octaves of detail halving in size
+	* width, depth - IN samples in x and z
+	* seed - IN different seeds, different hills
+	* featureSize - IN width in samples of the biggest hills
+	* octaves - IN layers of detail
+	*/
+	void Generate(int width, int depth, unsigned int seed, float featureSize = 128, int octaves = 6);
+
+	int GetWidth() const {
+		return mWidth;
+	}
+	int GetDepth() const {
+		return mDepth;
+	}
+	//height 0->1 at a sample, clamped to the edges
+	float Get(int x, int z) const {
+		x = (x < 0) ? 0 : (x >= mWidth) ? mWidth - 1 : x;
+		z = (z < 0) ? 0 : (z >= mDepth) ? mDepth - 1 : z;
+		return mHeights[z * mWidth + x] * (1.f / 65535.f);
+	}
+	//height 0->1 between samples, bilinear
+	float Sample(float x, float z) const;
+
+private:
+	int mWidth = 0, mDepth = 0;
+	std::vector<unsigned short> mHeights;
+};
+
+#endif
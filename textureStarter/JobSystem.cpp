@@ -0,0 +1,447 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "JobSystem.h"
+#include "Parallel.h"
+#include "DebugOut.h"
+
+using namespace std;
+
+typedef chrono::high_resolution_clock Clock;
+
+//the system a worker belongs to and which of its threads it is, there can be more than one system
+static thread_local const JobSystem* tSystem = nullptr;
+static thread_local int tThread = -1;
+
+//idle threads go round this many times looking for work before going to sleep
+static const int SPINS_BEFORE_SLEEP = 64;
+
+bool JobSystem::Deque::Push(Job* pJob)
+{
+	long long b = bottom.load(memory_order_relaxed);
+	long long t = top.load(memory_order_acquire);
+	if (b - t >= QUEUE_SIZE)
+		return false;
+	jobs[b & (QUEUE_SIZE - 1)].store(pJob, memory_order_relaxed);
+	//the job has to be there before a thief can see the new bottom
+	atomic_thread_fence(memory_order_release);
+	bottom.store(b + 1, memory_order_relaxed);
+	return true;
+}
+
+JobSystem::Job* JobSystem::Deque::Pop()
+{
+	//claim the bottom one, then check a thief didn't get there first
+	long long b = bottom.load(memory_order_relaxed) - 1;
+	bottom.store(b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	long long t = top.load(memory_order_relaxed);
+	if (t > b)
+	{
+		//it was empty
+		bottom.store(b + 1, memory_order_relaxed);
+		return nullptr;
+	}
+	Job* pJob = jobs[b & (QUEUE_SIZE - 1)].load(memory_order_relaxed);
+	if (t == b)
+	{
+		//the last one, race any thieves for it
+		if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+			pJob = nullptr;
+		bottom.store(b + 1, memory_order_relaxed);
+	}
+	return pJob;
+}
+
+JobSystem::Job* JobSystem::Deque::Steal(bool& lost)
+{
+	long long t = top.load(memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	long long b = bottom.load(memory_order_acquire);
+	lost = false;
+	if (t >= b)
+		return nullptr;
+	Job* pJob = jobs[t & (QUEUE_SIZE - 1)].load(memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+	{
+		lost = true;
+		return nullptr;
+	}
+	return pJob;
+}
+
+JobSystem& JobSystem::Get()
+{
+	static JobSystem instance;
+	return instance;
+}
+
+JobSystem::JobSystem(int numWorkers)
+{
+	Start(numWorkers);
+}
+
+JobSystem::~JobSystem()
+{
+	Stop();
+	for (Slot* pSlot : mSlots)
+		delete pSlot;
+}
+
+void JobSystem::Start(int numWorkers)
+{
+	Stop();
+	assert(mPending == 0 && mShared.empty());
+	if (numWorkers < 0)
+		numWorkers = std::max(0, (int)thread::hardware_concurrency() - 1);
+	for (Slot* pSlot : mSlots)
+		delete pSlot;
+	mSlots.clear();
+	for (int i = 0; i <= numWorkers; ++i)
+		mSlots.push_back(new Slot);
+	mQuit = false;
+	mMainThread = this_thread::get_id();
+	for (int i = 1; i <= numWorkers; ++i)
+		mWorkers.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+void JobSystem::Stop()
+{
+	{
+		lock_guard<mutex> lock(mSleepLock);
+		mQuit = true;
+	}
+	mWake.notify_all();
+	for (thread& t : mWorkers)
+		t.join();
+	mWorkers.clear();
+}
+
+int JobSystem::ThisThread() const
+{
+	if (tSystem == this)
+		return tThread;
+	return this_thread::get_id() == mMainThread ? 0 : -1;
+}
+
+void JobSystem::Push(Job* pJob)
+{
+	//counted first so a worker never sleeps through it
+	mPending.fetch_add(1);
+	int t = ThisThread();
+	if (t >= 0 && t < (int)mSlots.size())
+	{
+		if (!mSlots[t]->queue.Push(pJob))
+		{
+			//full, so there's plenty to be getting on with - just do it
+			mPending.fetch_sub(1);
+			Execute(*pJob, t);
+			return;
+		}
+	}
+	else
+	{
+		lock_guard<mutex> lock(mSharedLock);
+		mShared.push_back(pJob);
+		mNumShared.fetch_add(1);
+	}
+	if (mNumSleeping.load() > 0)
+	{
+		lock_guard<mutex> lock(mSleepLock);
+		mWake.notify_one();
+	}
+}
+
+void JobSystem::Run(Job jobs[], int count, Counter& counter, Counter* pDependsOn)
+{
+	assert(count >= 0);
+	if (count == 0)
+		return;
+	counter.mValue.fetch_add(count);
+	for (int i = 0; i < count; ++i)
+	{
+		assert(jobs[i].fn);
+		jobs[i].pCounter = &counter;
+	}
+	if (pDependsOn)
+	{
+		//whoever takes the counter to zero starts anything waiting, so check under its lock
+		lock_guard<mutex> lock(pDependsOn->mLock);
+		if (pDependsOn->mValue.load() != 0)
+		{
+			for (int i = 0; i < count; ++i)
+				pDependsOn->mWaiting.push_back(&jobs[i]);
+			return;
+		}
+	}
+	for (int i = 0; i < count; ++i)
+		Push(&jobs[i]);
+}
+
+JobSystem::Job* JobSystem::Find(int thread)
+{
+	Job* pJob = nullptr;
+	//our own newest first, it's likely still in the cache
+	if (thread >= 0)
+		pJob = mSlots[thread]->queue.Pop();
+	if (!pJob && mNumShared.load(memory_order_relaxed) > 0)
+	{
+		lock_guard<mutex> lock(mSharedLock);
+		if (!mShared.empty())
+		{
+			pJob = mShared.front();
+			mShared.pop_front();
+			mNumShared.fetch_sub(1);
+		}
+	}
+	if (!pJob)
+	{
+		//everyone else's oldest, starting somewhere different each time so thieves spread out
+		static thread_local unsigned int seed = 2463534242u + (unsigned int)thread * 977u;
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		const int numSlots = (int)mSlots.size();
+		const int start = (int)(seed % (unsigned int)numSlots);
+		for (int i = 0; i < numSlots && !pJob; ++i)
+		{
+			int victim = (start + i) % numSlots;
+			if (victim == thread)
+				continue;
+			bool lost;
+			pJob = mSlots[victim]->queue.Steal(lost);
+			if (thread >= 0)
+			{
+				if (pJob)
+					mSlots[thread]->steals.fetch_add(1, memory_order_relaxed);
+				else if (lost)
+					mSlots[thread]->failedSteals.fetch_add(1, memory_order_relaxed);
+			}
+		}
+	}
+	if (pJob)
+		mPending.fetch_sub(1);
+	return pJob;
+}
+
+void JobSystem::Execute(Job& job, int thread)
+{
+	//the job may go away as soon as its counter reaches zero, so it's read first
+	Counter& counter = *job.pCounter;
+	job.fn(job.data, job.begin, job.end);
+	if (thread >= 0)
+		mSlots[thread]->jobs.fetch_add(1, memory_order_relaxed);
+
+	counter.mFinishing.fetch_add(1);
+	if (counter.mValue.fetch_sub(1) == 1)
+	{
+		vector<Job*> ready;
+		{
+			lock_guard<mutex> lock(counter.mLock);
+			ready.swap(counter.mWaiting);
+		}
+		for (Job* pJob : ready)
+			Push(pJob);
+	}
+	counter.mFinishing.fetch_sub(1);
+}
+
+void JobSystem::Wait(Counter& counter)
+{
+	const int thread = ThisThread();
+	bool idle = false;
+	Clock::time_point idleStart;
+	while (counter.mValue.load(memory_order_acquire) != 0)
+	{
+		Job* pJob = Find(thread);
+		if (pJob)
+		{
+			if (idle && thread >= 0)
+				mSlots[thread]->idleNs.fetch_add(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - idleStart).count(), memory_order_relaxed);
+			idle = false;
+			Execute(*pJob, thread);
+		}
+		else
+		{
+			//what's left is running elsewhere
+			if (!idle)
+				idleStart = Clock::now();
+			idle = true;
+			this_thread::yield();
+		}
+	}
+	if (idle && thread >= 0)
+		mSlots[thread]->idleNs.fetch_add(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - idleStart).count(), memory_order_relaxed);
+	//the last job to finish may still be starting anything waiting on the counter
+	while (counter.mFinishing.load(memory_order_acquire) != 0)
+		this_thread::yield();
+}
+
+void JobSystem::WorkerLoop(int thread)
+{
+	tSystem = this;
+	tThread = thread;
+	Slot& slot = *mSlots[thread];
+	while (!mQuit.load())
+	{
+		Job* pJob = Find(thread);
+		if (pJob)
+		{
+			Execute(*pJob, thread);
+			continue;
+		}
+		//look around a bit, then sleep until something's pushed
+		Clock::time_point idleStart = Clock::now();
+		for (int i = 0; i < SPINS_BEFORE_SLEEP && !pJob && !mQuit.load(); ++i)
+		{
+			this_thread::yield();
+			pJob = Find(thread);
+		}
+		if (!pJob)
+		{
+			unique_lock<mutex> lock(mSleepLock);
+			mNumSleeping.fetch_add(1);
+			mWake.wait(lock, [this] { return mQuit.load() || mPending.load() > 0; });
+			mNumSleeping.fetch_sub(1);
+		}
+		slot.idleNs.fetch_add(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - idleStart).count(), memory_order_relaxed);
+		if (pJob)
+			Execute(*pJob, thread);
+	}
+}
+
+void JobSystem::GetStats(vector<ThreadStats>& out) const
+{
+	out.resize(mSlots.size());
+	for (size_t i = 0; i < mSlots.size(); ++i)
+	{
+		out[i].jobs = mSlots[i]->jobs.load();
+		out[i].steals = mSlots[i]->steals.load();
+		out[i].failedSteals = mSlots[i]->failedSteals.load();
+		out[i].idleSecs = mSlots[i]->idleNs.load() * 1e-9;
+	}
+}
+
+void JobSystem::ResetStats()
+{
+	for (Slot* pSlot : mSlots)
+	{
+		pSlot->jobs = pSlot->steals = pSlot->failedSteals = 0;
+		pSlot->idleNs = 0;
+	}
+}
+
+double JobSystem::Benchmark(int numElements, int numRepeats)
+{
+	//every run has a system of its own, the one everything else uses is left as it is
+	const int maxThreads = Get().GetNumThreads();
+	typedef chrono::duration<double> Secs;
+	vector<float> a(numElements), b(numElements), c(numElements);
+	for (int i = 0; i < numElements; ++i)
+		b[i] = c[i] = (float)i;
+
+	//1, 2, 4... threads and then all of them
+	vector<int> counts;
+	for (int n = 1; n < maxThreads; n *= 2)
+		counts.push_back(n);
+	counts.push_back(maxThreads);
+	double computeOne = 0, memoryOne = 0, computeAll = 0;
+	DBOUT("Job system benchmark, " << numElements << " elements, up to " << maxThreads << " threads:");
+	for (int n : counts)
+	{
+		JobSystem js(n - 1);
+		//plenty of maths per element, should scale with cores
+		Clock::time_point start = Clock::now();
+		for (int r = 0; r < numRepeats; ++r)
+			ParallelFor(js, numElements, 1024, [&](int begin, int end) {
+				for (int i = begin; i < end; ++i)
+					a[i] = sqrtf(b[i]) * sinf(c[i] * 0.001f) + cosf(b[i] * 0.002f);
+			});
+		double compute = Secs(Clock::now() - start).count() / numRepeats;
+		//little maths, limited by memory bandwidth
+		js.ResetStats();
+		start = Clock::now();
+		for (int r = 0; r < numRepeats; ++r)
+			ParallelFor(js, numElements, 16384, [&](int begin, int end) {
+				for (int i = begin; i < end; ++i)
+					a[i] = b[i] * 2 + c[i];
+			});
+		double memory = Secs(Clock::now() - start).count() / numRepeats;
+		vector<ThreadStats> stats;
+		js.GetStats(stats);
+		long long steals = 0, failed = 0;
+		double idle = 0;
+		for (const ThreadStats& s : stats)
+		{
+			steals += s.steals;
+			failed += s.failedSteals;
+			idle += s.idleSecs;
+		}
+		if (n == 1)
+		{
+			computeOne = compute;
+			memoryOne = memory;
+		}
+		computeAll = computeOne / compute;
+		DBOUT("  " << n << " threads, compute " << compute * 1000 << "ms (x" << computeOne / compute << "), memory "
+			<< memory * 1000 << "ms (x" << memoryOne / memory << "), " << steals << " steals " << failed << " lost, idle "
+			<< idle * 1000 / numRepeats << "ms per run across threads");
+	}
+
+	//what a job costs, lots of empty ones a batch at a time
+	JobSystem js;
+	vector<Job> empty(QUEUE_SIZE / 2);
+	for (Job& job : empty)
+		job.fn = [](void*, int, int) {};
+	const int numBatches = 200;
+	Clock::time_point start = Clock::now();
+	for (int r = 0; r < numBatches; ++r)
+	{
+		Counter done;
+		js.Run(empty.data(), (int)empty.size(), done);
+		js.Wait(done);
+	}
+	double perJob = Secs(Clock::now() - start).count() / (numBatches * empty.size());
+
+	//stages that must run in order, each waiting on the one before, checking it really had finished
+	const int numStages = 100, jobsPerStage = 16;
+	struct Stage
+	{
+		atomic<int> finished{ 0 };
+		atomic<int>* pBefore = nullptr;
+		atomic<int> outOfOrder{ 0 };
+	};
+	vector<Stage> stages(numStages);
+	vector<Job> stageJobs(numStages * jobsPerStage);
+	vector<Counter> counters(numStages);
+	start = Clock::now();
+	for (int s = 0; s < numStages; ++s)
+	{
+		stages[s].pBefore = s > 0 ? &stages[s - 1].finished : nullptr;
+		for (int j = 0; j < jobsPerStage; ++j)
+		{
+			Job& job = stageJobs[s * jobsPerStage + j];
+			job.data = &stages[s];
+			job.fn = [](void* data, int, int) {
+				Stage& stage = *(Stage*)data;
+				if (stage.pBefore && stage.pBefore->load() != jobsPerStage)
+					++stage.outOfOrder;
+				++stage.finished;
+			};
+		}
+		js.Run(&stageJobs[s * jobsPerStage], jobsPerStage, counters[s], s > 0 ? &counters[s - 1] : nullptr);
+	}
+	js.Wait(counters[numStages - 1]);
+	double perStage = Secs(Clock::now() - start).count() / numStages;
+	int outOfOrder = 0;
+	for (Stage& s : stages)
+		outOfOrder += s.outOfOrder;
+	//the earlier stages finished before the last one could start, but their counters may still be counting down
+	for (Counter& counter : counters)
+		js.Wait(counter);
+
+	DBOUT("  an empty job " << perJob * 1e9 << "ns, a stage of " << jobsPerStage << " waiting on the last " << perStage * 1e6
+		<< "us" << (outOfOrder ? " - STAGES RAN OUT OF ORDER" : ""));
+	return computeAll;
+}
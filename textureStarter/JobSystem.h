@@ -0,0 +1,158 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+A worker thread per core (less the main one) kept for the whole run, and work handed
+out as small jobs. Each worker has its own queue it pushes and pops at one end without
+locking, and when it runs dry it steals from the other end of someone else's (Chase-Lev
+deques), so busy threads keep their work local and idle ones balance the load.
+Jobs report to a Counter when they finish. Waiting on a counter doesn't block - the
+waiting thread runs jobs until it's reached zero, so the main thread helps rather than
+sitting idle. A job can also be held back until another counter reaches zero, which
+is how one stage of work is made to follow another.
+Threads that aren't ours (e.g. a loading thread) can add jobs too, they go in a locked
+queue the workers check when their own is empty.
+Idle workers sleep, so it costs nothing when there's no work.
+See ParallelFor (Parallel.h) for the simple case of splitting a loop up.
+*/
+class JobSystem
+{
+public:
+	//a parallel loop is cut into at most this many pieces per thread, so stealing has something to balance
+	static constexpr int CHUNKS_PER_THREAD = 4;
+	//jobs one thread can have queued, more than this run straight away
+	static constexpr int QUEUE_SIZE = 4096;
+
+	struct Job;
+	//counts jobs still to finish, it must outlive them
+	class Counter
+	{
+	public:
+		~Counter() {
+			assert(IsDone());
+		}
+		bool IsDone() const {
+			return mValue.load(std::memory_order_acquire) == 0;
+		}
+	private:
+		friend class JobSystem;
+		std::atomic<int> mValue{ 0 };
+		std::atomic<int> mFinishing{ 0 };	//threads part way through counting down, it mustn't go away until they're done
+		std::mutex mLock;					//guards mWaiting
+		std::vector<Job*> mWaiting;			//jobs to start when it reaches zero
+	};
+
+	/*
+	a piece of work - fn(data, begin, end). The caller owns it and it mustn't move or go
+	away until its counter says it's finished.
+	*/
+	struct Job
+	{
+		void(*fn)(void* data, int begin, int end) = nullptr;
+		void* data = nullptr;
+		int begin = 0, end = 0;
+		Counter* pCounter = nullptr;		//set by Run
+	};
+
+	//what one thread has been doing since ResetStats
+	struct ThreadStats
+	{
+		long long jobs = 0;					//run
+		long long steals = 0;				//of those, taken from another thread
+		long long failedSteals = 0;			//lost a race with the owner or another thief
+		double idleSecs = 0;				//with nothing to run
+	};
+
+	//the one job system, started with a worker per core the first time it's asked for. The first
+	//thread to ask is treated as the main thread, so ask early in WinMain.
+	static JobSystem& Get();
+	//one of its own, e.g. to measure with fewer threads without disturbing the one everything else uses
+	explicit JobSystem(int numWorkers = -1);
+	~JobSystem();
+	/*
+	* (re)start the workers, nothing can be running. The calling thread becomes the main thread.
+	* numWorkers - IN threads besides the main one, -1 for one per core
+	*/
+	void Start(int numWorkers = -1);
+	//finish the workers off
+	void Stop();
+	//workers plus the main thread
+	int GetNumThreads() const {
+		return (int)mWorkers.size() + 1;
+	}
+
+	/*
+	* queue jobs, they may start straight away
+	* jobs - IN count of them, see Job
+	* counter - IN goes up by count, and down as each finishes
+	* pDependsOn - IN if not null they don't start until it reaches zero
+	*/
+	void Run(Job jobs[], int count, Counter& counter, Counter* pDependsOn = nullptr);
+	//run jobs on this thread until the counter reaches zero
+	void Wait(Counter& counter);
+
+	//per thread, the main thread first
+	void GetStats(std::vector<ThreadStats>& out) const;
+	void ResetStats();
+
+	/*
+	* how well work spreads as threads are added - a compute heavy loop and a memory heavy one
+	* with 1 thread up to all of them, plus the cost of an empty job and of a chain of stages
+	* waiting on each other. Results go to DBOUT.
+	* numElements - IN size of the loops
+	* numRepeats - IN times each is run
+	* returns - compute loop speed up with every thread
+	*/
+	static double Benchmark(int numElements, int numRepeats);
+
+private:
+	//one thread's queue. The owner pushes and pops the bottom, anyone can steal from the top.
+	struct Deque
+	{
+		alignas(64) std::atomic<long long> top{ 0 };		//apart, thieves only touch top
+		alignas(64) std::atomic<long long> bottom{ 0 };
+		std::atomic<Job*> jobs[QUEUE_SIZE];
+		//owner only, false if it's full
+		bool Push(Job* pJob);
+		Job* Pop();
+		//lost is set if there was a job but someone else got it
+		Job* Steal(bool& lost);
+	};
+	//stats, one per cache line so threads don't fight over them
+	struct alignas(64) Slot
+	{
+		Deque queue;
+		std::atomic<long long> jobs{ 0 }, steals{ 0 }, failedSteals{ 0 };
+		std::atomic<long long> idleNs{ 0 };
+	};
+
+	std::vector<std::thread> mWorkers;
+	std::thread::id mMainThread;		//slot 0, the one that called Start
+	std::vector<Slot*> mSlots;			//main thread then workers
+	std::mutex mSharedLock;
+	std::deque<Job*> mShared;			//from threads that aren't ours
+	std::atomic<int> mNumShared{ 0 };	//so workers only lock it when there's something there
+	std::atomic<int> mPending{ 0 };		//queued and not yet taken, so workers know whether to sleep
+	std::atomic<int> mNumSleeping{ 0 };
+	std::mutex mSleepLock;
+	std::condition_variable mWake;
+	std::atomic<bool> mQuit{ false };
+
+	void Push(Job* pJob);
+	//the next job for a thread (-1 if it isn't one of ours), nullptr if there's none anywhere
+	Job* Find(int thread);
+	void Execute(Job& job, int thread);
+	void WorkerLoop(int thread);
+	//this thread's number in this system, -1 if it isn't one of ours
+	int ThisThread() const;
+};
+
+#endif
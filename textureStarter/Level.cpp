@@ -0,0 +1,354 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+
+#include "Level.h"
+#include "D3D.h"
+#include "FX.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+#include "WindowUtils.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+//read a byte from every page so the OS loads the whole file now
+static void PageIn(const MappedFile& file)
+{
+	const unsigned char* p = (const unsigned char*)file.GetData();
+	unsigned int sum = 0;
+	for (size_t i = 0; i < file.GetSize(); i += 4096)
+		sum += p[i];
+	volatile unsigned int sink = sum;
+	(void)sink;
+}
+
+static string GetName(const SceneFile::NameRecord& r)
+{
+	//might not be terminated in a bad file
+	return string(r.name, strnlen(r.name, SceneFile::MAX_NAME));
+}
+
+bool Level::Load(const string& fileName)
+{
+	Release();
+	typedef chrono::high_resolution_clock Clock;
+	Clock::time_point start = Clock::now();
+	MappedFile file;
+	if (!file.Open(fileName))
+	{
+		DBOUT("Cannot open scene " << fileName);
+		return false;
+	}
+	const SceneFile::Header* pHdr = SceneFile::Validate(file.GetData(), file.GetSize());
+	if (!pHdr)
+	{
+		DBOUT("Not a valid version " << SceneFile::VERSION << " scene file " << fileName);
+		return false;
+	}
+	Clock::time_point validated = Clock::now();
+
+	//meshes already in the library are just looked up, the rest are mesh files
+	MyD3D& d3d = WinUtil::Get().GetD3D();
+	MeshMgr& meshMgr = d3d.GetMeshMgr();
+	const SceneFile::NameRecord* pMeshNames = SceneFile::GetRecords<SceneFile::NameRecord>(*pHdr, pHdr->meshOffset);
+	vector<string> meshNames(pHdr->numMeshes);
+	vector<MeshHandle> meshes(pHdr->numMeshes);
+	vector<int> toLoad;
+	for (unsigned int i = 0; i < pHdr->numMeshes; ++i)
+	{
+		meshNames[i] = GetName(pMeshNames[i]);
+		if (Mesh* pMesh = meshMgr.FindMesh(meshNames[i]))
+			meshes[i] = pMesh->GetHandle();
+		else
+			toLoad.push_back(i);
+	}
+	//open and page in the files on all the cores, only creating the meshes needs the main thread
+	unique_ptr<MappedFile[]> files(new MappedFile[toLoad.size()]);
+	vector<unsigned char> opened(toLoad.size(), 0);
+	ParallelFor((int)toLoad.size(), 1, [&](int begin, int end) {
+		for (int n = begin; n < end; ++n)
+			if (files[n].Open(meshNames[toLoad[n]]))
+			{
+				PageIn(files[n]);
+				opened[n] = 1;
+			}
+	});
+	for (size_t n = 0; n < toLoad.size(); ++n)
+	{
+		const string& name = meshNames[toLoad[n]];
+		Mesh* pMesh = opened[n] ? meshMgr.LoadMesh(files[n], name) : nullptr;
+		files[n].Close();
+		if (!pMesh)
+		{
+			DBOUT("Scene " << fileName << " can't load mesh " << name);
+			return false;
+		}
+		meshes[toLoad[n]] = pMesh->GetHandle();
+	}
+	vector<int> meshFormats(pHdr->numMeshes);
+	unsigned int formatsUsed = 0;
+	for (unsigned int i = 0; i < pHdr->numMeshes; ++i)
+	{
+		meshFormats[i] = meshMgr.GetMesh(meshes[i])->GetVertexFormat();
+		formatsUsed |= 1 << meshFormats[i];
+	}
+
+	//textures come from the asset folder, the cache only loads each one once
+	const SceneFile::NameRecord* pTexNames = SceneFile::GetRecords<SceneFile::NameRecord>(*pHdr, pHdr->textureOffset);
+	vector<string> texNames(pHdr->numTextures);
+	vector<ID3D11ShaderResourceView*> textures(pHdr->numTextures);
+	for (unsigned int i = 0; i < pHdr->numTextures; ++i)
+	{
+		texNames[i] = GetName(pTexNames[i]);
+		textures[i] = d3d.GetCache().LoadTexture(&d3d.GetDevice(), texNames[i]);
+	}
+
+	//each material is compiled for every vertex format the meshes use, so objects can just point at one
+	const SceneFile::MaterialRecord* pMaterials = SceneFile::GetRecords<SceneFile::MaterialRecord>(*pHdr, pHdr->materialOffset);
+	mMaterials.resize(pHdr->numMaterials * VertexFormat::MAX_FORMATS);
+	for (unsigned int i = 0; i < pHdr->numMaterials; ++i)
+	{
+		const SceneFile::MaterialRecord& r = pMaterials[i];
+		Material mat;
+		mat.gfxData = r.gfxData;
+		mat.texTrsfm.scale = Vector2(r.texScale[0], r.texScale[1]);
+		mat.texTrsfm.angle = r.texAngle;
+		mat.texTrsfm.translate = Vector2(r.texTranslate[0], r.texTranslate[1]);
+		mat.flags = r.flags;
+		mat.SetBlendFactors(r.blendFactors[0], r.blendFactors[1], r.blendFactors[2], r.blendFactors[3]);
+		mat.name.assign(r.name, strnlen(r.name, SceneFile::MAX_NAME));
+		if (r.texture >= 0)
+		{
+			mat.texture = texNames[r.texture];
+			mat.pTextureRV = textures[r.texture];
+		}
+		for (int fmt = 0; fmt < VertexFormat::MAX_FORMATS; ++fmt)
+			if (formatsUsed & (1 << fmt))
+			{
+				Material& compiled = mMaterials[i * VertexFormat::MAX_FORMATS + fmt];
+				compiled = mat;
+				d3d.GetFX().CompileMaterial(compiled, fmt);
+			}
+	}
+	Clock::time_point resolved = Clock::now();
+
+	//all the transforms at once, then everything else straight from the file on all the cores
+	const int numObjects = (int)pHdr->numObjects;
+	const SceneFile::ObjectRecord* pObjects = SceneFile::GetRecords<SceneFile::ObjectRecord>(*pHdr, pHdr->objectOffset);
+	TransformStore& store = d3d.GetTransforms();
+	vector<TransformHandle> transforms(numObjects);
+	store.Add(numObjects, transforms.data());
+	mModels.resize(numObjects);
+	mModelMats.resize(numObjects);
+	ParallelFor(numObjects, 4096, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+		{
+			const SceneFile::ObjectRecord& r = pObjects[i];
+			mModels[i].Initialise(meshes[r.mesh], transforms[i]);
+			store.SetPosition(transforms[i], Vector3(r.pos));
+			store.SetRotation(transforms[i], Quaternion(r.rot[0], r.rot[1], r.rot[2], r.rot[3]));
+			store.SetScale(transforms[i], Vector3(r.scale));
+			mModelMats[i] = (r.material < 0) ? nullptr : &mMaterials[r.material * VertexFormat::MAX_FORMATS + meshFormats[r.mesh]];
+		}
+	});
+
+	const SceneFile::LightRecord* pLights = SceneFile::GetRecords<SceneFile::LightRecord>(*pHdr, pHdr->lightOffset);
+	mLights.assign(pLights, pLights + pHdr->numLights);
+
+	//each texture the sprites use has its frames looked up once
+	const SceneFile::SpriteRecord* pSprites = SceneFile::GetRecords<SceneFile::SpriteRecord>(*pHdr, pHdr->spriteOffset);
+	vector<int> spriteTextures(pHdr->numTextures, -1);
+	mSpriteHandles.resize(pHdr->numSprites);
+	for (unsigned int i = 0; i < pHdr->numSprites; ++i)
+	{
+		const SceneFile::SpriteRecord& r = pSprites[i];
+		if (spriteTextures[r.texture] < 0)
+			spriteTextures[r.texture] = mSprites.AddTexture(d3d.GetCache().Get(textures[r.texture]));
+		SpriteHandle h = mSprites.Add(spriteTextures[r.texture], Vector2(r.pos));
+		if (r.frame >= 0 && r.frame < mSprites.GetNumFrames(spriteTextures[r.texture]))
+			mSprites.SetFrame(h, r.frame);
+		else if (r.texRect[2] > r.texRect[0] && r.texRect[3] > r.texRect[1])
+			mSprites.SetTexRect(h, RECTF{ r.texRect[0], r.texRect[1], r.texRect[2], r.texRect[3] });
+		mSprites.SetScale(h, Vector2(r.scale));
+		mSprites.SetOrigin(h, Vector2(r.origin));
+		mSprites.SetRotation(h, r.rotation);
+		mSprites.SetDepth(h, r.depth);
+		mSprites.SetColour(h, Vector4(r.colour));
+		mSpriteHandles[i] = h;
+	}
+	Clock::time_point end = Clock::now();
+
+	typedef chrono::duration<double, milli> Ms;
+	DBOUT("Loaded scene " << fileName << " (" << file.GetSize() << " bytes, " << numObjects << " objects, "
+		<< mSprites.GetNumSprites() << " sprites) in " << Ms(end - start).count() << "ms - validate " << Ms(validated - start).count()
+		<< "ms, meshes/textures/materials " << Ms(resolved - validated).count() << "ms, objects/sprites " << Ms(end - resolved).count() << "ms");
+	return true;
+}
+
+void Level::Release()
+{
+	mModels.clear();
+	mModelMats.clear();
+	mMaterials.clear();
+	mLights.clear();
+	mSprites = SpriteSystem();
+	mSpriteHandles.clear();
+}
+
+void Level::SetupLights(FX::MyFX& fx) const
+{
+	for (const SceneFile::LightRecord& l : mLights)
+		switch (l.type)
+		{
+		case SceneFile::LightType::DIRECTIONAL:
+			fx.SetupDirectionalLight(l.index, l.enable != 0, Vector3(l.direction), Vector3(l.diffuse), Vector3(l.ambient), Vector3(l.specular));
+			break;
+		case SceneFile::LightType::POINT:
+			fx.SetupPointLight(l.index, l.enable != 0, Vector3(l.position), Vector3(l.diffuse), Vector3(l.ambient), Vector3(l.specular),
+				l.range, l.atten1);
+			break;
+		case SceneFile::LightType::SPOT:
+			fx.SetupSpotLight(l.index, l.enable != 0, Vector3(l.position), Vector3(l.direction), Vector3(l.diffuse), Vector3(l.ambient),
+				Vector3(l.specular), l.range, l.atten1, l.innerConeTheta, l.outerConePhi);
+			break;
+		}
+}
+
+void Level::Submit(FX::MyFX& fx)
+{
+	for (size_t i = 0; i < mModels.size(); ++i)
+		fx.Submit(mModels[i], mModelMats[i]);
+}
+
+void Level::DrawSprites(SpriteBatch& batch)
+{
+	mSprites.Draw(batch);
+}
+
+void Level::DrawSprites(SpriteRenderer& renderer)
+{
+	mSprites.Draw(renderer);
+}
+
+double Level::Benchmark(int numObjects)
+{
+	MyD3D& d3d = WinUtil::Get().GetD3D();
+	MeshMgr& meshMgr = d3d.GetMeshMgr();
+	//any meshes that can be found by name
+	SceneFile::Desc desc;
+	for (int i = 0; i < meshMgr.GetNumMeshes() && desc.meshes.size() < 8; ++i)
+	{
+		Mesh& mesh = meshMgr.GetMeshAt(i);
+		if (meshMgr.FindMesh(mesh.mName) == &mesh && mesh.mName.size() < SceneFile::MAX_NAME)
+			desc.meshes.push_back(mesh.mName);
+	}
+	if (desc.meshes.empty())
+	{
+		DBOUT("Level benchmark needs some meshes in the library");
+		return 0;
+	}
+	desc.textures.push_back("floor.dds");
+
+	mt19937 rng(1234);
+	uniform_real_distribution<float> unit(0, 1);
+	const int numMaterials = 16;
+	for (int m = 0; m < numMaterials; ++m)
+	{
+		Material mat;
+		Vector4 colour(unit(rng), unit(rng), unit(rng), 1);
+		mat.gfxData.Set(colour, colour, Vector4(0.5f, 0.5f, 0.5f, 20));
+		mat.name = "benchmark" + to_string(m);
+		desc.materials.push_back(SceneFile::MakeMaterialRecord(mat, (m % 4) ? -1 : 0));
+	}
+	//a square of objects, a few keeping their mesh's materials
+	int side = (int)ceilf(sqrtf((float)numObjects));
+	desc.objects.resize(numObjects);
+	for (int i = 0; i < numObjects; ++i)
+	{
+		SceneFile::ObjectRecord& o = desc.objects[i];
+		o.mesh = i % (int)desc.meshes.size();
+		o.material = (i % 5) ? (int)(rng() % numMaterials) : -1;
+		Vector3 pos((float)(i % side) * 3, 0, (float)(i / side) * 3);
+		Quaternion rot = TransformStore::FromEuler(Vector3(0, unit(rng) * 2 * PI, 0));
+		float scale = 0.5f + unit(rng);
+		memcpy(o.pos, &pos, sizeof(o.pos));
+		memcpy(o.rot, &rot, sizeof(o.rot));
+		o.scale[0] = o.scale[1] = o.scale[2] = scale;
+	}
+	SceneFile::LightRecord light;
+	memset(&light, 0, sizeof(light));
+	light.type = SceneFile::LightType::DIRECTIONAL;
+	light.enable = 1;
+	light.direction[0] = light.direction[1] = -0.7f;
+	light.direction[2] = 0.7f;
+	light.diffuse[0] = light.diffuse[1] = light.diffuse[2] = 0.5f;
+	desc.lights.push_back(light);
+	for (int i = 0; i < numObjects / 100; ++i)
+	{
+		SceneFile::SpriteRecord s;
+		memset(&s, 0, sizeof(s));
+		s.frame = -1;
+		s.pos[0] = unit(rng) * 1000;
+		s.pos[1] = unit(rng) * 1000;
+		s.scale[0] = s.scale[1] = 0.1f;
+		s.colour[0] = s.colour[1] = s.colour[2] = s.colour[3] = 1;
+		desc.sprites.push_back(s);
+	}
+	//out of the way of the game's own files
+	const string fileName = (filesystem::temp_directory_path() / "benchmark.scene").string();
+	if (!SceneFile::Save(fileName, desc))
+		return 0;
+
+	typedef chrono::high_resolution_clock Clock;
+	typedef chrono::duration<double> Secs;
+	double loadSecs, oldSecs;
+	{
+		Level level;
+		Clock::time_point start = Clock::now();
+		bool loaded = level.Load(fileName);
+		loadSecs = Secs(Clock::now() - start).count();
+		assert(loaded);
+	}
+	//the way Game sets up models, one at a time each with its own copy of a material
+	{
+		vector<Material> mats(numMaterials);
+		for (int m = 0; m < numMaterials; ++m)
+		{
+			mats[m].gfxData = desc.materials[m].gfxData;
+			if (desc.materials[m].texture >= 0)
+			{
+				mats[m].texture = desc.textures[0];
+				mats[m].pTextureRV = d3d.GetCache().LoadTexture(&d3d.GetDevice(), mats[m].texture);
+			}
+		}
+		vector<Mesh*> pMeshes;
+		for (const string& name : desc.meshes)
+			pMeshes.push_back(meshMgr.FindMesh(name));
+		vector<Model> models(numObjects);
+		Clock::time_point start = Clock::now();
+		for (int i = 0; i < numObjects; ++i)
+		{
+			const SceneFile::ObjectRecord& o = desc.objects[i];
+			Model& model = models[i];
+			model.Initialise(*pMeshes[o.mesh]);
+			model.SetPosition(Vector3(o.pos));
+			model.SetRotation(Quaternion(o.rot[0], o.rot[1], o.rot[2], o.rot[3]));
+			model.SetScale(Vector3(o.scale));
+			if (o.material >= 0)
+				model.SetOverrideMat(&mats[o.material]);
+		}
+		oldSecs = Secs(Clock::now() - start).count();
+	}
+	remove(fileName.c_str());
+
+	DBOUT("Level benchmark, " << numObjects << " objects " << desc.sprites.size() << " sprites: loaded from a scene file in "
+		<< loadSecs * 1000 << "ms, set up one at a time (no file) in " << oldSecs * 1000 << "ms, "
+		<< oldSecs / loadSecs << "x quicker");
+	return numObjects / loadSecs;
+}
@@ -0,0 +1,78 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+#include <string>
+#include <vector>
+
+#include "Model.h"
+#include "SpriteSystem.h"
+#include "SceneFile.h"
+
+/*
+A whole level loaded from a scene file (see SceneFile) rather than built in code.
+Each name in the file is resolved once - meshes already in the library are looked up,
+the rest are mesh files that are opened and paged in on all the cores before being
+created - and then every object is instantiated in one go: one TransformStore::Add for
+the lot, and the models, their transforms and materials filled in parallel straight from
+the mapped file. Models sit next to each other in one array, in file order.
+Materials in the file are compiled once for each vertex format and shared.
+*/
+class Level
+{
+public:
+	~Level() {
+		Release();
+	}
+	/*
+	* load a scene file, replacing whatever was loaded before
+	* fileName - IN the file to load
+	* returns - false if it's missing, not a valid scene file or a mesh it needs can't be loaded
+	*/
+	bool Load(const std::string& fileName);
+	//drop everything, the meshes and textures stay in their libraries
+	void Release();
+	//turn on the file's lights (they replace whatever was using the same light numbers)
+	void SetupLights(FX::MyFX& fx) const;
+	//queue every model for drawing, see MyFX::Submit
+	void Submit(FX::MyFX& fx);
+	//between SpriteBatch Begin and End
+	void DrawSprites(DirectX::SpriteBatch& batch);
+	//or between SpriteRenderer Begin and End
+	void DrawSprites(SpriteRenderer& renderer);
+
+	//getters
+	int GetNumModels() const {
+		return (int)mModels.size();
+	}
+	Model& GetModel(int i) {
+		return mModels.at(i);
+	}
+	//the file's sprites, in file order
+	int GetNumSprites() const {
+		return (int)mSpriteHandles.size();
+	}
+	SpriteHandle GetSprite(int i) const {
+		return mSpriteHandles.at(i);
+	}
+	SpriteSystem& GetSprites() {
+		return mSprites;
+	}
+
+	/*
+	* write a scene of lots of objects using the meshes already in the library to the temp folder, then time loading
+	* it against setting up the same models one at a time. Needs the device. Results go to DBOUT.
+	* numObjects - IN how many models
+	* returns - objects loaded per second
+	*/
+	static double Benchmark(int numObjects);
+
+private:
+	std::vector<Model> mModels;
+	std::vector<Material*> mModelMats;		//per model, nullptr for the mesh's own
+	std::vector<Material> mMaterials;		//the file's, VertexFormat::MAX_FORMATS each, compiled for the formats used
+	std::vector<SceneFile::LightRecord> mLights;
+	SpriteSystem mSprites;
+	std::vector<SpriteHandle> mSpriteHandles;
+};
+
+#endif
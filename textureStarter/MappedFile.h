@@ -0,0 +1,36 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <windows.h>
+
+/*
+Read only view of a whole file, the OS pages it in as it's touched
+and there's no copy into a buffer of our own
+*/
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile() {
+		Close();
+	}
+	//false if the file is missing or empty
+	bool Open(const std::string& fileName);
+	void Close();
+	const void* GetData() const {
+		return mpData;
+	}
+	size_t GetSize() const {
+		return mSize;
+	}
+private:
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = nullptr;
+	const void* mpData = nullptr;
+	size_t mSize = 0;
+};
+
+#endif
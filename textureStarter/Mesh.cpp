@@ -1,58 +1,659 @@
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <filesystem>
+#include <fstream>
+
 #include "Mesh.h"
 #include "D3DUtil.h"
 #include "FX.h"
 #include "D3D.h"
 #include "WindowUtils.h"
+#include "MeshOptimiser.h"
+#include "MeshFile.h"
+#include "MappedFile.h"
+#include "MeshImport.h"
 
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
 
 void SubMesh::Release()
 {
-	ReleaseCOM(mpVB);
-	ReleaseCOM(mpIB);
+	//the buffers belong to the MeshMgr
+	mpVB = mpIB = nullptr;
+	mBaseVertex = mStartIndex = 0;
 	mNumIndices = mNumVerts = 0;
 }
 
 Mesh& MeshMgr::GetMesh(const std::string& name)
 {
-	Meshes::iterator it = mMeshes.find(name);
-	assert(it != mMeshes.end());
-	return *(*it).second;
+	Mesh* p = FindMesh(name);
+	assert(p);
+	return *p;
 }
 
+Mesh* MeshMgr::FindMesh(const std::string& name)
+{
+	MeshNames::iterator it = mNames.find(name);
+	return (it != mNames.end()) ? mMeshes.Get((*it).second) : nullptr;
+}
 
-Mesh& MeshMgr::CreateMesh(const std::string& name)
+Mesh& MeshMgr::CreateMesh(const std::string& name, bool findByName)
 {
-	Meshes::iterator it = mMeshes.find(name);
-	assert(it == mMeshes.end());
+	MeshHandle h = mMeshes.Add(name, *this);
+	Mesh& mesh = *mMeshes.Get(h);
+	mesh.mHandle = h;
+	if (findByName)
+	{
+		assert(mNames.find(name) == mNames.end());
+		mNames[name] = h;
+	}
+	return mesh;
+}
 
-	Mesh *p = new Mesh(name);
-	mMeshes[name] = p;
-	return *p;
+void MeshMgr::ReleaseMesh(MeshHandle h)
+{
+	Mesh* p = mMeshes.Get(h);
+	assert(p);
+	MeshNames::iterator it = mNames.find(p->mName);
+	if (it != mNames.end() && (*it).second == h)
+		mNames.erase(it);
+	mMeshes.Remove(h);
 }
 
-void MeshMgr::Release()
+void MeshMgr::ReleaseMesh(const std::string& name)
+{
+	ReleaseMesh(GetMesh(name).GetHandle());
+}
+
+unsigned int MeshMgr::AllocSubMeshes(int count)
 {
-	for (auto it : mMeshes)
+	assert(count > 0);
+	unsigned int first;
+	if (!mSubMeshAlloc.Allocate(count, first))
+	{
+		//double the pool, submesh references held now go bad
+		unsigned int capacity = mSubMeshAlloc.GetCapacity();
+		capacity = (capacity * 2 > capacity + count) ? capacity * 2 : capacity + count;
+		mSubMeshPool.resize(capacity);
+		mSubMeshAlloc.Grow(capacity);
+		bool ok = mSubMeshAlloc.Allocate(count, first);
+		assert(ok);
+	}
+	for (int i = 0; i < count; ++i)
+		mSubMeshPool[first + i] = SubMesh();
+	return first;
+}
+
+void MeshMgr::FreeSubMeshes(unsigned int first, int count)
+{
+	for (int i = 0; i < count; ++i)
+		mSubMeshPool[first + i].Release();
+	mSubMeshAlloc.Free(first, count);
+}
+
+Mesh* MeshMgr::LoadMesh(const std::string& fileName, const std::string& name)
+{
+	const std::string& meshName = name.empty() ? fileName : name;
+	if (Mesh* pMesh = FindMesh(meshName))
+		return pMesh;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	MappedFile file;
+	if (!file.Open(fileName))
+	{
+		DBOUT("Cannot open mesh " << fileName);
+		return nullptr;
+	}
+	Mesh* pMesh = LoadMesh(file, meshName);
+	if (!pMesh)
+	{
+		DBOUT("Not a valid version " << MeshFile::VERSION << " mesh file " << fileName);
+		return nullptr;
+	}
+	std::chrono::duration<double, std::milli> ms = std::chrono::high_resolution_clock::now() - start;
+	DBOUT("Loaded mesh " << fileName << " (" << file.GetSize() << " bytes) in " << ms.count() << "ms");
+	return pMesh;
+}
+
+Mesh* MeshMgr::LoadMesh(const MappedFile& file, const std::string& name)
+{
+	const MeshFile::Header* pHdr = MeshFile::Validate(file.GetData(), file.GetSize());
+	if (!pHdr)
+		return nullptr;
+
+	//the streams point straight into the mapped file
+	const char* pBase = (const char*)file.GetData();
+	MeshStreams streams;
+	streams.pVerts = pBase + pHdr->vertexOffset;
+	streams.numVerts = pHdr->numVerts;
+	streams.vertexFormat = pHdr->vertexFormat;
+	streams.pIndices = pBase + pHdr->indexOffset;
+	streams.numIndices = pHdr->numIndices;
+	streams.indexFormat = (pHdr->indexSize == 2) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	streams.boundsMin = Vector3(pHdr->boundsMin);
+	streams.boundsMax = Vector3(pHdr->boundsMax);
+
+	MyD3D& d3d = WinUtil::Get().GetD3D();
+	const MeshFile::SubMeshRecord* pRecords = (const MeshFile::SubMeshRecord*)(pBase + pHdr->subMeshOffset);
+	std::vector<SubMeshDesc> descs(pHdr->numSubMeshes);
+	for (unsigned int i = 0; i < pHdr->numSubMeshes; ++i)
+	{
+		const MeshFile::SubMeshRecord& r = pRecords[i];
+		SubMeshDesc& d = descs[i];
+		d.startIndex = r.startIndex;
+		d.numIndices = r.numIndices;
+		Material& mat = d.material;
+		mat.gfxData = r.gfxData;
+		mat.texTrsfm.scale = Vector2(r.texScale[0], r.texScale[1]);
+		mat.texTrsfm.angle = r.texAngle;
+		mat.texTrsfm.translate = Vector2(r.texTranslate[0], r.texTranslate[1]);
+		mat.flags = r.flags;
+		mat.SetBlendFactors(r.blendFactors[0], r.blendFactors[1], r.blendFactors[2], r.blendFactors[3]);
+		//the strings might not be terminated in a bad file
+		mat.name.assign(r.name, strnlen(r.name, MeshFile::MAX_NAME));
+		mat.texture.assign(r.texture, strnlen(r.texture, MeshFile::MAX_NAME));
+		if (!mat.texture.empty())
+			mat.pTextureRV = d3d.GetCache().LoadTexture(&d3d.GetDevice(), mat.texture, "", (mat.flags & Material::TFlags::APPEND_PATH) != 0);
+	}
+
+	Mesh& mesh = CreateMesh(name);
+	mesh.CreateFrom(streams, descs.data(), (int)descs.size());
+	return &mesh;
+}
+
+Mesh* MeshMgr::ImportMesh(const std::string& fileName, const std::string& cacheFileName)
+{
+	if (Mesh* pMesh = FindMesh(fileName))
+		return pMesh;
+	if (!cacheFileName.empty() && std::filesystem::exists(cacheFileName))
+		if (Mesh* pMesh = LoadMesh(cacheFileName, fileName))
+			return pMesh;
+
+	MeshImport::Result result;
+	if (!MeshImport::Load(fileName, result))
+		return nullptr;
+
+	MyD3D& d3d = WinUtil::Get().GetD3D();
+	std::vector<SubMeshDesc> descs(result.groups.size());
+	for (size_t i = 0; i < descs.size(); ++i)
+	{
+		const MeshImport::Group& g = result.groups[i];
+		const MeshImport::ImportMaterial& im = result.materials[g.material];
+		SubMeshDesc& d = descs[i];
+		d.startIndex = g.startIndex;
+		d.numIndices = g.numIndices;
+		Material& mat = d.material;
+		mat.name = im.name;
+		mat.gfxData.Set(im.diffuse, im.ambient, im.specular);
+		//the importer gives complete texture paths
+		mat.flags &= ~Material::TFlags::APPEND_PATH;
+		//the texture cache only loads dds files
+		if (!im.texture.empty())
+		{
+			if (std::filesystem::path(im.texture).extension() == ".dds" && std::filesystem::exists(im.texture))
+			{
+				mat.texture = im.texture;
+				mat.pTextureRV = d3d.GetCache().LoadTexture(&d3d.GetDevice(), im.texture, "", false);
+			}
+			else
+				DBOUT("Cannot use texture " << im.texture << " (dds only), " << mat.name << " will be untextured");
+		}
+		if (im.transparent)
+		{
+			if (mat.pTextureRV)
+				mat.flags |= Material::TFlags::ALPHA_TRANSPARENCY;
+			else
+			{
+				mat.flags |= Material::TFlags::TRANSPARENCY;
+				mat.SetBlendFactors(im.diffuse.w, im.diffuse.w, im.diffuse.w, 1);
+			}
+		}
+	}
+
+	std::vector<unsigned char> vertData;
+	std::vector<unsigned int> indexData;
+	MeshStreams streams;
+	Mesh::PrepareGeometry(fileName, result.verts.data(), (int)result.verts.size(), result.indices.data(), (int)result.indices.size(),
+		descs.data(), (int)descs.size(), mVertexFormat, mOptimiseOnCreate, vertData, indexData, streams);
+	Mesh& mesh = CreateMesh(fileName);
+	mesh.CreateFrom(streams, descs.data(), (int)descs.size());
+	if (!cacheFileName.empty())
+		MeshFile::Save(cacheFileName, streams, descs.data(), (int)descs.size());
+	return &mesh;
+}
+
+double MeshMgr::BenchmarkLoading(int gridSize)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	typedef std::chrono::duration<double> Secs;
+	//the OBJ benchmark's grid as a file, imported once to write the mesh file
+	const std::string objFile = "benchmark_grid.obj", meshFile = "benchmark_grid.mesh";
+	{
+		std::string text = MeshImport::MakeTestOBJ(gridSize);
+		std::ofstream out(objFile, std::ios::binary);
+		out.write(text.data(), text.size());
+		if (!out)
+		{
+			DBOUT("Mesh loading benchmark can't write " << objFile);
+			return 0;
+		}
+	}
+	std::filesystem::remove(meshFile);
+	if (!ImportMesh(objFile, meshFile))
+		return 0;
+	ReleaseMesh(objFile);
+
+	//parsing, welding, optimising and encoding the text then copying it to the gpu
+	Clock::time_point start = Clock::now();
+	bool ok = ImportMesh(objFile) != nullptr;
+	double importSecs = Secs(Clock::now() - start).count();
+	if (ok)
+		ReleaseMesh(objFile);
+	//against mapping the mesh file and copying it straight to the gpu
+	start = Clock::now();
+	ok = LoadMesh(meshFile) != nullptr && ok;
+	double loadSecs = Secs(Clock::now() - start).count();
+	if (FindMesh(meshFile))
+		ReleaseMesh(meshFile);
+
+	std::error_code ec;
+	uintmax_t objBytes = std::filesystem::file_size(objFile, ec), meshBytes = std::filesystem::file_size(meshFile, ec);
+	std::filesystem::remove(objFile, ec);
+	std::filesystem::remove(meshFile, ec);
+	if (!ok)
+		return 0;
+	double speedUp = importSecs / std::max(loadSecs, 1e-9);
+	DBOUT("Mesh loading, " << gridSize << "x" << gridSize << " grid: OBJ (" << objBytes / (1024 * 1024) << "MB) imported in "
+		<< importSecs * 1000 << "ms, mesh file (" << meshBytes / (1024 * 1024) << "MB) loaded in " << loadSecs * 1000
+		<< "ms, " << speedUp << " times quicker");
+	return speedUp;
+}
+
+double MeshMgr::BenchmarkStorage(int numMeshes)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	//the new way, packed with handles and a name index
+	MeshMgr mgr;
+	std::vector<std::string> names(numMeshes);
+	std::vector<MeshHandle> handles(numMeshes);
+	for (int i = 0; i < numMeshes; ++i)
+	{
+		names[i] = "mesh" + std::to_string(i);
+		handles[i] = mgr.CreateMesh(names[i]).GetHandle();
+	}
+	//the old way, one allocation each found through their names
+	std::unordered_map<std::string, Mesh*> oldMeshes;
+	for (int i = 0; i < numMeshes; ++i)
+		oldMeshes[names[i]] = new Mesh(names[i], mgr);
+
+	//read what rendering would
+	auto visit = [](Mesh& m) {
+		return m.GetNumSubMeshes() + m.GetVertexFormat() + m.GetBoundsMax().x - m.GetBoundsMin().x;
+	};
+	const int passes = 10;
+	float sum = 0;
+	Clock::time_point t0 = Clock::now();
+	for (int p = 0; p < passes; ++p)
+		for (Mesh& m : mgr.mMeshes)
+			sum += visit(m);
+	Clock::time_point t1 = Clock::now();
+	for (int p = 0; p < passes; ++p)
+		for (auto& it : oldMeshes)
+			sum += visit(*it.second);
+	Clock::time_point t2 = Clock::now();
+	for (int p = 0; p < passes; ++p)
+		for (MeshHandle h : handles)
+			sum += visit(*mgr.GetMesh(h));
+	Clock::time_point t3 = Clock::now();
+	for (int p = 0; p < passes; ++p)
+		for (const std::string& name : names)
+			sum += visit(*(*oldMeshes.find(name)).second);
+	Clock::time_point t4 = Clock::now();
+
+	std::chrono::duration<double, std::milli> packed = t1 - t0, scattered = t2 - t1, byHandle = t3 - t2, byName = t4 - t3;
+	DBOUT("Mesh storage, " << numMeshes << " meshes x" << passes << ": iterate packed " << packed.count() << "ms, scattered "
+		<< scattered.count() << "ms; lookup by handle " << byHandle.count() << "ms, by name " << byName.count() << "ms (" << sum << ")");
+	for (auto& it : oldMeshes)
 		delete it.second;
-	mMeshes.clear();
+	return scattered.count() / std::max(packed.count(), 1e-6);
+}
+
+void MeshMgr::Release()
+{
+	mMeshes.Clear();
+	mNames.clear();
+	mSubMeshPool.clear();
+	mSubMeshAlloc.Init(0);
+	for (BufferPage& page : mVBPages)
+		ReleaseCOM(page.pBuffer);
+	for (BufferPage& page : mIBPages)
+		ReleaseCOM(page.pBuffer);
+	mVBPages.clear();
+	mIBPages.clear();
+}
+
+void MeshMgr::Alloc(std::vector<BufferPage>& pages, UINT bindFlags, unsigned int pageBytes, const void* pData,
+	unsigned int count, unsigned int elementSize, int& page, unsigned int& offset)
+{
+	assert(count > 0 && pData);
+	page = -1;
+	for (int i = 0; i < (int)pages.size() && page == -1; ++i)
+		if (pages[i].elementSize == elementSize && pages[i].alloc.Allocate(count, offset))
+			page = i;
+
+	if (page == -1)
+	{
+		//no room anywhere, start a new page, big meshes get a page to themselves
+		BufferPage p;
+		p.elementSize = elementSize;
+		unsigned int capacity = pageBytes / elementSize;
+		if (capacity < count)
+			capacity = count;
+		p.alloc.Init(capacity);
+		CreateDefaultBuffer(WinUtil::Get().GetD3D().GetDevice(), capacity * elementSize, bindFlags, p.pBuffer);
+		bool ok = p.alloc.Allocate(count, offset);
+		assert(ok);
+		page = (int)pages.size();
+		pages.push_back(p);
+	}
+
+	//copy our bit in
+	D3D11_BOX box;
+	box.left = offset * elementSize;
+	box.right = (offset + count) * elementSize;
+	box.top = box.front = 0;
+	box.bottom = box.back = 1;
+	WinUtil::Get().GetD3D().GetDeviceCtx().UpdateSubresource(pages[page].pBuffer, 0, &box, pData, 0, 0);
+}
+
+bool NarrowIndices(const unsigned int* pIndices, unsigned int numIndices, unsigned int numVerts, std::vector<unsigned short>& out)
+{
+	if (numVerts >= 65536)
+		return false;
+	out.resize(numIndices);
+	for (unsigned int i = 0; i < numIndices; ++i)
+	{
+		//an index past the vertices would be silently wrapped
+		assert(pIndices[i] < numVerts && pIndices[i] <= 0xffff);
+		out[i] = (unsigned short)pIndices[i];
+	}
+	return true;
+}
+
+void MeshMgr::AllocGeometry(const void* pVerts, unsigned int numVerts, unsigned int vertSize,
+	const void* pIndices, unsigned int numIndices, DXGI_FORMAT indexFormat, GeometryAlloc& alloc)
+{
+	assert(indexFormat == DXGI_FORMAT_R16_UINT || indexFormat == DXGI_FORMAT_R32_UINT);
+	Alloc(mVBPages, D3D11_BIND_VERTEX_BUFFER, VB_PAGE_BYTES, pVerts, numVerts, vertSize, alloc.vbPage, alloc.baseVertex);
+	alloc.numVerts = numVerts;
+	alloc.numIndices = numIndices;
+	alloc.vertexSize = vertSize;
+
+	//indices are relative to the base vertex, so small meshes can always use 16bit
+	unsigned int indexSize = sizeof(unsigned int);
+	std::vector<unsigned short> shortIndices;
+	if (indexFormat == DXGI_FORMAT_R32_UINT && NarrowIndices((const unsigned int*)pIndices, numIndices, numVerts, shortIndices))
+	{
+		indexSize = sizeof(unsigned short);
+		Alloc(mIBPages, D3D11_BIND_INDEX_BUFFER, IB_PAGE_BYTES, shortIndices.data(), numIndices, indexSize, alloc.ibPage, alloc.startIndex);
+		alloc.indexFormat = DXGI_FORMAT_R16_UINT;
+	}
+	else
+	{
+		//already the right size, straight in
+		if (indexFormat == DXGI_FORMAT_R16_UINT)
+			indexSize = sizeof(unsigned short);
+		Alloc(mIBPages, D3D11_BIND_INDEX_BUFFER, IB_PAGE_BYTES, pIndices, numIndices, indexSize, alloc.ibPage, alloc.startIndex);
+		alloc.indexFormat = indexFormat;
+	}
+
+	unsigned int bytes = numVerts * vertSize + numIndices * indexSize;
+	unsigned int fullBytes = numVerts * sizeof(VertexPosNormTex) + numIndices * sizeof(unsigned int);
+	mGeometryBytes += bytes;
+	mGeometryBytesSaved += fullBytes - bytes;
+}
+
+void MeshMgr::UpdateVertices(Mesh& mesh, const void* pVerts)
+{
+	const GeometryAlloc& alloc = mesh.GetGeometry();
+	assert(alloc.vbPage != -1 && pVerts);
+	D3D11_BOX box;
+	box.left = alloc.baseVertex * alloc.vertexSize;
+	box.right = (alloc.baseVertex + alloc.numVerts) * alloc.vertexSize;
+	box.top = box.front = 0;
+	box.bottom = box.back = 1;
+	WinUtil::Get().GetD3D().GetDeviceCtx().UpdateSubresource(GetVB(alloc.vbPage), 0, &box, pVerts, 0, 0);
+}
+
+void MeshMgr::FreeGeometry(GeometryAlloc& alloc)
+{
+	if (alloc.vbPage != -1)
+	{
+		unsigned int indexSize = (alloc.indexFormat == DXGI_FORMAT_R16_UINT) ? sizeof(unsigned short) : sizeof(unsigned int);
+		unsigned int bytes = alloc.numVerts * alloc.vertexSize + alloc.numIndices * indexSize;
+		mGeometryBytes -= bytes;
+		mGeometryBytesSaved -= alloc.numVerts * sizeof(VertexPosNormTex) + alloc.numIndices * sizeof(unsigned int) - bytes;
+	}
+	if (alloc.vbPage != -1)
+		mVBPages.at(alloc.vbPage).alloc.Free(alloc.baseVertex, alloc.numVerts);
+	if (alloc.ibPage != -1)
+		mIBPages.at(alloc.ibPage).alloc.Free(alloc.startIndex, alloc.numIndices);
+	alloc = GeometryAlloc();
+}
+
+Mesh& Mesh::operator=(Mesh&& m)
+{
+	if (this == &m)
+		return *this;
+	Release();
+	mName = std::move(m.mName);
+	mFirstSubMesh = m.mFirstSubMesh;
+	mNumSubMeshes = m.mNumSubMeshes;
+	mpMgr = m.mpMgr;
+	mHandle = m.mHandle;
+	mGeom = m.mGeom;
+	mVertexFormat = m.mVertexFormat;
+	mDequantise = m.mDequantise;
+	mBoundsMin = m.mBoundsMin;
+	mBoundsMax = m.mBoundsMax;
+	//it's ours now, the old one mustn't free it
+	m.mNumSubMeshes = 0;
+	m.mGeom = GeometryAlloc();
+	return *this;
 }
 
 void Mesh::Release()
 {
-	for (int i = 0; i < (int)mSubMeshes.size(); ++i)
-		delete mSubMeshes[i];
-	mSubMeshes.clear();
+	if (!mpMgr)
+		return;
+	if (mNumSubMeshes > 0)
+		mpMgr->FreeSubMeshes(mFirstSubMesh, mNumSubMeshes);
+	mNumSubMeshes = 0;
+	mpMgr->FreeGeometry(mGeom);
 }
 
 void Mesh::CreateFrom(const VertexPosNormTex verts[], int numVerts, const unsigned int indices[], int numIndices, 
 	const Material& mat, int meshStartIndex, int meshNumIndices)
+{
+	SubMeshDesc desc;
+	desc.startIndex = meshStartIndex;
+	desc.numIndices = meshNumIndices;
+	desc.material = mat;
+	CreateFrom(verts, numVerts, indices, numIndices, &desc, 1);
+}
+
+Vector3 Mesh::GetQuantiseSize(const Vector3& boundsMin, const Vector3& boundsMax)
+{
+	//flat meshes (e.g. a quad) have no size on one axis, avoid dividing by zero
+	Vector3 size = boundsMax - boundsMin;
+	size.x = (size.x > VERY_SMALL) ? size.x : 1;
+	size.y = (size.y > VERY_SMALL) ? size.y : 1;
+	size.z = (size.z > VERY_SMALL) ? size.z : 1;
+	return size;
+}
+
+void Mesh::PrepareGeometry(const std::string& name, const VertexPosNormTex verts[], int numVerts, const unsigned int indices[], int numIndices,
+	const SubMeshDesc subMeshes[], int numSubMeshes, int vertexFormat, bool optimise,
+	std::vector<unsigned char>& vertData, std::vector<unsigned int>& indexData, MeshStreams& streams)
+{
+	assert(numVerts > 0 && numIndices > 0 && numSubMeshes > 0);
+	assert(vertexFormat != VertexFormat::SKINNED);
+	for (int i = 0; i < numSubMeshes; ++i)
+		assert(subMeshes[i].startIndex >= 0 && subMeshes[i].startIndex + subMeshes[i].numIndices <= numIndices);
+
+	//reorder for the vertex cache, overdraw and vertex fetch, on copies so the caller's data is left alone
+	std::vector<VertexPosNormTex> optVerts;
+	indexData.assign(indices, indices + numIndices);
+	if (optimise)
+	{
+		MeshOpt::CacheStats before = MeshOpt::AnalyseVertexCache(indices, numIndices, numVerts);
+		//triangles can only move around inside their own submesh
+		std::vector<int> clusters;
+		int numClusters = 0;
+		for (int i = 0; i < numSubMeshes; ++i)
+		{
+			const SubMeshDesc& desc = subMeshes[i];
+			if (desc.numIndices < 3)
+				continue;
+			unsigned int* pRange = indexData.data() + desc.startIndex;
+			MeshOpt::OptimiseVertexCache(indices + desc.startIndex, desc.numIndices, numVerts, pRange, MeshOpt::CACHE_SIZE, &clusters);
+			MeshOpt::OptimiseOverdraw(pRange, desc.numIndices, &verts[0].Pos.x, sizeof(VertexPosNormTex), clusters);
+			numClusters += (int)clusters.size();
+		}
+		MeshOpt::CacheStats after = MeshOpt::AnalyseVertexCache(indexData.data(), numIndices, numVerts);
+
+		std::vector<int> remap;
+		int numUsed = MeshOpt::OptimiseVertexFetch(indexData.data(), numIndices, numVerts, remap);
+		optVerts.resize(numUsed);
+		MeshOpt::RemapVertices(verts, numVerts, remap, optVerts.data());
+		DBOUT("Mesh " << name << " optimised: ACMR " << before.acmr << "->" << after.acmr << ", ATVR " << before.atvr
+			<< "->" << after.atvr << ", " << numClusters << " clusters, " << numVerts - numUsed << " unused verts removed");
+		verts = optVerts.data();
+		numVerts = numUsed;
+	}
+
+	//bounds, needed to quantise positions
+	streams.boundsMin = streams.boundsMax = verts[0].Pos;
+	for (int i = 1; i < numVerts; ++i)
+	{
+		streams.boundsMin = Vector3::Min(streams.boundsMin, verts[i].Pos);
+		streams.boundsMax = Vector3::Max(streams.boundsMax, verts[i].Pos);
+	}
+
+	streams.vertexFormat = vertexFormat;
+	if (vertexFormat == VertexFormat::COMPACT)
+	{
+		Vector3 size = GetQuantiseSize(streams.boundsMin, streams.boundsMax);
+		vertData.resize(numVerts * sizeof(VertexPosNormTexQ));
+		VertexPosNormTexQ* pPacked = (VertexPosNormTexQ*)vertData.data();
+		for (int i = 0; i < numVerts; ++i)
+			pPacked[i] = VertexPosNormTexQ::Encode(verts[i], streams.boundsMin, size);
+	}
+	else
+	{
+		vertData.resize(numVerts * sizeof(VertexPosNormTex));
+		memcpy(vertData.data(), verts, vertData.size());
+	}
+	streams.pVerts = vertData.data();
+	streams.numVerts = numVerts;
+	streams.pIndices = indexData.data();
+	streams.numIndices = numIndices;
+	streams.indexFormat = DXGI_FORMAT_R32_UINT;
+}
+
+void Mesh::CreateFrom(const VertexPosNormTex verts[], int numVerts, const unsigned int indices[], int numIndices,
+	const SubMeshDesc subMeshes[], int numSubMeshes)
+{
+	std::vector<unsigned char> vertData;
+	std::vector<unsigned int> indexData;
+	MeshStreams streams;
+	PrepareGeometry(mName, verts, numVerts, indices, numIndices, subMeshes, numSubMeshes, mpMgr->GetVertexFormat(),
+		mpMgr->GetOptimiseOnCreate(), vertData, indexData, streams);
+	CreateFrom(streams, subMeshes, numSubMeshes);
+}
+
+void Mesh::CreateFrom(const VertexPosNormTexSkin verts[], int numVerts, const unsigned int indices[], int numIndices,
+	const SubMeshDesc subMeshes[], int numSubMeshes, bool cpuSkinned)
+{
+	assert(numVerts > 0 && numIndices > 0 && numSubMeshes > 0);
+	//triangles can move around inside their submesh, the vertices can't move at all
+	std::vector<unsigned int> indexData(indices, indices + numIndices);
+	if (mpMgr->GetOptimiseOnCreate())
+		for (int i = 0; i < numSubMeshes; ++i)
+		{
+			const SubMeshDesc& desc = subMeshes[i];
+			assert(desc.startIndex >= 0 && desc.startIndex + desc.numIndices <= numIndices);
+			if (desc.numIndices >= 3)
+				MeshOpt::OptimiseVertexCache(indices + desc.startIndex, desc.numIndices, numVerts, indexData.data() + desc.startIndex);
+		}
+
+	MeshStreams streams;
+	std::vector<VertexPosNormTex> bindPose;
+	if (cpuSkinned)
+	{
+		bindPose.resize(numVerts);
+		for (int i = 0; i < numVerts; ++i)
+		{
+			bindPose[i].Pos = verts[i].Pos;
+			bindPose[i].Norm = verts[i].Norm;
+			bindPose[i].Tex = verts[i].Tex;
+		}
+		streams.pVerts = bindPose.data();
+		streams.vertexFormat = VertexFormat::FULL;
+	}
+	else
+	{
+		streams.pVerts = verts;
+		streams.vertexFormat = VertexFormat::SKINNED;
+	}
+	//bind pose bounds, an animation can go outside them
+	streams.boundsMin = streams.boundsMax = verts[0].Pos;
+	for (int i = 1; i < numVerts; ++i)
+	{
+		streams.boundsMin = Vector3::Min(streams.boundsMin, verts[i].Pos);
+		streams.boundsMax = Vector3::Max(streams.boundsMax, verts[i].Pos);
+	}
+	streams.numVerts = numVerts;
+	streams.pIndices = indexData.data();
+	streams.numIndices = numIndices;
+	streams.indexFormat = DXGI_FORMAT_R32_UINT;
+	CreateFrom(streams, subMeshes, numSubMeshes);
+}
+
+void Mesh::CreateFrom(const MeshStreams& streams, const SubMeshDesc subMeshes[], int numSubMeshes)
 {
 	Release();
-	SubMesh*p = new SubMesh;
-	mSubMeshes.push_back(p);
-	p->mNumIndices = meshNumIndices;
-	p->mNumVerts = numVerts;
-	p->material = mat;
-	CreateVertexBuffer(WinUtil::Get().GetD3D().GetDevice(),sizeof(VertexPosNormTex)*numVerts, verts, p->mpVB);
-	CreateIndexBuffer(WinUtil::Get().GetD3D().GetDevice(), sizeof(unsigned int)*numIndices, indices, p->mpIB);
+	assert(streams.numVerts > 0 && streams.numIndices > 0 && numSubMeshes > 0);
+	assert(streams.vertexFormat >= 0 && streams.vertexFormat < VertexFormat::MAX_FORMATS);
+
+	mBoundsMin = streams.boundsMin;
+	mBoundsMax = streams.boundsMax;
+	mVertexFormat = streams.vertexFormat;
+	if (mVertexFormat == VertexFormat::COMPACT)
+		mDequantise = Matrix::CreateScale(GetQuantiseSize(mBoundsMin, mBoundsMax)) * Matrix::CreateTranslation(mBoundsMin);
+	else
+		mDequantise = Matrix::Identity;
+	mpMgr->AllocGeometry(streams.pVerts, streams.numVerts, gVertexFormats[mVertexFormat].size, 
+		streams.pIndices, streams.numIndices, streams.indexFormat, mGeom);
+	DBOUT("Mesh " << mName << ": " << streams.numVerts << " verts at " << mGeom.vertexSize << " bytes (full=" << sizeof(VertexPosNormTex)
+		<< "), " << streams.numIndices << " indices at " << ((mGeom.indexFormat == DXGI_FORMAT_R16_UINT) ? 2 : 4) << " bytes");
+
+	mFirstSubMesh = mpMgr->AllocSubMeshes(numSubMeshes);
+	mNumSubMeshes = numSubMeshes;
+	for (int i = 0; i < numSubMeshes; ++i)
+	{
+		assert(subMeshes[i].startIndex >= 0 && subMeshes[i].startIndex + subMeshes[i].numIndices <= (int)streams.numIndices);
+		SubMesh* p = &GetSubMesh(i);
+		p->mpVB = mpMgr->GetVB(mGeom.vbPage);
+		p->mpIB = mpMgr->GetIB(mGeom.ibPage);
+		p->mBaseVertex = mGeom.baseVertex;
+		p->mStartIndex = mGeom.startIndex + subMeshes[i].startIndex;
+		p->mVertexSize = mGeom.vertexSize;
+		p->mIndexFormat = mGeom.indexFormat;
+		p->mNumIndices = subMeshes[i].numIndices;
+		p->mNumVerts = streams.numVerts;
+		p->material = subMeshes[i].material;
+		WinUtil::Get().GetD3D().GetFX().CompileMaterial(p->material, mVertexFormat);
+	}
 }
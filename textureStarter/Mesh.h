@@ -3,13 +3,67 @@
 
 #include <vector>
 #include <unordered_map>
+#include <cassert>
 
 #include "ShaderTypes.h"
+#include "FreeListAllocator.h"
+#include "SlotMap.h"
 
+class Mesh;
+class MeshMgr;
+class MappedFile;
+//how models refer to meshes, see MeshMgr::GetMesh
+typedef Handle<Mesh> MeshHandle;
+
+/*
+Where a mesh's geometry lives inside the big vertex and index
+buffers that the MeshMgr shares out between all meshes
+*/
+struct GeometryAlloc
+{
+	int vbPage = -1, ibPage = -1;		//which shared buffers
+	unsigned int baseVertex = 0;		//first vertex in the vertex buffer
+	unsigned int numVerts = 0;
+	unsigned int startIndex = 0;		//first index in the index buffer
+	unsigned int numIndices = 0;
+	unsigned int vertexSize = 0;		//bytes per vertex
+	DXGI_FORMAT indexFormat = DXGI_FORMAT_R32_UINT;	//16bit if there are few enough vertices
+};
+
+//geometry already in its gpu format, e.g. straight out of a mesh file, see Mesh::PrepareGeometry
+struct MeshStreams
+{
+	const void* pVerts = nullptr;			//in vertexFormat
+	unsigned int numVerts = 0;
+	int vertexFormat = VertexFormat::FULL;
+	const void* pIndices = nullptr;
+	unsigned int numIndices = 0;
+	DXGI_FORMAT indexFormat = DXGI_FORMAT_R32_UINT;	//32bit ones are made 16bit if they fit
+	DirectX::SimpleMath::Vector3 boundsMin, boundsMax;	//local space, compact positions are relative to these
+};
+
+/*
+* make a 16bit copy of 32bit indices, if there are few enough vertices for them to fit
+* pIndices - IN 32bit indices
+* numIndices - IN how many
+* numVerts - IN how many vertices they index
+* out - OUT the 16bit indices, untouched if they don't fit
+* returns - true if they fit
+*/
+bool NarrowIndices(const unsigned int* pIndices, unsigned int numIndices, unsigned int numVerts, std::vector<unsigned short>& out);
+
+//a range of a mesh's indices that all use one material
+struct SubMeshDesc
+{
+	int startIndex = 0;
+	int numIndices = 0;
+	Material material;
+};
 
 /*
 Part of a vertex/index buffer that uses the same
-material (colour and texture).
+material (colour and texture). They live in one pool
+in the MeshMgr, each mesh has a range of them.
 */
 class SubMesh
 {
@@ -19,11 +73,15 @@ public:
 	}
 	void Release();
 
-	//buffer data
+	//buffer data - shared buffers owned by the MeshMgr, don't release
 	ID3D11Buffer* mpVB = nullptr;
 	ID3D11Buffer* mpIB = nullptr;
+	int mBaseVertex = 0;		//where our vertices start in mpVB
+	int mStartIndex = 0;		//where our indices start in mpIB, other submeshes of the mesh share it
 	int mNumIndices = 0;
 	int mNumVerts = 0;
+	UINT mVertexSize = 0;		//stride
+	DXGI_FORMAT mIndexFormat = DXGI_FORMAT_R32_UINT;
 
 	Material material;	//the material describes how the surface reacts to light
 };
@@ -38,28 +96,87 @@ into different parts.
 class Mesh
 {
 public:
-	Mesh(const std::string& name) : mName(name) {}
+	Mesh(const std::string& name, MeshMgr& mgr) : mName(name), mpMgr(&mgr) {}
 	~Mesh() { 
 		Release(); 
 	}
+	//meshes are packed in an array that moves them around, the geometry goes with them
+	Mesh(Mesh&& m) {
+		*this = std::move(m);
+	}
+	Mesh& operator=(Mesh&& m);
 	void Release();
 	/*
-	* configure the geometry inside a mesh
+	* configure the geometry inside a mesh, it's stored in the MeshMgr's current vertex format
+	* and with 16bit indices if there are less than 65536 vertices
+	* all the submeshes share the one vertex and index buffer range, each drawing its own part of the indices
 	* verts - IN an array of local space vertex data
 	* numVerts - IN how many
 	* indices - IN an array of vertex indices that define triangles
 	* numIndices - IN how many
-	* mat - IN a material definining how this geometry reflects light
+	* subMeshes - IN which indices belong to which material
+	* numSubMeshes - IN how many
+	* if the MeshMgr says so the triangles and vertices are reordered first (within each submesh), unused vertices are dropped
 	*/
+	void CreateFrom(const VertexPosNormTex verts[], int numVerts, const unsigned int indices[],
+		int numIndices, const SubMeshDesc subMeshes[], int numSubMeshes);
+	//one material for the meshStartIndex/meshNumIndices range of the indices
 	void CreateFrom(const VertexPosNormTex verts[], int numVerts, const unsigned int indices[],
 		int numIndices, const Material& mat, int meshStartIndex, int meshNumIndices);
+	//geometry that's already been prepared, it goes straight into the gpu buffers without any copying
+	void CreateFrom(const MeshStreams& streams, const SubMeshDesc subMeshes[], int numSubMeshes);
+	/*
+	* a mesh that bends with a skeleton (see Skeleton.h), only the triangle order is optimised, vertices stay
+	* where they are so they still line up with the array the cpu skins from
+	* verts, numVerts, indices, numIndices, subMeshes, numSubMeshes - IN as above
+	* cpuSkinned - IN false: SKINNED vertices and TextureVSSkin does the work, the model needs a palette (Model::SetPalette)
+	*			   true: FULL vertices in the bind pose, replace them each frame with Skinning::SkinVertices and MeshMgr::UpdateVertices
+	*/
+	void CreateFrom(const VertexPosNormTexSkin verts[], int numVerts, const unsigned int indices[],
+		int numIndices, const SubMeshDesc subMeshes[], int numSubMeshes, bool cpuSkinned = false);
+	/*
+	* everything CreateFrom does to raw geometry before it goes to the gpu - optimise, find the bounds, 
+	* encode into the vertex format. Tools use this to write mesh files.
+	* name - IN just for debug output
+	* verts, numVerts, indices, numIndices, subMeshes, numSubMeshes - IN as CreateFrom
+	* vertexFormat - IN see VertexFormat
+	* optimise - IN reorder for the gpu caches, see MeshOptimiser
+	* vertData, indexData - OUT storage for the results
+	* streams - OUT describes the results, points into vertData and indexData
+	*/
+	static void PrepareGeometry(const std::string& name, const VertexPosNormTex verts[], int numVerts, const unsigned int indices[], int numIndices,
+		const SubMeshDesc subMeshes[], int numSubMeshes, int vertexFormat, bool optimise,
+		std::vector<unsigned char>& vertData, std::vector<unsigned int>& indexData, MeshStreams& streams);
+	//compact vertex positions are 0-1 across this size
+	static DirectX::SimpleMath::Vector3 GetQuantiseSize(const DirectX::SimpleMath::Vector3& boundsMin, const DirectX::SimpleMath::Vector3& boundsMax);
 
 	//getters
 	int GetNumSubMeshes() const {
-		return (int)mSubMeshes.size();
+		return mNumSubMeshes;
+	}
+	//don't hold on to it, it can move when meshes are created or released
+	SubMesh& GetSubMesh(int idx);
+	//hold on to this instead of a pointer, see MeshMgr::GetMesh
+	MeshHandle GetHandle() const {
+		return mHandle;
+	}
+	const GeometryAlloc& GetGeometry() const {
+		return mGeom;
+	}
+	//see VertexFormat
+	int GetVertexFormat() const {
+		return mVertexFormat;
+	}
+	//compact vertex positions are 0-1 inside the bounds, this puts them back (identity for full vertices)
+	const DirectX::SimpleMath::Matrix& GetDequantise() const {
+		return mDequantise;
+	}
+	//local space bounding box
+	const DirectX::SimpleMath::Vector3& GetBoundsMin() const {
+		return mBoundsMin;
 	}
-	SubMesh& GetSubMesh(int idx) {
-		return *mSubMeshes.at(idx);
+	const DirectX::SimpleMath::Vector3& GetBoundsMax() const {
+		return mBoundsMax;
 	}
 
 	//give the mesh a name so we can look it up in the library
@@ -67,34 +184,205 @@ public:
 
 
 private:
+	friend class MeshMgr;
 	Mesh(const Mesh& m) = delete;
 	Mesh& operator=(const Mesh& m) = delete;
 	//a mesh can contain multiple surfaces (geometry), each surface having 
-	//potentially different material properties
-	std::vector<SubMesh*> mSubMeshes;
+	//potentially different material properties, they're a range of the MeshMgr's pool
+	unsigned int mFirstSubMesh = 0;
+	int mNumSubMeshes = 0;
+	//the library we live in, it owns the buffers our geometry is in
+	MeshMgr* mpMgr = nullptr;
+	MeshHandle mHandle;
+	GeometryAlloc mGeom;
+	int mVertexFormat = VertexFormat::FULL;
+	DirectX::SimpleMath::Matrix mDequantise;
+	DirectX::SimpleMath::Vector3 mBoundsMin, mBoundsMax;
 };
 
 /*
 A mesh is only ever loaded once, many model instances can use the same
 mesh e.g. one tree mesh used to render 1000 trees, all different sizes,
 orientations, positions.
+All the meshes share a few big vertex and index buffers, each mesh just has
+a range inside them. So when rendering the input assembler rarely needs
+changing and lots of small meshes don't fragment video memory.
+Meshes themselves are packed in a SlotMap and their submeshes in one pool, so
+there's no allocation per mesh. Models keep a MeshHandle, which goes stale
+rather than dangling if the mesh is released. Names are an optional extra.
 */
 class MeshMgr
 {
 public:
+	//default size of each shared buffer
+	static const unsigned int VB_PAGE_BYTES = 4 * 1024 * 1024;
+	static const unsigned int IB_PAGE_BYTES = 2 * 1024 * 1024;
+
 	~MeshMgr() { 
 		Release(); 
 	}
 	void Release();
 	//look up a mesh by name
 	Mesh& GetMesh(const std::string& name);
-	//create a new mesh in the library with the given name
-	Mesh& CreateMesh(const std::string& name);
+	//as above but returns nullptr if it isn't there
+	Mesh* FindMesh(const std::string& name);
+	//the mesh a handle refers to, nullptr if it's been released. Don't keep the pointer, meshes move.
+	Mesh* GetMesh(MeshHandle h) {
+		return mMeshes.Get(h);
+	}
+	bool IsValid(MeshHandle h) const {
+		return mMeshes.IsValid(h);
+	}
+	/*
+	* create a new mesh in the library
+	* name - IN its name, for debug output and looking it up
+	* findByName - IN false if it'll only be used by handle, e.g. lots of streamed meshes, names must be unique if true
+	*/
+	Mesh& CreateMesh(const std::string& name, bool findByName = true);
+	//remove a mesh from the library and give its geometry back, handles to it go stale
+	void ReleaseMesh(MeshHandle h);
+	void ReleaseMesh(const std::string& name);
+	//all the meshes, packed together in no particular order
+	int GetNumMeshes() const {
+		return mMeshes.Size();
+	}
+	Mesh& GetMeshAt(int i) {
+		return mMeshes[i];
+	}
+	/*
+	* load a mesh file (see MeshFile), it's memory mapped and the geometry copied straight
+	* into the gpu buffers. Textures are loaded through the texture cache.
+	* fileName - IN the file to load
+	* name - IN the mesh's name in the library, the file name if it's empty. If it's already there it isn't reloaded
+	* returns - nullptr if the file is missing or not a valid mesh file
+	*/
+	Mesh* LoadMesh(const std::string& fileName, const std::string& name = "");
+	/*
+	* as above from a mesh file that's already mapped, e.g. opened and paged in on another thread
+	* file - IN the mapped file, it can be closed afterwards
+	* name - IN the mesh's name in the library, it mustn't already be there
+	* returns - nullptr if it's not a valid mesh file
+	*/
+	Mesh* LoadMesh(const MappedFile& file, const std::string& name);
+	/*
+	* import an OBJ or glTF file (see MeshImport), each material becomes a submesh
+	* fileName - IN the file, it's also the mesh's name in the library
+	* cacheFileName - IN optional mesh file, if it exists it's loaded instead (much quicker), 
+	*				  if not it's written after importing ready for next time
+	* returns - nullptr if it can't be imported
+	*/
+	Mesh* ImportMesh(const std::string& fileName, const std::string& cacheFileName = "");
+
+	/*
+	* find room in the shared buffers and copy geometry into it
+	* pVerts - IN vertex data
+	* numVerts - IN how many
+	* vertSize - IN bytes per vertex, only meshes with the same vertex size share a buffer
+	* pIndices - IN index data, 32bit indices are stored as 16bit if numVerts < 65536
+	* numIndices - IN how many
+	* indexFormat - IN R16_UINT or R32_UINT
+	* alloc - OUT where it ended up
+	*/
+	void AllocGeometry(const void* pVerts, unsigned int numVerts, unsigned int vertSize,
+		const void* pIndices, unsigned int numIndices, DXGI_FORMAT indexFormat, GeometryAlloc& alloc);
+	//give the space back
+	void FreeGeometry(GeometryAlloc& alloc);
+	//overwrite all of a mesh's vertices, same number and format, e.g. after skinning them on the cpu
+	void UpdateVertices(Mesh& mesh, const void* pVerts);
+	//the d3d buffers
+	ID3D11Buffer* GetVB(int page) {
+		return mVBPages.at(page).pBuffer;
+	}
+	ID3D11Buffer* GetIB(int page) {
+		return mIBPages.at(page).pBuffer;
+	}
+	int GetNumVBPages() const {
+		return (int)mVBPages.size();
+	}
+	int GetNumIBPages() const {
+		return (int)mIBPages.size();
+	}
+	//what vertex format should new meshes use, see VertexFormat
+	void SetVertexFormat(int fmt) {
+		//skinned meshes need bone data, see Mesh::CreateFrom
+		assert(fmt >= 0 && fmt < VertexFormat::MAX_FORMATS && fmt != VertexFormat::SKINNED);
+		mVertexFormat = fmt;
+	}
+	int GetVertexFormat() const {
+		return mVertexFormat;
+	}
+	//reorder triangles and vertices for the gpu caches when meshes are created, see MeshOptimiser
+	void SetOptimiseOnCreate(bool optimise) {
+		mOptimiseOnCreate = optimise;
+	}
+	bool GetOptimiseOnCreate() const {
+		return mOptimiseOnCreate;
+	}
+	//geometry bytes the gpu holds, and how many more it would be with full vertices and 32bit indices
+	void GetGeometryStats(unsigned int& bytes, unsigned int& bytesSaved) const {
+		bytes = mGeometryBytes;
+		bytesSaved = mGeometryBytesSaved;
+	}
+
+	//a range of submeshes for a mesh, they're reset to defaults
+	unsigned int AllocSubMeshes(int count);
+	void FreeSubMeshes(unsigned int first, int count);
+	SubMesh& GetPooledSubMesh(unsigned int idx) {
+		return mSubMeshPool.at(idx);
+	}
+
+	/*
+	* time walking over numMeshes meshes packed in a SlotMap against the old way - each one
+	* allocated on its own and found through a map of names. Also compares handle and name lookups.
+	* Doesn't need a device, the meshes have no geometry. Results go to DBOUT.
+	* returns - how many times quicker the packed iteration is
+	*/
+	static double BenchmarkStorage(int numMeshes);
+	/*
+	* time importing an OBJ (a gridSize*gridSize grid, see MeshImport::MakeTestOBJ) against loading
+	* the same mesh from the mesh file it's saved as. Both end up on the gpu, so this needs the
+	* device. The files are written to the working folder and deleted after. Results go to DBOUT.
+	* returns - how many times quicker the mesh file is
+	*/
+	double BenchmarkLoading(int gridSize);
+
+private:
+	//the library of meshes and an index of their names
+	SlotMap<Mesh> mMeshes;
+	typedef std::unordered_map<std::string, MeshHandle> MeshNames;
+	MeshNames mNames;
+	//every mesh's submeshes, a range each
+	std::vector<SubMesh> mSubMeshPool;
+	FreeListAllocator mSubMeshAlloc;
 
-	//array of meshes - a clever array where you can look things up with a key
-	//and in this case the key is a string
-	typedef std::unordered_map<std::string, Mesh*> Meshes;
-	Meshes mMeshes;
+	//one big d3d buffer and a record of which bits are used
+	struct BufferPage
+	{
+		ID3D11Buffer* pBuffer = nullptr;
+		FreeListAllocator alloc;		//counts in elements (vertices or indices)
+		unsigned int elementSize = 0;	//bytes per element
+	};
+	std::vector<BufferPage> mVBPages, mIBPages;
+	int mVertexFormat = VertexFormat::FULL;
+	bool mOptimiseOnCreate = true;
+	unsigned int mGeometryBytes = 0, mGeometryBytesSaved = 0;
+	/*
+	* find space in a page with the right element size, add a new page if needed
+	* pages - IN/OUT vertex or index pages
+	* bindFlags - IN d3d bind flags for a new page
+	* pageBytes - IN default size of a new page
+	* pData - IN data to copy in
+	* count, elementSize - IN how many elements and how big
+	* page, offset - OUT where it went
+	*/
+	void Alloc(std::vector<BufferPage>& pages, UINT bindFlags, unsigned int pageBytes, const void* pData,
+		unsigned int count, unsigned int elementSize, int& page, unsigned int& offset);
 };
 
+inline SubMesh& Mesh::GetSubMesh(int idx)
+{
+	assert(idx >= 0 && idx < mNumSubMeshes);
+	return mpMgr->GetPooledSubMesh(mFirstSubMesh + idx);
+}
+
 #endif
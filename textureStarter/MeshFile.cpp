@@ -0,0 +1,130 @@
+#include <fstream>
+
+#include "MeshFile.h"
+#include "D3DUtil.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+namespace MeshFile
+{
+	static unsigned int Align(unsigned int offset)
+	{
+		return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	}
+
+	static void CopyName(char dest[MAX_NAME], const string& src)
+	{
+		if (src.size() >= MAX_NAME)
+			DBOUT("Mesh file name truncated: " << src);
+		strncpy_s(dest, MAX_NAME, src.c_str(), _TRUNCATE);
+	}
+
+	bool Save(const string& fileName, const MeshStreams& streams, const SubMeshDesc subMeshes[], int numSubMeshes)
+	{
+		assert(streams.vertexFormat >= 0 && streams.vertexFormat < VertexFormat::MAX_FORMATS);
+		//store 16bit indices if they fit, the loader won't have to convert them
+		vector<unsigned short> shortIndices;
+		const void* pIndices = streams.pIndices;
+		unsigned int indexSize = (streams.indexFormat == DXGI_FORMAT_R16_UINT) ? 2 : 4;
+		if (indexSize == 4 && NarrowIndices((const unsigned int*)streams.pIndices, streams.numIndices, streams.numVerts, shortIndices))
+		{
+			pIndices = shortIndices.data();
+			indexSize = 2;
+		}
+
+		Header hdr;
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.magic = MAGIC;
+		hdr.version = VERSION;
+		hdr.vertexFormat = streams.vertexFormat;
+		hdr.vertexSize = gVertexFormats[streams.vertexFormat].size;
+		hdr.numVerts = streams.numVerts;
+		hdr.indexSize = indexSize;
+		hdr.numIndices = streams.numIndices;
+		hdr.numSubMeshes = numSubMeshes;
+		hdr.subMeshOffset = sizeof(Header);
+		hdr.vertexOffset = Align(hdr.subMeshOffset + numSubMeshes * sizeof(SubMeshRecord));
+		hdr.indexOffset = Align(hdr.vertexOffset + hdr.numVerts * hdr.vertexSize);
+		hdr.fileBytes = hdr.indexOffset + hdr.numIndices * hdr.indexSize;
+		memcpy(hdr.boundsMin, &streams.boundsMin, sizeof(hdr.boundsMin));
+		memcpy(hdr.boundsMax, &streams.boundsMax, sizeof(hdr.boundsMax));
+
+		vector<SubMeshRecord> records(numSubMeshes);
+		for (int i = 0; i < numSubMeshes; ++i)
+		{
+			SubMeshRecord& r = records[i];
+			const SubMeshDesc& d = subMeshes[i];
+			memset(&r, 0, sizeof(r));
+			r.startIndex = d.startIndex;
+			r.numIndices = d.numIndices;
+			r.gfxData = d.material.gfxData;
+			r.texScale[0] = d.material.texTrsfm.scale.x;
+			r.texScale[1] = d.material.texTrsfm.scale.y;
+			r.texAngle = d.material.texTrsfm.angle;
+			r.texTranslate[0] = d.material.texTrsfm.translate.x;
+			r.texTranslate[1] = d.material.texTrsfm.translate.y;
+			r.flags = d.material.flags;
+			memcpy(r.blendFactors, d.material.blendFactors, sizeof(r.blendFactors));
+			CopyName(r.name, d.material.name);
+			CopyName(r.texture, d.material.texture);
+		}
+
+		ofstream fs(fileName, ios::binary);
+		if (!fs)
+		{
+			DBOUT("Can't write mesh file " << fileName);
+			return false;
+		}
+		const char padding[ALIGNMENT] = { 0 };
+		fs.write((const char*)&hdr, sizeof(hdr));
+		fs.write((const char*)records.data(), records.size() * sizeof(SubMeshRecord));
+		fs.write(padding, hdr.vertexOffset - (hdr.subMeshOffset + numSubMeshes * sizeof(SubMeshRecord)));
+		fs.write((const char*)streams.pVerts, hdr.numVerts * hdr.vertexSize);
+		fs.write(padding, hdr.indexOffset - (hdr.vertexOffset + hdr.numVerts * hdr.vertexSize));
+		fs.write((const char*)pIndices, hdr.numIndices * hdr.indexSize);
+		return fs.good();
+	}
+
+	//does every index point at a vertex
+	template<class T>
+	static bool IndicesInRange(const T* pIndices, unsigned int numIndices, unsigned int numVerts)
+	{
+		for (unsigned int i = 0; i < numIndices; ++i)
+			if (pIndices[i] >= numVerts)
+				return false;
+		return true;
+	}
+
+	const Header* Validate(const void* pData, size_t bytes)
+	{
+		if (!pData || bytes < sizeof(Header))
+			return nullptr;
+		const Header* pHdr = (const Header*)pData;
+		if (pHdr->magic != MAGIC || pHdr->version != VERSION || pHdr->fileBytes != bytes)
+			return nullptr;
+		if (pHdr->vertexFormat < 0 || pHdr->vertexFormat >= VertexFormat::MAX_FORMATS ||
+			pHdr->vertexSize != gVertexFormats[pHdr->vertexFormat].size)
+			return nullptr;
+		if ((pHdr->indexSize != 2 && pHdr->indexSize != 4) || pHdr->numVerts == 0 || pHdr->numIndices == 0 || pHdr->numSubMeshes == 0)
+			return nullptr;
+		//everything has to fit, 64bit sums so big counts can't wrap
+		if ((unsigned long long)pHdr->subMeshOffset + (unsigned long long)pHdr->numSubMeshes * sizeof(SubMeshRecord) > bytes ||
+			(unsigned long long)pHdr->vertexOffset + (unsigned long long)pHdr->numVerts * pHdr->vertexSize > bytes ||
+			(unsigned long long)pHdr->indexOffset + (unsigned long long)pHdr->numIndices * pHdr->indexSize > bytes)
+			return nullptr;
+		if ((pHdr->vertexOffset % ALIGNMENT) || (pHdr->indexOffset % ALIGNMENT) || (pHdr->subMeshOffset % sizeof(unsigned int)))
+			return nullptr;
+		const SubMeshRecord* pRecords = (const SubMeshRecord*)((const char*)pData + pHdr->subMeshOffset);
+		for (unsigned int i = 0; i < pHdr->numSubMeshes; ++i)
+			if ((unsigned long long)pRecords[i].startIndex + pRecords[i].numIndices > pHdr->numIndices)
+				return nullptr;
+		//an index past the vertices would have the gpu reading another mesh's
+		const char* pIndices = (const char*)pData + pHdr->indexOffset;
+		if (pHdr->indexSize == 2 ? !IndicesInRange((const unsigned short*)pIndices, pHdr->numIndices, pHdr->numVerts)
+			: !IndicesInRange((const unsigned int*)pIndices, pHdr->numIndices, pHdr->numVerts))
+			return nullptr;
+		return pHdr;
+	}
+}
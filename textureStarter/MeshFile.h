@@ -0,0 +1,78 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include <string>
+
+#include "Mesh.h"
+
+/*
+Binary mesh files, the geometry is stored exactly as the gpu wants it
+(already optimised, encoded and with 16bit indices where possible) so
+loading is just mapping the file into memory and copying to the gpu.
+Layout:
+	Header
+	SubMeshRecord * numSubMeshes
+	vertices	(ALIGNMENT aligned)
+	indices		(ALIGNMENT aligned)
+All offsets are from the start of the file. Bump VERSION if anything changes.
+*/
+namespace MeshFile
+{
+	const unsigned int MAGIC = 0x4853454d;		//"MESH"
+	const unsigned int VERSION = 1;
+	const unsigned int ALIGNMENT = 16;			//streams start on a multiple of this
+	const int MAX_NAME = 64;					//including the terminating zero
+
+	struct Header
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned int fileBytes;			//total, to spot truncated files
+		int vertexFormat;				//see VertexFormat
+		unsigned int vertexSize;		//bytes, must agree with vertexFormat
+		unsigned int numVerts;
+		unsigned int vertexOffset;
+		unsigned int indexSize;			//2 or 4 bytes
+		unsigned int numIndices;
+		unsigned int indexOffset;
+		unsigned int numSubMeshes;
+		unsigned int subMeshOffset;
+		float boundsMin[3];				//local space bounds, compact positions are relative to these
+		float boundsMax[3];
+	};
+
+	//a range of indices and the material to draw it with
+	struct SubMeshRecord
+	{
+		unsigned int startIndex;
+		unsigned int numIndices;
+		BasicMaterial gfxData;
+		float texScale[2];
+		float texAngle;
+		float texTranslate[2];
+		int flags;						//Material::TFlags
+		float blendFactors[4];
+		char name[MAX_NAME];
+		char texture[MAX_NAME];			//file name, empty if not textured
+	};
+
+	/*
+	* write a mesh file
+	* fileName - IN where to
+	* streams - IN prepared geometry, see Mesh::PrepareGeometry
+	* subMeshes, numSubMeshes - IN index ranges and their materials
+	* returns - false if the file couldn't be written
+	*/
+	bool Save(const std::string& fileName, const MeshStreams& streams, const SubMeshDesc subMeshes[], int numSubMeshes);
+
+	/*
+	* check that some memory holds a mesh file we can use, everything it points at has to be inside it
+	* and every index has to be one of its vertices
+	* pData - IN start of the file
+	* bytes - IN how big it is
+	* returns - the header or nullptr if something is wrong
+	*/
+	const Header* Validate(const void* pData, size_t bytes);
+}
+
+#endif
@@ -0,0 +1,1395 @@
+#include <climits>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <memory>
+#include <filesystem>
+#include <unordered_map>
+
+#include "MeshImport.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+#include "D3DUtil.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+namespace MeshImport
+{
+	//don't split files up into parallel chunks smaller than this
+	const size_t MIN_CHUNK_BYTES = 256 * 1024;
+	//vertices converted per parallel task
+	const int MIN_VERTS_PER_TASK = 16 * 1024;
+
+	/*
+	*************************************************************
+	text parsing helpers
+	*/
+	static const double sPow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	inline bool IsDigit(char c) {
+		return (unsigned)(c - '0') < 10;
+	}
+
+	inline void SkipSpaces(const char*& p, const char* pEnd) {
+		while (p < pEnd && (*p == ' ' || *p == '\t'))
+			++p;
+	}
+
+	inline void NextLine(const char*& p, const char* pEnd) {
+		while (p < pEnd && *p != '\n')
+			++p;
+		if (p < pEnd)
+			++p;
+	}
+
+	inline bool IsLineEnd(const char* p, const char* pEnd) {
+		return p >= pEnd || *p == '\n' || *p == '\r' || *p == '#';
+	}
+
+	float ParseFloat(const char*& p, const char* pEnd)
+	{
+		const char* s = p;
+		bool neg = false;
+		if (s < pEnd && (*s == '-' || *s == '+'))
+			neg = (*s++ == '-');
+
+		//up to 19 significant digits fit in 64bits, more than a float can use anyway
+		unsigned long long mant = 0;
+		int digits = 0, exp10 = 0;
+		bool any = false;
+		for (; s < pEnd && IsDigit(*s); ++s, any = true)
+		{
+			if (digits < 19)
+			{
+				mant = mant * 10 + (*s - '0');
+				digits += (mant != 0);
+			}
+			else
+				++exp10;
+		}
+		if (s < pEnd && *s == '.')
+		{
+			for (++s; s < pEnd && IsDigit(*s); ++s, any = true)
+				if (digits < 19)
+				{
+					mant = mant * 10 + (*s - '0');
+					digits += (mant != 0);
+					--exp10;
+				}
+		}
+		if (!any)
+			return 0;
+
+		if (s < pEnd && (*s == 'e' || *s == 'E'))
+		{
+			const char* e = s + 1;
+			bool expNeg = false;
+			if (e < pEnd && (*e == '-' || *e == '+'))
+				expNeg = (*e++ == '-');
+			if (e < pEnd && IsDigit(*e))
+			{
+				int ev = 0;
+				for (; e < pEnd && IsDigit(*e); ++e)
+					if (ev < 10000)
+						ev = ev * 10 + (*e - '0');
+				exp10 += expNeg ? -ev : ev;
+				s = e;
+			}
+		}
+
+		//powers of ten up to 22 are exact in a double
+		double v = (double)mant;
+		if (exp10 < 0)
+			v = (exp10 >= -22) ? v / sPow10[-exp10] : v * pow(10.0, exp10);
+		else if (exp10 > 0)
+			v = (exp10 <= 22) ? v * sPow10[exp10] : v * pow(10.0, exp10);
+		p = s;
+		return (float)(neg ? -v : v);
+	}
+
+	static bool ParseInt(const char*& p, const char* pEnd, int& v)
+	{
+		const char* s = p;
+		bool neg = false;
+		if (s < pEnd && (*s == '-' || *s == '+'))
+			neg = (*s++ == '-');
+		if (s >= pEnd || !IsDigit(*s))
+			return false;
+		long long n = 0;
+		for (; s < pEnd && IsDigit(*s); ++s)
+		{
+			n = n * 10 + (*s - '0');
+			//too big to be an index, the file's broken
+			if (n > INT_MAX)
+				return false;
+		}
+		v = (int)(neg ? -n : n);
+		p = s;
+		return true;
+	}
+
+	//the rest of the line, without trailing spaces or comments
+	static string RestOfLine(const char* p, const char* pEnd)
+	{
+		SkipSpaces(p, pEnd);
+		const char* e = p;
+		while (!IsLineEnd(e, pEnd))
+			++e;
+		while (e > p && (e[-1] == ' ' || e[-1] == '\t'))
+			--e;
+		return string(p, e);
+	}
+
+	static bool StartsWith(const char* p, const char* pEnd, const char* word)
+	{
+		size_t len = strlen(word);
+		return (size_t)(pEnd - p) > len && memcmp(p, word, len) == 0 && (p[len] == ' ' || p[len] == '\t');
+	}
+
+	static string JoinPath(const string& folder, const string& file)
+	{
+		if (folder.empty())
+			return file;
+		return (filesystem::path(folder) / filesystem::path(file)).string();
+	}
+
+	/*
+	*************************************************************
+	welding and grouping, shared by all the formats
+	*/
+
+	//open addressing (linear probing) table from a key to a vertex number
+	//it's sized up front for the worst case (every key different) so never grows
+	template<class Key>
+	class WeldTable
+	{
+	public:
+		WeldTable(size_t maxKeys) {
+			size_t capacity = 16;
+			while (capacity < maxKeys * 2)
+				capacity <<= 1;
+			mKeys.resize(capacity);
+			mValues.assign(capacity, EMPTY);
+			mMask = capacity - 1;
+		}
+		//the vertex already using this key, or value if it's new
+		unsigned int Insert(const Key& key, size_t hash, unsigned int value) {
+			size_t i = hash & mMask;
+			while (mValues[i] != EMPTY)
+			{
+				if (mKeys[i] == key)
+					return mValues[i];
+				i = (i + 1) & mMask;
+			}
+			mKeys[i] = key;
+			mValues[i] = value;
+			return value;
+		}
+	private:
+		static constexpr unsigned int EMPTY = 0xffffffff;
+		vector<Key> mKeys;
+		vector<unsigned int> mValues;
+		size_t mMask;
+	};
+
+	inline size_t MixHash(unsigned long long h) {
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		return (size_t)h;
+	}
+
+	//an OBJ corner - which position, texcoord and normal
+	struct CornerKey
+	{
+		int p, t, n;
+		bool operator==(const CornerKey& rhs) const {
+			return p == rhs.p && t == rhs.t && n == rhs.n;
+		}
+		size_t Hash() const {
+			return MixHash((unsigned long long)p * 0x9E3779B97F4A7C15ULL ^ (unsigned long long)(t + 1) * 0xC2B2AE3D27D4EB4FULL ^ (unsigned)(n + 1));
+		}
+	};
+
+	//a whole vertex, bit for bit
+	struct VertexKey
+	{
+		unsigned int w[sizeof(VertexPosNormTex) / 4];
+		bool operator==(const VertexKey& rhs) const {
+			return memcmp(w, rhs.w, sizeof(w)) == 0;
+		}
+		size_t Hash() const {
+			unsigned long long h = 0;
+			for (unsigned int v : w)
+				h = (h ^ v) * 0x100000001B3ULL;
+			return MixHash(h);
+		}
+	};
+	static_assert(sizeof(VertexPosNormTex) % 4 == 0, "vertex isn't a whole number of words");
+
+	//merge identical vertices and renumber the indices
+	static void WeldVertices(Result& result)
+	{
+		vector<VertexPosNormTex>& verts = result.verts;
+		WeldTable<VertexKey> table(verts.size());
+		vector<unsigned int> remap(verts.size());
+		unsigned int numOut = 0;
+		for (size_t i = 0; i < verts.size(); ++i)
+		{
+			//make -0 and +0 the same
+			VertexPosNormTex v = verts[i];
+			float* pF = &v.Pos.x;
+			for (size_t f = 0; f < sizeof(v) / 4; ++f)
+				pF[f] += 0.0f;
+			VertexKey key;
+			memcpy(key.w, &v, sizeof(v));
+			unsigned int idx = table.Insert(key, key.Hash(), numOut);
+			if (idx == numOut)
+				verts[numOut++] = v;
+			remap[i] = idx;
+		}
+		result.numWelded += (int)(verts.size() - numOut);
+		verts.resize(numOut);
+		for (unsigned int& idx : result.indices)
+			idx = remap[idx];
+	}
+
+	//face normals added up at each vertex that didn't come with one
+	static void GenerateNormals(Result& result, const vector<bool>& needNormal)
+	{
+		vector<VertexPosNormTex>& verts = result.verts;
+		for (size_t i = 0; i < verts.size(); ++i)
+			if (needNormal[i])
+				verts[i].Norm = Vector3(0, 0, 0);
+		const vector<unsigned int>& idx = result.indices;
+		for (size_t i = 0; i + 2 < idx.size(); i += 3)
+		{
+			Vector3 n = (verts[idx[i + 1]].Pos - verts[idx[i]].Pos).Cross(verts[idx[i + 2]].Pos - verts[idx[i]].Pos);
+			for (int c = 0; c < 3; ++c)
+				if (needNormal[idx[i + c]])
+					verts[idx[i + c]].Norm += n;
+		}
+		for (size_t i = 0; i < verts.size(); ++i)
+			if (needNormal[i])
+			{
+				if (verts[i].Norm.LengthSquared() > 0)
+					verts[i].Norm.Normalize();
+				else
+					verts[i].Norm = Vector3(0, 1, 0);
+			}
+	}
+
+	//put the triangles in material order so each material is one range of indices
+	static void GroupByMaterial(const vector<int>& triMaterial, Result& result)
+	{
+		int numMats = (int)result.materials.size();
+		vector<int> start(numMats + 1, 0);
+		for (int m : triMaterial)
+			++start[m + 1];
+		for (int m = 0; m < numMats; ++m)
+			start[m + 1] += start[m];
+
+		vector<unsigned int> sorted(result.indices.size());
+		vector<int> fill(start.begin(), start.end() - 1);
+		for (size_t t = 0; t < triMaterial.size(); ++t)
+		{
+			int dst = fill[triMaterial[t]]++;
+			for (int c = 0; c < 3; ++c)
+				sorted[dst * 3 + c] = result.indices[t * 3 + c];
+		}
+		result.indices.swap(sorted);
+
+		result.groups.clear();
+		for (int m = 0; m < numMats; ++m)
+			if (start[m + 1] > start[m])
+			{
+				Group g;
+				g.material = m;
+				g.startIndex = start[m] * 3;
+				g.numIndices = (start[m + 1] - start[m]) * 3;
+				result.groups.push_back(g);
+			}
+	}
+
+	/*
+	*************************************************************
+	Wavefront OBJ
+	*/
+
+	//what one thread found in its part of the file
+	struct ObjChunk
+	{
+		vector<float> pos, tex, norm;
+		vector<CornerKey> corners;			//3 per triangle, 0 based, -1 = missing
+		vector<unsigned char> relative;		//per corner, bit per component that came from a negative index
+		vector<pair<int, string>> useMtl;	//first triangle (in this chunk) to use each material
+		vector<string> mtlLibs;
+		int numBadFaces = 0;
+	};
+
+	static void ParseOBJChunk(const char* p, const char* pEnd, ObjChunk& ch)
+	{
+		vector<CornerKey> face;
+		vector<unsigned char> faceRel;
+		while (p < pEnd)
+		{
+			SkipSpaces(p, pEnd);
+			if (p >= pEnd)
+				break;
+			if (*p == 'v' && p + 1 < pEnd)
+			{
+				++p;
+				if (*p == ' ' || *p == '\t')
+				{
+					for (int i = 0; i < 3; ++i)
+					{
+						SkipSpaces(p, pEnd);
+						ch.pos.push_back(ParseFloat(p, pEnd));
+					}
+				}
+				else if (*p == 't')
+				{
+					++p;
+					for (int i = 0; i < 2; ++i)
+					{
+						SkipSpaces(p, pEnd);
+						ch.tex.push_back(ParseFloat(p, pEnd));
+					}
+				}
+				else if (*p == 'n')
+				{
+					++p;
+					for (int i = 0; i < 3; ++i)
+					{
+						SkipSpaces(p, pEnd);
+						ch.norm.push_back(ParseFloat(p, pEnd));
+					}
+				}
+			}
+			else if (*p == 'f' && p + 1 < pEnd && (p[1] == ' ' || p[1] == '\t'))
+			{
+				++p;
+				face.clear();
+				faceRel.clear();
+				int localCount[3] = { (int)ch.pos.size() / 3, (int)ch.tex.size() / 2, (int)ch.norm.size() / 3 };
+				bool bad = false;
+				for (;;)
+				{
+					SkipSpaces(p, pEnd);
+					if (IsLineEnd(p, pEnd))
+						break;
+					//v, v/t, v//n or v/t/n
+					int idx[3] = { -1, -1, -1 };
+					unsigned char rel = 0;
+					for (int c = 0; c < 3; ++c)
+					{
+						if (c > 0)
+						{
+							if (p < pEnd && *p == '/')
+								++p;
+							else
+								break;
+						}
+						int v;
+						if (ParseInt(p, pEnd, v))
+						{
+							if (v > 0)
+								idx[c] = v - 1;
+							else if (v < 0)
+							{
+								//relative to the end of the list so far, our chunk's start gets added later
+								idx[c] = localCount[c] + v;
+								rel |= 1 << c;
+							}
+						}
+					}
+					if (idx[0] == -1 && !(rel & 1))
+						bad = true;
+					while (p < pEnd && !IsLineEnd(p, pEnd) && *p != ' ' && *p != '\t')
+						++p;
+					face.push_back(CornerKey{ idx[0], idx[1], idx[2] });
+					faceRel.push_back(rel);
+				}
+				if (bad || face.size() < 3)
+					++ch.numBadFaces;
+				else
+				{
+					//polygons become triangle fans
+					for (size_t i = 1; i + 1 < face.size(); ++i)
+					{
+						ch.corners.push_back(face[0]);
+						ch.corners.push_back(face[i]);
+						ch.corners.push_back(face[i + 1]);
+						ch.relative.push_back(faceRel[0]);
+						ch.relative.push_back(faceRel[i]);
+						ch.relative.push_back(faceRel[i + 1]);
+					}
+				}
+			}
+			else if (StartsWith(p, pEnd, "usemtl"))
+				ch.useMtl.push_back(make_pair((int)ch.corners.size() / 3, RestOfLine(p + 6, pEnd)));
+			else if (StartsWith(p, pEnd, "mtllib"))
+				ch.mtlLibs.push_back(RestOfLine(p + 6, pEnd));
+			NextLine(p, pEnd);
+		}
+	}
+
+	//materials library, small so not worth doing in parallel
+	static void LoadMTL(const string& fileName, const string& folder, vector<ImportMaterial>& materials)
+	{
+		MappedFile file;
+		if (!file.Open(fileName))
+		{
+			DBOUT("Cannot open material library " << fileName);
+			return;
+		}
+		const char* p = (const char*)file.GetData();
+		const char* pEnd = p + file.GetSize();
+		ImportMaterial* pMat = nullptr;
+		auto readColour = [pEnd](const char* pStart, Vector4& col) {
+			const char* s = pStart;
+			for (int i = 0; i < 3; ++i)
+			{
+				SkipSpaces(s, pEnd);
+				(&col.x)[i] = ParseFloat(s, pEnd);
+			}
+		};
+		while (p < pEnd)
+		{
+			SkipSpaces(p, pEnd);
+			if (StartsWith(p, pEnd, "newmtl"))
+			{
+				materials.push_back(ImportMaterial());
+				pMat = &materials.back();
+				pMat->name = RestOfLine(p + 6, pEnd);
+				pMat->ambient = Vector4(0.2f, 0.2f, 0.2f, 1);
+			}
+			else if (pMat && StartsWith(p, pEnd, "Kd"))
+				readColour(p + 2, pMat->diffuse);
+			else if (pMat && StartsWith(p, pEnd, "Ka"))
+				readColour(p + 2, pMat->ambient);
+			else if (pMat && StartsWith(p, pEnd, "Ks"))
+			{
+				float power = pMat->specular.w;
+				readColour(p + 2, pMat->specular);
+				pMat->specular.w = power;
+			}
+			else if (pMat && StartsWith(p, pEnd, "Ns"))
+			{
+				const char* s = p + 2;
+				SkipSpaces(s, pEnd);
+				pMat->specular.w = ParseFloat(s, pEnd);
+			}
+			else if (pMat && (StartsWith(p, pEnd, "d") || StartsWith(p, pEnd, "Tr")))
+			{
+				bool isTr = (*p == 'T');
+				const char* s = p + (isTr ? 2 : 1);
+				SkipSpaces(s, pEnd);
+				float a = ParseFloat(s, pEnd);
+				pMat->diffuse.w = isTr ? 1 - a : a;
+				pMat->transparent = pMat->diffuse.w < 1;
+			}
+			else if (pMat && StartsWith(p, pEnd, "map_Kd"))
+			{
+				//options (-s etc) come first, the file name is last
+				string line = RestOfLine(p + 6, pEnd);
+				size_t space = line.find_last_of(" \t");
+				pMat->texture = JoinPath(folder, (space == string::npos) ? line : line.substr(space + 1));
+			}
+			NextLine(p, pEnd);
+		}
+	}
+
+	bool ParseOBJ(const char* pText, size_t bytes, const string& folder, Result& result, const Options& opts)
+	{
+		auto start = chrono::steady_clock::now();
+		result = Result();
+
+		//split on line ends, one chunk per core if it's big enough
+		int numChunks = (int)min<size_t>(max(1u, thread::hardware_concurrency()), max<size_t>(1, bytes / MIN_CHUNK_BYTES));
+		vector<const char*> bounds(numChunks + 1);
+		bounds[0] = pText;
+		bounds[numChunks] = pText + bytes;
+		for (int c = 1; c < numChunks; ++c)
+		{
+			const char* p = pText + bytes * c / numChunks;
+			p = max(p, bounds[c - 1]);
+			NextLine(p, pText + bytes);
+			bounds[c] = p;
+		}
+		vector<ObjChunk> chunks(numChunks);
+		ParallelFor(numChunks, 1, [&](int begin, int end) {
+			for (int c = begin; c < end; ++c)
+				ParseOBJChunk(bounds[c], bounds[c + 1], chunks[c]);
+		});
+
+		//where each chunk's data starts in the whole file
+		vector<int> posStart(numChunks + 1, 0), texStart(numChunks + 1, 0), normStart(numChunks + 1, 0), triStart(numChunks + 1, 0);
+		int numBadFaces = 0;
+		for (int c = 0; c < numChunks; ++c)
+		{
+			posStart[c + 1] = posStart[c] + (int)chunks[c].pos.size() / 3;
+			texStart[c + 1] = texStart[c] + (int)chunks[c].tex.size() / 2;
+			normStart[c + 1] = normStart[c] + (int)chunks[c].norm.size() / 3;
+			triStart[c + 1] = triStart[c] + (int)chunks[c].corners.size() / 3;
+			numBadFaces += chunks[c].numBadFaces;
+		}
+		int numPos = posStart[numChunks], numTex = texStart[numChunks], numNorm = normStart[numChunks];
+		int numTris = triStart[numChunks];
+		if (numBadFaces)
+			DBOUT("OBJ: skipped " << numBadFaces << " faces with no position");
+		if (numTris == 0 || numPos == 0)
+		{
+			DBOUT("OBJ: no triangles");
+			return false;
+		}
+
+		//make the indices absolute, anything out of range is an error for positions or ignored for the rest
+		vector<int> numBadIndices(numChunks, 0);
+		ParallelFor(numChunks, 1, [&](int begin, int end) {
+			for (int c = begin; c < end; ++c)
+			{
+				ObjChunk& ch = chunks[c];
+				for (size_t i = 0; i < ch.corners.size(); ++i)
+				{
+					CornerKey& k = ch.corners[i];
+					unsigned char rel = ch.relative[i];
+					if (rel & 1) k.p += posStart[c];
+					if (rel & 2) k.t += texStart[c];
+					if (rel & 4) k.n += normStart[c];
+					if (k.p < 0 || k.p >= numPos)
+					{
+						k.p = 0;
+						++numBadIndices[c];
+					}
+					if (k.t >= numTex || k.t < 0)
+						k.t = -1;
+					if (k.n >= numNorm || k.n < 0)
+						k.n = -1;
+				}
+			}
+		});
+		for (int n : numBadIndices)
+			if (n)
+			{
+				DBOUT("OBJ: position index out of range");
+				return false;
+			}
+
+		//materials
+		unordered_map<string, int> matLookup;
+		for (ObjChunk& ch : chunks)
+			for (const string& lib : ch.mtlLibs)
+				if (!folder.empty())
+					LoadMTL(JoinPath(folder, lib), folder, result.materials);
+		for (int i = 0; i < (int)result.materials.size(); ++i)
+			matLookup[result.materials[i].name] = i;
+		auto findMaterial = [&](const string& name) {
+			auto it = matLookup.find(name);
+			if (it != matLookup.end())
+				return it->second;
+			//not in a library, or no material at all
+			ImportMaterial mat;
+			mat.name = name.empty() ? "default" : name;
+			result.materials.push_back(mat);
+			return matLookup[name] = (int)result.materials.size() - 1;
+		};
+		vector<int> triMaterial(numTris);
+		string current;
+		for (int c = 0; c < numChunks; ++c)
+		{
+			const ObjChunk& ch = chunks[c];
+			size_t next = 0;
+			//only looked up when a face uses it, so a default isn't made unless something has no material
+			int mat = -1;
+			for (int t = 0; t < (int)ch.corners.size() / 3; ++t)
+			{
+				while (next < ch.useMtl.size() && ch.useMtl[next].first == t)
+				{
+					current = ch.useMtl[next++].second;
+					mat = -1;
+				}
+				if (mat < 0)
+					mat = findMaterial(current);
+				triMaterial[triStart[c] + t] = mat;
+			}
+			//usemtl after the last face in this chunk
+			if (next < ch.useMtl.size())
+				current = ch.useMtl.back().second;
+		}
+
+		//all the file's positions etc in one place
+		vector<float> pos(numPos * 3), tex(numTex * 2), norm(numNorm * 3);
+		ParallelFor(numChunks, 1, [&](int begin, int end) {
+			for (int c = begin; c < end; ++c)
+			{
+				copy(chunks[c].pos.begin(), chunks[c].pos.end(), pos.begin() + posStart[c] * 3);
+				copy(chunks[c].tex.begin(), chunks[c].tex.end(), tex.begin() + texStart[c] * 2);
+				copy(chunks[c].norm.begin(), chunks[c].norm.end(), norm.begin() + normStart[c] * 3);
+			}
+		});
+
+		//one vertex per unique corner
+		float zSign = opts.toLeftHanded ? -1.f : 1.f;
+		WeldTable<CornerKey> table(opts.weld ? numTris * 3 : 0);
+		vector<bool> needNormal;
+		result.indices.resize(numTris * 3);
+		result.verts.reserve(opts.weld ? min(numTris * 3, numPos * 2) : numTris * 3);
+		int numCorners = 0;
+		for (ObjChunk& ch : chunks)
+		{
+			for (const CornerKey& k : ch.corners)
+			{
+				unsigned int idx = (unsigned int)result.verts.size();
+				if (opts.weld)
+					idx = table.Insert(k, k.Hash(), idx);
+				if (idx == result.verts.size())
+				{
+					VertexPosNormTex v;
+					v.Pos = Vector3(pos[k.p * 3], pos[k.p * 3 + 1], pos[k.p * 3 + 2] * zSign);
+					if (k.n >= 0)
+						v.Norm = Vector3(norm[k.n * 3], norm[k.n * 3 + 1], norm[k.n * 3 + 2] * zSign);
+					else
+						v.Norm = Vector3(0, 0, 0);
+					//OBJ v goes up the texture
+					v.Tex = (k.t >= 0) ? Vector2(tex[k.t * 2], 1 - tex[k.t * 2 + 1]) : Vector2(0, 0);
+					result.verts.push_back(v);
+					needNormal.push_back(k.n < 0);
+				}
+				result.indices[numCorners++] = idx;
+			}
+			//done with it, give the memory back
+			ch = ObjChunk();
+		}
+		result.numWelded = numTris * 3 - (int)result.verts.size();
+		if (opts.toLeftHanded)
+			for (int t = 0; t < numTris; ++t)
+				swap(result.indices[t * 3 + 1], result.indices[t * 3 + 2]);
+		GenerateNormals(result, needNormal);
+		GroupByMaterial(triMaterial, result);
+
+		result.bytesParsed = bytes;
+		result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		return true;
+	}
+
+	bool LoadOBJ(const string& fileName, Result& result, const Options& opts)
+	{
+		MappedFile file;
+		if (!file.Open(fileName))
+		{
+			DBOUT("Cannot open " << fileName);
+			return false;
+		}
+		string folder = filesystem::path(fileName).parent_path().string();
+		if (folder.empty())
+			folder = ".";
+		return ParseOBJ((const char*)file.GetData(), file.GetSize(), folder, result, opts);
+	}
+
+	/*
+	*************************************************************
+	glTF 2.0
+	*/
+
+	//just enough json for glTF
+	struct Json
+	{
+		enum Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+		Type type = NUL;
+		double num = 0;
+		string str;
+		vector<Json> items;		//array elements or object values
+		vector<string> keys;	//object keys, same order as items
+
+		const Json* Get(const char* key) const {
+			for (size_t i = 0; i < keys.size(); ++i)
+				if (keys[i] == key)
+					return &items[i];
+			return nullptr;
+		}
+		const Json* At(int i) const {
+			return (type == ARRAY && i >= 0 && i < (int)items.size()) ? &items[i] : nullptr;
+		}
+		int Size() const {
+			return (type == ARRAY) ? (int)items.size() : 0;
+		}
+		double Num(const char* key, double def) const {
+			const Json* p = Get(key);
+			return (p && p->type == NUMBER) ? p->num : def;
+		}
+		int Int(const char* key, int def) const {
+			return (int)Num(key, def);
+		}
+		string Str(const char* key) const {
+			const Json* p = Get(key);
+			return (p && p->type == STRING) ? p->str : string();
+		}
+	};
+
+	class JsonParser
+	{
+	public:
+		JsonParser(const char* p, const char* pEnd) : mp(p), mpEnd(pEnd) {}
+		bool Parse(Json& root) {
+			return Value(root, 0);
+		}
+	private:
+		const char *mp, *mpEnd;
+		static const int MAX_DEPTH = 128;
+
+		void Skip() {
+			while (mp < mpEnd && (*mp == ' ' || *mp == '\t' || *mp == '\n' || *mp == '\r'))
+				++mp;
+		}
+		bool Expect(char c) {
+			Skip();
+			if (mp < mpEnd && *mp == c)
+			{
+				++mp;
+				return true;
+			}
+			return false;
+		}
+		bool Literal(const char* word) {
+			size_t len = strlen(word);
+			if ((size_t)(mpEnd - mp) < len || memcmp(mp, word, len) != 0)
+				return false;
+			mp += len;
+			return true;
+		}
+		bool String(string& s) {
+			if (!Expect('"'))
+				return false;
+			s.clear();
+			while (mp < mpEnd && *mp != '"')
+			{
+				if (*mp != '\\')
+				{
+					s += *mp++;
+					continue;
+				}
+				if (++mp >= mpEnd)
+					return false;
+				char c = *mp++;
+				switch (c)
+				{
+				case 'n': s += '\n'; break;
+				case 't': s += '\t'; break;
+				case 'r': s += '\r'; break;
+				case 'b': s += '\b'; break;
+				case 'f': s += '\f'; break;
+				case 'u':
+				{
+					if (mpEnd - mp < 4)
+						return false;
+					unsigned int code = 0;
+					for (int i = 0; i < 4; ++i, ++mp)
+					{
+						char h = *mp;
+						code <<= 4;
+						if (IsDigit(h)) code |= h - '0';
+						else if (h >= 'a' && h <= 'f') code |= h - 'a' + 10;
+						else if (h >= 'A' && h <= 'F') code |= h - 'A' + 10;
+						else return false;
+					}
+					//utf8, surrogate pairs are left as two characters
+					if (code < 0x80)
+						s += (char)code;
+					else if (code < 0x800)
+					{
+						s += (char)(0xc0 | (code >> 6));
+						s += (char)(0x80 | (code & 0x3f));
+					}
+					else
+					{
+						s += (char)(0xe0 | (code >> 12));
+						s += (char)(0x80 | ((code >> 6) & 0x3f));
+						s += (char)(0x80 | (code & 0x3f));
+					}
+					break;
+				}
+				default: s += c;	//quote, slashes
+				}
+			}
+			if (mp >= mpEnd)
+				return false;
+			++mp;
+			return true;
+		}
+		bool Value(Json& v, int depth) {
+			if (depth > MAX_DEPTH)
+				return false;
+			Skip();
+			if (mp >= mpEnd)
+				return false;
+			switch (*mp)
+			{
+			case '{':
+				++mp;
+				v.type = Json::OBJECT;
+				if (Expect('}'))
+					return true;
+				do {
+					v.keys.emplace_back();
+					v.items.emplace_back();
+					if (!String(v.keys.back()) || !Expect(':') || !Value(v.items.back(), depth + 1))
+						return false;
+				} while (Expect(','));
+				return Expect('}');
+			case '[':
+				++mp;
+				v.type = Json::ARRAY;
+				if (Expect(']'))
+					return true;
+				do {
+					v.items.emplace_back();
+					if (!Value(v.items.back(), depth + 1))
+						return false;
+				} while (Expect(','));
+				return Expect(']');
+			case '"':
+				v.type = Json::STRING;
+				return String(v.str);
+			case 't':
+				v.type = Json::BOOL;
+				v.num = 1;
+				return Literal("true");
+			case 'f':
+				v.type = Json::BOOL;
+				return Literal("false");
+			case 'n':
+				return Literal("null");
+			default:
+			{
+				const char* p = mp;
+				v.type = Json::NUMBER;
+				v.num = ParseFloat(mp, mpEnd);
+				return mp != p;
+			}
+			}
+		}
+	};
+
+	//a piece of memory, either mapped or decoded
+	struct Span
+	{
+		const unsigned char* p = nullptr;
+		size_t bytes = 0;
+	};
+
+	static bool DecodeBase64(const char* p, const char* pEnd, vector<unsigned char>& out)
+	{
+		out.clear();
+		out.reserve((pEnd - p) * 3 / 4);
+		unsigned int acc = 0;
+		int bits = 0;
+		for (; p < pEnd && *p != '='; ++p)
+		{
+			char c = *p;
+			int v;
+			if (c >= 'A' && c <= 'Z') v = c - 'A';
+			else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+			else if (IsDigit(c)) v = c - '0' + 52;
+			else if (c == '+') v = 62;
+			else if (c == '/') v = 63;
+			else return false;
+			acc = (acc << 6) | v;
+			bits += 6;
+			if (bits >= 8)
+			{
+				bits -= 8;
+				out.push_back((unsigned char)(acc >> bits));
+			}
+		}
+		return true;
+	}
+
+	//where to find one attribute or the indices
+	struct Accessor
+	{
+		const unsigned char* p = nullptr;
+		size_t stride = 0;
+		int compType = 0;
+		int numComps = 0;
+		bool normalized = false;
+		int count = 0;
+	};
+
+	static int ComponentSize(int compType)
+	{
+		switch (compType)
+		{
+		case 5120: case 5121: return 1;		//byte, unsigned byte
+		case 5122: case 5123: return 2;		//short, unsigned short
+		case 5125: case 5126: return 4;		//unsigned int, float
+		}
+		return 0;
+	}
+
+	static bool GetAccessor(const Json& root, int idx, const vector<Span>& buffers, Accessor& acc)
+	{
+		const Json* pAccs = root.Get("accessors");
+		const Json* pAcc = pAccs ? pAccs->At(idx) : nullptr;
+		if (!pAcc || pAcc->Get("sparse"))
+			return false;
+		string type = pAcc->Str("type");
+		acc.numComps = (type == "SCALAR") ? 1 : (type == "VEC2") ? 2 : (type == "VEC3") ? 3 : (type == "VEC4") ? 4 : 0;
+		acc.compType = pAcc->Int("componentType", 0);
+		acc.count = pAcc->Int("count", 0);
+		const Json* pNorm = pAcc->Get("normalized");
+		acc.normalized = pNorm && pNorm->num != 0;
+		size_t elemSize = acc.numComps * ComponentSize(acc.compType);
+		const Json* pViews = root.Get("bufferViews");
+		const Json* pView = pViews ? pViews->At(pAcc->Int("bufferView", -1)) : nullptr;
+		if (!pView || elemSize == 0 || acc.count <= 0)
+			return false;
+		int buffer = pView->Int("buffer", -1);
+		size_t viewOffset = (size_t)pView->Num("byteOffset", 0);
+		size_t viewBytes = (size_t)pView->Num("byteLength", 0);
+		if (buffer < 0 || buffer >= (int)buffers.size() || viewOffset + viewBytes > buffers[buffer].bytes)
+			return false;
+		acc.stride = (size_t)pView->Num("byteStride", 0);
+		if (acc.stride == 0)
+			acc.stride = elemSize;
+		size_t accOffset = (size_t)pAcc->Num("byteOffset", 0);
+		if (accOffset + (acc.count - 1) * acc.stride + elemSize > viewBytes)
+			return false;
+		acc.p = buffers[buffer].p + viewOffset + accOffset;
+		return true;
+	}
+
+	//one component of one element, as the spec says normalized integers turn into floats
+	static float ReadFloat(const Accessor& a, int elem, int comp)
+	{
+		const unsigned char* p = a.p + elem * a.stride;
+		switch (a.compType)
+		{
+		case 5126: { float f; memcpy(&f, p + comp * 4, 4); return f; }
+		case 5121: { float f = p[comp]; return a.normalized ? f / 255.f : f; }
+		case 5123: { unsigned short s; memcpy(&s, p + comp * 2, 2); return a.normalized ? s / 65535.f : s; }
+		case 5120: { float f = (signed char)p[comp]; return a.normalized ? max(f / 127.f, -1.f) : f; }
+		case 5122: { short s; memcpy(&s, p + comp * 2, 2); return a.normalized ? max(s / 32767.f, -1.f) : s; }
+		case 5125: { unsigned int u; memcpy(&u, p + comp * 4, 4); return (float)u; }
+		}
+		return 0;
+	}
+
+	static unsigned int ReadIndex(const Accessor& a, int elem)
+	{
+		const unsigned char* p = a.p + elem * a.stride;
+		switch (a.compType)
+		{
+		case 5121: return *p;
+		case 5123: { unsigned short s; memcpy(&s, p, 2); return s; }
+		case 5125: { unsigned int u; memcpy(&u, p, 4); return u; }
+		}
+		return 0;
+	}
+
+	//glTF matrices are column major
+	struct Mat4
+	{
+		float m[16] = { 1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 };
+		Mat4 operator*(const Mat4& b) const {
+			Mat4 r;
+			for (int c = 0; c < 4; ++c)
+				for (int row = 0; row < 4; ++row)
+				{
+					float sum = 0;
+					for (int k = 0; k < 4; ++k)
+						sum += m[k * 4 + row] * b.m[c * 4 + k];
+					r.m[c * 4 + row] = sum;
+				}
+			return r;
+		}
+	};
+
+	static Mat4 NodeMatrix(const Json& node)
+	{
+		Mat4 local;
+		const Json* pMat = node.Get("matrix");
+		if (pMat && pMat->Size() == 16)
+		{
+			for (int i = 0; i < 16; ++i)
+				local.m[i] = (float)pMat->items[i].num;
+			return local;
+		}
+		//translation * rotation * scale
+		float t[3] = { 0,0,0 }, q[4] = { 0,0,0,1 }, s[3] = { 1,1,1 };
+		const Json* pT = node.Get("translation");
+		const Json* pR = node.Get("rotation");
+		const Json* pS = node.Get("scale");
+		for (int i = 0; i < 3; ++i)
+		{
+			if (pT && pT->Size() == 3) t[i] = (float)pT->items[i].num;
+			if (pS && pS->Size() == 3) s[i] = (float)pS->items[i].num;
+		}
+		if (pR && pR->Size() == 4)
+			for (int i = 0; i < 4; ++i)
+				q[i] = (float)pR->items[i].num;
+		float x = q[0], y = q[1], z = q[2], w = q[3];
+		float rot[9] = {
+			1 - 2 * (y*y + z*z), 2 * (x*y + z*w), 2 * (x*z - y*w),
+			2 * (x*y - z*w), 1 - 2 * (x*x + z*z), 2 * (y*z + x*w),
+			2 * (x*z + y*w), 2 * (y*z - x*w), 1 - 2 * (x*x + y*y)
+		};
+		for (int c = 0; c < 3; ++c)
+			for (int r = 0; r < 3; ++r)
+				local.m[c * 4 + r] = rot[c * 3 + r] * s[c];
+		for (int i = 0; i < 3; ++i)
+			local.m[12 + i] = t[i];
+		return local;
+	}
+
+	//which meshes get drawn, and where
+	static void CollectMeshes(const Json& root, int nodeIdx, const Mat4& parent, vector<pair<int, Mat4>>& out, int depth)
+	{
+		const Json* pNodes = root.Get("nodes");
+		const Json* pNode = pNodes ? pNodes->At(nodeIdx) : nullptr;
+		if (!pNode || depth > 64)
+			return;
+		Mat4 world = parent * NodeMatrix(*pNode);
+		int mesh = pNode->Int("mesh", -1);
+		if (mesh >= 0)
+			out.push_back(make_pair(mesh, world));
+		const Json* pChildren = pNode->Get("children");
+		for (int i = 0; pChildren && i < pChildren->Size(); ++i)
+			CollectMeshes(root, (int)pChildren->items[i].num, world, out, depth + 1);
+	}
+
+	bool LoadGLTF(const string& fileName, Result& result, const Options& opts)
+	{
+		auto start = chrono::steady_clock::now();
+		result = Result();
+		MappedFile file;
+		if (!file.Open(fileName))
+		{
+			DBOUT("Cannot open " << fileName);
+			return false;
+		}
+		string folder = filesystem::path(fileName).parent_path().string();
+		const unsigned char* pData = (const unsigned char*)file.GetData();
+		size_t bytes = file.GetSize();
+		result.bytesParsed = bytes;
+
+		//.glb is a json chunk and an optional binary chunk
+		const char* pJson = (const char*)pData;
+		size_t jsonBytes = bytes;
+		Span glbBin;
+		unsigned int header[5] = { 0 };
+		if (bytes >= sizeof(header))
+			memcpy(header, pData, sizeof(header));
+		if (header[0] == 0x46546C67)	//"glTF"
+		{
+			if (header[1] != 2 || header[2] > bytes || header[4] != 0x4E4F534A || 20 + (size_t)header[3] > bytes)
+			{
+				DBOUT("glTF: bad glb header " << fileName);
+				return false;
+			}
+			pJson = (const char*)pData + 20;
+			jsonBytes = header[3];
+			size_t binAt = (20 + jsonBytes + 3) & ~(size_t)3;
+			unsigned int binHeader[2] = { 0 };
+			if (binAt + sizeof(binHeader) <= bytes)
+				memcpy(binHeader, pData + binAt, sizeof(binHeader));
+			if (binHeader[1] == 0x004E4942 && binAt + 8 + binHeader[0] <= bytes)
+			{
+				glbBin.p = pData + binAt + 8;
+				glbBin.bytes = binHeader[0];
+			}
+		}
+		Json root;
+		if (!JsonParser(pJson, pJson + jsonBytes).Parse(root) || root.type != Json::OBJECT)
+		{
+			DBOUT("glTF: can't parse json " << fileName);
+			return false;
+		}
+
+		//buffers are in the glb, embedded as base64 or in separate files
+		vector<Span> buffers;
+		vector<unique_ptr<MappedFile>> bufferFiles;
+		vector<vector<unsigned char>> decoded;
+		const Json* pBuffers = root.Get("buffers");
+		for (int i = 0; pBuffers && i < pBuffers->Size(); ++i)
+		{
+			const Json& b = pBuffers->items[i];
+			string uri = b.Str("uri");
+			Span span;
+			if (uri.empty())
+				span = glbBin;
+			else if (uri.compare(0, 5, "data:") == 0)
+			{
+				size_t comma = uri.find(',');
+				decoded.emplace_back();
+				if (comma == string::npos || !DecodeBase64(uri.data() + comma + 1, uri.data() + uri.size(), decoded.back()))
+				{
+					DBOUT("glTF: bad data uri in buffer " << i);
+					return false;
+				}
+				span.p = decoded.back().data();
+				span.bytes = decoded.back().size();
+			}
+			else
+			{
+				bufferFiles.emplace_back(new MappedFile);
+				if (!bufferFiles.back()->Open(JoinPath(folder, uri)))
+				{
+					DBOUT("glTF: cannot open buffer " << uri);
+					return false;
+				}
+				span.p = (const unsigned char*)bufferFiles.back()->GetData();
+				span.bytes = bufferFiles.back()->GetSize();
+				result.bytesParsed += span.bytes;
+			}
+			//the buffer can be bigger than it says, never smaller
+			if (span.bytes < (size_t)b.Num("byteLength", 0))
+			{
+				DBOUT("glTF: buffer " << i << " is too small");
+				return false;
+			}
+			buffers.push_back(span);
+		}
+
+		//materials, just the base colour
+		const Json* pMats = root.Get("materials");
+		const Json* pTextures = root.Get("textures");
+		const Json* pImages = root.Get("images");
+		for (int i = 0; pMats && i < pMats->Size(); ++i)
+		{
+			const Json& m = pMats->items[i];
+			ImportMaterial mat;
+			mat.name = m.Str("name");
+			mat.transparent = (m.Str("alphaMode") == "BLEND");
+			if (const Json* pPbr = m.Get("pbrMetallicRoughness"))
+			{
+				const Json* pCol = pPbr->Get("baseColorFactor");
+				if (pCol && pCol->Size() == 4)
+					mat.diffuse = Vector4((float)pCol->items[0].num, (float)pCol->items[1].num, (float)pCol->items[2].num, (float)pCol->items[3].num);
+				const Json* pTexInfo = pPbr->Get("baseColorTexture");
+				const Json* pTex = (pTexInfo && pTextures) ? pTextures->At(pTexInfo->Int("index", -1)) : nullptr;
+				const Json* pImage = (pTex && pImages) ? pImages->At(pTex->Int("source", -1)) : nullptr;
+				if (pImage)
+				{
+					string uri = pImage->Str("uri");
+					if (!uri.empty() && uri.compare(0, 5, "data:") != 0)
+						mat.texture = JoinPath(folder, uri);
+					else
+						DBOUT("glTF: embedded images aren't supported, material " << mat.name);
+				}
+			}
+			result.materials.push_back(mat);
+		}
+		int defaultMat = -1;
+
+		//the default scene's nodes, or every mesh if there isn't a scene
+		vector<pair<int, Mat4>> instances;
+		const Json* pScenes = root.Get("scenes");
+		const Json* pScene = pScenes ? pScenes->At(root.Int("scene", 0)) : nullptr;
+		const Json* pSceneNodes = pScene ? pScene->Get("nodes") : nullptr;
+		if (pSceneNodes)
+		{
+			for (int i = 0; i < pSceneNodes->Size(); ++i)
+				CollectMeshes(root, (int)pSceneNodes->items[i].num, Mat4(), instances, 0);
+		}
+		else if (const Json* pMeshes = root.Get("meshes"))
+			for (int i = 0; i < pMeshes->Size(); ++i)
+				instances.push_back(make_pair(i, Mat4()));
+
+		vector<int> triMaterial;
+		vector<bool> needNormal;
+		const Json* pMeshes = root.Get("meshes");
+		float zSign = opts.toLeftHanded ? -1.f : 1.f;
+		for (auto& inst : instances)
+		{
+			const Json* pMesh = pMeshes ? pMeshes->At(inst.first) : nullptr;
+			const Json* pPrims = pMesh ? pMesh->Get("primitives") : nullptr;
+			const Mat4& w = inst.second;
+			//normals need the inverse transpose, which is the cofactor matrix divided by the determinant
+			float nm[9];
+			for (int c = 0; c < 3; ++c)
+				for (int r = 0; r < 3; ++r)
+				{
+					int c1 = (c + 1) % 3, c2 = (c + 2) % 3, r1 = (r + 1) % 3, r2 = (r + 2) % 3;
+					nm[c * 3 + r] = w.m[c1 * 4 + r1] * w.m[c2 * 4 + r2] - w.m[c1 * 4 + r2] * w.m[c2 * 4 + r1];
+				}
+			float det = w.m[0] * nm[0] + w.m[4] * nm[3] + w.m[8] * nm[6];
+			//a mirroring transform turns the triangles inside out
+			bool flipWinding = (det < 0) != opts.toLeftHanded;
+
+			for (int p = 0; pPrims && p < pPrims->Size(); ++p)
+			{
+				const Json& prim = pPrims->items[p];
+				if (prim.Int("mode", 4) != 4)
+				{
+					DBOUT("glTF: only triangle lists are supported, skipping a primitive");
+					continue;
+				}
+				const Json* pAttribs = prim.Get("attributes");
+				Accessor pos, norm, tex, idx;
+				if (!pAttribs || !GetAccessor(root, pAttribs->Int("POSITION", -1), buffers, pos) || pos.numComps != 3)
+				{
+					DBOUT("glTF: primitive with no usable positions");
+					return false;
+				}
+				bool hasNorm = GetAccessor(root, pAttribs->Int("NORMAL", -1), buffers, norm) && norm.numComps == 3 && norm.count == pos.count;
+				bool hasTex = GetAccessor(root, pAttribs->Int("TEXCOORD_0", -1), buffers, tex) && tex.numComps == 2 && tex.count == pos.count;
+				bool hasIdx = (prim.Get("indices") != nullptr);
+				//indices can only be unsigned byte, short or int
+				if (hasIdx && (!GetAccessor(root, prim.Int("indices", -1), buffers, idx) || idx.numComps != 1
+					|| (idx.compType != 5121 && idx.compType != 5123 && idx.compType != 5125)))
+				{
+					DBOUT("glTF: bad indices");
+					return false;
+				}
+
+				int base = (int)result.verts.size();
+				int numVerts = pos.count;
+				result.verts.resize(base + numVerts);
+				needNormal.resize(base + numVerts, !hasNorm);
+				ParallelFor(numVerts, MIN_VERTS_PER_TASK, [&](int begin, int end) {
+					for (int i = begin; i < end; ++i)
+					{
+						VertexPosNormTex& v = result.verts[base + i];
+						float x = ReadFloat(pos, i, 0), y = ReadFloat(pos, i, 1), z = ReadFloat(pos, i, 2);
+						v.Pos.x = w.m[0] * x + w.m[4] * y + w.m[8] * z + w.m[12];
+						v.Pos.y = w.m[1] * x + w.m[5] * y + w.m[9] * z + w.m[13];
+						v.Pos.z = (w.m[2] * x + w.m[6] * y + w.m[10] * z + w.m[14]) * zSign;
+						if (hasNorm)
+						{
+							x = ReadFloat(norm, i, 0), y = ReadFloat(norm, i, 1), z = ReadFloat(norm, i, 2);
+							Vector3 n(nm[0] * x + nm[3] * y + nm[6] * z, nm[1] * x + nm[4] * y + nm[7] * z, nm[2] * x + nm[5] * y + nm[8] * z);
+							if (det < 0)
+								n = -n;
+							n.Normalize();
+							v.Norm = Vector3(n.x, n.y, n.z * zSign);
+						}
+						else
+							v.Norm = Vector3(0, 0, 0);
+						//glTF uvs already start top left
+						v.Tex = hasTex ? Vector2(ReadFloat(tex, i, 0), ReadFloat(tex, i, 1)) : Vector2(0, 0);
+					}
+				});
+
+				int numIndices = hasIdx ? idx.count : numVerts;
+				numIndices -= numIndices % 3;
+				size_t firstIndex = result.indices.size();
+				result.indices.resize(firstIndex + numIndices);
+				int numBad = 0;
+				for (int i = 0; i < numIndices; ++i)
+				{
+					unsigned int v = hasIdx ? ReadIndex(idx, i) : i;
+					if (v >= (unsigned int)numVerts)
+					{
+						v = 0;
+						++numBad;
+					}
+					result.indices[firstIndex + i] = base + v;
+				}
+				if (numBad)
+				{
+					DBOUT("glTF: index out of range");
+					return false;
+				}
+				if (flipWinding)
+					for (size_t i = firstIndex; i < result.indices.size(); i += 3)
+						swap(result.indices[i + 1], result.indices[i + 2]);
+
+				int mat = prim.Int("material", -1);
+				if (mat < 0 || mat >= (int)result.materials.size())
+				{
+					if (defaultMat < 0)
+					{
+						ImportMaterial def;
+						def.name = "default";
+						defaultMat = (int)result.materials.size();
+						result.materials.push_back(def);
+					}
+					mat = defaultMat;
+				}
+				triMaterial.insert(triMaterial.end(), numIndices / 3, mat);
+			}
+		}
+		if (result.indices.empty())
+		{
+			DBOUT("glTF: no triangles in " << fileName);
+			return false;
+		}
+
+		GenerateNormals(result, needNormal);
+		if (opts.weld)
+			WeldVertices(result);
+		GroupByMaterial(triMaterial, result);
+		result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		return true;
+	}
+
+	/*
+	*************************************************************
+	*/
+
+	bool Load(const string& fileName, Result& result, const Options& opts)
+	{
+		string ext = filesystem::path(fileName).extension().string();
+		for (char& c : ext)
+			c = (char)tolower(c);
+		bool ok;
+		if (ext == ".obj")
+			ok = LoadOBJ(fileName, result, opts);
+		else if (ext == ".gltf" || ext == ".glb")
+			ok = LoadGLTF(fileName, result, opts);
+		else
+		{
+			DBOUT("Don't know how to import " << fileName);
+			return false;
+		}
+		if (ok)
+			DBOUT("Imported " << fileName << ": " << result.verts.size() << " verts (" << result.numWelded << " welded), "
+				<< result.indices.size() / 3 << " tris, " << result.groups.size() << " materials in " << result.seconds * 1000 << "ms, "
+				<< (result.bytesParsed / (1024.0 * 1024.0)) / max(result.seconds, 1e-9) << "MB/s");
+		return ok;
+	}
+
+	string MakeTestOBJ(int gridSize)
+	{
+		//positions, uvs and normals on a wavy grid, like a scan
+		string text;
+		text.reserve((size_t)(gridSize + 1) * (gridSize + 1) * 100);
+		char line[256];
+		for (int z = 0; z <= gridSize; ++z)
+			for (int x = 0; x <= gridSize; ++x)
+			{
+				float h = sinf(x * 0.1f) * cosf(z * 0.1f);
+				snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n",
+					x * 0.01f, h, z * 0.01f, (float)x / gridSize, (float)z / gridSize, 0.f, 1.f, 0.f);
+				text += line;
+			}
+		int row = gridSize + 1;
+		for (int z = 0; z < gridSize; ++z)
+			for (int x = 0; x < gridSize; ++x)
+			{
+				int a = z * row + x + 1, b = a + 1, c = a + row, d = c + 1;
+				snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d\nf %d/%d/%d %d/%d/%d %d/%d/%d\n",
+					a, a, a, c, c, c, b, b, b, b, b, b, c, c, c, d, d, d);
+				text += line;
+			}
+		return text;
+	}
+
+	double BenchmarkOBJ(int gridSize)
+	{
+		string text = MakeTestOBJ(gridSize);
+		Result result;
+		if (!ParseOBJ(text.data(), text.size(), "", result))
+			return 0;
+		double mbs = (text.size() / (1024.0 * 1024.0)) / max(result.seconds, 1e-9);
+		DBOUT("OBJ benchmark: " << text.size() / (1024 * 1024) << "MB, " << result.indices.size() / 3 << " tris in "
+			<< result.seconds * 1000 << "ms = " << mbs << "MB/s");
+		return mbs;
+	}
+}
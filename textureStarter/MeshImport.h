@@ -0,0 +1,95 @@
+#ifndef MESHIMPORT_H
+#define MESHIMPORT_H
+
+#include <string>
+#include <vector>
+
+#include "ShaderTypes.h"
+
+/*
+Bring in geometry made by other programs - Wavefront OBJ (+MTL) and glTF 2.0
+(.gltf with .bin or embedded buffers, or .glb). Files are memory mapped and
+big ones are parsed in parallel chunks. Duplicate vertices are welded together
+and triangles are grouped by material so each group can become a SubMesh.
+Everything comes out left handed with D3D style uvs.
+See MeshMgr::ImportMesh to turn the result into a Mesh or a mesh file.
+*/
+namespace MeshImport
+{
+	//what the file said about a surface, the texture path is relative to the working folder
+	struct ImportMaterial
+	{
+		std::string name;
+		std::string texture;		//empty if none
+		DirectX::SimpleMath::Vector4 diffuse = DirectX::SimpleMath::Vector4(1, 1, 1, 1);
+		DirectX::SimpleMath::Vector4 ambient = DirectX::SimpleMath::Vector4(1, 1, 1, 1);
+		DirectX::SimpleMath::Vector4 specular = DirectX::SimpleMath::Vector4(0, 0, 0, 1);	//w = power
+		bool transparent = false;	//texture/diffuse alpha should be blended
+	};
+
+	//a range of triangles that use one material
+	struct Group
+	{
+		int material = 0;			//into Result::materials
+		int startIndex = 0;
+		int numIndices = 0;
+	};
+
+	struct Result
+	{
+		std::vector<VertexPosNormTex> verts;
+		std::vector<unsigned int> indices;
+		std::vector<ImportMaterial> materials;
+		std::vector<Group> groups;		//in material order, they don't overlap
+		//how it went
+		size_t bytesParsed = 0;
+		double seconds = 0;
+		int numWelded = 0;				//duplicate vertices removed
+	};
+
+	struct Options
+	{
+		bool toLeftHanded = true;	//both formats are right handed, flip z and the winding
+		bool weld = true;			//merge identical vertices
+	};
+
+	/*
+	* load an OBJ or glTF file, picked by extension (.obj .gltf .glb)
+	* fileName - IN file to load
+	* result - OUT geometry and materials
+	* opts - IN see Options
+	* returns - false if the file is missing or can't be understood, with a DBOUT saying why
+	*/
+	bool Load(const std::string& fileName, Result& result, const Options& opts = Options());
+	bool LoadOBJ(const std::string& fileName, Result& result, const Options& opts = Options());
+	bool LoadGLTF(const std::string& fileName, Result& result, const Options& opts = Options());
+
+	/*
+	* parse OBJ text that's already in memory
+	* pText, bytes - IN the text, doesn't need to be zero terminated
+	* folder - IN where to find mtllib files and textures, empty to ignore materials files
+	* result - OUT as Load
+	*/
+	bool ParseOBJ(const char* pText, size_t bytes, const std::string& folder, Result& result, const Options& opts = Options());
+
+	/*
+	* read a decimal number, quicker than atof/strtof because it doesn't care about locales
+	* p - IN/OUT start of the text, left just after the number
+	* pEnd - IN end of the text
+	* returns - the value, 0 and p unchanged if there isn't a number there
+	*/
+	float ParseFloat(const char*& p, const char* pEnd);
+
+	/*
+	* a big synthetic OBJ, a gridSize*gridSize wavy grid with uvs and normals, two triangles per square
+	* returns - the text
+	*/
+	std::string MakeTestOBJ(int gridSize);
+	/*
+	* make a MakeTestOBJ grid and time parsing it
+	* returns - MB/s
+	*/
+	double BenchmarkOBJ(int gridSize);
+}
+
+#endif
@@ -0,0 +1,226 @@
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+#include "MeshOptimiser.h"
+
+using namespace std;
+
+namespace MeshOpt
+{
+
+	CacheStats AnalyseVertexCache(const unsigned int indices[], int numIndices, int numVerts, int cacheSize)
+	{
+		CacheStats stats;
+		if (numIndices < 3 || numVerts <= 0)
+			return stats;
+
+		//a vertex is in the cache if fewer than cacheSize misses have happened since it was loaded
+		vector<int> loadedAt(numVerts, -1);
+		vector<bool> used(numVerts, false);
+		int misses = 0, numUsed = 0;
+		for (int i = 0; i < numIndices; ++i)
+		{
+			unsigned int v = indices[i];
+			assert(v < (unsigned int)numVerts);
+			if (loadedAt[v] < 0 || misses - loadedAt[v] >= cacheSize)
+			{
+				loadedAt[v] = misses;
+				++misses;
+			}
+			if (!used[v])
+			{
+				used[v] = true;
+				++numUsed;
+			}
+		}
+		stats.acmr = (float)misses / (numIndices / 3);
+		stats.atvr = (float)misses / numUsed;
+		return stats;
+	}
+
+	//Tipsify support - somewhere to go when the current fan runs out
+	static int SkipDeadEnd(vector<int>& deadEnd, const vector<int>& live, int& cursor, int numVerts)
+	{
+		//recently used vertices first, they might still be in the cache
+		while (!deadEnd.empty())
+		{
+			int d = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[d] > 0)
+				return d;
+		}
+		//otherwise just the next vertex with something left to draw
+		while (cursor < numVerts)
+		{
+			if (live[cursor] > 0)
+				return cursor;
+			++cursor;
+		}
+		return -1;
+	}
+
+	void OptimiseVertexCache(const unsigned int indices[], int numIndices, int numVerts, unsigned int out[],
+		int cacheSize, vector<int>* pClusters)
+	{
+		assert(indices != out);
+		assert(numIndices % 3 == 0);
+		if (pClusters)
+			pClusters->clear();
+		if (numIndices % 3 != 0)
+		{
+			//not a triangle list, the triangle bookkeeping below would run off the end, leave it as it is
+			copy(indices, indices + numIndices, out);
+			return;
+		}
+		int numTris = numIndices / 3;
+		if (numTris == 0)
+			return;
+
+		//vertex -> triangles adjacency, packed into one array
+		vector<int> live(numVerts, 0), adjStart(numVerts + 1, 0), adj(numIndices);
+		for (int i = 0; i < numIndices; ++i)
+			++live[indices[i]];
+		for (int v = 0; v < numVerts; ++v)
+			adjStart[v + 1] = adjStart[v] + live[v];
+		vector<int> fill(adjStart.begin(), adjStart.end() - 1);
+		for (int i = 0; i < numIndices; ++i)
+			adj[fill[indices[i]]++] = i / 3;
+
+		vector<int> cacheTime(numVerts, 0), deadEnd, candidates;
+		vector<bool> emitted(numTris, false);
+		deadEnd.reserve(numIndices);
+		int time = cacheSize + 1, cursor = 0, numOut = 0;
+		bool newCluster = true;
+
+		int fan = SkipDeadEnd(deadEnd, live, cursor, numVerts);
+		while (fan >= 0)
+		{
+			if (newCluster && pClusters)
+				pClusters->push_back(numOut / 3);
+			candidates.clear();
+			//emit every triangle around the fanning vertex
+			for (int a = adjStart[fan]; a < adjStart[fan + 1]; ++a)
+			{
+				int t = adj[a];
+				if (emitted[t])
+					continue;
+				for (int c = 0; c < 3; ++c)
+				{
+					int v = indices[t * 3 + c];
+					out[numOut++] = v;
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					--live[v];
+					if (time - cacheTime[v] > cacheSize)
+						cacheTime[v] = time++;
+				}
+				emitted[t] = true;
+			}
+
+			//next fan - the candidate that will still be in the cache after its own triangles are drawn
+			int best = -1, bestPriority = -1;
+			for (int v : candidates)
+			{
+				if (live[v] <= 0)
+					continue;
+				int priority = 0;
+				if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+					priority = time - cacheTime[v];
+				if (priority > bestPriority)
+				{
+					bestPriority = priority;
+					best = v;
+				}
+			}
+			newCluster = (best == -1);
+			fan = (best == -1) ? SkipDeadEnd(deadEnd, live, cursor, numVerts) : best;
+		}
+		assert(numOut == numTris * 3);
+	}
+
+	void OptimiseOverdraw(unsigned int indices[], int numIndices, const float* pPositions, int stride,
+		const vector<int>& clusters)
+	{
+		int numTris = numIndices / 3;
+		int numClusters = (int)clusters.size();
+		if (numClusters < 2)
+			return;
+		auto pos = [pPositions, stride](unsigned int v) {
+			return (const float*)((const char*)pPositions + (size_t)v * stride);
+		};
+
+		//area weighted centre and normal of each cluster, and of the whole mesh
+		struct Cluster
+		{
+			int start, end;
+			float centre[3] = { 0,0,0 }, normal[3] = { 0,0,0 }, area = 0;
+			float sortKey = 0;
+		};
+		vector<Cluster> cl(numClusters);
+		float meshCentre[3] = { 0,0,0 }, meshArea = 0;
+		for (int c = 0; c < numClusters; ++c)
+		{
+			Cluster& k = cl[c];
+			k.start = clusters[c];
+			k.end = (c + 1 < numClusters) ? clusters[c + 1] : numTris;
+			for (int t = k.start; t < k.end; ++t)
+			{
+				const float *a = pos(indices[t * 3]), *b = pos(indices[t * 3 + 1]), *d = pos(indices[t * 3 + 2]);
+				float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+				float e2[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+				float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+				float area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) * 0.5f;
+				for (int i = 0; i < 3; ++i)
+				{
+					k.centre[i] += (a[i] + b[i] + d[i]) * (area / 3.f);
+					k.normal[i] += n[i];
+				}
+				k.area += area;
+			}
+			for (int i = 0; i < 3; ++i)
+				meshCentre[i] += k.centre[i];
+			meshArea += k.area;
+			if (k.area > 0)
+				for (int i = 0; i < 3; ++i)
+					k.centre[i] /= k.area;
+		}
+		if (meshArea <= 0)
+			return;
+		for (int i = 0; i < 3; ++i)
+			meshCentre[i] /= meshArea;
+
+		//how much does the cluster face away from the middle of the mesh
+		for (Cluster& k : cl)
+		{
+			float len = sqrtf(k.normal[0] * k.normal[0] + k.normal[1] * k.normal[1] + k.normal[2] * k.normal[2]);
+			if (len > 0)
+				for (int i = 0; i < 3; ++i)
+					k.sortKey += (k.centre[i] - meshCentre[i]) * k.normal[i] / len;
+		}
+		stable_sort(cl.begin(), cl.end(), [](const Cluster& a, const Cluster& b) {
+			return a.sortKey > b.sortKey;
+		});
+
+		vector<unsigned int> copy(indices, indices + numTris * 3);
+		int numOut = 0;
+		for (const Cluster& k : cl)
+			for (int i = k.start * 3; i < k.end * 3; ++i)
+				indices[numOut++] = copy[i];
+	}
+
+	int OptimiseVertexFetch(unsigned int indices[], int numIndices, int numVerts, vector<int>& remap)
+	{
+		remap.assign(numVerts, -1);
+		int next = 0;
+		for (int i = 0; i < numIndices; ++i)
+		{
+			unsigned int v = indices[i];
+			assert(v < (unsigned int)numVerts);
+			if (remap[v] < 0)
+				remap[v] = next++;
+			indices[i] = remap[v];
+		}
+		return next;
+	}
+}
@@ -0,0 +1,79 @@
+#ifndef MESHOPTIMISER_H
+#define MESHOPTIMISER_H
+
+#include <vector>
+
+/*
+Reorder triangles and vertices so the gpu does less work, all CPU side, run
+once when a mesh is created. Nothing here knows about d3d so it can be used
+by tools too.
+1. OptimiseVertexCache - triangles are reordered so recently transformed vertices
+   get reused from the post transform cache (Tipsify, Sander et al 2007)
+2. OptimiseOverdraw - groups of triangles (clusters) are put in an order so 
+   outward facing bits that are likely to hide others get drawn first
+3. OptimiseVertexFetch - vertices are renumbered in the order they are first used
+   so the gpu reads the vertex buffer (more or less) in a straight line
+*/
+namespace MeshOpt
+{
+	//a conservative guess at the post transform cache size, too big is worse than too small
+	const int CACHE_SIZE = 16;
+
+	//how well an index order uses a post transform vertex cache
+	struct CacheStats
+	{
+		float acmr = 0;		//average cache miss ratio, vertices transformed per triangle 0.5-3, lower is better
+		float atvr = 0;		//average transform to vertex ratio, 1 is perfect
+	};
+
+	/*
+	* simulate a FIFO vertex cache to see how well an index order will work
+	* indices, numIndices - IN triangle list
+	* numVerts - IN how many vertices there are
+	* cacheSize - IN how many vertices the cache holds, 16-32 is typical
+	*/
+	CacheStats AnalyseVertexCache(const unsigned int indices[], int numIndices, int numVerts, int cacheSize = CACHE_SIZE);
+
+	/*
+	* reorder the triangles to reuse vertices in the cache (Tipsify)
+	* indices, numIndices - IN triangle list, numIndices must be a multiple of 3 (anything else is copied out unchanged)
+	* numVerts - IN how many vertices there are
+	* out - OUT reordered triangle list, numIndices long, can't be the same as indices
+	* cacheSize - IN cache size to optimise for
+	* pClusters - OUT optional, where the order had to jump (the cache was as good as flushed), these are
+	*				the start triangles of groups that can be moved around without hurting the cache much
+	*/
+	void OptimiseVertexCache(const unsigned int indices[], int numIndices, int numVerts, unsigned int out[],
+		int cacheSize = CACHE_SIZE, std::vector<int>* pClusters = nullptr);
+
+	/*
+	* reorder clusters of triangles to reduce overdraw, surfaces facing out from the middle
+	* of the mesh go first as they're the most likely to hide other bits
+	* indices, numIndices - IN/OUT triangle list, normally the output from OptimiseVertexCache
+	* pPositions - IN first vertex position, 3 floats
+	* stride - IN bytes from one position to the next
+	* clusters - IN start triangle of each cluster, from OptimiseVertexCache
+	*/
+	void OptimiseOverdraw(unsigned int indices[], int numIndices, const float* pPositions, int stride,
+		const std::vector<int>& clusters);
+
+	/*
+	* renumber vertices in the order the triangles first use them
+	* indices, numIndices - IN/OUT triangle list, rewritten to use the new numbers
+	* numVerts - IN how many vertices there are
+	* remap - OUT remap[old] = new vertex index, or -1 if not used
+	* returns - how many vertices are used
+	*/
+	int OptimiseVertexFetch(unsigned int indices[], int numIndices, int numVerts, std::vector<int>& remap);
+
+	//move vertices to where OptimiseVertexFetch says they should go
+	template<class T>
+	void RemapVertices(const T in[], int numVerts, const std::vector<int>& remap, T out[])
+	{
+		for (int i = 0; i < numVerts; ++i)
+			if (remap[i] >= 0)
+				out[remap[i]] = in[i];
+	}
+}
+
+#endif
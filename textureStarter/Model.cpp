@@ -8,22 +8,115 @@ using namespace DirectX::SimpleMath;
 
 void Model::Initialise(const std::string& meshFileName)
 {
-	MyD3D& d3d = WinUtil::Get().GetD3D();
-	
+	Mesh* pMesh = WinUtil::Get().GetD3D().GetMeshMgr().LoadMesh(meshFileName);
+	assert(pMesh);
+	Initialise(*pMesh);
 }
 
 
 void Model::Initialise(Mesh &mesh)
 {
-	mpMesh = &mesh;
-	mPosition = Vector3(0, 0, 0);
-	mScale = Vector3(1, 1, 1);
-	mRotation = Vector3(0, 0, 0);
+	mMesh = mesh.GetHandle();
+	TransformStore& store = WinUtil::Get().GetD3D().GetTransforms();
+	store.Remove(mTransform);
+	mTransform = store.Add();
 }
 
-void Model::GetWorldMatrix(DirectX::SimpleMath::Matrix& w)
+void Model::Initialise(MeshHandle mesh, TransformHandle transform)
 {
-	w = Matrix::CreateScale(mScale) * Matrix::CreateRotationX(mRotation.x) *
-		Matrix::CreateRotationY(mRotation.y) * Matrix::CreateRotationZ(mRotation.z) *
-		Matrix::CreateTranslation(mPosition);
+	mMesh = mesh;
+	if (!mTransform.IsNull())
+		WinUtil::Get().GetD3D().GetTransforms().Remove(mTransform);
+	mTransform = transform;
+}
+
+Model::~Model()
+{
+	//nothing to free if it was never initialised
+	if (!mTransform.IsNull())
+		WinUtil::Get().GetD3D().GetTransforms().Remove(mTransform);
+}
+
+Model& Model::operator=(const Model& m)
+{
+	if (this == &m)
+		return *this;
+	mMesh = m.mMesh;
+	mpPalette = m.mpPalette;
+	mNumBones = m.mNumBones;
+	if (m.mTransform.IsNull())
+		return *this;
+	TransformStore& store = WinUtil::Get().GetD3D().GetTransforms();
+	if (mTransform.IsNull())
+		mTransform = store.Add(store.GetPosition(m.mTransform), store.GetRotation(m.mTransform), store.GetScale(m.mTransform));
+	else
+	{
+		store.SetPosition(mTransform, store.GetPosition(m.mTransform));
+		store.SetRotation(mTransform, store.GetRotation(m.mTransform));
+		store.SetScale(mTransform, store.GetScale(m.mTransform));
+	}
+	return *this;
+}
+
+void Model::SetOverrideMat(Material* pMat)
+{
+	if (!pMat) {
+		mUseOverrideMat = false;
+		return;
+	}
+	mUseOverrideMat = true;
+	mOverrideMaterial = *pMat;
+	WinUtil::Get().GetD3D().GetFX().CompileMaterial(mOverrideMaterial, HasMesh() ? GetMesh().GetVertexFormat() : VertexFormat::FULL);
+}
+
+Mesh& Model::GetMesh()
+{
+	Mesh* p = WinUtil::Get().GetD3D().GetMeshMgr().GetMesh(mMesh);
+	assert(p);
+	return *p;
+}
+
+bool Model::HasMesh() const
+{
+	return WinUtil::Get().GetD3D().GetMeshMgr().IsValid(mMesh);
+}
+
+Vector3 Model::GetPosition() const
+{
+	return WinUtil::Get().GetD3D().GetTransforms().GetPosition(mTransform);
+}
+
+Vector3 Model::GetScale() const
+{
+	return WinUtil::Get().GetD3D().GetTransforms().GetScale(mTransform);
+}
+
+Quaternion Model::GetRotation() const
+{
+	return WinUtil::Get().GetD3D().GetTransforms().GetRotation(mTransform);
+}
+
+void Model::SetPosition(const Vector3& pos)
+{
+	WinUtil::Get().GetD3D().GetTransforms().SetPosition(mTransform, pos);
+}
+
+void Model::SetScale(const Vector3& scale)
+{
+	WinUtil::Get().GetD3D().GetTransforms().SetScale(mTransform, scale);
+}
+
+void Model::SetRotation(const Quaternion& rot)
+{
+	WinUtil::Get().GetD3D().GetTransforms().SetRotation(mTransform, rot);
+}
+
+void Model::SetRotation(const Vector3& angles)
+{
+	SetRotation(TransformStore::FromEuler(angles));
+}
+
+const Matrix& Model::GetWorldMatrix()
+{
+	return WinUtil::Get().GetD3D().GetTransforms().GetMatrices(mTransform).world;
 }
@@ -5,31 +5,42 @@
 #include <cassert>
 #include "d3d.h"
 
-//forward declaration, only using a reference/pointer
-class Mesh;
-
 /*
 * A model is a rendered instance of a mesh, which is geometry
 */
 class Model
 {
 public:
-	//go find the mesh with this name and setup
+	//load the mesh file (see MeshFile) if it isn't already and setup
 	void Initialise(const std::string& meshFileName);
 	//setup using the given mesh
 	void Initialise(Mesh& mesh);
+	/*
+	* setup with a transform that's already been added (e.g. lots at once, see TransformStore::Add),
+	* the model takes it over. Different models without a transform can be done on different threads.
+	*/
+	void Initialise(MeshHandle mesh, TransformHandle transform);
 
-	//get and optionally set pos/scale/rotation
-	DirectX::SimpleMath::Vector3& GetPosition() { return mPosition; }
-	DirectX::SimpleMath::Vector3& GetScale() { return mScale; }
-	DirectX::SimpleMath::Vector3& GetRotation() { return mRotation; }
-	//build a matrix from the euler angles, pos and scale
-	//note that this hard codes a concatenation order that you might not want
-	void GetWorldMatrix(DirectX::SimpleMath::Matrix& w);
-	//get the mesh this model is using
-	Mesh& GetMesh() {
-		assert(mpMesh);
-		return *mpMesh;
+	//where it is, kept in the TransformStore, setting marks it to be rebuilt
+	DirectX::SimpleMath::Vector3 GetPosition() const;
+	DirectX::SimpleMath::Vector3 GetScale() const;
+	DirectX::SimpleMath::Quaternion GetRotation() const;
+	void SetPosition(const DirectX::SimpleMath::Vector3& pos);
+	void SetScale(const DirectX::SimpleMath::Vector3& scale);
+	void SetRotation(const DirectX::SimpleMath::Quaternion& rot);
+	//euler angles in radians, applied x then y then z
+	void SetRotation(const DirectX::SimpleMath::Vector3& angles);
+	//scale * rotation * translation, rebuilt now if it's moved since TransformStore::Update
+	const DirectX::SimpleMath::Matrix& GetWorldMatrix();
+	TransformHandle GetTransform() const {
+		return mTransform;
+	}
+	//get the mesh this model is using, it must still be in the MeshMgr
+	Mesh& GetMesh();
+	//false if there's no mesh or it's been released
+	bool HasMesh() const;
+	MeshHandle GetMeshHandle() const {
+		return mMesh;
 	}
 	//has this model been configured to use a custom material
 	Material* HasOverrideMat() {
@@ -38,29 +49,40 @@ public:
 		return nullptr;
 	}
 	//tell the model to use a custom material (take a copy of it) or stop using one
-	void SetOverrideMat(Material* pMat = nullptr) {
-		if (!pMat) {
-			mUseOverrideMat = false;
-			return;
-		}
-		mUseOverrideMat = true;
-		mOverrideMaterial = *pMat;
+	void SetOverrideMat(Material* pMat = nullptr);
+	/*
+	* bone matrices for a skinned mesh (see Animator::GetPalette), not copied so they must
+	* stay alive and unchanged until the frame is drawn
+	* pPalette - IN one matrix per bone the mesh uses, nullptr if it isn't skinned
+	* numBones - IN how many, up to MAX_BONES
+	*/
+	void SetPalette(const DirectX::SimpleMath::Matrix* pPalette, int numBones) {
+		assert(!pPalette || (numBones > 0 && numBones <= MAX_BONES));
+		mpPalette = pPalette;
+		mNumBones = numBones;
 	}
-	//copy a model
-	Model& operator=(const Model& m)
-	{
-		mpMesh = m.mpMesh;
-		mPosition = m.mPosition;
-		mScale = m.mScale;
-		mRotation = m.mRotation;
-		return *this;
+	const DirectX::SimpleMath::Matrix* GetPalette() const {
+		return mpPalette;
 	}
+	int GetNumBones() const {
+		return mNumBones;
+	}
+	Model() {}
+	//copies get their own transform
+	Model(const Model& m) {
+		*this = m;
+	}
+	~Model();
+	//copy a model
+	Model& operator=(const Model& m);
 private:
 
-	Mesh* mpMesh = nullptr;		//the mesh we are using
-	DirectX::SimpleMath::Vector3 mPosition, mScale, mRotation;	//positon, scale and orientation
+	MeshHandle mMesh;		//the mesh we are using
+	TransformHandle mTransform;		//positon, scale and orientation
 	Material mOverrideMaterial;		//an alternate material to the one in the Mesh
 	bool mUseOverrideMat = false;	//should we actually be using it?
+	const DirectX::SimpleMath::Matrix* mpPalette = nullptr;		//bone matrices if the mesh is skinned
+	int mNumBones = 0;
 };
 
 #endif
@@ -0,0 +1,57 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+
+#include "JobSystem.h"
+
+//most pieces a ParallelFor is cut into, whatever the core count
+static constexpr int MAX_PARALLEL_CHUNKS = 256;
+
+/*
+Split the range 0->count into a few chunks per core and run fn(begin, end) on
+each chunk at the same time, returns when they've all finished.
+The chunks are jobs (see JobSystem), the calling thread does the first chunk
+itself and then helps with the rest, so it can be called from inside a job too.
+jobs - IN the job system to run on, JobSystem::Get() if not given
+count - IN size of the range
+minPerChunk - IN don't bother splitting up work smaller than this, jobs aren't free
+fn - IN void fn(int begin, int end), must be safe to run on different chunks at once
+*/
+template<class Fn>
+void ParallelFor(JobSystem& jobs, int count, int minPerChunk, Fn fn)
+{
+	if (count <= 0)
+		return;
+	int maxChunks = std::min(MAX_PARALLEL_CHUNKS, jobs.GetNumThreads() * JobSystem::CHUNKS_PER_THREAD);
+	int numChunks = std::min(maxChunks, (count + minPerChunk - 1) / std::max(1, minPerChunk));
+	if (numChunks <= 1)
+	{
+		fn(0, count);
+		return;
+	}
+	//the jobs only need to last until Wait returns
+	JobSystem::Job chunks[MAX_PARALLEL_CHUNKS];
+	for (int c = 1; c < numChunks; ++c)
+	{
+		JobSystem::Job& job = chunks[c - 1];
+		job.fn = [](void* data, int begin, int end) {
+			(*(Fn*)data)(begin, end);
+		};
+		job.data = &fn;
+		job.begin = (int)((long long)count * c / numChunks);
+		job.end = (int)((long long)count * (c + 1) / numChunks);
+	}
+	JobSystem::Counter done;
+	jobs.Run(chunks, numChunks - 1, done);
+	fn(0, (int)((long long)count / numChunks));
+	jobs.Wait(done);
+}
+
+template<class Fn>
+void ParallelFor(int count, int minPerChunk, Fn fn)
+{
+	ParallelFor(JobSystem::Get(), count, minPerChunk, fn);
+}
+
+#endif
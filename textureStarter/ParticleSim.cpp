@@ -0,0 +1,322 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+#include "ParticleSim.h"
+#include "DebugOut.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+using namespace std;
+
+//a colour as the bytes the shader reads as RGBA8
+static unsigned int PackColour(const float colour[4])
+{
+	unsigned int packed = 0;
+	for (int i = 0; i < 4; ++i)
+		packed |= (unsigned int)(std::max(0.f, std::min(colour[i], 1.f)) * 255 + 0.5f) << (i * 8);
+	return packed;
+}
+
+//the colours the simulation lerps between, kept in 0-255 so a lerp never needs clamping
+static void ColourRange(const ParticleSim::Settings& s, float start[4], float delta[4])
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		start[i] = std::max(0.f, std::min(s.startColour[i], 1.f)) * 255;
+		delta[i] = std::max(0.f, std::min(s.endColour[i], 1.f)) * 255 - start[i];
+	}
+}
+
+int ParticleSim::AddEmitter(const Settings& settings)
+{
+	assert(settings.maxParticles > 0 && settings.minLife > 0 && settings.maxLife >= settings.minLife);
+	assert(settings.numFrames > 0);
+	mEmitters.push_back(Emitter());
+	Emitter& e = mEmitters.back();
+	e.settings = settings;
+	//different emitters shouldn't spray the same pattern
+	e.rng = 0x9E3779B9u * (unsigned int)mEmitters.size();
+
+	const int n = settings.maxParticles;
+	for (int c = 0; c < 3; ++c)
+	{
+		e.pos[c].resize(n);
+		e.vel[c].resize(n);
+	}
+	e.age.resize(n);
+	e.invLife.resize(n);
+	e.size.resize(n);
+	e.colour.resize(n);
+	e.frame.resize(n);
+	return (int)mEmitters.size() - 1;
+}
+
+void ParticleSim::Burst(int emitter, int count)
+{
+	assert(count >= 0);
+	mEmitters.at(emitter).burst += count;
+}
+
+void ParticleSim::Clear(int emitter)
+{
+	Emitter& e = mEmitters.at(emitter);
+	e.numParticles = 0;
+	e.burst = 0;
+	e.spawnCarry = 0;
+}
+
+int ParticleSim::GetNumParticles() const
+{
+	int total = 0;
+	for (const Emitter& e : mEmitters)
+		total += e.numParticles;
+	return total;
+}
+
+void ParticleSim::Spawn(Emitter& e, float dTime)
+{
+	const Settings& s = e.settings;
+	float wanted = s.rate * dTime + e.spawnCarry;
+	int count = (int)wanted + e.burst;
+	e.spawnCarry = wanted - floorf(wanted);
+	e.burst = 0;
+	count = std::min(count, s.maxParticles - e.numParticles);
+	if (count <= 0)
+		return;
+
+	//xorshift, plenty random for sparks and cheap enough to call a few times per particle
+	unsigned int x = e.rng;
+	auto unit = [&x]() {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		return (x >> 8) * (1 / 16777216.f);
+	};
+	const unsigned int colour = PackColour(s.startColour);
+	for (int i = e.numParticles; i < e.numParticles + count; ++i)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			e.pos[c][i] = s.pos[c] + s.posSpread[c] * (unit() * 2 - 1);
+			e.vel[c][i] = s.velocity[c] + s.velSpread[c] * (unit() * 2 - 1);
+		}
+		e.age[i] = 0;
+		e.invLife[i] = 1 / (s.minLife + (s.maxLife - s.minLife) * unit());
+		e.size[i] = s.startSize;
+		e.colour[i] = colour;
+		e.frame[i] = 0;
+	}
+	e.rng = x;
+	e.numParticles += count;
+}
+
+void ParticleSim::SimulatePlain(Emitter& e, int begin, int end, float dTime, vector<int>& dead)
+{
+	const Settings& s = e.settings;
+	const float damp = std::max(0.f, 1 - s.drag * dTime);
+	const float gravity[3] = { s.gravity[0] * dTime, s.gravity[1] * dTime, s.gravity[2] * dTime };
+	const float sizeDelta = s.endSize - s.startSize;
+	float colStart[4], colDelta[4];
+	ColourRange(s, colStart, colDelta);
+	const int lastFrame = s.numFrames - 1;
+	for (int i = begin; i < end; ++i)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			float v = e.vel[c][i] * damp + gravity[c];
+			e.vel[c][i] = v;
+			e.pos[c][i] += v * dTime;
+		}
+		float age = e.age[i] + dTime;
+		e.age[i] = age;
+		float t = age * e.invLife[i];
+		if (t >= 1)
+			dead.push_back(i);
+		t = std::min(t, 1.f);
+		e.size[i] = s.startSize + t * sizeDelta;
+		unsigned int colour = 0;
+		for (int c = 0; c < 4; ++c)
+			colour |= (unsigned int)(colStart[c] + t * colDelta[c] + 0.5f) << (c * 8);
+		e.colour[i] = colour;
+		e.frame[i] = (unsigned int)std::min((int)(t * s.numFrames), lastFrame);
+	}
+}
+
+SIMD_AVX2 void ParticleSim::SimulateAVX2(Emitter& e, int begin, int end, float dTime, vector<int>& dead)
+{
+	const Settings& s = e.settings;
+	const __m256 dt = _mm256_set1_ps(dTime);
+	const __m256 damp = _mm256_set1_ps(std::max(0.f, 1 - s.drag * dTime));
+	const __m256 gravity[3] = { _mm256_set1_ps(s.gravity[0] * dTime), _mm256_set1_ps(s.gravity[1] * dTime), _mm256_set1_ps(s.gravity[2] * dTime) };
+	const __m256 sizeStart = _mm256_set1_ps(s.startSize), sizeDelta = _mm256_set1_ps(s.endSize - s.startSize);
+	float colStart[4], colDelta[4];
+	ColourRange(s, colStart, colDelta);
+	__m256 cStart[4], cDelta[4];
+	for (int c = 0; c < 4; ++c)
+	{
+		cStart[c] = _mm256_set1_ps(colStart[c] + 0.5f);
+		cDelta[c] = _mm256_set1_ps(colDelta[c]);
+	}
+	const __m256 one = _mm256_set1_ps(1);
+	const __m256 numFrames = _mm256_set1_ps((float)s.numFrames);
+	const __m256i lastFrame = _mm256_set1_epi32(s.numFrames - 1);
+	int i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			__m256 v = _mm256_fmadd_ps(_mm256_loadu_ps(&e.vel[c][i]), damp, gravity[c]);
+			_mm256_storeu_ps(&e.vel[c][i], v);
+			_mm256_storeu_ps(&e.pos[c][i], _mm256_fmadd_ps(v, dt, _mm256_loadu_ps(&e.pos[c][i])));
+		}
+		__m256 age = _mm256_add_ps(_mm256_loadu_ps(&e.age[i]), dt);
+		_mm256_storeu_ps(&e.age[i], age);
+		__m256 t = _mm256_mul_ps(age, _mm256_loadu_ps(&e.invLife[i]));
+		int deadMask = _mm256_movemask_ps(_mm256_cmp_ps(t, one, _CMP_GE_OQ));
+		t = _mm256_min_ps(t, one);
+		_mm256_storeu_ps(&e.size[i], _mm256_fmadd_ps(t, sizeDelta, sizeStart));
+		//each channel to a byte and shifted into place
+		__m256i colour = _mm256_cvttps_epi32(_mm256_fmadd_ps(t, cDelta[0], cStart[0]));
+		for (int c = 1; c < 4; ++c)
+		{
+			__m256i channel = _mm256_cvttps_epi32(_mm256_fmadd_ps(t, cDelta[c], cStart[c]));
+			colour = _mm256_or_si256(colour, _mm256_slli_epi32(channel, c * 8));
+		}
+		_mm256_storeu_si256((__m256i*)&e.colour[i], colour);
+		__m256i frame = _mm256_min_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(t, numFrames)), lastFrame);
+		_mm256_storeu_si256((__m256i*)&e.frame[i], frame);
+		if (deadMask)
+			for (int lane = 0; lane < 8; ++lane)
+				if (deadMask & (1 << lane))
+					dead.push_back(i + lane);
+	}
+	SimulatePlain(e, i, end, dTime, dead);
+}
+
+void ParticleSim::RemoveDead(Emitter& e, const vector<int>& dead)
+{
+	//last first, so whatever is on the end is always alive (or the dead one itself)
+	for (int d = (int)dead.size() - 1; d >= 0; --d)
+	{
+		int i = dead[d];
+		int last = --e.numParticles;
+		if (i == last)
+			continue;
+		for (int c = 0; c < 3; ++c)
+		{
+			e.pos[c][i] = e.pos[c][last];
+			e.vel[c][i] = e.vel[c][last];
+		}
+		e.age[i] = e.age[last];
+		e.invLife[i] = e.invLife[last];
+		e.size[i] = e.size[last];
+		e.colour[i] = e.colour[last];
+		e.frame[i] = e.frame[last];
+	}
+}
+
+void ParticleSim::Update(float dTime, bool allowAVX2, bool allowThreads)
+{
+	const int numEmitters = (int)mEmitters.size();
+	const int minPerChunk = allowThreads ? 1 : std::max(1, numEmitters);
+	//each emitter has its own random numbers, so they can all spawn at once
+	ParallelFor(numEmitters, minPerChunk, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+			Spawn(mEmitters[i], dTime);
+	});
+
+	//every emitter's particles cut into blocks, so one big emitter still uses every core
+	mNumJobs = 0;
+	mFirstJob.resize(numEmitters + 1);
+	for (int i = 0; i < numEmitters; ++i)
+	{
+		mFirstJob[i] = mNumJobs;
+		for (int begin = 0; begin < mEmitters[i].numParticles; begin += BLOCK_SIZE)
+		{
+			if (mNumJobs == (int)mJobs.size())
+				mJobs.push_back(Job());
+			Job& job = mJobs[mNumJobs++];
+			job.emitter = i;
+			job.begin = begin;
+			job.end = std::min(begin + BLOCK_SIZE, mEmitters[i].numParticles);
+			job.dead.clear();
+		}
+	}
+	mFirstJob[numEmitters] = mNumJobs;
+	bool avx2 = allowAVX2 && Simd::HasAVX2();
+	ParallelFor(mNumJobs, allowThreads ? 1 : std::max(1, mNumJobs), [&](int begin, int end) {
+		for (int j = begin; j < end; ++j)
+		{
+			Job& job = mJobs[j];
+			if (avx2)
+				SimulateAVX2(mEmitters[job.emitter], job.begin, job.end, dTime, job.dead);
+			else
+				SimulatePlain(mEmitters[job.emitter], job.begin, job.end, dTime, job.dead);
+		}
+	});
+
+	//blocks of one emitter done last to first, so the dead go from the back
+	ParallelFor(numEmitters, minPerChunk, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+			for (int j = mFirstJob[i + 1] - 1; j >= mFirstJob[i]; --j)
+				RemoveDead(mEmitters[i], mJobs[j].dead);
+	});
+}
+
+ParticleSim::Settings ParticleSim::BenchmarkFountain(int emitter, int numParticles)
+{
+	assert(emitter >= 0 && emitter < BENCHMARK_EMITTERS);
+	Settings s;
+	s.numFrames = 4;
+	s.maxParticles = numParticles / BENCHMARK_EMITTERS + numParticles / 8;
+	s.pos[0] = emitter * 4.f;
+	s.posSpread[0] = s.posSpread[2] = 0.1f;
+	s.velocity[1] = 8;
+	s.velSpread[0] = s.velSpread[1] = s.velSpread[2] = 2;
+	s.minLife = 1;
+	s.maxLife = 3;
+	//lives average 2 seconds, so this many a second settles at numParticles
+	s.rate = (float)(numParticles / BENCHMARK_EMITTERS) / 2;
+	s.drag = 0.2f;
+	const float start[4] = { 1, 0.9f, 0.3f, 1 }, end[4] = { 1, 0.1f, 0, 0 };
+	std::copy(start, start + 4, s.startColour);
+	std::copy(end, end + 4, s.endColour);
+	s.startSize = 0.05f;
+	s.endSize = 0.2f;
+	return s;
+}
+
+double ParticleSim::Benchmark(int numParticles, int numFrames)
+{
+	const float dTime = 1 / 60.f;
+	ParticleSim sim;
+	for (int i = 0; i < BENCHMARK_EMITTERS; ++i)
+		sim.AddEmitter(BenchmarkFountain(i, numParticles));
+	//run until as many are dying as spawning
+	for (int f = 0; f < 4 * 60; ++f)
+		sim.Update(dTime);
+
+	typedef chrono::high_resolution_clock Clock;
+	typedef chrono::duration<double> Secs;
+	//one core, plain then AVX2, then AVX2 on all of them
+	double secs[3];
+	long long updates[3];
+	for (int pass = 0; pass < 3; ++pass)
+	{
+		updates[pass] = 0;
+		Clock::time_point start = Clock::now();
+		for (int f = 0; f < numFrames; ++f)
+		{
+			updates[pass] += sim.GetNumParticles();
+			sim.Update(dTime, pass > 0, pass == 2);
+		}
+		secs[pass] = Secs(Clock::now() - start).count();
+	}
+
+	DBOUT("Particle benchmark, " << BENCHMARK_EMITTERS << " emitters, " << sim.GetNumParticles() << " particles alive x " << numFrames << " frames (ns per particle update):");
+	DBOUT("  plain " << secs[0] * 1e9 / updates[0] << ", AVX2 " << (Simd::HasAVX2() ? secs[1] * 1e9 / updates[1] : 0)
+		<< ", AVX2 all cores " << secs[2] * 1e9 / updates[2] << " (" << secs[2] * 1000 / numFrames << "ms per frame)");
+	return updates[2] / secs[2];
+}
@@ -0,0 +1,131 @@
+#ifndef PARTICLESIM_H
+#define PARTICLESIM_H
+
+#include <vector>
+
+/*
+The simulation half of ParticleSystem - emitters spraying out lots of short lived
+particles - with nothing to do with drawing, so it builds anywhere (the tests build it
+on Linux). Each emitter keeps its particles as separate arrays (all the x positions
+together, then all the y and so on) with room for its maximum allocated up front.
+Update spawns new ones, then cuts every emitter's particles into blocks and spreads the
+blocks over the cores, each block is moved on by gravity and drag and has its colour,
+size and atlas frame worked out from how far through its life it is, 8 at a time with
+AVX2. The dead are swapped out for live ones off the end, so the arrays never have gaps.
+*/
+class ParticleSim
+{
+public:
+	//particles are simulated in blocks this big, one block is one job for a core
+	static constexpr int BLOCK_SIZE = 16384;
+	//how many fountains Benchmark sprays
+	static constexpr int BENCHMARK_EMITTERS = 4;
+
+	//how an emitter's particles behave
+	struct Settings
+	{
+		int maxParticles = 10000;		//only read by AddEmitter, spawning stops while it's full
+		int numFrames = 1;				//atlas frames played once over each particle's life
+
+		float pos[3] = { 0, 0, 0 };			//where they come from
+		float posSpread[3] = { 0, 0, 0 };	//+/- this far from pos on each axis
+		float rate = 100;					//particles per second
+		float velocity[3] = { 0, 1, 0 };
+		float velSpread[3] = { 0, 0, 0 };	//+/- this much on each axis
+		float minLife = 1, maxLife = 2;		//seconds
+		float gravity[3] = { 0, -9.8f, 0 };
+		float drag = 0;						//fraction of velocity lost per second
+
+		//over each particle's life these go from start to end, colours are RGBA 0-1
+		float startColour[4] = { 1, 1, 1, 1 };
+		float endColour[4] = { 1, 1, 1, 0 };
+		float startSize = 0.1f, endSize = 0.1f;	//world units
+	};
+	struct Emitter
+	{
+		Settings settings;
+		unsigned int rng = 1;		//xorshift state
+		float spawnCarry = 0;		//fraction of a particle left over from the last spawn
+		int burst = 0;
+		//everything below is one per particle, packed, the first numParticles are alive
+		int numParticles = 0;
+		std::vector<float> pos[3], vel[3];
+		std::vector<float> age, invLife;	//seconds and 1/lifetime
+		std::vector<float> size;
+		std::vector<unsigned int> colour;	//RGBA8
+		std::vector<unsigned int> frame;	//0 to numFrames-1
+	};
+
+	/*
+	* a new emitter, it starts spawning straight away
+	* settings - IN copied
+	* returns - its number
+	*/
+	int AddEmitter(const Settings& settings);
+	int GetNumEmitters() const {
+		return (int)mEmitters.size();
+	}
+	//move it, change its rate, colours, etc. - anything but maxParticles and numFrames
+	Settings& GetSettings(int emitter) {
+		return mEmitters.at(emitter).settings;
+	}
+	//its particles, e.g. to draw them
+	const Emitter& GetEmitter(int emitter) const {
+		return mEmitters.at(emitter);
+	}
+	//spawn this many at the next Update on top of the rate
+	void Burst(int emitter, int count);
+	//kill all its particles
+	void Clear(int emitter);
+	int GetNumParticles(int emitter) const {
+		return mEmitters.at(emitter).numParticles;
+	}
+	//every emitter's
+	int GetNumParticles() const;
+
+	/*
+	* spawn, move, age and kill particles
+	* dTime - IN elapsed seconds
+	* allowAVX2 - IN false to force the plain version, e.g. to compare them
+	* allowThreads - IN false to do everything on this thread
+	*/
+	void Update(float dTime, bool allowAVX2 = true, bool allowThreads = true);
+
+	/*
+	* one of the fountains of sparks Benchmark uses, 4 atlas frames and lives of 1-3 seconds
+	* emitter - IN which, 0 to BENCHMARK_EMITTERS-1
+	* numParticles - IN roughly how many are alive across all of them once it settles
+	*/
+	static Settings BenchmarkFountain(int emitter, int numParticles);
+	/*
+	* time updating a million or so particles spread over a few emitters - plain and AVX2 on
+	* one core then AVX2 on every core. Results go to DBOUT.
+	* numParticles - IN roughly how many are alive once it settles
+	* numFrames - IN how many updates to time
+	* returns - particles updated per second, AVX2 on every core
+	*/
+	static double Benchmark(int numParticles, int numFrames);
+
+private:
+	//some of an emitter's particles, simulated by one core
+	struct Job
+	{
+		int emitter, begin, end;
+		std::vector<int> dead;		//ones that died, in order
+	};
+
+	std::vector<Emitter> mEmitters;
+	std::vector<Job> mJobs;			//reused each Update so the dead lists keep their memory
+	int mNumJobs = 0;
+	std::vector<int> mFirstJob;		//each emitter's first job, and one past the last emitter's
+
+	//add new particles to the end of an emitter
+	void Spawn(Emitter& e, float dTime);
+	//move on a range of an emitter's particles, noting the dead ones
+	static void SimulatePlain(Emitter& e, int begin, int end, float dTime, std::vector<int>& dead);
+	static void SimulateAVX2(Emitter& e, int begin, int end, float dTime, std::vector<int>& dead);
+	//fill the gaps the dead left with particles off the end, dead indices must be in order
+	static void RemoveDead(Emitter& e, const std::vector<int>& dead);
+};
+
+#endif
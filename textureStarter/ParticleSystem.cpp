@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <chrono>
+
+#include "ParticleSystem.h"
+#include "D3D.h"
+#include "D3DUtil.h"
+#include "FX.h"
+#include "Parallel.h"
+#include "WindowUtils.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+//vectors as the plain arrays ParticleSim uses
+static void ToFloats(const Vector3& v, float out[3])
+{
+	out[0] = v.x;
+	out[1] = v.y;
+	out[2] = v.z;
+}
+
+static void ToFloats(const Vector4& v, float out[4])
+{
+	out[0] = v.x;
+	out[1] = v.y;
+	out[2] = v.z;
+	out[3] = v.w;
+}
+
+void ParticleSystem::Init(ID3D11Device& device, int maxInstances)
+{
+	assert(maxInstances > 0);
+	Release();
+	char* pBuff = nullptr;
+	unsigned int bytes = 0;
+	//everything is per instance, the vertex shader makes the corners from SV_VertexID
+	const D3D11_INPUT_ELEMENT_DESC desc[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "SIZE", 0, DXGI_FORMAT_R32_FLOAT, 0, 12, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "FRAME", 0, DXGI_FORMAT_R32_UINT, 0, 20, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	};
+	pBuff = FX::ReadAndAllocate("../bin/data/ParticleVS.cso", bytes);
+	FX::CreateVertexShader(device, pBuff, bytes, mpVS);
+	FX::CreateInputLayout(device, desc, sizeof(desc) / sizeof(desc[0]), pBuff, bytes, &mpInputLayout);
+	delete[] pBuff;
+	pBuff = FX::ReadAndAllocate("../bin/data/ParticlePS.cso", bytes);
+	FX::CreatePixelShader(device, pBuff, bytes, mpPS);
+	delete[] pBuff;
+	FX::CreateConstantBuffer(device, sizeof(Constants), &mpConsts);
+
+	mRing.Init(device, sizeof(Instance), maxInstances);
+
+	//the same blending materials use, plus additive, depth tested but not written like the transparent queue
+	FX::CreateAlphaTransparentBlendState(device, mpBlend[ALPHA]);
+	FX::CreateAdditiveBlendState(device, mpBlend[ADDITIVE]);
+	D3D11_DEPTH_STENCIL_DESC depthDesc;
+	ZeroMemory(&depthDesc, sizeof(depthDesc));
+	depthDesc.DepthEnable = true;
+	depthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	depthDesc.DepthFunc = D3D11_COMPARISON_LESS;
+	HR(device.CreateDepthStencilState(&depthDesc, &mpDepth));
+	FX::CreateNoCullRasterState(device, mpRaster);
+	FX::CreateSampler(device, mpSampler);
+}
+
+void ParticleSystem::Release()
+{
+	mRing.Release();
+	ReleaseCOM(mpConsts);
+	ReleaseCOM(mpVS);
+	ReleaseCOM(mpPS);
+	ReleaseCOM(mpInputLayout);
+	ReleaseCOM(mpBlend[ALPHA]);
+	ReleaseCOM(mpBlend[ADDITIVE]);
+	ReleaseCOM(mpRaster);
+	ReleaseCOM(mpDepth);
+	ReleaseCOM(mpSampler);
+}
+
+int ParticleSystem::AddEmitter(const Settings& settings)
+{
+	assert(settings.frames.size() <= MAX_FRAMES);
+	ParticleSim::Settings sim;
+	sim.maxParticles = settings.maxParticles;
+	sim.numFrames = std::max(1, (int)settings.frames.size());
+	ToFloats(settings.pos, sim.pos);
+	ToFloats(settings.posSpread, sim.posSpread);
+	ToFloats(settings.velocity, sim.velocity);
+	ToFloats(settings.velSpread, sim.velSpread);
+	ToFloats(settings.gravity, sim.gravity);
+	ToFloats(settings.startColour, sim.startColour);
+	ToFloats(settings.endColour, sim.endColour);
+	sim.rate = settings.rate;
+	sim.minLife = settings.minLife;
+	sim.maxLife = settings.maxLife;
+	sim.drag = settings.drag;
+	sim.startSize = settings.startSize;
+	sim.endSize = settings.endSize;
+
+	Look look;
+	look.pTex = settings.pTex;
+	look.blend = settings.blend;
+	look.numFrames = sim.numFrames;
+	//frames are turned into uvs once here, a texture with none is one frame
+	if (settings.frames.empty())
+		look.uvFrames[0] = Vector4(0, 0, 1, 1);
+	else
+	{
+		assert(settings.texDim.x > 0 && settings.texDim.y > 0);
+		for (int f = 0; f < look.numFrames; ++f)
+		{
+			const RECTF& r = settings.frames[f];
+			look.uvFrames[f] = Vector4(r.left / settings.texDim.x, r.top / settings.texDim.y, r.right / settings.texDim.x, r.bottom / settings.texDim.y);
+		}
+	}
+	return AddEmitter(sim, look);
+}
+
+int ParticleSystem::AddEmitter(const ParticleSim::Settings& sim, const Look& look)
+{
+	assert(sim.numFrames == look.numFrames && look.numFrames <= MAX_FRAMES);
+	mLooks.push_back(look);
+	return mSim.AddEmitter(sim);
+}
+
+void ParticleSystem::DrawRange(ID3D11DeviceContext& ctx, const ParticleSim::Emitter& e, int first, int count)
+{
+	Instance* pDst = (Instance*)mRing.Map(ctx, count);
+	//the arrays back into one struct each, lots of them is worth spreading over the cores
+	ParallelFor(count, ParticleSim::BLOCK_SIZE, [&](int begin, int end) {
+		for (int i = first + begin; i < first + end; ++i)
+		{
+			Instance& inst = pDst[i - first];
+			inst.pos[0] = e.pos[0][i];
+			inst.pos[1] = e.pos[1][i];
+			inst.pos[2] = e.pos[2][i];
+			inst.size = e.size[i];
+			inst.colour = e.colour[i];
+			inst.frame = e.frame[i];
+		}
+	});
+	ctx.DrawInstanced(4, count, 0, mRing.Unmap(ctx));
+}
+
+void ParticleSystem::Draw(ID3D11DeviceContext& ctx, const Matrix& view, const Matrix& proj)
+{
+	assert(mRing.GetMaxInstances() > 0);
+	Constants consts;
+	consts.viewProj = view * proj;
+	//the camera's right and up in world space are the view matrix's first two columns
+	consts.camRight = Vector4(view._11, view._21, view._31, 0);
+	consts.camUp = Vector4(view._12, view._22, view._32, 0);
+
+	mRing.Bind(ctx);
+	ctx.IASetInputLayout(mpInputLayout);
+	ctx.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	ctx.VSSetShader(mpVS, nullptr, 0);
+	ctx.VSSetConstantBuffers(0, 1, &mpConsts);
+	ctx.PSSetShader(mpPS, nullptr, 0);
+	ctx.PSSetSamplers(0, 1, &mpSampler);
+	ctx.OMSetDepthStencilState(mpDepth, 0);
+	ctx.RSSetState(mpRaster);
+	const float blendFactors[4] = { 0, 0, 0, 0 };
+
+	for (int i = 0; i < mSim.GetNumEmitters(); ++i)
+	{
+		const ParticleSim::Emitter& e = mSim.GetEmitter(i);
+		const Look& look = mLooks[i];
+		if (e.numParticles == 0)
+			continue;
+		assert(look.pTex);
+		memcpy(consts.frames, look.uvFrames, look.numFrames * sizeof(Vector4));
+		ctx.UpdateSubresource(mpConsts, 0, nullptr, &consts, 0, 0);
+		ctx.PSSetShaderResources(0, 1, &look.pTex);
+		ctx.OMSetBlendState(mpBlend[look.blend], blendFactors, 0xffffffff);
+		//more than the ring buffer holds goes in pieces
+		const int maxInstances = mRing.GetMaxInstances();
+		for (int first = 0; first < e.numParticles; first += maxInstances)
+			DrawRange(ctx, e, first, std::min(e.numParticles - first, maxInstances));
+	}
+}
+
+double ParticleSystem::Benchmark(int numParticles, int numFrames)
+{
+	double perSec = ParticleSim::Benchmark(numParticles, numFrames);
+
+	//and getting the same fountains to the GPU
+	MyD3D& d3d = WinUtil::Get().GetD3D();
+	ID3D11DeviceContext& ctx = d3d.GetDeviceCtx();
+	ParticleSystem system;
+	system.Init(d3d.GetDevice(), 1 << 20);
+	Look look;
+	look.pTex = d3d.GetCache().LoadTexture(&d3d.GetDevice(), "cross.dds");
+	look.blend = ADDITIVE;
+	//the four quarters of the texture
+	look.numFrames = 4;
+	for (int f = 0; f < 4; ++f)
+		look.uvFrames[f] = Vector4((f % 2) * 0.5f, (f / 2) * 0.5f, (f % 2 + 1) * 0.5f, (f / 2 + 1) * 0.5f);
+	for (int i = 0; i < ParticleSim::BENCHMARK_EMITTERS; ++i)
+		system.AddEmitter(ParticleSim::BenchmarkFountain(i, numParticles), look);
+	//run until as many are dying as spawning
+	const float dTime = 1 / 60.f;
+	for (int f = 0; f < 4 * 60; ++f)
+		system.Update(dTime);
+
+	typedef chrono::high_resolution_clock Clock;
+	typedef chrono::duration<double> Secs;
+	Matrix view, proj;
+	CreateViewMatrix(view, Vector3(6, 6, -20), Vector3(6, 6, 0), Vector3(0, 1, 0));
+	CreateProjectionMatrix(proj, 0.25f * PI, 16 / 9.f, 1, 1000);
+	const int drawFrames = std::max(1, numFrames / 4);
+	Clock::time_point start = Clock::now();
+	for (int f = 0; f < drawFrames; ++f)
+		system.Draw(ctx, view, proj);
+	double drawSecs = Secs(Clock::now() - start).count() / drawFrames;
+	//Draw changed the pipeline
+	d3d.InvalidateInputAssembler();
+	d3d.GetFX().InvalidatePSO();
+
+	DBOUT("  copying " << system.GetNumParticles() << " of them for drawing " << drawSecs * 1000 << "ms per frame");
+	return perSec;
+}
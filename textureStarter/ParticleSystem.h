@@ -0,0 +1,167 @@
+#ifndef PARTICLESYSTEM_H
+#define PARTICLESYSTEM_H
+
+#include <vector>
+#include <d3d11.h>
+
+#include "SimpleMath.h"
+#include "TexCache.h"
+#include "DynamicBuffers.h"
+#include "ParticleSim.h"
+
+/*
+Emitters spraying out lots of short lived particles, drawn as camera facing billboards.
+The simulation is ParticleSim's (see there), this adds what each emitter looks like.
+Draw copies the particles into a ring buffer and draws each emitter with one instanced
+call, the vertex shader (ParticleVS) turns each into a quad. Particles aren't sorted, so
+alpha blended ones look best small and soft, additive ones don't care.
+The simulation doesn't touch the GPU, only Init and Draw need the device.
+Like SpriteBatch, Draw changes the pipeline, tell anything that tracks state afterwards
+(MyFX::InvalidatePSO, MyD3D::InvalidateInputAssembler).
+*/
+class ParticleSystem
+{
+public:
+	//the most atlas frames an emitter can animate through, see ParticleConstants.hlsl
+	static constexpr int MAX_FRAMES = 64;
+
+	//how particles go on top of what's already drawn
+	typedef enum {
+		ALPHA,		//layered by the texture alpha (smoke)
+		ADDITIVE	//added on, scaled by the texture alpha (fire, sparks)
+	} BlendMode;
+
+	//what an emitter looks like and how its particles behave
+	struct Settings
+	{
+		ID3D11ShaderResourceView* pTex = nullptr;	//not released
+		DirectX::SimpleMath::Vector2 texDim;		//texels
+		std::vector<RECTF> frames;		//atlas frames played once over each particle's life, empty for the whole texture
+		BlendMode blend = ADDITIVE;
+		int maxParticles = 10000;		//only read by AddEmitter, spawning stops while it's full
+
+		DirectX::SimpleMath::Vector3 pos;		//where they come from
+		DirectX::SimpleMath::Vector3 posSpread;	//+/- this far from pos on each axis
+		float rate = 100;						//particles per second
+		DirectX::SimpleMath::Vector3 velocity = DirectX::SimpleMath::Vector3(0, 1, 0);
+		DirectX::SimpleMath::Vector3 velSpread;	//+/- this much on each axis
+		float minLife = 1, maxLife = 2;			//seconds
+		DirectX::SimpleMath::Vector3 gravity = DirectX::SimpleMath::Vector3(0, -9.8f, 0);
+		float drag = 0;							//fraction of velocity lost per second
+
+		//over each particle's life these go from start to end
+		DirectX::SimpleMath::Vector4 startColour = DirectX::SimpleMath::Vector4(1, 1, 1, 1);
+		DirectX::SimpleMath::Vector4 endColour = DirectX::SimpleMath::Vector4(1, 1, 1, 0);
+		float startSize = 0.1f, endSize = 0.1f;	//world units
+	};
+
+	~ParticleSystem() {
+		Release();
+	}
+	/*
+	* load the shaders and create the buffers and states, not needed just to simulate
+	* device - IN the gpu
+	* maxInstances - IN size of the ring buffer, Draw draws a bigger emitter in pieces
+	*/
+	void Init(ID3D11Device& device, int maxInstances = 65536);
+	void Release();
+
+	/*
+	* a new emitter, it starts spawning straight away
+	* settings - IN copied
+	* returns - its number
+	*/
+	int AddEmitter(const Settings& settings);
+	int GetNumEmitters() const {
+		return mSim.GetNumEmitters();
+	}
+	//move it, change its rate, colours, etc. - anything but maxParticles and numFrames
+	ParticleSim::Settings& GetSettings(int emitter) {
+		return mSim.GetSettings(emitter);
+	}
+	//spawn this many at the next Update on top of the rate
+	void Burst(int emitter, int count) {
+		mSim.Burst(emitter, count);
+	}
+	//kill all its particles
+	void Clear(int emitter) {
+		mSim.Clear(emitter);
+	}
+	int GetNumParticles(int emitter) const {
+		return mSim.GetNumParticles(emitter);
+	}
+	//every emitter's
+	int GetNumParticles() const {
+		return mSim.GetNumParticles();
+	}
+
+	/*
+	* spawn, move, age and kill particles
+	* dTime - IN elapsed seconds
+	* allowAVX2 - IN false to force the plain version, e.g. to compare them
+	* allowThreads - IN false to do everything on this thread
+	*/
+	void Update(float dTime, bool allowAVX2 = true, bool allowThreads = true) {
+		mSim.Update(dTime, allowAVX2, allowThreads);
+	}
+	/*
+	* draw every emitter into whatever render target and viewport are set, testing against
+	* the depth buffer but not writing to it, so do it after the opaques
+	* view, proj - IN the camera, as MyFX::GetViewMatrix and GetProjectionMatrix
+	*/
+	void Draw(ID3D11DeviceContext& ctx, const DirectX::SimpleMath::Matrix& view, const DirectX::SimpleMath::Matrix& proj);
+
+	/*
+	* ParticleSim::Benchmark then copying the same particles for drawing. Results go to DBOUT.
+	* numParticles - IN roughly how many are alive once it settles
+	* numFrames - IN how many updates to time
+	* returns - particles updated per second, AVX2 on every core
+	*/
+	static double Benchmark(int numParticles, int numFrames);
+
+private:
+	//what the vertex shader gets per particle, see ParticleConstants.hlsl
+	struct Instance
+	{
+		float pos[3];
+		float size;
+		unsigned int colour;		//RGBA8
+		unsigned int frame;			//into the emitter's frames
+	};
+	static_assert(sizeof(Instance) == 24, "one instance should be 24 bytes");
+	struct Constants
+	{
+		DirectX::SimpleMath::Matrix viewProj;
+		DirectX::SimpleMath::Vector4 camRight, camUp;
+		DirectX::SimpleMath::Vector4 frames[MAX_FRAMES];	//uv left, top, right, bottom
+	};
+	//what an emitter looks like, one per ParticleSim emitter
+	struct Look
+	{
+		ID3D11ShaderResourceView* pTex = nullptr;
+		BlendMode blend = ADDITIVE;
+		int numFrames = 1;
+		DirectX::SimpleMath::Vector4 uvFrames[MAX_FRAMES];
+	};
+
+	ParticleSim mSim;
+	std::vector<Look> mLooks;
+
+	//gpu
+	InstanceRing mRing;
+	ID3D11Buffer* mpConsts = nullptr;
+	ID3D11VertexShader* mpVS = nullptr;
+	ID3D11PixelShader* mpPS = nullptr;
+	ID3D11InputLayout* mpInputLayout = nullptr;
+	ID3D11BlendState* mpBlend[2] = { nullptr, nullptr };	//by BlendMode
+	ID3D11RasterizerState* mpRaster = nullptr;
+	ID3D11DepthStencilState* mpDepth = nullptr;
+	ID3D11SamplerState* mpSampler = nullptr;
+
+	//the simulation and looks already worked out, e.g. ParticleSim::BenchmarkFountain
+	int AddEmitter(const ParticleSim::Settings& sim, const Look& look);
+	//copy some particles into the ring buffer and draw them
+	void DrawRange(ID3D11DeviceContext& ctx, const ParticleSim::Emitter& e, int first, int count);
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include <fstream>
+#include <cstring>
+
+#include "SceneFile.h"
+#include "D3DUtil.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+namespace SceneFile
+{
+	static void CopyName(char dest[MAX_NAME], const string& src)
+	{
+		if (src.size() >= MAX_NAME)
+			DBOUT("Scene file name truncated: " << src);
+		strncpy_s(dest, MAX_NAME, src.c_str(), _TRUNCATE);
+	}
+
+	MaterialRecord MakeMaterialRecord(const Material& mat, int texture)
+	{
+		MaterialRecord r;
+		memset(&r, 0, sizeof(r));
+		r.gfxData = mat.gfxData;
+		r.texScale[0] = mat.texTrsfm.scale.x;
+		r.texScale[1] = mat.texTrsfm.scale.y;
+		r.texAngle = mat.texTrsfm.angle;
+		r.texTranslate[0] = mat.texTrsfm.translate.x;
+		r.texTranslate[1] = mat.texTrsfm.translate.y;
+		r.flags = mat.flags;
+		memcpy(r.blendFactors, mat.blendFactors, sizeof(r.blendFactors));
+		r.texture = texture;
+		CopyName(r.name, mat.name);
+		return r;
+	}
+
+	bool Save(const string& fileName, const Desc& desc)
+	{
+		Header hdr;
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.magic = MAGIC;
+		hdr.version = VERSION;
+		hdr.numMeshes = (unsigned int)desc.meshes.size();
+		hdr.numTextures = (unsigned int)desc.textures.size();
+		hdr.numMaterials = (unsigned int)desc.materials.size();
+		hdr.numObjects = (unsigned int)desc.objects.size();
+		hdr.numLights = (unsigned int)desc.lights.size();
+		hdr.numSprites = (unsigned int)desc.sprites.size();
+		//every record is a whole number of 4 byte fields, so they all stay aligned packed one after another
+		hdr.meshOffset = sizeof(Header);
+		hdr.textureOffset = hdr.meshOffset + hdr.numMeshes * sizeof(NameRecord);
+		hdr.materialOffset = hdr.textureOffset + hdr.numTextures * sizeof(NameRecord);
+		hdr.objectOffset = hdr.materialOffset + hdr.numMaterials * sizeof(MaterialRecord);
+		hdr.lightOffset = hdr.objectOffset + hdr.numObjects * sizeof(ObjectRecord);
+		hdr.spriteOffset = hdr.lightOffset + hdr.numLights * sizeof(LightRecord);
+		hdr.fileBytes = hdr.spriteOffset + hdr.numSprites * sizeof(SpriteRecord);
+
+		vector<NameRecord> names(hdr.numMeshes + hdr.numTextures);
+		memset(names.data(), 0, names.size() * sizeof(NameRecord));
+		for (unsigned int i = 0; i < hdr.numMeshes; ++i)
+			CopyName(names[i].name, desc.meshes[i]);
+		for (unsigned int i = 0; i < hdr.numTextures; ++i)
+			CopyName(names[hdr.numMeshes + i].name, desc.textures[i]);
+
+		ofstream fs(fileName, ios::binary);
+		if (!fs)
+		{
+			DBOUT("Can't write scene file " << fileName);
+			return false;
+		}
+		fs.write((const char*)&hdr, sizeof(hdr));
+		fs.write((const char*)names.data(), names.size() * sizeof(NameRecord));
+		fs.write((const char*)desc.materials.data(), desc.materials.size() * sizeof(MaterialRecord));
+		fs.write((const char*)desc.objects.data(), desc.objects.size() * sizeof(ObjectRecord));
+		fs.write((const char*)desc.lights.data(), desc.lights.size() * sizeof(LightRecord));
+		fs.write((const char*)desc.sprites.data(), desc.sprites.size() * sizeof(SpriteRecord));
+		return fs.good();
+	}
+
+	//does a table fit inside the file, 64bit sums so big counts can't wrap
+	static bool Fits(unsigned int offset, unsigned int count, size_t recordSize, size_t bytes)
+	{
+		return (offset % sizeof(unsigned int)) == 0 &&
+			(unsigned long long)offset + (unsigned long long)count * recordSize <= bytes;
+	}
+
+	const Header* Validate(const void* pData, size_t bytes)
+	{
+		if (!pData || bytes < sizeof(Header))
+			return nullptr;
+		const Header* pHdr = (const Header*)pData;
+		if (pHdr->magic != MAGIC || pHdr->version != VERSION || pHdr->fileBytes != bytes)
+			return nullptr;
+		if (!Fits(pHdr->meshOffset, pHdr->numMeshes, sizeof(NameRecord), bytes) ||
+			!Fits(pHdr->textureOffset, pHdr->numTextures, sizeof(NameRecord), bytes) ||
+			!Fits(pHdr->materialOffset, pHdr->numMaterials, sizeof(MaterialRecord), bytes) ||
+			!Fits(pHdr->objectOffset, pHdr->numObjects, sizeof(ObjectRecord), bytes) ||
+			!Fits(pHdr->lightOffset, pHdr->numLights, sizeof(LightRecord), bytes) ||
+			!Fits(pHdr->spriteOffset, pHdr->numSprites, sizeof(SpriteRecord), bytes))
+			return nullptr;
+
+		//everything refers to something that's there
+		const int numMeshes = (int)pHdr->numMeshes, numTextures = (int)pHdr->numTextures, numMaterials = (int)pHdr->numMaterials;
+		const MaterialRecord* pMaterials = GetRecords<MaterialRecord>(*pHdr, pHdr->materialOffset);
+		for (unsigned int i = 0; i < pHdr->numMaterials; ++i)
+			if (pMaterials[i].texture < -1 || pMaterials[i].texture >= numTextures)
+				return nullptr;
+		const ObjectRecord* pObjects = GetRecords<ObjectRecord>(*pHdr, pHdr->objectOffset);
+		for (unsigned int i = 0; i < pHdr->numObjects; ++i)
+			if (pObjects[i].mesh < 0 || pObjects[i].mesh >= numMeshes ||
+				pObjects[i].material < -1 || pObjects[i].material >= numMaterials)
+				return nullptr;
+		const LightRecord* pLights = GetRecords<LightRecord>(*pHdr, pHdr->lightOffset);
+		for (unsigned int i = 0; i < pHdr->numLights; ++i)
+			if (pLights[i].type < 0 || pLights[i].type >= LightType::MAX_TYPES || pLights[i].index < 0 || pLights[i].index >= MAX_LIGHTS)
+				return nullptr;
+		const SpriteRecord* pSprites = GetRecords<SpriteRecord>(*pHdr, pHdr->spriteOffset);
+		for (unsigned int i = 0; i < pHdr->numSprites; ++i)
+			if (pSprites[i].texture < 0 || pSprites[i].texture >= numTextures)
+				return nullptr;
+		return pHdr;
+	}
+}
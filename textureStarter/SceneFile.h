@@ -0,0 +1,154 @@
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include <string>
+#include <vector>
+
+#include "ShaderTypes.h"
+
+/*
+Binary scene files, a whole level of placed models, lights and sprites. Objects are
+fixed size records that refer to meshes, textures and materials by number, each name
+is only stored once however many objects use it. See Level::Load.
+Layout:
+	Header
+	NameRecord * numMeshes		mesh library names, or mesh files (see MeshFile) if they aren't there
+	NameRecord * numTextures	texture file names, for the texture cache
+	MaterialRecord * numMaterials
+	ObjectRecord * numObjects
+	LightRecord * numLights
+	SpriteRecord * numSprites
+All offsets are from the start of the file. Bump VERSION if anything changes.
+*/
+namespace SceneFile
+{
+	const unsigned int MAGIC = 0x4e454353;		//"SCEN"
+	const unsigned int VERSION = 1;
+	const int MAX_NAME = 64;					//including the terminating zero
+
+	struct Header
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned int fileBytes;			//total, to spot truncated files
+		unsigned int numMeshes;
+		unsigned int meshOffset;
+		unsigned int numTextures;
+		unsigned int textureOffset;
+		unsigned int numMaterials;
+		unsigned int materialOffset;
+		unsigned int numObjects;
+		unsigned int objectOffset;
+		unsigned int numLights;
+		unsigned int lightOffset;
+		unsigned int numSprites;
+		unsigned int spriteOffset;
+	};
+
+	struct NameRecord
+	{
+		char name[MAX_NAME];
+	};
+
+	//replaces the materials of any mesh it's used with
+	struct MaterialRecord
+	{
+		BasicMaterial gfxData;
+		float texScale[2];
+		float texAngle;
+		float texTranslate[2];
+		int flags;						//Material::TFlags
+		float blendFactors[4];
+		int texture;					//into the texture names, -1 if not textured
+		char name[MAX_NAME];
+	};
+
+	//a model
+	struct ObjectRecord
+	{
+		int mesh;						//into the mesh names
+		int material;					//-1 to use the mesh's own materials
+		float pos[3];
+		float rot[4];					//quaternion x,y,z,w
+		float scale[3];
+	};
+
+	//which of MyFX's Setup...Light functions a light is for
+	namespace LightType
+	{
+		enum { DIRECTIONAL, POINT, SPOT, MAX_TYPES };
+	}
+
+	//the parameters of MyFX::SetupDirectionalLight/SetupPointLight/SetupSpotLight, a type only uses some
+	struct LightRecord
+	{
+		int type;						//see LightType
+		int index;						//which light it is
+		int enable;
+		float position[3];
+		float direction[3];
+		float diffuse[3];
+		float ambient[3];
+		float specular[3];
+		float range;
+		float atten1;
+		float innerConeTheta;
+		float outerConePhi;
+	};
+
+	struct SpriteRecord
+	{
+		int texture;					//into the texture names
+		int frame;						//an atlas frame (see TexCache::Data), -1 to use texRect
+		float texRect[4];				//left, top, right, bottom in texels, all 0 for the whole texture
+		float pos[2];
+		float scale[2];
+		float origin[2];
+		float rotation;
+		float depth;
+		float colour[4];
+	};
+
+	//everything that goes in a file
+	struct Desc
+	{
+		std::vector<std::string> meshes;
+		std::vector<std::string> textures;
+		std::vector<MaterialRecord> materials;
+		std::vector<ObjectRecord> objects;
+		std::vector<LightRecord> lights;
+		std::vector<SpriteRecord> sprites;
+	};
+
+	/*
+	* a material record from a material
+	* mat - IN the material, its texture isn't stored here
+	* texture - IN into the texture names, -1 if it isn't textured
+	*/
+	MaterialRecord MakeMaterialRecord(const Material& mat, int texture);
+
+	/*
+	* write a scene file
+	* fileName - IN where to
+	* desc - IN what's in it, names are truncated to MAX_NAME - 1
+	* returns - false if the file couldn't be written
+	*/
+	bool Save(const std::string& fileName, const Desc& desc);
+
+	/*
+	* check that some memory holds a scene file we can use, everything it points at has to be inside
+	* it and every mesh, texture and material number has to be one of the file's
+	* pData - IN start of the file
+	* bytes - IN how big it is
+	* returns - the header or nullptr if something is wrong
+	*/
+	const Header* Validate(const void* pData, size_t bytes);
+
+	//the records in a file that's been validated
+	template<class T>
+	const T* GetRecords(const Header& hdr, unsigned int offset) {
+		return (const T*)((const char*)&hdr + offset);
+	}
+}
+
+#endif
@@ -0,0 +1,530 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include "SceneGraph.h"
+#include "D3DUtil.h"
+#include "Parallel.h"
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+//how a box sits against the view
+namespace BoxTest { enum { OUTSIDE = 0, PARTLY = 1, INSIDE = 2 }; }
+
+//v rotated by a unit quaternion
+static Vector3 Rotate(const Quaternion& q, const Vector3& v)
+{
+	//t = 2 * cross(q.xyz, v), v' = v + w * t + cross(q.xyz, t)
+	Vector3 t(2 * (q.y * v.z - q.z * v.y), 2 * (q.z * v.x - q.x * v.z), 2 * (q.x * v.y - q.y * v.x));
+	return Vector3(v.x + q.w * t.x + (q.y * t.z - q.z * t.y),
+		v.y + q.w * t.y + (q.z * t.x - q.x * t.z),
+		v.z + q.w * t.z + (q.x * t.y - q.y * t.x));
+}
+
+//where a box is against 6 planes, inside is a*x + b*y + c*z + d >= 0
+static int TestBox(const float planes[6][4], const Vector3& boxMin, const Vector3& boxMax)
+{
+	if (boxMin.x > boxMax.x)
+		return BoxTest::OUTSIDE;
+	int result = BoxTest::INSIDE;
+	for (int p = 0; p < 6; ++p)
+	{
+		const float* pl = planes[p];
+		//the corners furthest along and furthest against the plane's normal
+		float far = pl[3], near = pl[3];
+		far += pl[0] * (pl[0] > 0 ? boxMax.x : boxMin.x);
+		near += pl[0] * (pl[0] > 0 ? boxMin.x : boxMax.x);
+		far += pl[1] * (pl[1] > 0 ? boxMax.y : boxMin.y);
+		near += pl[1] * (pl[1] > 0 ? boxMin.y : boxMax.y);
+		far += pl[2] * (pl[2] > 0 ? boxMax.z : boxMin.z);
+		near += pl[2] * (pl[2] > 0 ? boxMin.z : boxMax.z);
+		if (far < 0)
+			return BoxTest::OUTSIDE;
+		if (near < 0)
+			result = BoxTest::PARTLY;
+	}
+	return result;
+}
+
+void SceneGraph::Box::Merge(const Box& b)
+{
+	min = Vector3(std::min(min.x, b.min.x), std::min(min.y, b.min.y), std::min(min.z, b.min.z));
+	max = Vector3(std::max(max.x, b.max.x), std::max(max.y, b.max.y), std::max(max.z, b.max.z));
+}
+
+NodeHandle SceneGraph::Add(NodeHandle parent, TransformHandle transform)
+{
+	unsigned int slot;
+	if (mFreeSlot != NodeHandle::NONE)
+	{
+		//reuse a slot, its generation was bumped when it was freed
+		slot = mFreeSlot;
+		mFreeSlot = mSlots[slot].node;
+	}
+	else
+	{
+		slot = (unsigned int)mSlots.size();
+		mSlots.push_back(Slot());
+	}
+	//on the end for now, a root there is already in order
+	int i = (int)mParents.size();
+	mSlots[slot].node = i;
+	mParents.push_back(-1);
+	mEnds.push_back(i + 1);
+	if (parent.IsNull())
+		mParentSlots.push_back(NodeHandle::NONE);
+	else
+	{
+		assert(IsValid(parent));
+		mParentSlots.push_back(parent.index);
+		mOrderStale = true;
+	}
+	mNodeSlots.push_back(slot);
+	mLocal.push_back(TRS());
+	mWorld.push_back(TRS());
+	mLocalBounds.push_back(Box());
+	mWorldBounds.push_back(Box());
+	mSubtreeBounds.push_back(Box());
+	mTransforms.push_back(transform);
+	mDirty.push_back(1);
+	mDead.push_back(0);
+	mVisible.push_back(0);
+	mAncestorFlags.push_back(0);
+
+	NodeHandle h;
+	h.index = slot;
+	h.generation = mSlots[slot].generation;
+	return h;
+}
+
+bool SceneGraph::Remove(NodeHandle node)
+{
+	if (!IsValid(node))
+		return false;
+	//the subtree has to be in one run to find it
+	if (mOrderStale)
+		Sort();
+	int i = GetNode(node);
+	//the parent's box shrinks
+	if (mParents[i] >= 0)
+		mDirty[mParents[i]] = 1;
+	for (int j = i; j < mEnds[i]; ++j)
+	{
+		mDead[j] = 1;
+		//the slot goes on the free list with a new generation, skipping 0 if it wraps
+		Slot& s = mSlots[mNodeSlots[j]];
+		if (++s.generation == 0)
+			s.generation = 1;
+		s.node = mFreeSlot;
+		mFreeSlot = mNodeSlots[j];
+	}
+	mNumDead += mEnds[i] - i;
+	mOrderStale = true;
+	return true;
+}
+
+void SceneGraph::SetParent(NodeHandle node, NodeHandle parent)
+{
+	if (mOrderStale)
+		Sort();
+	int i = GetNode(node);
+	if (!parent.IsNull())
+	{
+		int p = GetNode(parent);
+		assert((p < i || p >= mEnds[i]) && "a node can't go under its own subtree");
+	}
+	if (mParents[i] >= 0)
+		mDirty[mParents[i]] = 1;
+	mParentSlots[i] = parent.IsNull() ? NodeHandle::NONE : parent.index;
+	mDirty[i] = 1;
+	mOrderStale = true;
+}
+
+int SceneGraph::GetNode(NodeHandle node) const
+{
+	assert(IsValid(node));
+	return (int)mSlots[node.index].node;
+}
+
+void SceneGraph::SetPosition(NodeHandle node, const Vector3& pos)
+{
+	int i = GetNode(node);
+	mLocal[i].pos = pos;
+	mDirty[i] = 1;
+}
+
+void SceneGraph::SetRotation(NodeHandle node, const Quaternion& rot)
+{
+	int i = GetNode(node);
+	mLocal[i].rot = rot;
+	mLocal[i].rot.Normalize();
+	mDirty[i] = 1;
+}
+
+void SceneGraph::SetScale(NodeHandle node, const Vector3& scale)
+{
+	int i = GetNode(node);
+	mLocal[i].scale = scale;
+	mDirty[i] = 1;
+}
+
+void SceneGraph::SetBounds(NodeHandle node, const Vector3& boundsMin, const Vector3& boundsMax)
+{
+	int i = GetNode(node);
+	mLocalBounds[i].min = boundsMin;
+	mLocalBounds[i].max = boundsMax;
+	mDirty[i] = 1;
+}
+
+Vector3 SceneGraph::GetWorldPosition(NodeHandle node) const
+{
+	return mWorld[GetNode(node)].pos;
+}
+
+Quaternion SceneGraph::GetWorldRotation(NodeHandle node) const
+{
+	return mWorld[GetNode(node)].rot;
+}
+
+Vector3 SceneGraph::GetWorldScale(NodeHandle node) const
+{
+	return mWorld[GetNode(node)].scale;
+}
+
+void SceneGraph::GetSubtreeBounds(NodeHandle node, Vector3& boundsMin, Vector3& boundsMax) const
+{
+	const Box& b = mSubtreeBounds[GetNode(node)];
+	boundsMin = b.min;
+	boundsMax = b.max;
+}
+
+bool SceneGraph::IsVisible(NodeHandle node) const
+{
+	return mVisible[GetNode(node)] != 0;
+}
+
+//put v in the order given, order[new] = old
+template<class T>
+static void Reorder(std::vector<T>& v, const std::vector<int>& order)
+{
+	std::vector<T> sorted;
+	sorted.reserve(order.size());
+	for (int old : order)
+		sorted.push_back(v[old]);
+	v.swap(sorted);
+}
+
+void SceneGraph::Sort()
+{
+	int n = (int)mParents.size();
+	//every live node's children, siblings stay in the order they're in now
+	std::vector<int> parents(n, -1), firstChild(n + 1, 0), children;
+	for (int i = 0; i < n; ++i)
+	{
+		if (mDead[i] || mParentSlots[i] == NodeHandle::NONE)
+			continue;
+		parents[i] = (int)mSlots[mParentSlots[i]].node;
+		assert(!mDead[parents[i]]);
+		++firstChild[parents[i] + 1];
+	}
+	for (int i = 0; i < n; ++i)
+		firstChild[i + 1] += firstChild[i];
+	children.resize(firstChild[n]);
+	std::vector<int> next(firstChild.begin(), firstChild.end() - 1);
+	for (int i = 0; i < n; ++i)
+		if (!mDead[i] && parents[i] >= 0)
+			children[next[parents[i]]++] = i;
+
+	//depth first from each root in turn, children pushed backwards so they come out in order
+	std::vector<int> order, stack;
+	order.reserve(n - mNumDead);
+	for (int root = 0; root < n; ++root)
+	{
+		if (mDead[root] || parents[root] >= 0)
+			continue;
+		stack.push_back(root);
+		while (!stack.empty())
+		{
+			int i = stack.back();
+			stack.pop_back();
+			order.push_back(i);
+			for (int c = firstChild[i + 1]; c > firstChild[i]; --c)
+				stack.push_back(children[c - 1]);
+		}
+	}
+	assert((int)order.size() == n - mNumDead && "every live node should be under a live root");
+
+	//parents and subtree ends in the new order
+	std::vector<int> newIndex(n, -1);
+	for (int k = 0; k < (int)order.size(); ++k)
+		newIndex[order[k]] = k;
+	n = (int)order.size();
+	mParents.resize(n);
+	mEnds.resize(n);
+	for (int k = 0; k < n; ++k)
+	{
+		int p = parents[order[k]];
+		mParents[k] = (p < 0) ? -1 : newIndex[p];
+		mEnds[k] = k + 1;
+	}
+	for (int k = n - 1; k > 0; --k)
+		if (mParents[k] >= 0)
+			mEnds[mParents[k]] = std::max(mEnds[mParents[k]], mEnds[k]);
+
+	Reorder(mParentSlots, order);
+	Reorder(mNodeSlots, order);
+	Reorder(mLocal, order);
+	Reorder(mWorld, order);
+	Reorder(mLocalBounds, order);
+	Reorder(mWorldBounds, order);
+	Reorder(mSubtreeBounds, order);
+	Reorder(mTransforms, order);
+	Reorder(mDirty, order);
+	mDead.assign(n, 0);
+	mVisible.assign(n, 0);
+	mAncestorFlags.assign(n, 0);
+	for (int k = 0; k < n; ++k)
+		mSlots[mNodeSlots[k]].node = k;
+	mNumDead = 0;
+	mOrderStale = false;
+}
+
+void SceneGraph::UpdateNode(int i, TransformStore* pTransforms)
+{
+	const TRS& local = mLocal[i];
+	TRS& world = mWorld[i];
+	int p = mParents[i];
+	if (p < 0)
+		world = local;
+	else
+	{
+		const TRS& pw = mWorld[p];
+		world.scale = Vector3(pw.scale.x * local.scale.x, pw.scale.y * local.scale.y, pw.scale.z * local.scale.z);
+		world.rot = local.rot * pw.rot;
+		world.pos = pw.pos + Rotate(pw.rot, Vector3(pw.scale.x * local.pos.x, pw.scale.y * local.pos.y, pw.scale.z * local.pos.z));
+	}
+
+	//the local box's centre goes through the transform, its half size through the absolute rotation
+	Box& box = mWorldBounds[i];
+	const Box& lb = mLocalBounds[i];
+	if (lb.IsEmpty())
+		box = Box();
+	else
+	{
+		const Quaternion& q = world.rot;
+		float xx = 2 * q.x * q.x, yy = 2 * q.y * q.y, zz = 2 * q.z * q.z;
+		float xy = 2 * q.x * q.y, xz = 2 * q.x * q.z, yz = 2 * q.y * q.z;
+		float wx = 2 * q.w * q.x, wy = 2 * q.w * q.y, wz = 2 * q.w * q.z;
+		const float r[3][3] = {
+			{ 1 - (yy + zz), xy + wz, xz - wy },
+			{ xy - wz, 1 - (xx + zz), yz + wx },
+			{ xz + wy, yz - wx, 1 - (xx + yy) }
+		};
+		Vector3 c = (lb.min + lb.max) * 0.5f, e = (lb.max - lb.min) * 0.5f;
+		c = world.pos + Rotate(q, Vector3(c.x * world.scale.x, c.y * world.scale.y, c.z * world.scale.z));
+		e = Vector3(fabsf(e.x * world.scale.x), fabsf(e.y * world.scale.y), fabsf(e.z * world.scale.z));
+		Vector3 we(fabsf(r[0][0]) * e.x + fabsf(r[1][0]) * e.y + fabsf(r[2][0]) * e.z,
+			fabsf(r[0][1]) * e.x + fabsf(r[1][1]) * e.y + fabsf(r[2][1]) * e.z,
+			fabsf(r[0][2]) * e.x + fabsf(r[1][2]) * e.y + fabsf(r[2][2]) * e.z);
+		box.min = c - we;
+		box.max = c + we;
+	}
+	mSubtreeBounds[i] = box;
+
+	if (!mTransforms[i].IsNull())
+	{
+		assert(pTransforms);
+		pTransforms->SetPosition(mTransforms[i], world.pos);
+		pTransforms->SetRotation(mTransforms[i], world.rot);
+		pTransforms->SetScale(mTransforms[i], world.scale);
+	}
+	mDirty[i] = 0;
+}
+
+void SceneGraph::GatherBounds(int i)
+{
+	Box b = mWorldBounds[i];
+	for (int c = i + 1; c < mEnds[i]; c = mEnds[c])
+		b.Merge(mSubtreeBounds[c]);
+	mSubtreeBounds[i] = b;
+}
+
+void SceneGraph::Update(TransformStore* pTransforms)
+{
+	if (mOrderStale)
+		Sort();
+
+	//the subtrees under moved nodes that aren't already inside another one
+	int n = (int)mParents.size();
+	mRuns.clear();
+	int total = 0;
+	for (int i = 0; i < n;)
+	{
+		const void* p = memchr(mDirty.data() + i, 1, n - i);
+		if (!p)
+			break;
+		i = (int)(static_cast<const unsigned char*>(p) - mDirty.data());
+		Run run;
+		run.begin = i;
+		run.end = mEnds[i];
+		run.total = total;
+		mRuns.push_back(run);
+		total += run.end - run.begin;
+		i = run.end;
+	}
+	mNumUpdated = total;
+
+	//runs don't overlap, so they can be done at once, shared out by how many nodes they have
+	ParallelFor(total, 4096, [&](int begin, int end) {
+		auto it = std::lower_bound(mRuns.begin(), mRuns.end(), begin, [](const Run& r, int t) {
+			return r.total < t;
+		});
+		for (; it != mRuns.end() && it->total < end; ++it)
+		{
+			for (int i = it->begin; i < it->end; ++i)
+				UpdateNode(i, pTransforms);
+			//children come after parents, so backwards carries boxes up
+			for (int i = it->end - 1; i > it->begin; --i)
+				mSubtreeBounds[mParents[i]].Merge(mSubtreeBounds[i]);
+		}
+	});
+
+	//boxes above the runs, deepest first, each redone once however many runs are below it
+	mAncestors.clear();
+	for (const Run& run : mRuns)
+		for (int p = mParents[run.begin]; p >= 0 && !mAncestorFlags[p]; p = mParents[p])
+		{
+			mAncestorFlags[p] = 1;
+			mAncestors.push_back(p);
+		}
+	std::sort(mAncestors.begin(), mAncestors.end(), std::greater<int>());
+	for (int a : mAncestors)
+	{
+		GatherBounds(a);
+		mAncestorFlags[a] = 0;
+	}
+}
+
+int SceneGraph::Cull(const Matrix& viewProj)
+{
+	//the view's planes from the columns of view*proj, d3d clip space has 0<=z<=w
+	const Matrix& m = viewProj;
+	float planes[6][4];
+	for (int k = 0; k < 4; ++k)
+	{
+		float c0 = m.m[k][0], c1 = m.m[k][1], c2 = m.m[k][2], c3 = m.m[k][3];
+		planes[0][k] = c3 + c0;		//left
+		planes[1][k] = c3 - c0;		//right
+		planes[2][k] = c3 + c1;		//bottom
+		planes[3][k] = c3 - c1;		//top
+		planes[4][k] = c2;			//near
+		planes[5][k] = c3 - c2;		//far
+	}
+
+	int n = (int)mParents.size();
+	int numVisible = 0;
+	for (int i = 0; i < n;)
+	{
+		const Box& sb = mSubtreeBounds[i];
+		int test = TestBox(planes, sb.min, sb.max);
+		if (test == BoxTest::OUTSIDE)
+		{
+			memset(&mVisible[i], 0, mEnds[i] - i);
+			i = mEnds[i];
+		}
+		else if (test == BoxTest::INSIDE)
+		{
+			for (int end = mEnds[i]; i < end; ++i)
+			{
+				mVisible[i] = !mWorldBounds[i].IsEmpty();
+				numVisible += mVisible[i];
+			}
+		}
+		else
+		{
+			const Box& b = mWorldBounds[i];
+			mVisible[i] = TestBox(planes, b.min, b.max) != BoxTest::OUTSIDE;
+			numVisible += mVisible[i];
+			++i;
+		}
+	}
+	return numVisible;
+}
+
+double SceneGraph::Benchmark(int numNodes, int numFrames)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	typedef std::chrono::duration<double> Seconds;
+	const int chainLength = 1000;
+	double totalPerSec = 0;
+	for (int shape = 0; shape < 2; ++shape)
+	{
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> unit(-1, 1);
+		SceneGraph scene;
+		std::vector<NodeHandle> nodes, roots;
+		nodes.reserve(numNodes);
+
+		//deep - chains hanging off their roots, wide - a root, a few hundred children, the rest under them
+		Clock::time_point t0 = Clock::now();
+		int numMid = (int)sqrtf((float)numNodes);
+		for (int i = 0; i < numNodes; ++i)
+		{
+			NodeHandle parent;
+			if (shape == 0 && i % chainLength)
+				parent = nodes.back();
+			else if (shape == 1 && i > 0)
+				parent = nodes[(i <= numMid) ? 0 : 1 + i % numMid];
+			NodeHandle h = scene.Add(parent);
+			if (parent.IsNull())
+				roots.push_back(h);
+			nodes.push_back(h);
+			Vector3 offset = (shape == 0) ? Vector3(0, 1, 0) : Vector3(unit(rng), unit(rng), unit(rng)) * 20;
+			scene.SetPosition(h, offset);
+			scene.SetRotation(h, Quaternion::CreateFromAxisAngle(Vector3(0, 0, 1), unit(rng) * 0.02f));
+			scene.SetBounds(h, Vector3(-0.5f, -0.5f, -0.5f), Vector3(0.5f, 0.5f, 0.5f));
+		}
+		for (int i = 0; i < (int)roots.size(); ++i)
+			scene.SetPosition(roots[i], Vector3((float)(i % 10) * 50, 0, (float)(i / 10) * 50));
+		scene.Update(nullptr);
+		Clock::time_point t1 = Clock::now();
+
+		//everything moves
+		for (int f = 0; f < numFrames; ++f)
+		{
+			for (NodeHandle root : roots)
+				scene.SetRotation(root, Quaternion::CreateFromAxisAngle(Vector3(0, 1, 0), f * 0.01f));
+			scene.Update(nullptr);
+		}
+		Clock::time_point t2 = Clock::now();
+		//a few random ones move, in a chain everything after them does too
+		int numMoved = std::max(1, numNodes / 1000), numRedone = 0;
+		for (int f = 0; f < numFrames; ++f)
+		{
+			for (int i = 0; i < numMoved; ++i)
+				scene.SetScale(nodes[rng() % numNodes], Vector3(1, 1, 1) * (1 + f * 0.001f));
+			scene.Update(nullptr);
+			numRedone += scene.GetNumUpdated();
+		}
+		Clock::time_point t3 = Clock::now();
+		//looking at part of it
+		Matrix viewProj = Matrix::CreateTranslation(-200, -50, -700) * Matrix::CreatePerspectiveFieldOfView(0.25f * PI, 4 / 3.f, 1, 1000);
+		int numVisible = 0;
+		for (int f = 0; f < numFrames; ++f)
+			numVisible = scene.Cull(viewProj);
+		Clock::time_point t4 = Clock::now();
+
+		Seconds build = t1 - t0, all = t2 - t1, few = t3 - t2, cull = t4 - t3;
+		double perSec = (double)numNodes * numFrames / std::max(all.count(), 1e-9);
+		totalPerSec += perSec * 0.5;
+		DBOUT("Scene graph, " << (shape == 0 ? "deep, chains of " : "wide, 1 root with ") << (shape == 0 ? chainLength : numMid)
+			<< (shape == 0 ? "" : " children") << ", " << numNodes << " nodes: built in " << build.count() * 1000 << "ms, roots moving "
+			<< all.count() * 1e9 / ((double)numNodes * numFrames) << "ns a node, " << numMoved << " random nodes moving "
+			<< few.count() * 1000 / numFrames << "ms a frame (" << numRedone / numFrames << " nodes redone), cull "
+			<< cull.count() * 1000 / numFrames << "ms (" << numVisible << " visible)");
+	}
+	return totalPerSec;
+}
@@ -0,0 +1,161 @@
+#ifndef SCENEGRAPH_H
+#define SCENEGRAPH_H
+
+#include <cfloat>
+#include <vector>
+
+#include "SimpleMath.h"
+#include "SlotMap.h"
+#include "TransformStore.h"
+
+class SceneGraph;
+//a node in a SceneGraph
+typedef Handle<SceneGraph> NodeHandle;
+
+/*
+Parent/child transforms, so things attached to other things follow them around.
+Nodes are kept depth first - a parent, then all of its descendants, then its next
+sibling - so a node's subtree is one run of the arrays, parents always come before
+their children and moving a node means redoing just its run. Adding, removing and
+reparenting only mark the order as stale, it's sorted again by the next Update.
+A node's world transform is its local one on top of its parent's:
+    world scale = parent scale * local scale
+    world rotation = local rotation then parent rotation
+    world position = parent position + parent rotation(parent scale * local position)
+which is the same as multiplying the matrices as long as parents with rotated children
+are scaled the same on every axis (otherwise there'd be shear, which is left out).
+A node can drive a transform in the TransformStore (e.g. Model::GetTransform()), the
+model should then be moved through the node.
+Each node can have a box around what it draws, boxes are carried up to their parents
+so culling can throw away whole subtrees.
+*/
+class SceneGraph
+{
+public:
+	/*
+	* a new node, it gets sorted into place at the next Update
+	* parent - IN a null handle for a root
+	* transform - IN optional, set to the node's world transform at each Update
+	* returns - its handle
+	*/
+	NodeHandle Add(NodeHandle parent = NodeHandle(), TransformHandle transform = TransformHandle());
+	//remove a node and everything below it, their handles go stale. Returns false if it already had.
+	bool Remove(NodeHandle node);
+	//move a node (and what's below it) under another, or make it a root with a null handle
+	void SetParent(NodeHandle node, NodeHandle parent);
+	//does the handle still refer to something
+	bool IsValid(NodeHandle node) const {
+		return node.index < mSlots.size() && mSlots[node.index].generation == node.generation && node.generation != 0;
+	}
+
+	//relative to the parent, setting marks the node and everything below it to be redone
+	void SetPosition(NodeHandle node, const DirectX::SimpleMath::Vector3& pos);
+	void SetRotation(NodeHandle node, const DirectX::SimpleMath::Quaternion& rot);
+	void SetScale(NodeHandle node, const DirectX::SimpleMath::Vector3& scale);
+	/*
+	* a box around what the node draws, in its own space, e.g. a mesh's bounds
+	* boundsMin, boundsMax - IN corners, min > max for nothing
+	*/
+	void SetBounds(NodeHandle node, const DirectX::SimpleMath::Vector3& boundsMin, const DirectX::SimpleMath::Vector3& boundsMax);
+	//world space, as of the last Update
+	DirectX::SimpleMath::Vector3 GetWorldPosition(NodeHandle node) const;
+	DirectX::SimpleMath::Quaternion GetWorldRotation(NodeHandle node) const;
+	DirectX::SimpleMath::Vector3 GetWorldScale(NodeHandle node) const;
+	//box round the node and everything below it, as of the last Update
+	void GetSubtreeBounds(NodeHandle node, DirectX::SimpleMath::Vector3& boundsMin, DirectX::SimpleMath::Vector3& boundsMax) const;
+
+	/*
+	* sort the nodes if anything's been added or moved about, then redo every subtree
+	* with a moved node at the top. Separate subtrees are spread over the cores.
+	* pTransforms - IN/OUT where the nodes' transforms are, nullptr if none have one
+	*/
+	void Update(TransformStore* pTransforms);
+	/*
+	* find which nodes' boxes can be seen, a subtree outside the view is skipped in one go
+	* and one inside it isn't tested any further. See IsVisible.
+	* viewProj - IN the camera's view * projection
+	* returns - how many nodes with a box can be seen
+	*/
+	int Cull(const DirectX::SimpleMath::Matrix& viewProj);
+	//as of the last Cull, nodes without a box never are
+	bool IsVisible(NodeHandle node) const;
+
+	//getters
+	int GetNumNodes() const {
+		return (int)mParents.size() - mNumDead;
+	}
+	//how many nodes the last Update redid
+	int GetNumUpdated() const {
+		return mNumUpdated;
+	}
+
+	/*
+	* time building, moving and culling 2 shapes of hierarchy - deep (long chains) and wide
+	* (a few levels with lots of children). Doesn't need a device. Results go to DBOUT.
+	* numNodes - IN in each hierarchy
+	* numFrames - IN how many updates to time
+	* returns - nodes per second redone when the roots move, deep and wide together
+	*/
+	static double Benchmark(int numNodes, int numFrames);
+
+private:
+	//position, rotation and scale
+	struct TRS
+	{
+		DirectX::SimpleMath::Vector3 pos;
+		DirectX::SimpleMath::Quaternion rot;
+		DirectX::SimpleMath::Vector3 scale = DirectX::SimpleMath::Vector3(1, 1, 1);
+	};
+	struct Box
+	{
+		DirectX::SimpleMath::Vector3 min = DirectX::SimpleMath::Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+		DirectX::SimpleMath::Vector3 max = DirectX::SimpleMath::Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+		bool IsEmpty() const {
+			return min.x > max.x;
+		}
+		void Merge(const Box& b);
+	};
+	struct Slot
+	{
+		unsigned int node = 0;			//where it is in the arrays, or the next free slot
+		unsigned int generation = 1;
+	};
+	//a subtree to redo in Update
+	struct Run
+	{
+		int begin, end;
+		int total;			//nodes in the runs before this one, for sharing them out
+	};
+
+	//everything below is in depth first order, one per node
+	std::vector<int> mParents;				//-1 for roots
+	std::vector<int> mEnds;					//one past a node's last descendant
+	std::vector<unsigned int> mParentSlots;	//so the parents survive sorting, NONE for roots
+	std::vector<unsigned int> mNodeSlots;	//which slot each node belongs to
+	std::vector<TRS> mLocal, mWorld;
+	std::vector<Box> mLocalBounds, mWorldBounds, mSubtreeBounds;
+	std::vector<TransformHandle> mTransforms;
+	std::vector<unsigned char> mDirty;		//moved, it and its subtree need redoing
+	std::vector<unsigned char> mDead;		//removed, dropped when sorted
+	std::vector<unsigned char> mVisible;
+
+	std::vector<Slot> mSlots;
+	unsigned int mFreeSlot = NodeHandle::NONE;
+	std::vector<Run> mRuns;
+	std::vector<int> mAncestors;			//whose subtree boxes need redoing
+	std::vector<unsigned char> mAncestorFlags;
+	bool mOrderStale = false;
+	int mNumDead = 0, mNumUpdated = 0;
+
+	//check the handle and turn it into a position in the arrays
+	int GetNode(NodeHandle node) const;
+	//put the nodes back in depth first order, dropping dead ones
+	void Sort();
+	//redo a node's world transform and box, its parent has to be done already
+	void UpdateNode(int i, TransformStore* pTransforms);
+	//a node's subtree box from its own and its children's
+	void GatherBounds(int i);
+};
+
+#endif
@@ -1,5 +1,10 @@
+#include <DirectXPackedVector.h>
+
 #include "ShaderTypes.h"
 
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
 const Material Material::default {
 	{ { 1, 1, 1, 1 }, { 1, 1, 1, 1 }, { 1, 1, 1, 1 } },
 		nullptr,
@@ -16,3 +21,68 @@ const D3D11_INPUT_ELEMENT_DESC VertexPosNormTex::sVertexDesc[3]{
 	{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 }
 };
 
+
+const D3D11_INPUT_ELEMENT_DESC VertexPosNormTexQ::sVertexDesc[3]{
+	{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+};
+
+const D3D11_INPUT_ELEMENT_DESC VertexPosNormTexSkin::sVertexDesc[5]{
+	{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "BLENDINDICES", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 32, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "BLENDWEIGHT", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 36, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+};
+
+const VertexFormatInfo gVertexFormats[VertexFormat::MAX_FORMATS]{
+	{ VertexPosNormTex::sVertexDesc, 3, sizeof(VertexPosNormTex), "../bin/data/TextureVS.cso" },
+	{ VertexPosNormTexQ::sVertexDesc, 3, sizeof(VertexPosNormTexQ), "../bin/data/TextureVSQ.cso" },
+	{ VertexPosNormTexSkin::sVertexDesc, 5, sizeof(VertexPosNormTexSkin), "../bin/data/TextureVSSkin.cso" }
+};
+
+//0-1 -> 0-65535
+static unsigned short ToUNorm16(float x)
+{
+	x = (x < 0) ? 0 : ((x > 1) ? 1 : x);
+	return (unsigned short)(x * 65535.f + 0.5f);
+}
+
+//-1-1 -> -32767-32767
+static short ToSNorm16(float x)
+{
+	x = (x < -1) ? -1 : ((x > 1) ? 1 : x);
+	return (short)roundf(x * 32767.f);
+}
+
+VertexPosNormTexQ VertexPosNormTexQ::Encode(const VertexPosNormTex& v, const Vector3& boundsMin, const Vector3& boundsSize)
+{
+	VertexPosNormTexQ q;
+	q.Pos[0] = ToUNorm16((v.Pos.x - boundsMin.x) / boundsSize.x);
+	q.Pos[1] = ToUNorm16((v.Pos.y - boundsMin.y) / boundsSize.y);
+	q.Pos[2] = ToUNorm16((v.Pos.z - boundsMin.z) / boundsSize.z);
+	q.Pos[3] = 0;
+
+	//octahedral - project onto the octahedron |x|+|y|+|z|=1 then fold the bottom half over the top
+	float l1 = fabsf(v.Norm.x) + fabsf(v.Norm.y) + fabsf(v.Norm.z);
+	float ox = 0, oy = 0;
+	if (l1 > 0)
+	{
+		ox = v.Norm.x / l1;
+		oy = v.Norm.y / l1;
+		if (v.Norm.z < 0)
+		{
+			float fx = (1 - fabsf(oy)) * ((ox >= 0) ? 1.f : -1.f);
+			float fy = (1 - fabsf(ox)) * ((oy >= 0) ? 1.f : -1.f);
+			ox = fx;
+			oy = fy;
+		}
+	}
+	q.Norm[0] = ToSNorm16(ox);
+	q.Norm[1] = ToSNorm16(oy);
+
+	q.Tex[0] = PackedVector::XMConvertFloatToHalf(v.Tex.x);
+	q.Tex[1] = PackedVector::XMConvertFloatToHalf(v.Tex.y);
+	return q;
+}
@@ -6,6 +6,8 @@
 
 #include "SimpleMath.h"
 
+namespace FX { struct PipelineState; }
+
 
 /*
 This is what our vertex data will look like
@@ -20,6 +22,58 @@ struct VertexPosNormTex
 	static const D3D11_INPUT_ELEMENT_DESC sVertexDesc[3];
 };
 
+/*
+A compact version of VertexPosNormTex, half the size so half the bandwidth
+when the gpu fetches vertices. Decoded by TextureVSQ.
+*/
+struct VertexPosNormTexQ
+{
+	unsigned short Pos[4];		//UNORM16 position inside the mesh bounding box, w unused
+	short Norm[2];				//SNORM16 octahedral encoded normal
+	unsigned short Tex[2];		//half float uv, so still fine for tiling uvs outside 0-1
+
+	//a description of this structure that we can pass to d3d
+	static const D3D11_INPUT_ELEMENT_DESC sVertexDesc[3];
+	/*
+	* pack a full size vertex
+	* v - IN the vertex
+	* boundsMin - IN smallest corner of the mesh bounding box
+	* boundsSize - IN size of the box (no zero components)
+	*/
+	static VertexPosNormTexQ Encode(const VertexPosNormTex& v, const DirectX::SimpleMath::Vector3& boundsMin,
+		const DirectX::SimpleMath::Vector3& boundsSize);
+};
+static_assert(sizeof(VertexPosNormTexQ) == 16, "compact vertex should be 16 bytes");
+
+/*
+A vertex that bends with a skeleton, each one follows up to 4 bones.
+Decoded by TextureVSSkin, which blends the bone matrices in GfxParamsSkin.
+See Skeleton.h and Skinning.h
+*/
+struct VertexPosNormTexSkin
+{
+	DirectX::SimpleMath::Vector3 Pos;		//bind pose position
+	DirectX::SimpleMath::Vector3 Norm;
+	DirectX::SimpleMath::Vector2 Tex;
+	unsigned char Bones[4];					//palette indices
+	unsigned char Weights[4];				//UNORM8, should add up to 255
+
+	static const D3D11_INPUT_ELEMENT_DESC sVertexDesc[5];
+};
+static_assert(sizeof(VertexPosNormTexSkin) == 40, "skinned vertex should be 40 bytes");
+
+//which vertex structure a mesh is using
+namespace VertexFormat { enum { FULL = 0, COMPACT = 1, SKINNED = 2, MAX_FORMATS = 3 }; }
+//everything needed to use a vertex format
+struct VertexFormatInfo
+{
+	const D3D11_INPUT_ELEMENT_DESC* pDesc;	//input layout description
+	int numElements;						//how many in the description
+	unsigned int size;						//bytes per vertex
+	const char* pVSFile;					//compiled vertex shader that can decode it
+};
+extern const VertexFormatInfo gVertexFormats[VertexFormat::MAX_FORMATS];
+
 /*
 Insted of a colour in each vertex we define a material
 for a group of primitves (an entire surface)
@@ -94,6 +148,10 @@ struct Material
 	std::string name;			//material names can come from 3DSMax and can be useful for debugging
 	std::string texture;		//file name of texture
 
+	const FX::PipelineState* pPSO = nullptr;	//shaders+states this material needs, see MyFX::CompileMaterial
+	unsigned int psoKey = 0;					//the key pPSO was built from, so we can tell if the material changed
+	ID3D11ShaderResourceView* pPSOTex = nullptr;	//the texture pPSO was built with, for the same reason
+
 	static const Material default; //a default set of values to get you started
 };
 
@@ -153,4 +211,12 @@ struct GfxParamsPerMesh
 };
 static_assert((sizeof(GfxParamsPerMesh) % 16) == 0, "CB size not padded correctly");
 
+//bone matrices for skinned meshes, one set per character
+const int MAX_BONES = 64;
+struct GfxParamsSkin
+{
+	DirectX::SimpleMath::Matrix bones[MAX_BONES];	//inverse bind * model space pose
+};
+static_assert((sizeof(GfxParamsSkin) % 16) == 0, "CB size not padded correctly");
+
 #endif
@@ -0,0 +1,32 @@
+#include "Simd.h"
+
+namespace Simd
+{
+	static bool CheckAVX2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+		//FMA, OSXSAVE and AVX
+		__cpuid(info, 1);
+		const int needed = (1 << 12) | (1 << 27) | (1 << 28);
+		if ((info[2] & needed) != needed)
+			return false;
+		//the os has to save the ymm registers when switching threads
+		if ((_xgetbv(0) & 6) != 6)
+			return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+	}
+
+	bool HasAVX2()
+	{
+		static const bool sHas = CheckAVX2();
+		return sHas;
+	}
+}
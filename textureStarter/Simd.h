@@ -0,0 +1,26 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/*
+What the AVX2 paths (skinning, transforms, sprites, particles) share. Each keeps
+a plain version as well and only takes the AVX2 one when HasAVX2 says it can.
+*/
+//msvc will use AVX2 intrinsics anywhere, gcc/clang need telling which functions can
+#if defined(_MSC_VER)
+#define SIMD_AVX2
+#else
+#define SIMD_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+namespace Simd
+{
+	//can this cpu and os use AVX2 and FMA, checked once
+	bool HasAVX2();
+}
+
+#endif
@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "Skeleton.h"
+#include "ShaderTypes.h"
+#include "D3DUtil.h"
+#include "Parallel.h"
+#include "CompressedClip.h"
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+Matrix BoneTransform::ToMatrix() const
+{
+	return Matrix::CreateScale(scale) * Matrix::CreateFromQuaternion(rotation) * Matrix::CreateTranslation(translation);
+}
+
+BoneTransform BoneTransform::Lerp(const BoneTransform& a, const BoneTransform& b, float t)
+{
+	BoneTransform r;
+	r.translation = Vector3::Lerp(a.translation, b.translation, t);
+	//normalised lerp, it flips b if that's the shorter way round
+	r.rotation = Quaternion::Lerp(a.rotation, b.rotation, t);
+	r.scale = Vector3::Lerp(a.scale, b.scale, t);
+	return r;
+}
+
+int Skeleton::AddBone(const std::string& name, int parent, const BoneTransform& bind)
+{
+	//parents first, so model space can be worked out in one pass
+	assert(parent >= -1 && parent < GetNumBones());
+	assert(GetNumBones() < MAX_BONES);
+	mNames.push_back(name);
+	mParents.push_back(parent);
+	mBindPose.push_back(bind);
+	return GetNumBones() - 1;
+}
+
+void Skeleton::Finalise()
+{
+	mInvBind.resize(GetNumBones());
+	Anim::LocalToModel(*this, mBindPose, mInvBind.data());
+	for (Matrix& m : mInvBind)
+		m = m.Invert();
+}
+
+int Skeleton::FindBone(const std::string& name) const
+{
+	std::vector<std::string>::const_iterator it = std::find(mNames.begin(), mNames.end(), name);
+	return (it != mNames.end()) ? (int)(it - mNames.begin()) : -1;
+}
+
+/*
+* find the keys either side of a time
+* times - IN key times, in order, not empty
+* time - IN when
+* t - OUT how far from the returned key to the next, 0 at or past the ends
+* returns - the key at or before time
+*/
+static int FindKey(const std::vector<float>& times, float time, float& t)
+{
+	int last = (int)times.size() - 1;
+	t = 0;
+	if (time <= times[0])
+		return 0;
+	if (time >= times[last])
+		return last;
+	int i = (int)(std::upper_bound(times.begin(), times.end(), time) - times.begin()) - 1;
+	t = (time - times[i]) / (times[i + 1] - times[i]);
+	return i;
+}
+
+void AnimClip::Sample(const Skeleton& skel, float time, bool loop, Pose& pose) const
+{
+	assert((int)mTracks.size() == skel.GetNumBones());
+	if (loop && mDuration > 0)
+	{
+		time = fmodf(time, mDuration);
+		if (time < 0)
+			time += mDuration;
+	}
+	else
+		time = std::min(std::max(time, 0.f), mDuration);
+
+	const Pose& bind = skel.GetBindPose();
+	pose.resize(mTracks.size());
+	for (size_t b = 0; b < mTracks.size(); ++b)
+	{
+		const BoneTrack& track = mTracks[b];
+		BoneTransform& out = pose[b];
+		float t;
+		int k;
+		if (track.positions.empty())
+			out.translation = bind[b].translation;
+		else
+		{
+			k = FindKey(track.posTimes, time, t);
+			out.translation = (t > 0) ? Vector3::Lerp(track.positions[k], track.positions[k + 1], t) : track.positions[k];
+		}
+		if (track.rotations.empty())
+			out.rotation = bind[b].rotation;
+		else
+		{
+			k = FindKey(track.rotTimes, time, t);
+			out.rotation = (t > 0) ? Quaternion::Lerp(track.rotations[k], track.rotations[k + 1], t) : track.rotations[k];
+		}
+		if (track.scales.empty())
+			out.scale = bind[b].scale;
+		else
+		{
+			k = FindKey(track.scaleTimes, time, t);
+			out.scale = (t > 0) ? Vector3::Lerp(track.scales[k], track.scales[k + 1], t) : track.scales[k];
+		}
+	}
+}
+
+size_t AnimClip::GetMemoryUsed() const
+{
+	size_t bytes = sizeof(*this) + mName.capacity() + mTracks.capacity() * sizeof(BoneTrack);
+	for (const BoneTrack& t : mTracks)
+		bytes += (t.posTimes.capacity() + t.rotTimes.capacity() + t.scaleTimes.capacity()) * sizeof(float) +
+			(t.positions.capacity() + t.scales.capacity()) * sizeof(Vector3) + t.rotations.capacity() * sizeof(Quaternion);
+	return bytes;
+}
+
+namespace Anim
+{
+	void Blend(const Pose& a, const Pose& b, float t, Pose& out)
+	{
+		assert(a.size() == b.size());
+		out.resize(a.size());
+		for (size_t i = 0; i < a.size(); ++i)
+			out[i] = BoneTransform::Lerp(a[i], b[i], t);
+	}
+
+	void LocalToModel(const Skeleton& skel, const Pose& local, Matrix model[])
+	{
+		const int* pParents = skel.GetParents();
+		for (int i = 0; i < skel.GetNumBones(); ++i)
+		{
+			//parents come first so theirs is already done
+			model[i] = local[i].ToMatrix();
+			if (pParents[i] >= 0)
+				model[i] *= model[pParents[i]];
+		}
+	}
+
+	void MakePalette(const Skeleton& skel, const Matrix model[], Matrix palette[])
+	{
+		const Matrix* pInvBind = skel.GetInverseBind();
+		for (int i = 0; i < skel.GetNumBones(); ++i)
+			palette[i] = pInvBind[i] * model[i];
+	}
+
+	AnimClip MakeSwingClip(const Skeleton& skel, const std::string& name, float duration,
+		const Vector3& axis, float maxAngle, int numKeys, float phase)
+	{
+		assert(numKeys >= 2 && duration > 0);
+		AnimClip clip(name, duration, skel.GetNumBones());
+		for (int b = 0; b < skel.GetNumBones(); ++b)
+		{
+			BoneTrack& track = clip.GetTrack(b);
+			const Quaternion& bind = skel.GetBindPose()[b].rotation;
+			for (int k = 0; k < numKeys; ++k)
+			{
+				float f = (float)k / (numKeys - 1);
+				float angle = maxAngle * sinf(2 * PI * (f + phase));
+				track.rotTimes.push_back(f * duration);
+				track.rotations.push_back(Quaternion::CreateFromAxisAngle(axis, angle) * bind);
+			}
+			//exactly the same, rounding in sinf shouldn't make it jump as it loops
+			track.rotations.back() = track.rotations.front();
+		}
+		return clip;
+	}
+
+	double BenchmarkPoses(int numCharacters, int numBones, int numFrames)
+	{
+		typedef std::chrono::high_resolution_clock Clock;
+		//a chain, like a tail or a spine
+		Skeleton skel;
+		for (int b = 0; b < numBones; ++b)
+		{
+			BoneTransform bt;
+			bt.translation = Vector3(0, (b == 0) ? 0.f : 0.5f, 0);
+			skel.AddBone("bone" + std::to_string(b), b - 1, bt);
+		}
+		skel.Finalise();
+		AnimClip sway = MakeSwingClip(skel, "sway", 2, Vector3(0, 0, 1), 0.2f);
+		AnimClip curl = MakeSwingClip(skel, "curl", 1.5f, Vector3(1, 0, 0), 0.3f);
+
+		//everyone at a different point, about half of them crossfading at any time
+		std::vector<Animator> animators(numCharacters);
+		for (int i = 0; i < numCharacters; ++i)
+		{
+			animators[i].Initialise(skel);
+			animators[i].Play(sway);
+			animators[i].Update(i * 0.013f);
+		}
+		const float dTime = 1 / 60.f;
+		auto frame = [&](int f, bool parallel) {
+			for (int i = f % 60; i < numCharacters; i += 60)
+				animators[i].Play((animators[i].GetClip() == &sway) ? curl : sway, 0.5f);
+			if (parallel)
+				Animator::UpdateMany(animators.data(), numCharacters, dTime);
+			else
+				for (Animator& a : animators)
+					a.Update(dTime);
+		};
+
+		Clock::time_point t0 = Clock::now();
+		for (int f = 0; f < numFrames; ++f)
+			frame(f, false);
+		Clock::time_point t1 = Clock::now();
+		for (int f = 0; f < numFrames; ++f)
+			frame(f, true);
+		Clock::time_point t2 = Clock::now();
+
+		std::chrono::duration<double> single = t1 - t0, multi = t2 - t1;
+		double poses = (double)numCharacters * numFrames;
+		double perSec = poses / std::max(multi.count(), 1e-9);
+		DBOUT("Animation, " << numCharacters << " characters x " << numBones << " bones x " << numFrames << " frames: "
+			<< poses / std::max(single.count(), 1e-9) << " poses/s on one thread, " << perSec << " poses/s on "
+			<< std::max(1u, std::thread::hardware_concurrency()) << " (" << animators[0].GetPalette()[numBones - 1]._42 << ")");
+		return perSec;
+	}
+}
+
+void Animator::Initialise(const Skeleton& skel)
+{
+	mpSkel = &skel;
+	mCurrent = mPrevious = Layer();
+	mFade = mFadeTime = 0;
+	mPose = skel.GetBindPose();
+	mModel.resize(skel.GetNumBones());
+	mPalette.assign(skel.GetNumBones(), Matrix::Identity);
+}
+
+void Animator::StartFade(const Layer& was, float fadeTime)
+{
+	if (fadeTime > 0 && was.IsPlaying())
+	{
+		//if a fade was already going the oldest clip just stops
+		mPrevious = was;
+		mFade = 0;
+		mFadeTime = fadeTime;
+	}
+	else
+		mPrevious = Layer();
+}
+
+void Animator::Play(const AnimClip& clip, float fadeTime, bool loop, float speed)
+{
+	assert(mpSkel);
+	Layer was = mCurrent;
+	mCurrent = Layer();
+	mCurrent.pClip = &clip;
+	mCurrent.speed = speed;
+	mCurrent.loop = loop;
+	StartFade(was, fadeTime);
+}
+
+void Animator::Play(const CompressedClip& clip, float fadeTime, bool loop, float speed)
+{
+	assert(mpSkel);
+	Layer was = mCurrent;
+	mCurrent = Layer();
+	mCurrent.pPacked = &clip;
+	mCurrent.speed = speed;
+	mCurrent.loop = loop;
+	StartFade(was, fadeTime);
+}
+
+float Animator::Layer::GetDuration() const
+{
+	return pClip ? pClip->GetDuration() : pPacked->GetDuration();
+}
+
+void Animator::Layer::Sample(const Skeleton& skel, Pose& pose) const
+{
+	if (pClip)
+		pClip->Sample(skel, time, loop, pose);
+	else
+		pPacked->Sample(skel, time, loop, pose);
+}
+
+void Animator::Update(float dTime)
+{
+	assert(mpSkel);
+	if (!mCurrent.IsPlaying())
+		return;
+	Advance(mCurrent, dTime);
+	mCurrent.Sample(*mpSkel, mPose);
+	if (mPrevious.IsPlaying())
+	{
+		mFade += dTime;
+		if (mFade >= mFadeTime)
+			mPrevious = Layer();
+		else
+		{
+			Advance(mPrevious, dTime);
+			mPrevious.Sample(*mpSkel, mFadePose);
+			Anim::Blend(mFadePose, mPose, mFade / mFadeTime, mPose);
+		}
+	}
+	Anim::LocalToModel(*mpSkel, mPose, mModel.data());
+	Anim::MakePalette(*mpSkel, mModel.data(), mPalette.data());
+}
+
+void Animator::Advance(Layer& layer, float dTime)
+{
+	layer.time += dTime * layer.speed;
+	//keep looping clocks small, a float that's run for hours can't tell frames apart
+	float duration = layer.GetDuration();
+	if (layer.loop && duration > 0 && (layer.time >= duration || layer.time < 0))
+	{
+		layer.time = fmodf(layer.time, duration);
+		if (layer.time < 0)
+			layer.time += duration;
+	}
+}
+
+void Animator::UpdateMany(Animator animators[], int count, float dTime)
+{
+	//each one only touches its own poses, the skeletons and clips are read only
+	ParallelFor(count, 16, [=](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+			animators[i].Update(dTime);
+	});
+}
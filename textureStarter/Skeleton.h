@@ -0,0 +1,241 @@
+#ifndef SKELETON_H
+#define SKELETON_H
+
+#include <string>
+#include <vector>
+
+#include "SimpleMath.h"
+
+class CompressedClip;
+
+/*
+Skeletal animation. A Skeleton is a hierarchy of bones, an AnimClip has
+keyframes for each bone and an Animator plays clips on one character:
+sample the clip(s) into a local pose -> blend -> local to model space ->
+multiply by the inverse bind pose to get the palette, one matrix per bone.
+The palette goes to TextureVSSkin (see Model::SetPalette) or to
+Skinning::SkinVertices if the cpu is doing the skinning.
+*/
+
+//a bone relative to its parent
+struct BoneTransform
+{
+	DirectX::SimpleMath::Vector3 translation;
+	DirectX::SimpleMath::Quaternion rotation;
+	DirectX::SimpleMath::Vector3 scale = DirectX::SimpleMath::Vector3(1, 1, 1);
+
+	//scale, then rotate, then translate
+	DirectX::SimpleMath::Matrix ToMatrix() const;
+	//t=0 is a, t=1 is b, rotations take the short way round
+	static BoneTransform Lerp(const BoneTransform& a, const BoneTransform& b, float t);
+};
+//one BoneTransform per bone, in skeleton order
+typedef std::vector<BoneTransform> Pose;
+
+/*
+Bones are stored parents first, so a pose can be turned into model space
+in one pass down the arrays. Set it up with AddBone then call Finalise.
+*/
+class Skeleton
+{
+public:
+	/*
+	* add a bone to the end of the hierarchy
+	* name - IN for finding it with FindBone
+	* parent - IN index of a bone that's already been added, -1 for a root
+	* bind - IN where it is, relative to its parent, when the mesh was made
+	* returns - its index
+	*/
+	int AddBone(const std::string& name, int parent, const BoneTransform& bind);
+	//work out the inverse bind matrices, call after the last AddBone
+	void Finalise();
+	//-1 if it isn't there
+	int FindBone(const std::string& name) const;
+
+	//getters
+	int GetNumBones() const {
+		return (int)mParents.size();
+	}
+	const std::string& GetName(int bone) const {
+		return mNames.at(bone);
+	}
+	int GetParent(int bone) const {
+		return mParents.at(bone);
+	}
+	//every bone's parent, -1 for roots
+	const int* GetParents() const {
+		return mParents.data();
+	}
+	const Pose& GetBindPose() const {
+		return mBindPose;
+	}
+	//model space -> bone space in the bind pose, one per bone
+	const DirectX::SimpleMath::Matrix* GetInverseBind() const {
+		return mInvBind.data();
+	}
+
+private:
+	std::vector<std::string> mNames;
+	std::vector<int> mParents;
+	Pose mBindPose;
+	std::vector<DirectX::SimpleMath::Matrix> mInvBind;
+};
+
+/*
+Keyframes for one bone. Each channel has its own key times, so a bone that
+only rotates doesn't store positions. An empty channel keeps the bind pose.
+*/
+struct BoneTrack
+{
+	std::vector<float> posTimes;
+	std::vector<DirectX::SimpleMath::Vector3> positions;
+	std::vector<float> rotTimes;
+	std::vector<DirectX::SimpleMath::Quaternion> rotations;
+	std::vector<float> scaleTimes;
+	std::vector<DirectX::SimpleMath::Vector3> scales;
+};
+
+//an animation for one skeleton, a track per bone
+class AnimClip
+{
+public:
+	AnimClip(const std::string& name, float duration, int numBones)
+		: mName(name), mDuration(duration), mTracks(numBones) {}
+	//fill in the keys, times in seconds, 0->duration, in order
+	BoneTrack& GetTrack(int bone) {
+		return mTracks.at(bone);
+	}
+	/*
+	* sample every bone at a point in time, keys either side are interpolated
+	* skel - IN the skeleton it was made for, missing channels come from its bind pose
+	* time - IN seconds
+	* loop - IN wrap the time round, otherwise it's clamped to the ends
+	* pose - OUT one transform per bone
+	*/
+	void Sample(const Skeleton& skel, float time, bool loop, Pose& pose) const;
+
+	//getters
+	const std::string& GetName() const {
+		return mName;
+	}
+	float GetDuration() const {
+		return mDuration;
+	}
+	//bytes for the keys and tables
+	size_t GetMemoryUsed() const;
+private:
+	std::string mName;
+	float mDuration;
+	std::vector<BoneTrack> mTracks;
+};
+
+namespace Anim
+{
+	//mix two poses, t=0 is all a, t=1 is all b. out can be a or b.
+	void Blend(const Pose& a, const Pose& b, float t, Pose& out);
+	/*
+	* each bone's local transform times its parent's model space matrix
+	* skel - IN the hierarchy
+	* local - IN a pose
+	* model - OUT a matrix per bone
+	*/
+	void LocalToModel(const Skeleton& skel, const Pose& local, DirectX::SimpleMath::Matrix model[]);
+	//inverse bind * model space, what the vertices are multiplied by
+	void MakePalette(const Skeleton& skel, const DirectX::SimpleMath::Matrix model[], DirectX::SimpleMath::Matrix palette[]);
+	/*
+	* a looping clip that swings every bone back and forth round an axis, so a chain of bones
+	* curls up and straightens out. Handy for testing without any animation files.
+	* skel - IN the skeleton, the bind pose rotations are kept and the swing added on
+	* name, duration - IN of the clip
+	* axis - IN in each bone's local space, normalised
+	* maxAngle - IN radians either way, per bone
+	* numKeys - IN rotation keys per bone, the last is a copy of the first so it loops cleanly
+	* phase - IN 0-1, how far round the swing the clip starts
+	*/
+	AnimClip MakeSwingClip(const Skeleton& skel, const std::string& name, float duration,
+		const DirectX::SimpleMath::Vector3& axis, float maxAngle, int numKeys = 9, float phase = 0);
+	/*
+	* time the whole sample->blend->palette chain for lots of characters, on one thread then
+	* on all of them. Doesn't need a device but does need SimpleMath, so like Skinning::Benchmark
+	* it only builds with the game on windows. Results go to DBOUT.
+	* numCharacters - IN how many are animated each frame
+	* numBones - IN per skeleton, a chain with a couple of clips crossfading
+	* numFrames - IN how many frames to time
+	* returns - poses per second using every thread
+	*/
+	double BenchmarkPoses(int numCharacters, int numBones, int numFrames);
+}
+
+/*
+Plays clips on one character, a new clip crossfades from whatever was
+playing. Update it once a frame then hand the palette to the renderer.
+The clips and skeleton must outlive it.
+*/
+class Animator
+{
+public:
+	void Initialise(const Skeleton& skel);
+	/*
+	* start a clip, from the beginning
+	* clip - IN made for our skeleton
+	* fadeTime - IN seconds to blend from the current clip, 0 to switch straight away
+	* loop - IN play it round and round, otherwise it holds the last frame
+	* speed - IN playback rate, 1 is normal
+	*/
+	void Play(const AnimClip& clip, float fadeTime = 0, bool loop = true, float speed = 1);
+	//as above but a compressed clip, see CompressedClip
+	void Play(const CompressedClip& clip, float fadeTime = 0, bool loop = true, float speed = 1);
+	//move the clock on and work out the palette
+	void Update(float dTime);
+	//animate lots of characters at once, spread over the cores
+	static void UpdateMany(Animator animators[], int count, float dTime);
+
+	//getters
+	const DirectX::SimpleMath::Matrix* GetPalette() const {
+		return mPalette.data();
+	}
+	int GetNumBones() const {
+		return (int)mPalette.size();
+	}
+	//model space bone matrices, e.g. to attach things to a hand
+	const DirectX::SimpleMath::Matrix& GetBoneMatrix(int bone) const {
+		return mModel.at(bone);
+	}
+	//nullptr if nothing's playing, or it's the other kind of clip
+	const AnimClip* GetClip() const {
+		return mCurrent.pClip;
+	}
+	const CompressedClip* GetCompressedClip() const {
+		return mCurrent.pPacked;
+	}
+	bool IsFading() const {
+		return mPrevious.IsPlaying();
+	}
+
+private:
+	//a clip playing
+	struct Layer
+	{
+		const AnimClip* pClip = nullptr;		//one or the other
+		const CompressedClip* pPacked = nullptr;
+		float time = 0, speed = 1;
+		bool loop = true;
+
+		bool IsPlaying() const {
+			return pClip || pPacked;
+		}
+		float GetDuration() const;
+		void Sample(const Skeleton& skel, Pose& pose) const;
+	};
+	const Skeleton* mpSkel = nullptr;
+	Layer mCurrent, mPrevious;			//previous is fading out
+	float mFade = 0, mFadeTime = 0;		//how far through the crossfade
+	Pose mPose, mFadePose;
+	std::vector<DirectX::SimpleMath::Matrix> mModel, mPalette;
+	//move a clip's clock on
+	static void Advance(Layer& layer, float dTime);
+	//the new clip is in mCurrent, fade from what was there
+	void StartFade(const Layer& was, float fadeTime);
+};
+
+#endif
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "Skinning.h"
+#include "D3DUtil.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+namespace Skinning
+{
+	void ToBoneMatrices(const Matrix palette[], int numBones, BoneMatrix out[])
+	{
+		for (int i = 0; i < numBones; ++i)
+		{
+			//row vectors, so x' is x*_11 + y*_21 + z*_31 + _41
+			const Matrix& m = palette[i];
+			float(&r)[3][4] = out[i].rows;
+			r[0][0] = m._11; r[0][1] = m._21; r[0][2] = m._31; r[0][3] = m._41;
+			r[1][0] = m._12; r[1][1] = m._22; r[1][2] = m._32; r[1][3] = m._42;
+			r[2][0] = m._13; r[2][1] = m._23; r[2][2] = m._33; r[2][3] = m._43;
+		}
+	}
+
+	static void SkinScalar(const VertexPosNormTexSkin in[], int numVerts, const BoneMatrix bones[], VertexPosNormTex out[])
+	{
+		for (int v = 0; v < numVerts; ++v)
+		{
+			const VertexPosNormTexSkin& src = in[v];
+			float m[12] = { 0 };
+			for (int i = 0; i < 4; ++i)
+			{
+				if (src.Weights[i] == 0)
+					continue;
+				float w = src.Weights[i] * (1 / 255.f);
+				const float* pB = bones[src.Bones[i]].rows[0];
+				for (int j = 0; j < 12; ++j)
+					m[j] += w * pB[j];
+			}
+			const Vector3& p = src.Pos;
+			const Vector3& n = src.Norm;
+			VertexPosNormTex& dst = out[v];
+			dst.Pos = Vector3(m[0] * p.x + m[1] * p.y + m[2] * p.z + m[3],
+				m[4] * p.x + m[5] * p.y + m[6] * p.z + m[7],
+				m[8] * p.x + m[9] * p.y + m[10] * p.z + m[11]);
+			dst.Norm = Vector3(m[0] * n.x + m[1] * n.y + m[2] * n.z,
+				m[4] * n.x + m[5] * n.y + m[6] * n.z,
+				m[8] * n.x + m[9] * n.y + m[10] * n.z);
+			dst.Norm.Normalize();
+			dst.Tex = src.Tex;
+		}
+	}
+
+	//same maths as SkinScalar, a blended matrix is rows 0-1 in one 8 wide register and row 2 in a 4 wide one
+	SIMD_AVX2 static void SkinAVX2(const VertexPosNormTexSkin in[], int numVerts, const BoneMatrix bones[], VertexPosNormTex out[])
+	{
+		const __m128 unorm = _mm_set1_ps(1 / 255.f);
+		const __m128 one = _mm_set1_ps(1);
+		for (int v = 0; v < numVerts; ++v)
+		{
+			const VertexPosNormTexSkin& src = in[v];
+			//4 UNORM8 weights to floats
+			int packed;
+			memcpy(&packed, src.Weights, sizeof(packed));
+			__m128 w = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed))), unorm);
+
+			const float* pB = bones[src.Bones[0]].rows[0];
+			__m256 wk = _mm256_broadcastss_ps(w);
+			__m256 r01 = _mm256_mul_ps(_mm256_loadu_ps(pB), wk);
+			__m128 r2 = _mm_mul_ps(_mm_loadu_ps(pB + 8), _mm256_castps256_ps128(wk));
+			pB = bones[src.Bones[1]].rows[0];
+			wk = _mm256_broadcastss_ps(_mm_shuffle_ps(w, w, 0x55));
+			r01 = _mm256_fmadd_ps(_mm256_loadu_ps(pB), wk, r01);
+			r2 = _mm_fmadd_ps(_mm_loadu_ps(pB + 8), _mm256_castps256_ps128(wk), r2);
+			pB = bones[src.Bones[2]].rows[0];
+			wk = _mm256_broadcastss_ps(_mm_shuffle_ps(w, w, 0xaa));
+			r01 = _mm256_fmadd_ps(_mm256_loadu_ps(pB), wk, r01);
+			r2 = _mm_fmadd_ps(_mm_loadu_ps(pB + 8), _mm256_castps256_ps128(wk), r2);
+			pB = bones[src.Bones[3]].rows[0];
+			wk = _mm256_broadcastss_ps(_mm_shuffle_ps(w, w, 0xff));
+			r01 = _mm256_fmadd_ps(_mm256_loadu_ps(pB), wk, r01);
+			r2 = _mm_fmadd_ps(_mm_loadu_ps(pB + 8), _mm256_castps256_ps128(wk), r2);
+
+			//(x,y,z,1) and (nx,ny,nz,0), the loads run into the next member so the 4th lane is replaced
+			__m128 p = _mm_blend_ps(_mm_loadu_ps(&src.Pos.x), one, 8);
+			__m128 n = _mm_blend_ps(_mm_loadu_ps(&src.Norm.x), _mm_setzero_ps(), 8);
+			__m256 pp = _mm256_insertf128_ps(_mm256_castps128_ps256(p), p, 1);
+			__m256 nn = _mm256_insertf128_ps(_mm256_castps128_ps256(n), n, 1);
+			//dot products by horizontal adds, position and normal together
+			__m256 h = _mm256_hadd_ps(_mm256_mul_ps(r01, pp), _mm256_mul_ps(r01, nn));
+			h = _mm256_hadd_ps(h, h);			//(p0,n0,p0,n0 | p1,n1,p1,n1)
+			__m128 h2 = _mm_hadd_ps(_mm_mul_ps(r2, p), _mm_mul_ps(r2, n));
+			h2 = _mm_hadd_ps(h2, h2);			//(p2,n2,p2,n2)
+			__m128 xy = _mm_unpacklo_ps(_mm256_castps256_ps128(h), _mm256_extractf128_ps(h, 1));	//(p0,p1,n0,n1)
+
+			float r[4];
+			_mm_storeu_ps(r, xy);
+			VertexPosNormTex& dst = out[v];
+			dst.Pos = Vector3(r[0], r[1], _mm_cvtss_f32(h2));
+			dst.Norm = Vector3(r[2], r[3], _mm_cvtss_f32(_mm_shuffle_ps(h2, h2, 0x55)));
+			dst.Norm.Normalize();
+			dst.Tex = src.Tex;
+		}
+	}
+
+	void SkinVertices(const VertexPosNormTexSkin in[], int numVerts, const BoneMatrix bones[],
+		VertexPosNormTex out[], bool allowAVX2)
+	{
+		if (allowAVX2 && Simd::HasAVX2())
+			SkinAVX2(in, numVerts, bones, out);
+		else
+			SkinScalar(in, numVerts, bones, out);
+	}
+
+	void SkinMany(const Job jobs[], int numJobs, bool allowAVX2)
+	{
+		//split by vertices rather than characters, so one big one doesn't hold everyone up
+		std::vector<int> starts(numJobs + 1, 0);
+		for (int i = 0; i < numJobs; ++i)
+			starts[i + 1] = starts[i] + jobs[i].numVerts;
+		ParallelFor(starts[numJobs], 4096, [&](int begin, int end) {
+			int j = (int)(std::upper_bound(starts.begin(), starts.end(), begin) - starts.begin()) - 1;
+			for (; j < numJobs && starts[j] < end; ++j)
+			{
+				const Job& job = jobs[j];
+				int first = std::max(begin, starts[j]) - starts[j];
+				int last = std::min(end, starts[j + 1]) - starts[j];
+				if (last > first)
+					SkinVertices(job.pIn + first, last - first, job.pBones, job.pOut + first, allowAVX2);
+			}
+		});
+	}
+
+	double Benchmark(int numCharacters, int numVerts, int numFrames)
+	{
+		typedef std::chrono::high_resolution_clock Clock;
+		const int numBones = 32;
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> unit(-1, 1);
+
+		//one mesh, each character has its own pose and output
+		std::vector<VertexPosNormTexSkin> verts(numVerts);
+		for (VertexPosNormTexSkin& v : verts)
+		{
+			v.Pos = Vector3(unit(rng), unit(rng), unit(rng));
+			v.Norm = Vector3(unit(rng), unit(rng), unit(rng)) + Vector3(0, 2, 0);
+			v.Norm.Normalize();
+			v.Tex = Vector2(0, 0);
+			int left = 255;
+			for (int i = 0; i < 4; ++i)
+			{
+				v.Bones[i] = (unsigned char)(rng() % numBones);
+				v.Weights[i] = (unsigned char)((i == 3) ? left : rng() % (left + 1));
+				left -= v.Weights[i];
+			}
+		}
+		std::vector<BoneMatrix> bones(numCharacters * numBones);
+		std::vector<Matrix> palette(numBones);
+		for (int c = 0; c < numCharacters; ++c)
+		{
+			for (Matrix& m : palette)
+				m = Matrix::CreateFromYawPitchRoll(unit(rng), unit(rng), unit(rng)) * Matrix::CreateTranslation(unit(rng), unit(rng), unit(rng));
+			ToBoneMatrices(palette.data(), numBones, &bones[c * numBones]);
+		}
+		std::vector<VertexPosNormTex> outScalar(numCharacters * numVerts), outAVX2(numCharacters * numVerts);
+		std::vector<Job> jobs(numCharacters);
+		for (int c = 0; c < numCharacters; ++c)
+		{
+			jobs[c].pIn = verts.data();
+			jobs[c].numVerts = numVerts;
+			jobs[c].pBones = &bones[c * numBones];
+			jobs[c].pOut = &outAVX2[c * numVerts];
+		}
+
+		Clock::time_point t0 = Clock::now();
+		for (int f = 0; f < numFrames; ++f)
+			for (int c = 0; c < numCharacters; ++c)
+				SkinVertices(verts.data(), numVerts, &bones[c * numBones], &outScalar[c * numVerts], false);
+		Clock::time_point t1 = Clock::now();
+		for (int f = 0; f < numFrames; ++f)
+			for (const Job& job : jobs)
+				SkinVertices(job.pIn, job.numVerts, job.pBones, job.pOut);
+		Clock::time_point t2 = Clock::now();
+		for (int f = 0; f < numFrames; ++f)
+			SkinMany(jobs.data(), numCharacters);
+		Clock::time_point t3 = Clock::now();
+
+		//the two versions should only differ by rounding
+		float maxDiff = 0;
+		for (size_t i = 0; i < outScalar.size(); ++i)
+			maxDiff = std::max(maxDiff, std::max((outScalar[i].Pos - outAVX2[i].Pos).Length(), (outScalar[i].Norm - outAVX2[i].Norm).Length()));
+
+		std::chrono::duration<double> scalar = t1 - t0, simd = t2 - t1, many = t3 - t2;
+		double total = (double)numCharacters * numVerts * numFrames;
+		double perSec = total / std::max(many.count(), 1e-9);
+		DBOUT("Skinning, " << numCharacters << " characters x " << numVerts << " verts x " << numFrames << " frames"
+			<< (Simd::HasAVX2() ? "" : " (no AVX2)") << ": plain " << total / std::max(scalar.count(), 1e-9) << " verts/s, AVX2 "
+			<< total / std::max(simd.count(), 1e-9) << " verts/s, AVX2 on " << std::max(1u, std::thread::hardware_concurrency())
+			<< " threads " << perSec << " verts/s, max difference " << maxDiff);
+		return perSec;
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include "ShaderTypes.h"
+
+/*
+Skinning on the cpu, for when the vertex shader can't do it (e.g. the skinned
+positions are needed for physics, or too many bones for the constant buffer).
+Normally TextureVSSkin does this on the gpu with the same palette.
+Each vertex blends up to 4 bone matrices by its weights, then the position and
+normal go through the blended matrix. With AVX2 a blended matrix is 3 FMA per bone.
+*/
+namespace Skinning
+{
+	//a palette matrix cut down to the 3 columns that matter and stored as rows, 48 bytes
+	struct BoneMatrix
+	{
+		float rows[3][4];	//x' = dot(rows[0], (x,y,z,1)) and so on
+	};
+	//convert a palette (see Animator::GetPalette), the last column of each is assumed to be 0,0,0,1
+	void ToBoneMatrices(const DirectX::SimpleMath::Matrix palette[], int numBones, BoneMatrix out[]);
+	/*
+	* move bind pose vertices into the current pose
+	* in - IN bind pose vertices, their bone indices must be in the palette
+	* numVerts - IN how many
+	* bones - IN from ToBoneMatrices
+	* out - OUT skinned vertices, ready for MeshMgr::UpdateVertices, normals are normalised
+	* allowAVX2 - IN false to force the plain version, e.g. to compare them
+	*/
+	void SkinVertices(const VertexPosNormTexSkin in[], int numVerts, const BoneMatrix bones[],
+		VertexPosNormTex out[], bool allowAVX2 = true);
+
+	//one character's worth of skinning
+	struct Job
+	{
+		const VertexPosNormTexSkin* pIn = nullptr;
+		int numVerts = 0;
+		const BoneMatrix* pBones = nullptr;
+		VertexPosNormTex* pOut = nullptr;
+	};
+	//skin lots of characters at once, spread over the cores, big ones are split up
+	void SkinMany(const Job jobs[], int numJobs, bool allowAVX2 = true);
+	/*
+	* time skinning numCharacters copies of a mesh - plain, AVX2 on one thread, AVX2 on all of them.
+	* Doesn't need a device, but it's SimpleMath throughout so it's windows only, run from
+	* Game::RunBenchmarks. Results go to DBOUT.
+	* numCharacters - IN how many
+	* numVerts - IN per character, each uses 4 bones out of 32
+	* numFrames - IN how many times to skin them all
+	* returns - vertices per second using AVX2 and every thread
+	*/
+	double Benchmark(int numCharacters, int numVerts, int numFrames);
+}
+
+#endif
@@ -0,0 +1,88 @@
+#include <cassert>
+
+#include "SkylinePacker.h"
+
+void SkylinePacker::Init(int width, int height)
+{
+	assert(width > 0 && height > 0);
+	mWidth = width;
+	mHeight = height;
+	Clear();
+}
+
+void SkylinePacker::Clear()
+{
+	mSkyline.clear();
+	mSkyline.push_back(Segment{ 0, 0, mWidth });
+	mUsedArea = 0;
+}
+
+int SkylinePacker::Fit(int segment, int w, int h) const
+{
+	int x = mSkyline[segment].x;
+	if (x + w > mWidth)
+		return -1;
+	//it sits on the highest segment under it
+	int y = 0, widthLeft = w;
+	for (int i = segment; widthLeft > 0; ++i)
+	{
+		y = mSkyline[i].y > y ? mSkyline[i].y : y;
+		if (y + h > mHeight)
+			return -1;
+		widthLeft -= mSkyline[i].width;
+	}
+	return y;
+}
+
+bool SkylinePacker::Add(int w, int h, int& x, int& y)
+{
+	assert(w > 0 && h > 0 && !mSkyline.empty());
+	//lowest top edge wins, then the narrowest segment so big flat areas are kept for big rectangles
+	int best = -1, bestY = mHeight, bestWidth = mWidth + 1;
+	for (int i = 0; i < (int)mSkyline.size(); ++i)
+	{
+		int fitY = Fit(i, w, h);
+		if (fitY < 0)
+			continue;
+		if (fitY < bestY || (fitY == bestY && mSkyline[i].width < bestWidth))
+		{
+			best = i;
+			bestY = fitY;
+			bestWidth = mSkyline[i].width;
+		}
+	}
+	if (best < 0)
+		return false;
+	x = mSkyline[best].x;
+	y = bestY;
+
+	//the new top edge replaces whatever it covers
+	mSkyline.insert(mSkyline.begin() + best, Segment{ x, y + h, w });
+	for (int i = best + 1; i < (int)mSkyline.size(); )
+	{
+		Segment& s = mSkyline[i];
+		int covered = x + w - s.x;
+		if (covered <= 0)
+			break;
+		if (covered < s.width)
+		{
+			s.x += covered;
+			s.width -= covered;
+			break;
+		}
+		mSkyline.erase(mSkyline.begin() + i);
+	}
+	//join neighbours at the same height so the list stays short
+	for (int i = 0; i + 1 < (int)mSkyline.size(); )
+	{
+		if (mSkyline[i].y == mSkyline[i + 1].y)
+		{
+			mSkyline[i].width += mSkyline[i + 1].width;
+			mSkyline.erase(mSkyline.begin() + i + 1);
+		}
+		else
+			++i;
+	}
+	mUsedArea += w * h;
+	return true;
+}
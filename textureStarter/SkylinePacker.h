@@ -0,0 +1,53 @@
+#ifndef SKYLINEPACKER_H
+#define SKYLINEPACKER_H
+
+#include <vector>
+
+/*
+Packs rectangles into a fixed size area, e.g. glyphs into a texture atlas. It only
+remembers the top edge of everything placed so far (the skyline), a run of flat
+segments, and puts each new rectangle as low down as it will go, so similar sized
+rectangles pack tightly without keeping a list of free space. Rectangles can't be
+taken back out one at a time, Clear empties the lot.
+*/
+class SkylinePacker
+{
+public:
+	//an empty area
+	void Init(int width, int height);
+	//take everything out
+	void Clear();
+	/*
+	* find room for a rectangle
+	* w, h - IN its size, must be more than 0
+	* x, y - OUT its top left if it fitted
+	* returns - false if there's no room
+	*/
+	bool Add(int w, int h, int& x, int& y);
+
+	int GetWidth() const {
+		return mWidth;
+	}
+	int GetHeight() const {
+		return mHeight;
+	}
+	//fraction of the area covered by rectangles
+	float GetOccupancy() const {
+		return (mWidth * mHeight) > 0 ? (float)mUsedArea / (mWidth * mHeight) : 0.f;
+	}
+
+private:
+	//a flat piece of the skyline, from x to x+width at height y
+	struct Segment
+	{
+		int x, y, width;
+	};
+	std::vector<Segment> mSkyline;	//left to right, no gaps
+	int mWidth = 0, mHeight = 0;
+	int mUsedArea = 0;
+
+	//how low a w wide rectangle can go with its left edge on a segment, -1 if it can't
+	int Fit(int segment, int w, int h) const;
+};
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef SLOTMAP_H
+#define SLOTMAP_H
+
+#include <vector>
+#include <cassert>
+#include <utility>
+
+/*
+A reference to something in a SlotMap. It's just two numbers, so it's cheap
+to copy and it can't dangle - once the thing it refers to is removed the
+generation no longer matches and the SlotMap says so.
+*/
+template<class T>
+struct Handle
+{
+	static constexpr unsigned int NONE = 0xffffffff;
+	unsigned int index = NONE;		//slot number
+	unsigned int generation = 0;	//which use of the slot, 0 is never valid
+
+	bool IsNull() const {
+		return index == NONE;
+	}
+	bool operator==(const Handle& h) const {
+		return index == h.index && generation == h.generation;
+	}
+	bool operator!=(const Handle& h) const {
+		return !(*this == h);
+	}
+};
+
+/*
+Objects packed together in one array, so looping over them all walks memory
+in a straight line. Removing swaps the last one into the gap, so objects move
+around and pointers to them only last until the next Add or Remove - hold a
+Handle instead. A handle goes through a slot that says where its object is now.
+T needs to be movable.
+*/
+template<class T>
+class SlotMap
+{
+public:
+	typedef Handle<T> HandleType;
+
+	//construct a new object at the end of the array
+	template<class... Args>
+	HandleType Add(Args&&... args)
+	{
+		unsigned int slot;
+		if (mFreeSlot != HandleType::NONE)
+		{
+			//reuse a slot, its generation was bumped when it was freed
+			slot = mFreeSlot;
+			mFreeSlot = mSlots[slot].dataIdx;
+		}
+		else
+		{
+			slot = (unsigned int)mSlots.size();
+			mSlots.push_back(Slot());
+		}
+		mSlots[slot].dataIdx = (unsigned int)mData.size();
+		mData.emplace_back(std::forward<Args>(args)...);
+		mDataSlots.push_back(slot);
+
+		HandleType h;
+		h.index = slot;
+		h.generation = mSlots[slot].generation;
+		return h;
+	}
+	//destroy an object, any handles to it go stale. Returns false if it already had.
+	bool Remove(HandleType h)
+	{
+		if (!IsValid(h))
+			return false;
+		Slot& s = mSlots[h.index];
+		unsigned int last = (unsigned int)mData.size() - 1;
+		if (s.dataIdx != last)
+		{
+			//fill the gap with the last one
+			mData[s.dataIdx] = std::move(mData[last]);
+			mDataSlots[s.dataIdx] = mDataSlots[last];
+			mSlots[mDataSlots[last]].dataIdx = s.dataIdx;
+		}
+		mData.pop_back();
+		mDataSlots.pop_back();
+		//the slot goes on the free list with a new generation, skipping 0 if it wraps
+		if (++s.generation == 0)
+			s.generation = 1;
+		s.dataIdx = mFreeSlot;
+		mFreeSlot = h.index;
+		return true;
+	}
+	//does the handle still refer to something
+	bool IsValid(HandleType h) const {
+		return h.index < mSlots.size() && mSlots[h.index].generation == h.generation && h.generation != 0;
+	}
+	//nullptr if the handle is stale
+	T* Get(HandleType h) {
+		return IsValid(h) ? &mData[mSlots[h.index].dataIdx] : nullptr;
+	}
+	const T* Get(HandleType h) const {
+		return IsValid(h) ? &mData[mSlots[h.index].dataIdx] : nullptr;
+	}
+	//the handle of the i'th object in the packed array
+	HandleType GetHandle(int i) const {
+		HandleType h;
+		h.index = mDataSlots.at(i);
+		h.generation = mSlots[h.index].generation;
+		return h;
+	}
+	//destroy everything, all handles go stale
+	void Clear()
+	{
+		while (!mData.empty())
+			Remove(GetHandle((int)mData.size() - 1));
+	}
+
+	//the packed objects, in no particular order
+	int Size() const {
+		return (int)mData.size();
+	}
+	T& operator[](int i) {
+		return mData[i];
+	}
+	typename std::vector<T>::iterator begin() {
+		return mData.begin();
+	}
+	typename std::vector<T>::iterator end() {
+		return mData.end();
+	}
+
+private:
+	struct Slot
+	{
+		unsigned int dataIdx = 0;		//where the object is, or the next free slot
+		unsigned int generation = 1;
+	};
+	std::vector<T> mData;				//packed objects
+	std::vector<unsigned int> mDataSlots;	//which slot each object belongs to
+	std::vector<Slot> mSlots;
+	unsigned int mFreeSlot = Handle<T>::NONE;	//head of the free slot list
+};
+
+#endif
@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#include "SpatialHash.h"
+#include "Sprite.h"
+#include "WindowUtils.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+//strictly overlapping, touching edges don't count
+static bool Overlaps(const RECTF& a, const RECTF& b)
+{
+	return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+}
+
+void SpatialHash::Init(float cellSize, int numBuckets)
+{
+	assert(cellSize > 0 && numBuckets > 0);
+	mCellSize = cellSize;
+	mInvCellSize = 1 / cellSize;
+	unsigned int size = 1;
+	while (size < (unsigned int)numBuckets)
+		size *= 2;
+	mBuckets.clear();
+	mBuckets.resize(size);
+	mMask = size - 1;
+	Clear();
+}
+
+void SpatialHash::Clear()
+{
+	for (vector<Entry>& b : mBuckets)
+		b.clear();
+	mItems.clear();
+	mBounds.clear();
+	mFree.clear();
+	mNumItems = 0;
+	mNumRehashed = 0;
+}
+
+int SpatialHash::ToCell(float x) const
+{
+	return (int)floorf(x * mInvCellSize);
+}
+
+RECTF SpatialHash::Fatten(const RECTF& bounds, const Vector2& vel)
+{
+	//stretched the way it's going, so it stays inside for a while
+	Vector2 ahead = vel * LOOKAHEAD;
+	RECTF fat = bounds;
+	(ahead.x < 0 ? fat.left : fat.right) += ahead.x;
+	(ahead.y < 0 ? fat.top : fat.bottom) += ahead.y;
+	return fat;
+}
+
+void SpatialHash::Insert(int id)
+{
+	const Item& item = mItems[id];
+	for (int cy = item.cells[1]; cy <= item.cells[3]; ++cy)
+		for (int cx = item.cells[0]; cx <= item.cells[2]; ++cx)
+			mBuckets[Hash(cx, cy)].push_back(Entry{ id, cx, cy });
+}
+
+void SpatialHash::Erase(int id)
+{
+	const Item& item = mItems[id];
+	for (int cy = item.cells[1]; cy <= item.cells[3]; ++cy)
+		for (int cx = item.cells[0]; cx <= item.cells[2]; ++cx)
+		{
+			//order in a bucket doesn't matter, swap with the last
+			vector<Entry>& b = mBuckets[Hash(cx, cy)];
+			for (size_t i = 0; i < b.size(); ++i)
+				if (b[i].id == id && b[i].cx == cx && b[i].cy == cy)
+				{
+					b[i] = b.back();
+					b.pop_back();
+					break;
+				}
+		}
+}
+
+int SpatialHash::Add(const RECTF& bounds, const Vector2& vel)
+{
+	assert(!mBuckets.empty());
+	int id;
+	if (!mFree.empty())
+	{
+		id = mFree.back();
+		mFree.pop_back();
+	}
+	else
+	{
+		id = (int)mItems.size();
+		mItems.push_back(Item());
+		mBounds.push_back(bounds);
+	}
+	Item& item = mItems[id];
+	item.used = true;
+	mBounds[id] = bounds;
+	item.fat = Fatten(bounds, vel);
+	item.cells[0] = ToCell(item.fat.left);
+	item.cells[1] = ToCell(item.fat.top);
+	item.cells[2] = ToCell(item.fat.right);
+	item.cells[3] = ToCell(item.fat.bottom);
+	Insert(id);
+	++mNumItems;
+	return id;
+}
+
+int SpatialHash::Add(const Sprite& spr)
+{
+	return Add(spr.GetBounds(), spr.mVel);
+}
+
+void SpatialHash::Remove(int id)
+{
+	assert(id >= 0 && id < (int)mItems.size() && mItems[id].used);
+	Erase(id);
+	mItems[id].used = false;
+	mFree.push_back(id);
+	--mNumItems;
+}
+
+void SpatialHash::Update(int id, const RECTF& bounds, const Vector2& vel)
+{
+	assert(id >= 0 && id < (int)mItems.size() && mItems[id].used);
+	Item& item = mItems[id];
+	mBounds[id] = bounds;
+	//still inside, nothing else to do
+	if (bounds.left >= item.fat.left && bounds.right <= item.fat.right && bounds.top >= item.fat.top && bounds.bottom <= item.fat.bottom)
+		return;
+	item.fat = Fatten(bounds, vel);
+	int cells[4] = { ToCell(item.fat.left), ToCell(item.fat.top), ToCell(item.fat.right), ToCell(item.fat.bottom) };
+	//new fat bounds, but often the same cells
+	if (cells[0] == item.cells[0] && cells[1] == item.cells[1] && cells[2] == item.cells[2] && cells[3] == item.cells[3])
+		return;
+	Erase(id);
+	for (int i = 0; i < 4; ++i)
+		item.cells[i] = cells[i];
+	Insert(id);
+	++mNumRehashed;
+}
+
+void SpatialHash::Update(int id, const Sprite& spr)
+{
+	Update(id, spr.GetBounds(), spr.mVel);
+}
+
+void SpatialHash::Query(const RECTF& rect, vector<int>& out)
+{
+	//stamp what's been found so something in several cells is only added once
+	if (++mStamp == 0)
+	{
+		for (Item& item : mItems)
+			item.stamp = 0;
+		mStamp = 1;
+	}
+	const int x0 = ToCell(rect.left), y0 = ToCell(rect.top), x1 = ToCell(rect.right), y1 = ToCell(rect.bottom);
+	for (int cy = y0; cy <= y1; ++cy)
+		for (int cx = x0; cx <= x1; ++cx)
+			for (const Entry& e : mBuckets[Hash(cx, cy)])
+			{
+				if (e.cx != cx || e.cy != cy)
+					continue;
+				Item& item = mItems[e.id];
+				if (item.stamp == mStamp)
+					continue;
+				item.stamp = mStamp;
+				if (Overlaps(mBounds[e.id], rect))
+					out.push_back(e.id);
+			}
+}
+
+void SpatialHash::FindPairs(vector<pair<int, int>>& out) const
+{
+	//a bucket at a time rather than an item at a time, each bucket's entries are read once and in order
+	for (const vector<Entry>& bucket : mBuckets)
+		for (size_t i = 0; i < bucket.size(); ++i)
+		{
+			const Entry& e = bucket[i];
+			const RECTF& bounds = mBounds[e.id];
+			for (size_t j = i + 1; j < bucket.size(); ++j)
+			{
+				const Entry& f = bucket[j];
+				if (f.cx != e.cx || f.cy != e.cy)
+					continue;
+				const RECTF& other = mBounds[f.id];
+				if (!Overlaps(bounds, other))
+					continue;
+				//two things can share several cells, only the one with the overlap's top left corner reports them
+				if (ToCell(max(bounds.left, other.left)) == e.cx && ToCell(max(bounds.top, other.top)) == e.cy)
+					out.push_back(e.id < f.id ? make_pair(e.id, f.id) : make_pair(f.id, e.id));
+			}
+		}
+}
+
+double SpatialHash::Benchmark(int numSprites, int numFrames)
+{
+	MyD3D& d3d = WinUtil::Get().GetD3D();
+	//32x32 frames out of the floor texture, the same as SpriteSystem's benchmark
+	vector<RECTF> frames;
+	for (int f = 0; f < 8; ++f)
+		frames.push_back(RECTF{ f * 32.f, 0, f * 32.f + 32, 32 });
+	ID3D11ShaderResourceView* pTex = d3d.GetCache().LoadTexture(&d3d.GetDevice(), "floor.dds", "sprite_benchmark", true, &frames);
+
+	//spread out so there's some space between them, and all moving
+	const float worldSize = sqrtf((float)numSprites) * 50;
+	mt19937 rng(1234);
+	uniform_real_distribution<float> unit(0, 1);
+	vector<Sprite> sprites(numSprites, Sprite(d3d));
+	for (Sprite& spr : sprites)
+	{
+		spr.SetTex(*pTex, frames[0]);
+		spr.origin = Vector2(16, 16);
+		spr.mPos = Vector2(unit(rng), unit(rng)) * worldSize;
+		spr.mVel = Vector2(unit(rng) - 0.5f, unit(rng) - 0.5f) * 200;
+	}
+
+	typedef chrono::high_resolution_clock Clock;
+	typedef chrono::duration<double> Secs;
+	SpatialHash hash;
+	hash.Init(64, numSprites);
+	Clock::time_point start = Clock::now();
+	vector<int> ids(numSprites);
+	for (int i = 0; i < numSprites; ++i)
+		ids[i] = hash.Add(sprites[i]);
+	double addSecs = Secs(Clock::now() - start).count();
+
+	//a screen sized camera wandering round the world
+	const float dTime = 1 / 60.f;
+	double updateSecs = 0, querySecs = 0, bruteSecs = 0, pairSecs = 0;
+	size_t numVisible = 0, numPairs = 0;
+	vector<int> visible;
+	vector<pair<int, int>> pairs;
+	for (int f = 0; f < numFrames; ++f)
+	{
+		for (Sprite& spr : sprites)
+			spr.mPos += spr.mVel * dTime;
+		start = Clock::now();
+		for (int i = 0; i < numSprites; ++i)
+			hash.Update(ids[i], sprites[i]);
+		updateSecs += Secs(Clock::now() - start).count();
+
+		Vector2 cam = Vector2(unit(rng), unit(rng)) * (worldSize - 1920);
+		RECTF view{ cam.x, cam.y, cam.x + 1920, cam.y + 1080 };
+		start = Clock::now();
+		visible.clear();
+		hash.Query(view, visible);
+		querySecs += Secs(Clock::now() - start).count();
+		numVisible += visible.size();
+
+		//what it replaces, checking every sprite
+		start = Clock::now();
+		int count = 0;
+		for (const Sprite& spr : sprites)
+			count += Overlaps(spr.GetBounds(), view);
+		bruteSecs += Secs(Clock::now() - start).count();
+		if (count != (int)visible.size())
+			DBOUT("SpatialHash culled " << visible.size() << " but " << count << " overlap the camera");
+
+		start = Clock::now();
+		pairs.clear();
+		hash.FindPairs(pairs);
+		pairSecs += Secs(Clock::now() - start).count();
+		numPairs += pairs.size();
+	}
+
+	DBOUT("Spatial hash benchmark, " << numSprites << " moving sprites in a " << worldSize << " pixel square, 64 pixel cells:");
+	DBOUT("  adding " << addSecs * 1000 << "ms, updating " << updateSecs * 1000 / numFrames << "ms per frame, "
+		<< (float)hash.GetNumRehashed() / numFrames << " changed cells per frame");
+	DBOUT("  culling to the screen " << querySecs * 1000 / numFrames << "ms (" << numVisible / numFrames << " visible), checking every sprite "
+		<< bruteSecs * 1000 / numFrames << "ms");
+	DBOUT("  finding overlapping pairs " << pairSecs * 1000 / numFrames << "ms (" << numPairs / numFrames << " pairs)");
+	return updateSecs * 1000 / numFrames;
+}
@@ -0,0 +1,122 @@
+#ifndef SPATIALHASH_H
+#define SPATIALHASH_H
+
+#include <utility>
+#include <vector>
+
+#include "SimpleMath.h"
+#include "TexCache.h"
+
+class Sprite;
+
+/*
+Finds what's near what in 2D without checking everything against everything. The plane
+is cut into square cells and each thing is listed in every cell its bounds touch, the
+cells live in a fixed size hash table so the world can be any size and empty space costs
+nothing. Culling to the camera only looks in the cells the camera covers and collision
+only compares things that share a cell.
+Things that move are listed under slightly bigger (fat) bounds stretched the way they're
+going, so most frames moving one is just storing its new bounds - it's only taken out of
+its cells and put back when it leaves the fat ones.
+Cells should be about the size of the bigger things in it, something much bigger than a
+cell is listed in a lot of them.
+*/
+class SpatialHash
+{
+public:
+	//fat bounds reach this many seconds of movement ahead
+	static constexpr float LOOKAHEAD = 0.25f;
+
+	/*
+	* an empty hash
+	* cellSize - IN width and height of a cell, in pixels
+	* numBuckets - IN size of the hash table, rounded up to a power of 2, around the number of things is plenty
+	*/
+	void Init(float cellSize, int numBuckets = 16384);
+	//take everything out
+	void Clear();
+
+	/*
+	* start tracking something
+	* bounds - IN where it is
+	* vel - IN how it's moving, pixels per second
+	* returns - its id, ids of removed things are used again
+	*/
+	int Add(const RECTF& bounds, const DirectX::SimpleMath::Vector2& vel = DirectX::SimpleMath::Vector2(0, 0));
+	//as above for a sprite, see Sprite::GetBounds
+	int Add(const Sprite& spr);
+	//stop tracking it, the id must be in use
+	void Remove(int id);
+	//it's moved, it only changes cells if it's left its fat bounds
+	void Update(int id, const RECTF& bounds, const DirectX::SimpleMath::Vector2& vel);
+	void Update(int id, const Sprite& spr);
+
+	/*
+	* everything whose bounds overlap a rectangle, e.g. what the camera can see
+	* rect - IN the area
+	* out - OUT ids are added on, each once
+	*/
+	void Query(const RECTF& rect, std::vector<int>& out);
+	/*
+	* every two things whose bounds overlap, for collision
+	* out - OUT pairs are added on, each once with the lower id first
+	*/
+	void FindPairs(std::vector<std::pair<int, int>>& out) const;
+
+	const RECTF& GetBounds(int id) const {
+		return mBounds.at(id);
+	}
+	int GetNumItems() const {
+		return mNumItems;
+	}
+	//how many times something has been taken out of its cells and put back
+	int GetNumRehashed() const {
+		return mNumRehashed;
+	}
+
+	/*
+	* time keeping track of lots of moving sprites - updating, culling to a screen sized camera
+	* and finding overlapping pairs, separately, and culling compared with checking every
+	* sprite. Needs the device. Results go to DBOUT.
+	* numSprites - IN how many
+	* numFrames - IN how many frames to time
+	* returns - milliseconds per frame to update the hash
+	*/
+	static double Benchmark(int numSprites, int numFrames);
+
+private:
+	struct Item
+	{
+		RECTF fat;					//it's listed under these
+		int cells[4];				//the cells fat covers, left, top, right, bottom inclusive
+		unsigned int stamp = 0;		//last query that found it
+		bool used = false;
+	};
+	//an item listed in a cell, different cells can hash to the same bucket
+	struct Entry
+	{
+		int id;
+		int cx, cy;
+	};
+	std::vector<Item> mItems;
+	std::vector<RECTF> mBounds;		//where each item really is, kept apart as it's all pair finding reads
+	std::vector<int> mFree;			//unused ids
+	std::vector<std::vector<Entry>> mBuckets;	//by hash of the cell
+	unsigned int mMask = 0;			//buckets - 1
+	float mCellSize = 0, mInvCellSize = 0;
+	unsigned int mStamp = 0;
+	int mNumItems = 0;
+	int mNumRehashed = 0;
+
+	int ToCell(float x) const;
+	unsigned int Hash(int cx, int cy) const {
+		return (((unsigned int)cx * 73856093u) ^ ((unsigned int)cy * 19349663u)) & mMask;
+	}
+	//list an item in, or take it out of, every cell it covers
+	void Insert(int id);
+	void Erase(int id);
+	//fat bounds for an item moving with vel
+	static RECTF Fatten(const RECTF& bounds, const DirectX::SimpleMath::Vector2& vel);
+};
+
+#endif
@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
 #include "CommonStates.h"
 
 
@@ -8,45 +12,41 @@ using namespace DirectX::SimpleMath;
 
 void Animate::Init(int _start, int _stop, float _rate, bool _loop)
 {
-	mElapsedSec = 0;
-	mStart = _start;
-	mStop = _stop;
-	mRateSec = _rate;
-	mLoop = _loop;
-	mSpr.SetFrame(mStart);
-	mCurrent = mStart;
+	mClip.Create(mSpr.GetTexData().frames, _start, _stop, _rate, _loop ? FlipbookClip::LOOP : FlipbookClip::ONCE);
+	Init(mClip);
+}
+
+void Animate::Init(const FlipbookClip& clip, float speed)
+{
+	mPlayer.Play(clip, speed);
+	mSpr.SetFrame(mPlayer.GetFrame());
 }
 
 void Animate::Update(float _elapsedSec)
 {
 	if (!mPlay)
 		return;
-	mElapsedSec += _elapsedSec;
-	if (mElapsedSec > (1.f / mRateSec))
+	//however long the frame took, the clip works out where it's got to
+	mPlayer.Update(_elapsedSec);
+	if (mPlayer.HasChanged())
 	{
-		mElapsedSec = 0;
-		mCurrent++;
-		if (mCurrent > mStop)
-		{
-			if (mLoop)
-				mCurrent = mStart;
-			else
-				mCurrent = mStop;
-		}
-		mSpr.SetFrame(mCurrent);
+		const RECT& r = *mPlayer.GetRect();
+		mSpr.SetTexRect(RECTF{ (float)r.left, (float)r.top, (float)r.right, (float)r.bottom });
 	}
 }
 
 Animate& Animate::operator=(const Animate& rhs)
 {
 	//needed because Animate has a reference to its sprite which cannot be copied
-	mStart = rhs.mStart;
-	mStop = rhs.mStop;
-	mCurrent = rhs.mCurrent;
-	mRateSec = rhs.mRateSec;
-	mElapsedSec = rhs.mElapsedSec;
-	mLoop = rhs.mLoop;
+	mClip = rhs.mClip;
+	mPlayer = rhs.mPlayer;
 	mPlay = rhs.mPlay;
+	//play our own copy of the clip, not theirs
+	if (rhs.mPlayer.GetClip() == &rhs.mClip)
+	{
+		mPlayer.Play(mClip, rhs.mPlayer.GetSpeed());
+		mPlayer.SetTime(rhs.mPlayer.GetTime());
+	}
 	return *this;
 }
 
@@ -70,6 +70,27 @@ void Sprite::Draw(SpriteBatch& batch)
 {
 	batch.Draw(mpTex, mPos, &(RECT)mTexRect, colour, rotation, origin, scale, DirectX::SpriteEffects::SpriteEffects_None, depth);
 }
+RECTF Sprite::GetBounds() const
+{
+	//origin is in texels so it's scaled too, the same as SpriteBatch
+	Vector2 size = GetScreenSize();
+	Vector2 topLeft = -origin * scale;
+	if (rotation == 0)
+		return RECTF{ mPos.x + topLeft.x, mPos.y + topLeft.y, mPos.x + topLeft.x + size.x, mPos.y + topLeft.y + size.y };
+	//turn the corners round the origin and box them
+	float s = sinf(rotation), c = cosf(rotation);
+	RECTF r{ FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (int i = 0; i < 4; ++i)
+	{
+		Vector2 local = topLeft + Vector2((float)(i & 1), (float)(i >> 1)) * size;
+		Vector2 p = mPos + Vector2(local.x * c - local.y * s, local.x * s + local.y * c);
+		r.left = std::min(r.left, p.x);
+		r.top = std::min(r.top, p.y);
+		r.right = std::max(r.right, p.x);
+		r.bottom = std::max(r.bottom, p.y);
+	}
+	return r;
+}
 void Sprite::SetTex(ID3D11ShaderResourceView& tex, const RECTF& texRect)
 {
 	mpTex = &tex;
@@ -93,7 +114,8 @@ void Sprite::Scroll(float x, float y) {
 
 void Sprite::SetFrame(int id) 
 {
-	const TexCache::Data& data = mD3D.GetCache().Get(mpTex);
-	SetTexRect(data.frames.at(id));
+	//the texture's data was found when it was set
+	assert(mpTexData && id >= 0 && id < (int)mpTexData->frames.size());
+	SetTexRect(mpTexData->frames[id]);
 }
 
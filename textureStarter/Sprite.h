@@ -1,19 +1,18 @@
 #pragma once
 #include "SpriteBatch.h"
 #include "D3D.h"
+#include "Flipbook.h"
 
  
 class Sprite;
 
 /*
-Animate by flicking through a series of sub-rectangle in an texture atlas
+Animate by flicking through a series of sub-rectangle in an texture atlas, see Flipbook
 */ 
 class Animate {
 private:
-	int mStart = 0, mStop = 0, mCurrent = 0; //start, stop and current frame of animation
-	float mRateSec = 0;		//how fast to play back
-	float mElapsedSec = 0;	//how long the current frame has been on screen
-	bool mLoop = false;		//loop at the end ?
+	FlipbookClip mClip;		//the frames Init was given
+	Flipbook mPlayer;		//plays mClip, or a clip from somewhere else
 	bool mPlay = false;		//should we be playing right now
 	Sprite& mSpr;			//the parent sprite
 
@@ -28,6 +27,8 @@ public:
 	loop	- loop at the end?
 	*/
 	void Init(int _start, int _stop, float _rate, bool _loop);
+	//play a clip made elsewhere, e.g. ping-pong or frames of different lengths, it must outlive us
+	void Init(const FlipbookClip& clip, float speed = 1);
 	//choose the frame
 	void Update(float _elapsedSec);
 	//start and stop
@@ -105,10 +106,13 @@ public:
 	const DirectX::SimpleMath::Vector2& GetScale() const {
 		return scale;
 	}
+	//size of the part of the texture showing, scaled
 	DirectX::SimpleMath::Vector2 GetScreenSize() const {
 		assert(mpTexData);
-		return scale * mpTexData->dim;
+		return scale * DirectX::SimpleMath::Vector2(mTexRect.right - mTexRect.left, mTexRect.bottom - mTexRect.top);
 	}
+	//the screen rectangle it covers, allowing for origin and rotation
+	RECTF GetBounds() const;
 };
 
 
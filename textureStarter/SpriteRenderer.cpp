@@ -0,0 +1,389 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <DirectXPackedVector.h>
+
+#include "SpriteRenderer.h"
+#include "SpriteBatch.h"
+#include "D3D.h"
+#include "D3DUtil.h"
+#include "FX.h"
+#include "WindowUtils.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+void SpriteRenderer::Init(ID3D11Device& device, int maxInstances)
+{
+	assert(maxInstances > 0);
+	Release();
+	char* pBuff = nullptr;
+	unsigned int bytes = 0;
+	//everything is per instance, the vertex shader makes the corners from SV_VertexID
+	const D3D11_INPUT_ELEMENT_DESC desc[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "SCALE", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 8, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "ORIGIN", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 12, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "ROTATION", 0, DXGI_FORMAT_R32_FLOAT, 0, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "FRAME", 0, DXGI_FORMAT_R32_UINT, 0, 20, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 24, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "DEPTH", 0, DXGI_FORMAT_R32_FLOAT, 0, 28, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	};
+	pBuff = FX::ReadAndAllocate("../bin/data/SpriteVS.cso", bytes);
+	FX::CreateVertexShader(device, pBuff, bytes, mpVS);
+	FX::CreateInputLayout(device, desc, sizeof(desc) / sizeof(desc[0]), pBuff, bytes, &mpInputLayout);
+	delete[] pBuff;
+	pBuff = FX::ReadAndAllocate("../bin/data/SpritePS.cso", bytes);
+	FX::CreatePixelShader(device, pBuff, bytes, mpPS);
+	delete[] pBuff;
+	FX::CreateConstantBuffer(device, sizeof(Vector4), &mpConsts);
+
+	mRing.Init(device, sizeof(Instance), maxInstances);
+	//the same states SpriteBatch uses by default - premultiplied alpha, no depth, no culling, linear clamp
+	FX::CreatePremultipliedBlendState(device, mpBlend);
+	FX::Create2DStates(device, mpDepth, mpRaster, mpSampler);
+}
+
+void SpriteRenderer::Release()
+{
+	mRing.Release();
+	mFrameTable.Release();
+	ReleaseCOM(mpConsts);
+	ReleaseCOM(mpVS);
+	ReleaseCOM(mpPS);
+	ReleaseCOM(mpInputLayout);
+	ReleaseCOM(mpBlend);
+	ReleaseCOM(mpRaster);
+	ReleaseCOM(mpDepth);
+	ReleaseCOM(mpSampler);
+	mFramesUploaded = 0;
+	//the textures aren't ours, they may not outlive this
+	mTextures.clear();
+	mTextureIDs.clear();
+	mFrames.clear();
+	mTextureGeneration = NewTextureGeneration();
+}
+
+unsigned int SpriteRenderer::NewTextureGeneration()
+{
+	static unsigned int sLast = 0;
+	return ++sLast;
+}
+
+int SpriteRenderer::AddTexture(const TexCache::Data& data)
+{
+	return AddTexture(data.pTex, data.dim, data.frames);
+}
+
+int SpriteRenderer::AddTexture(ID3D11ShaderResourceView* pTex, const Vector2& dim, const vector<RECTF>& frames)
+{
+	assert(pTex && dim.x > 0 && dim.y > 0);
+	unordered_map<ID3D11ShaderResourceView*, int>::iterator it = mTextureIDs.find(pTex);
+	if (it != mTextureIDs.end())
+		return it->second;
+	//the sort key only has room for 16 bits of texture
+	assert(mTextures.size() < 0x10000);
+
+	Texture tex;
+	tex.pTex = pTex;
+	tex.dim = dim;
+	tex.firstFrame = (int)mFrames.size();
+	Frame f;
+	f.invDim[0] = 1 / dim.x;
+	f.invDim[1] = 1 / dim.y;
+	f.pad[0] = f.pad[1] = 0;
+	if (frames.empty())
+	{
+		f.rect[0] = f.rect[1] = 0;
+		f.rect[2] = dim.x;
+		f.rect[3] = dim.y;
+		mFrames.push_back(f);
+	}
+	for (const RECTF& r : frames)
+	{
+		f.rect[0] = r.left;
+		f.rect[1] = r.top;
+		f.rect[2] = r.right;
+		f.rect[3] = r.bottom;
+		mFrames.push_back(f);
+	}
+	tex.numFrames = (int)mFrames.size() - tex.firstFrame;
+	mTextures.push_back(tex);
+	int id = (int)mTextures.size() - 1;
+	mTextureIDs[pTex] = id;
+	return id;
+}
+
+void SpriteRenderer::Begin(SortMode mode)
+{
+	mSortMode = mode;
+	mInstances.clear();
+	mInstTextures.clear();
+	mKeys.clear();
+	mOneOffFrames.clear();
+}
+
+void SpriteRenderer::Draw(int texture, int frame, const Vector2& pos, const Vector4& colour, float rotation, const Vector2& origin, const Vector2& scale, float depth)
+{
+	assert(texture >= 0 && texture < (int)mTextures.size());
+	const Texture& tex = mTextures[texture];
+	assert(frame >= 0 && frame < tex.numFrames);
+	Queue(texture, tex.firstFrame + frame, pos, colour, rotation, origin, scale, depth);
+}
+
+void SpriteRenderer::Draw(int texture, const RECT& texRect, const Vector2& pos, const Vector4& colour, float rotation, const Vector2& origin, const Vector2& scale, float depth)
+{
+	assert(texture >= 0 && texture < (int)mTextures.size());
+	const Texture& tex = mTextures[texture];
+	Frame f;
+	f.rect[0] = (float)texRect.left;
+	f.rect[1] = (float)texRect.top;
+	f.rect[2] = (float)texRect.right;
+	f.rect[3] = (float)texRect.bottom;
+	f.invDim[0] = 1 / tex.dim.x;
+	f.invDim[1] = 1 / tex.dim.y;
+	f.pad[0] = f.pad[1] = 0;
+	mOneOffFrames.push_back(f);
+	Queue(texture, ONE_OFF | (unsigned int)(mOneOffFrames.size() - 1), pos, colour, rotation, origin, scale, depth);
+}
+
+void SpriteRenderer::Queue(int texture, unsigned int frame, const Vector2& pos, const Vector4& colour, float rotation, const Vector2& origin, const Vector2& scale, float depth)
+{
+	Instance inst;
+	inst.pos[0] = pos.x;
+	inst.pos[1] = pos.y;
+	inst.scale[0] = PackedVector::XMConvertFloatToHalf(scale.x);
+	inst.scale[1] = PackedVector::XMConvertFloatToHalf(scale.y);
+	inst.origin[0] = PackedVector::XMConvertFloatToHalf(origin.x);
+	inst.origin[1] = PackedVector::XMConvertFloatToHalf(origin.y);
+	inst.rotation = rotation;
+	inst.frame = frame;
+	const float c[4] = { colour.x, colour.y, colour.z, colour.w };
+	inst.colour = 0;
+	for (int i = 0; i < 4; ++i)
+		inst.colour |= (unsigned int)(std::max(0.f, std::min(c[i], 1.f)) * 255 + 0.5f) << (i * 8);
+	inst.depth = depth;
+	mInstances.push_back(inst);
+	mInstTextures.push_back((unsigned short)texture);
+
+	//back to front is the biggest depth first, so it's flipped to sort smallest first
+	unsigned int d = 0xffff - (unsigned int)(std::max(0.f, std::min(depth, 1.f)) * 0xffff + 0.5f);
+	mKeys.push_back(mSortMode == TEXTURE ? ((unsigned int)texture << 16) | d : (d << 16) | (unsigned int)texture);
+}
+
+void SpriteRenderer::RadixSort()
+{
+	//key in the top half and where the sprite is in the bottom, so one array moves per pass
+	const int n = (int)mKeys.size();
+	mSorted.resize(n);
+	mSortScratch.resize(n);
+	int counts[4][256];
+	memset(counts, 0, sizeof(counts));
+	for (int i = 0; i < n; ++i)
+	{
+		unsigned int key = mKeys[i];
+		mSorted[i] = ((unsigned long long)key << 32) | (unsigned int)i;
+		for (int b = 0; b < 4; ++b)
+			++counts[b][(key >> (b * 8)) & 0xff];
+	}
+	for (int b = 0; b < 4; ++b)
+	{
+		int shift = 32 + b * 8;
+		//every key has the same byte here, this pass wouldn't change anything
+		if (counts[b][(mSorted[0] >> shift) & 0xff] == n)
+			continue;
+		int offsets[256];
+		int total = 0;
+		for (int i = 0; i < 256; ++i)
+		{
+			offsets[i] = total;
+			total += counts[b][i];
+		}
+		//stable, so sprites with the same key stay in the order they were drawn
+		for (int i = 0; i < n; ++i)
+			mSortScratch[offsets[(mSorted[i] >> shift) & 0xff]++] = mSorted[i];
+		mSorted.swap(mSortScratch);
+	}
+}
+
+void SpriteRenderer::UploadFrames(ID3D11DeviceContext& ctx)
+{
+	if (mOneOffFrames.empty() && mFramesUploaded == (int)mFrames.size())
+		return;
+	int total = (int)(mFrames.size() + mOneOffFrames.size());
+	Frame* pDst = (Frame*)mFrameTable.Map(ctx, total, sizeof(Frame));
+	if (!mFrames.empty())
+		memcpy(pDst, mFrames.data(), mFrames.size() * sizeof(Frame));
+	if (!mOneOffFrames.empty())
+		memcpy(pDst + mFrames.size(), mOneOffFrames.data(), mOneOffFrames.size() * sizeof(Frame));
+	mFrameTable.Unmap(ctx);
+	mFramesUploaded = (int)mFrames.size();
+}
+
+void SpriteRenderer::DrawSorted(ID3D11DeviceContext& ctx, int first, int count)
+{
+	Instance* pDst = (Instance*)mRing.Map(ctx, count);
+	const unsigned long long* pOrder = &mSorted[first];
+	const unsigned int oneOffBase = (unsigned int)mFrames.size();
+	for (int i = 0; i < count; ++i)
+	{
+		pDst[i] = mInstances[(unsigned int)pOrder[i]];
+		if (pDst[i].frame & ONE_OFF)
+			pDst[i].frame = oneOffBase + (pDst[i].frame & ~ONE_OFF);
+	}
+	int base = mRing.Unmap(ctx);
+
+	//one draw for each run of the same texture
+	int start = 0;
+	while (start < count)
+	{
+		unsigned short texture = mInstTextures[(unsigned int)pOrder[start]];
+		int end = start + 1;
+		while (end < count && mInstTextures[(unsigned int)pOrder[end]] == texture)
+			++end;
+		ctx.PSSetShaderResources(0, 1, &mTextures[texture].pTex);
+		ctx.DrawInstanced(4, end - start, 0, base + start);
+		++mNumDrawCalls;
+		start = end;
+	}
+}
+
+void SpriteRenderer::End(ID3D11DeviceContext& ctx)
+{
+	assert(mRing.GetMaxInstances() > 0);
+	mNumDrawCalls = 0;
+	const int n = (int)mInstances.size();
+	if (n == 0)
+		return;
+	RadixSort();
+	UploadFrames(ctx);
+
+	//pixels to clip space for the viewport that's set, like SpriteBatch
+	D3D11_VIEWPORT vp;
+	UINT numViewports = 1;
+	ctx.RSGetViewports(&numViewports, &vp);
+	assert(numViewports == 1 && vp.Width > 0 && vp.Height > 0);
+	Vector4 consts(2 / vp.Width, -2 / vp.Height, -1, 1);
+	ctx.UpdateSubresource(mpConsts, 0, nullptr, &consts, 0, 0);
+
+	mRing.Bind(ctx);
+	ctx.IASetInputLayout(mpInputLayout);
+	ctx.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	ctx.VSSetShader(mpVS, nullptr, 0);
+	ctx.VSSetConstantBuffers(0, 1, &mpConsts);
+	ID3D11ShaderResourceView* pFrames = mFrameTable.GetSRV();
+	ctx.VSSetShaderResources(1, 1, &pFrames);
+	ctx.PSSetShader(mpPS, nullptr, 0);
+	ctx.PSSetSamplers(0, 1, &mpSampler);
+	const float blendFactors[4] = { 0, 0, 0, 0 };
+	ctx.OMSetBlendState(mpBlend, blendFactors, 0xffffffff);
+	ctx.OMSetDepthStencilState(mpDepth, 0);
+	ctx.RSSetState(mpRaster);
+
+	//more than the ring buffer holds goes in pieces
+	const int maxInstances = mRing.GetMaxInstances();
+	for (int first = 0; first < n; first += maxInstances)
+		DrawSorted(ctx, first, std::min(n - first, maxInstances));
+
+	//don't leave the frame table bound where the 3D vertex shaders might trip over it
+	ID3D11ShaderResourceView* pNull = nullptr;
+	ctx.VSSetShaderResources(1, 1, &pNull);
+}
+
+double SpriteRenderer::Benchmark(int maxSprites, int numFrames)
+{
+	MyD3D& d3d = WinUtil::Get().GetD3D();
+	ID3D11DeviceContext& ctx = d3d.GetDeviceCtx();
+	//an 8 frame strip out of the floor texture (the same one SpriteSystem's benchmark uses) and a second texture
+	vector<RECTF> strip;
+	for (int f = 0; f < 8; ++f)
+		strip.push_back(RECTF{ f * 32.f, 0, f * 32.f + 32, 32 });
+	d3d.GetCache().LoadTexture(&d3d.GetDevice(), "floor.dds", "sprite_benchmark", true, &strip);
+	d3d.GetCache().LoadTexture(&d3d.GetDevice(), "tiles.dds", "sprite_benchmark2", true);
+	const TexCache::Data* pData[2] = { &d3d.GetCache().Get("sprite_benchmark"), &d3d.GetCache().Get("sprite_benchmark2") };
+
+	SpriteRenderer renderer;
+	renderer.Init(d3d.GetDevice());
+	int textures[2] = { renderer.AddTexture(*pData[0]), renderer.AddTexture(*pData[1]) };
+	SpriteBatch batch(&ctx);
+
+	struct Spr
+	{
+		int texture, frame;
+		Vector2 pos, origin, scale;
+		Vector4 colour;
+		float rotation, depth;
+	};
+	mt19937 rng(1234);
+	uniform_real_distribution<float> unit(0, 1);
+	vector<Spr> sprites(maxSprites);
+	for (Spr& s : sprites)
+	{
+		s.texture = unit(rng) < 0.5f ? 0 : 1;
+		s.frame = (int)(unit(rng) * renderer.GetNumFrames(textures[s.texture])) % renderer.GetNumFrames(textures[s.texture]);
+		s.pos = Vector2(unit(rng) * 1920, unit(rng) * 1080);
+		s.origin = Vector2(16, 16);
+		s.scale = Vector2(0.5f + unit(rng), 0.5f + unit(rng));
+		s.colour = Vector4(1, 1, 1, 0.5f + 0.5f * unit(rng));
+		s.rotation = unit(rng) * 6.28f;
+		s.depth = unit(rng);
+	}
+	//SpriteBatch wants the rectangles
+	vector<RECT> rects(maxSprites);
+	for (int i = 0; i < maxSprites; ++i)
+	{
+		const TexCache::Data& data = *pData[sprites[i].texture];
+		RECTF r = data.frames.empty() ? RECTF{ 0, 0, data.dim.x, data.dim.y } : data.frames[sprites[i].frame];
+		rects[i] = RECT{ (LONG)r.left, (LONG)r.top, (LONG)r.right, (LONG)r.bottom };
+	}
+
+	typedef chrono::high_resolution_clock Clock;
+	typedef chrono::duration<double> Secs;
+	const SpriteSortMode batchModes[2] = { SpriteSortMode_Texture, SpriteSortMode_BackToFront };
+	const SortMode modes[2] = { TEXTURE, BACK_TO_FRONT };
+	const char* modeNames[2] = { "by texture", "back to front" };
+	DBOUT("Sprite renderer benchmark, CPU ms per frame over " << numFrames << " frames, SpriteBatch vs instanced:");
+	vector<int> counts;
+	for (int count = 1000; count < maxSprites; count *= 10)
+		counts.push_back(count);
+	counts.push_back(maxSprites);
+	double result = 0;
+	for (int count : counts)
+		for (int m = 0; m < 2; ++m)
+		{
+			Clock::time_point start = Clock::now();
+			for (int f = 0; f < numFrames; ++f)
+			{
+				batch.Begin(batchModes[m]);
+				for (int i = 0; i < count; ++i)
+				{
+					const Spr& s = sprites[i];
+					batch.Draw(pData[s.texture]->pTex, XMFLOAT2(s.pos.x, s.pos.y), &rects[i], s.colour, s.rotation, s.origin, s.scale, SpriteEffects_None, s.depth);
+				}
+				batch.End();
+			}
+			double batchSecs = Secs(Clock::now() - start).count() / numFrames;
+
+			start = Clock::now();
+			for (int f = 0; f < numFrames; ++f)
+			{
+				renderer.Begin(modes[m]);
+				for (int i = 0; i < count; ++i)
+				{
+					const Spr& s = sprites[i];
+					renderer.Draw(textures[s.texture], s.frame, s.pos, s.colour, s.rotation, s.origin, s.scale, s.depth);
+				}
+				renderer.End(ctx);
+			}
+			double secs = Secs(Clock::now() - start).count() / numFrames;
+			DBOUT("  " << count << " sprites " << modeNames[m] << " - SpriteBatch " << batchSecs * 1000 << "ms, instanced " << secs * 1000
+				<< "ms in " << renderer.GetNumDrawCalls() << " draws");
+			result = count / secs;
+		}
+	//both changed the pipeline
+	d3d.InvalidateInputAssembler();
+	d3d.GetFX().InvalidatePSO();
+	return result;
+}
@@ -0,0 +1,175 @@
+#ifndef SPRITERENDERER_H
+#define SPRITERENDERER_H
+
+#include <unordered_map>
+#include <vector>
+#include <d3d11.h>
+
+#include "SimpleMath.h"
+#include "TexCache.h"
+#include "DynamicBuffers.h"
+
+/*
+Draws sprites instanced instead of through SpriteBatch. Each sprite is one 32 byte
+instance - no vertices are built on the CPU, the vertex shader (SpriteVS) makes the
+quad from the instance and the frame table. Textures are registered once and their
+atlas frames go in that table on the GPU, so a sprite just says which frame it shows.
+Between Begin and End sprites are queued, End radix sorts them by texture and depth,
+writes them into a ring buffer that's only discarded when it wraps, and draws each run
+of sprites sharing a texture with one call.
+Like SpriteBatch it changes the pipeline, tell anything that tracks state afterwards
+(MyFX::InvalidatePSO, MyD3D::InvalidateInputAssembler).
+*/
+class SpriteRenderer
+{
+public:
+	//the order sprites are drawn in
+	typedef enum {
+		TEXTURE,		//by texture, then back to front - fewest draws, only right if sprites with different textures don't overlap
+		BACK_TO_FRONT	//by depth (1 at the back, as SpriteBatch), then texture - always layered right
+	} SortMode;
+
+	~SpriteRenderer() {
+		Release();
+	}
+	/*
+	* load the shaders and create the buffers and states
+	* device - IN the gpu
+	* maxInstances - IN size of the ring buffer, End draws more than this in pieces
+	*/
+	void Init(ID3D11Device& device, int maxInstances = 65536);
+	//free the gpu side and forget every texture
+	void Release();
+
+	/*
+	* a texture sprites can use, with its atlas frames (the whole texture is one frame if it has none)
+	* a texture added again gives the same number back, its frames are assumed not to have changed
+	* data - IN from the texture cache
+	* returns - its number
+	*/
+	int AddTexture(const TexCache::Data& data);
+	/*
+	* as above without the texture cache
+	* pTex - IN the texture, not released
+	* dim - IN width and height in texels
+	* frames - IN atlas frames, can be empty
+	*/
+	int AddTexture(ID3D11ShaderResourceView* pTex, const DirectX::SimpleMath::Vector2& dim, const std::vector<RECTF>& frames);
+	int GetNumFrames(int texture) const {
+		return mTextures.at(texture).numFrames;
+	}
+	//changes whenever texture numbers stop meaning what they did (Release forgets them all), and no two
+	//renderers ever share one, so anything keeping numbers from AddTexture can tell when to add again
+	unsigned int GetTextureGeneration() const {
+		return mTextureGeneration;
+	}
+
+	//start queueing sprites
+	void Begin(SortMode mode = BACK_TO_FRONT);
+	/*
+	* queue a sprite, the parameters mean the same as SpriteBatch::Draw's
+	* texture, frame - IN see AddTexture, frame is one of the texture's
+	* pos - IN where the origin goes, in pixels
+	* colour - IN multiplies the texels
+	* rotation - IN radians
+	* origin - IN centre of rotation in texels from the frame's top left
+	* depth - IN 0 front to 1 back
+	*/
+	void Draw(int texture, int frame, const DirectX::SimpleMath::Vector2& pos,
+		const DirectX::SimpleMath::Vector4& colour = DirectX::SimpleMath::Vector4(1, 1, 1, 1), float rotation = 0,
+		const DirectX::SimpleMath::Vector2& origin = DirectX::SimpleMath::Vector2(0, 0),
+		const DirectX::SimpleMath::Vector2& scale = DirectX::SimpleMath::Vector2(1, 1), float depth = 0);
+	//as above showing any part of the texture (in texels), it goes in the frame table until End
+	void Draw(int texture, const RECT& texRect, const DirectX::SimpleMath::Vector2& pos,
+		const DirectX::SimpleMath::Vector4& colour = DirectX::SimpleMath::Vector4(1, 1, 1, 1), float rotation = 0,
+		const DirectX::SimpleMath::Vector2& origin = DirectX::SimpleMath::Vector2(0, 0),
+		const DirectX::SimpleMath::Vector2& scale = DirectX::SimpleMath::Vector2(1, 1), float depth = 0);
+	//sort and draw everything queued, into whatever render target and viewport are set
+	void End(ID3D11DeviceContext& ctx);
+
+	//draw calls made by the last End
+	int GetNumDrawCalls() const {
+		return mNumDrawCalls;
+	}
+
+	/*
+	* time queueing and drawing different numbers of sprites with SpriteBatch and with this,
+	* sorted by texture and back to front, in CPU milliseconds per frame. Needs the device.
+	* Results go to DBOUT.
+	* maxSprites - IN the most sprites, it starts at 1000 and goes up 10x at a time
+	* numFrames - IN how many frames to average over
+	* returns - sprites drawn per second by this, the most sprites, back to front
+	*/
+	static double Benchmark(int maxSprites, int numFrames);
+
+private:
+	//what the vertex shader gets per sprite, see SpriteConstants.hlsl
+	struct Instance
+	{
+		float pos[2];
+		unsigned short scale[2];		//half floats
+		unsigned short origin[2];		//half floats
+		float rotation;
+		unsigned int frame;				//into the frame table
+		unsigned int colour;			//RGBA8
+		float depth;
+	};
+	static_assert(sizeof(Instance) == 32, "one instance should be 32 bytes");
+	//one entry in the frame table on the GPU
+	struct Frame
+	{
+		float rect[4];					//texels
+		float invDim[2];				//1/texture size
+		float pad[2];
+	};
+	struct Texture
+	{
+		ID3D11ShaderResourceView* pTex;
+		DirectX::SimpleMath::Vector2 dim;
+		int firstFrame;					//into mFrames
+		int numFrames;
+	};
+
+	//never 0 and never repeats
+	static unsigned int NewTextureGeneration();
+
+	std::vector<Texture> mTextures;
+	std::unordered_map<ID3D11ShaderResourceView*, int> mTextureIDs;
+	unsigned int mTextureGeneration = NewTextureGeneration();
+	std::vector<Frame> mFrames;			//every texture's frames
+	std::vector<Frame> mOneOffFrames;	//rects drawn since Begin, they go after mFrames on the GPU
+	int mFramesUploaded = 0;			//how many of mFrames the GPU has
+
+	//queued since Begin
+	SortMode mSortMode = BACK_TO_FRONT;
+	std::vector<Instance> mInstances;
+	std::vector<unsigned short> mInstTextures;		//texture of each
+	std::vector<unsigned int> mKeys;				//sort key of each
+	std::vector<unsigned long long> mSorted, mSortScratch;	//key and instance, in drawing order after RadixSort
+	int mNumDrawCalls = 0;
+
+	//gpu
+	InstanceRing mRing;
+	StructuredTable mFrameTable;
+	ID3D11Buffer* mpConsts = nullptr;
+	ID3D11VertexShader* mpVS = nullptr;
+	ID3D11PixelShader* mpPS = nullptr;
+	ID3D11InputLayout* mpInputLayout = nullptr;
+	ID3D11BlendState* mpBlend = nullptr;
+	ID3D11RasterizerState* mpRaster = nullptr;
+	ID3D11DepthStencilState* mpDepth = nullptr;
+	ID3D11SamplerState* mpSampler = nullptr;
+
+	//queue one sprite, frame is into mFrames or has ONE_OFF set and is into mOneOffFrames
+	static const unsigned int ONE_OFF = 0x80000000;
+	void Queue(int texture, unsigned int frame, const DirectX::SimpleMath::Vector2& pos, const DirectX::SimpleMath::Vector4& colour,
+		float rotation, const DirectX::SimpleMath::Vector2& origin, const DirectX::SimpleMath::Vector2& scale, float depth);
+	//sort the instances into mSorted, 8 bits a pass, skipping bytes that are all the same
+	void RadixSort();
+	//make sure the GPU's frame table has mFrames then mOneOffFrames
+	void UploadFrames(ID3D11DeviceContext& ctx);
+	//copy some of the sorted instances into the ring buffer and draw them, a call for each run of one texture
+	void DrawSorted(ID3D11DeviceContext& ctx, int first, int count);
+};
+
+#endif
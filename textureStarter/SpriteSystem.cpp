@@ -0,0 +1,470 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#include "SpriteSystem.h"
+#include "D3D.h"
+#include "Parallel.h"
+#include "Simd.h"
+#include "Sprite.h"
+#include "SpriteRenderer.h"
+#include "WindowUtils.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+int SpriteSystem::AddTexture(const TexCache::Data& data)
+{
+	return AddTexture(data.pTex, data.dim, data.frames);
+}
+
+int SpriteSystem::AddTexture(ID3D11ShaderResourceView* pTex, const Vector2& dim, const vector<RECTF>& frames)
+{
+	Texture tex;
+	tex.pTex = pTex;
+	tex.dim = dim;
+	tex.firstFrame = (int)mFrames.size();
+	if (frames.empty())
+		mFrames.push_back(RECT{ 0, 0, (LONG)dim.x, (LONG)dim.y });
+	for (const RECTF& f : frames)
+		mFrames.push_back(RECT{ (LONG)f.left, (LONG)f.top, (LONG)f.right, (LONG)f.bottom });
+	tex.numFrames = (int)mFrames.size() - tex.firstFrame;
+	mTextures.push_back(tex);
+	return (int)mTextures.size() - 1;
+}
+
+SpriteHandle SpriteSystem::Add(int texture, const Vector2& pos)
+{
+	unsigned int slot;
+	if (mFreeSlot != SpriteHandle::NONE)
+	{
+		slot = mFreeSlot;
+		mFreeSlot = mSlots[slot].sprite;
+	}
+	else
+	{
+		slot = (unsigned int)mSlots.size();
+		mSlots.push_back(Slot());
+	}
+	int i = GetNumSprites();
+	mSlots[slot].sprite = i;
+	mSpriteSlots.push_back(slot);
+	mPos[0].push_back(pos.x);
+	mPos[1].push_back(pos.y);
+	mVel[0].push_back(0);
+	mVel[1].push_back(0);
+	mRotation.push_back(0);
+	mSpin.push_back(0);
+	mScale.push_back(Vector2(1, 1));
+	mOrigin.push_back(Vector2(0, 0));
+	mDepth.push_back(0);
+	mColour.push_back(Vector4(1, 1, 1, 1));
+	mTexture.push_back(0);
+	mRects.push_back(RECT{ 0, 0, 0, 0 });
+	mFrame.push_back(0);
+	mPlayhead.push_back(0);
+	mFPS.push_back(0);
+	mNumAnimFrames.push_back(0);
+	mAnimBase.push_back(0);
+	mAnimFlags.push_back(0);
+
+	SpriteHandle h;
+	h.index = slot;
+	h.generation = mSlots[slot].generation;
+	SetTexture(h, texture);
+	return h;
+}
+
+//fill the gap with the last one
+template<class T>
+static void MoveLast(vector<T>& v, int i)
+{
+	v[i] = v.back();
+	v.pop_back();
+}
+
+bool SpriteSystem::Remove(SpriteHandle h)
+{
+	if (!IsValid(h))
+		return false;
+	int i = mSlots[h.index].sprite;
+	int last = GetNumSprites() - 1;
+	mSlots[mSpriteSlots[last]].sprite = i;
+	for (int c = 0; c < 2; ++c)
+	{
+		MoveLast(mPos[c], i);
+		MoveLast(mVel[c], i);
+	}
+	MoveLast(mRotation, i);
+	MoveLast(mSpin, i);
+	MoveLast(mScale, i);
+	MoveLast(mOrigin, i);
+	MoveLast(mDepth, i);
+	MoveLast(mColour, i);
+	MoveLast(mTexture, i);
+	MoveLast(mRects, i);
+	MoveLast(mFrame, i);
+	MoveLast(mPlayhead, i);
+	MoveLast(mFPS, i);
+	MoveLast(mNumAnimFrames, i);
+	MoveLast(mAnimBase, i);
+	MoveLast(mAnimFlags, i);
+	MoveLast(mSpriteSlots, i);
+	//the slot goes on the free list with a new generation, skipping 0 if it wraps
+	Slot& s = mSlots[h.index];
+	if (++s.generation == 0)
+		s.generation = 1;
+	s.sprite = mFreeSlot;
+	mFreeSlot = h.index;
+	return true;
+}
+
+void SpriteSystem::Clear()
+{
+	while (GetNumSprites() > 0)
+	{
+		SpriteHandle h;
+		h.index = mSpriteSlots.back();
+		h.generation = mSlots[h.index].generation;
+		Remove(h);
+	}
+}
+
+int SpriteSystem::GetSprite(SpriteHandle h) const
+{
+	assert(IsValid(h));
+	return mSlots[h.index].sprite;
+}
+
+void SpriteSystem::SetPosition(SpriteHandle h, const Vector2& pos)
+{
+	int i = GetSprite(h);
+	mPos[0][i] = pos.x;
+	mPos[1][i] = pos.y;
+}
+
+Vector2 SpriteSystem::GetPosition(SpriteHandle h) const
+{
+	int i = GetSprite(h);
+	return Vector2(mPos[0][i], mPos[1][i]);
+}
+
+void SpriteSystem::SetVelocity(SpriteHandle h, const Vector2& vel)
+{
+	int i = GetSprite(h);
+	mVel[0][i] = vel.x;
+	mVel[1][i] = vel.y;
+}
+
+Vector2 SpriteSystem::GetVelocity(SpriteHandle h) const
+{
+	int i = GetSprite(h);
+	return Vector2(mVel[0][i], mVel[1][i]);
+}
+
+void SpriteSystem::SetRotation(SpriteHandle h, float angle)
+{
+	mRotation[GetSprite(h)] = angle;
+}
+
+float SpriteSystem::GetRotation(SpriteHandle h) const
+{
+	return mRotation[GetSprite(h)];
+}
+
+void SpriteSystem::SetSpin(SpriteHandle h, float spin)
+{
+	mSpin[GetSprite(h)] = spin;
+}
+
+void SpriteSystem::SetScale(SpriteHandle h, const Vector2& scale)
+{
+	mScale[GetSprite(h)] = scale;
+}
+
+void SpriteSystem::SetDepth(SpriteHandle h, float depth)
+{
+	mDepth[GetSprite(h)] = depth;
+}
+
+void SpriteSystem::SetColour(SpriteHandle h, const Vector4& colour)
+{
+	mColour[GetSprite(h)] = colour;
+}
+
+void SpriteSystem::SetOrigin(SpriteHandle h, const Vector2& origin)
+{
+	mOrigin[GetSprite(h)] = origin;
+}
+
+void SpriteSystem::SetTexture(SpriteHandle h, int texture)
+{
+	int i = GetSprite(h);
+	assert(texture >= 0 && texture < (int)mTextures.size());
+	mTexture[i] = texture;
+	SetFrame(h, 0);
+}
+
+void SpriteSystem::SetFrame(SpriteHandle h, int frame)
+{
+	int i = GetSprite(h);
+	const Texture& tex = mTextures[mTexture[i]];
+	assert(frame >= 0 && frame < tex.numFrames);
+	mFrame[i] = tex.firstFrame + frame;
+	mRects[i] = mFrames[mFrame[i]];
+	mAnimFlags[i] = 0;
+}
+
+int SpriteSystem::GetFrame(SpriteHandle h) const
+{
+	int i = GetSprite(h);
+	return mFrame[i] < 0 ? -1 : mFrame[i] - mTextures[mTexture[i]].firstFrame;
+}
+
+void SpriteSystem::SetTexRect(SpriteHandle h, const RECTF& texRect)
+{
+	int i = GetSprite(h);
+	mRects[i] = RECT{ (LONG)texRect.left, (LONG)texRect.top, (LONG)texRect.right, (LONG)texRect.bottom };
+	mFrame[i] = -1;
+	mAnimFlags[i] = 0;
+}
+
+void SpriteSystem::Play(SpriteHandle h, int first, int count, float fps, bool loop)
+{
+	int i = GetSprite(h);
+	const Texture& tex = mTextures[mTexture[i]];
+	assert(first >= 0 && count > 0 && first + count <= tex.numFrames);
+	mAnimBase[i] = tex.firstFrame + first;
+	mNumAnimFrames[i] = (float)count;
+	mFPS[i] = fps;
+	mPlayhead[i] = 0;
+	mAnimFlags[i] = PLAYING | (loop ? LOOP : 0);
+	mFrame[i] = mAnimBase[i];
+	mRects[i] = mFrames[mFrame[i]];
+}
+
+void SpriteSystem::Stop(SpriteHandle h)
+{
+	mAnimFlags[GetSprite(h)] &= ~PLAYING;
+}
+
+void SpriteSystem::UpdatePlain(int begin, int end, float dTime)
+{
+	for (int i = begin; i < end; ++i)
+	{
+		mPos[0][i] += mVel[0][i] * dTime;
+		mPos[1][i] += mVel[1][i] * dTime;
+		mRotation[i] += mSpin[i] * dTime;
+		if (!(mAnimFlags[i] & PLAYING))
+			continue;
+		//the time left over carries on into the next frame, so it never drifts
+		float n = mNumAnimFrames[i];
+		float p = mPlayhead[i] + mFPS[i] * dTime;
+		if (p >= n)
+			p = (mAnimFlags[i] & LOOP) ? p - n * floorf(p / n) : n;
+		mPlayhead[i] = p;
+		int frame = mAnimBase[i] + std::max(0, std::min((int)p, (int)n - 1));
+		if (frame != mFrame[i])
+		{
+			mFrame[i] = frame;
+			mRects[i] = mFrames[frame];
+		}
+	}
+}
+
+SIMD_AVX2 void SpriteSystem::UpdateAVX2(int begin, int end, float dTime)
+{
+	const __m256 dt = _mm256_set1_ps(dTime);
+	const __m256i playingBit = _mm256_set1_epi32(PLAYING), loopBit = _mm256_set1_epi32(LOOP);
+	const __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi32(1);
+	int i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		for (int c = 0; c < 2; ++c)
+			_mm256_storeu_ps(&mPos[c][i], _mm256_fmadd_ps(_mm256_loadu_ps(&mVel[c][i]), dt, _mm256_loadu_ps(&mPos[c][i])));
+		_mm256_storeu_ps(&mRotation[i], _mm256_fmadd_ps(_mm256_loadu_ps(&mSpin[i]), dt, _mm256_loadu_ps(&mRotation[i])));
+
+		__m256i flags = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&mAnimFlags[i]));
+		__m256i playing = _mm256_cmpgt_epi32(_mm256_and_si256(flags, playingBit), zero);
+		int playMask = _mm256_movemask_ps(_mm256_castsi256_ps(playing));
+		if (!playMask)
+			continue;
+		__m256i loop = _mm256_cmpgt_epi32(_mm256_and_si256(flags, loopBit), zero);
+		//same sums as UpdatePlain, sprites that aren't playing keep their playhead
+		__m256 n = _mm256_max_ps(_mm256_loadu_ps(&mNumAnimFrames[i]), _mm256_set1_ps(1));
+		__m256 old = _mm256_loadu_ps(&mPlayhead[i]);
+		__m256 p = _mm256_add_ps(old, _mm256_mul_ps(_mm256_loadu_ps(&mFPS[i]), dt));
+		__m256 wrapped = _mm256_sub_ps(p, _mm256_mul_ps(n, _mm256_floor_ps(_mm256_div_ps(p, n))));
+		p = _mm256_blendv_ps(_mm256_min_ps(p, n), wrapped, _mm256_castsi256_ps(loop));
+		p = _mm256_blendv_ps(old, p, _mm256_castsi256_ps(playing));
+		_mm256_storeu_ps(&mPlayhead[i], p);
+		__m256i last = _mm256_sub_epi32(_mm256_cvttps_epi32(n), one);
+		__m256i frame = _mm256_max_epi32(zero, _mm256_min_epi32(_mm256_cvttps_epi32(p), last));
+		frame = _mm256_add_epi32(frame, _mm256_loadu_si256((const __m256i*)&mAnimBase[i]));
+		//only the ones that have moved on a frame need their rectangle changing
+		__m256i oldFrame = _mm256_loadu_si256((const __m256i*)&mFrame[i]);
+		__m256i changed = _mm256_andnot_si256(_mm256_cmpeq_epi32(frame, oldFrame), playing);
+		int changedMask = _mm256_movemask_ps(_mm256_castsi256_ps(changed));
+		if (!changedMask)
+			continue;
+		_mm256_storeu_si256((__m256i*)&mFrame[i], _mm256_blendv_epi8(oldFrame, frame, changed));
+		for (int lane = 0; lane < 8; ++lane)
+			if (changedMask & (1 << lane))
+				mRects[i + lane] = mFrames[mFrame[i + lane]];
+	}
+	UpdatePlain(i, end, dTime);
+}
+
+void SpriteSystem::Update(float dTime, bool allowAVX2)
+{
+	bool avx2 = allowAVX2 && Simd::HasAVX2();
+	ParallelFor(GetNumSprites(), 8192, [&](int begin, int end) {
+		if (avx2)
+			UpdateAVX2(begin, end, dTime);
+		else
+			UpdatePlain(begin, end, dTime);
+	});
+}
+
+void SpriteSystem::Draw(SpriteBatch& batch)
+{
+	const int numSprites = GetNumSprites();
+	for (int i = 0; i < numSprites; ++i)
+		batch.Draw(mTextures[mTexture[i]].pTex, XMFLOAT2(mPos[0][i], mPos[1][i]), &mRects[i], mColour[i],
+			mRotation[i], mOrigin[i], mScale[i], SpriteEffects_None, mDepth[i]);
+}
+
+void SpriteSystem::Draw(SpriteRenderer& renderer)
+{
+	//the renderer numbers textures its own way, tell it about any it hasn't had from us. A
+	//different renderer, or one that's forgotten them, has a different generation.
+	if (mRendererGeneration != renderer.GetTextureGeneration())
+	{
+		mRendererGeneration = renderer.GetTextureGeneration();
+		mRendererTex.clear();
+	}
+	for (int t = (int)mRendererTex.size(); t < (int)mTextures.size(); ++t)
+	{
+		const Texture& tex = mTextures[t];
+		vector<RECTF> frames;
+		for (int f = tex.firstFrame; f < tex.firstFrame + tex.numFrames; ++f)
+			frames.push_back(RECTF{ (float)mFrames[f].left, (float)mFrames[f].top, (float)mFrames[f].right, (float)mFrames[f].bottom });
+		mRendererTex.push_back(renderer.AddTexture(tex.pTex, tex.dim, frames));
+	}
+
+	const int numSprites = GetNumSprites();
+	for (int i = 0; i < numSprites; ++i)
+	{
+		int texture = mTexture[i];
+		Vector2 pos(mPos[0][i], mPos[1][i]);
+		//a frame is just a number to the renderer, only a rect from SetTexRect needs sending
+		if (mFrame[i] >= 0)
+			renderer.Draw(mRendererTex[texture], mFrame[i] - mTextures[texture].firstFrame, pos, mColour[i],
+				mRotation[i], mOrigin[i], mScale[i], mDepth[i]);
+		else
+			renderer.Draw(mRendererTex[texture], mRects[i], pos, mColour[i], mRotation[i], mOrigin[i], mScale[i], mDepth[i]);
+	}
+}
+
+double SpriteSystem::Benchmark(int numSprites, int numFrames)
+{
+	MyD3D& d3d = WinUtil::Get().GetD3D();
+	//an 8 frame strip out of the floor texture, kept apart from the real one by its name
+	vector<RECTF> frames;
+	for (int f = 0; f < 8; ++f)
+		frames.push_back(RECTF{ f * 32.f, 0, f * 32.f + 32, 32 });
+	ID3D11ShaderResourceView* pTex = d3d.GetCache().LoadTexture(&d3d.GetDevice(), "floor.dds", "sprite_benchmark", true, &frames);
+	const TexCache::Data& data = d3d.GetCache().Get("sprite_benchmark");
+
+	mt19937 rng(1234);
+	uniform_real_distribution<float> unit(0, 1);
+	struct Start
+	{
+		Vector2 pos, vel;
+		float fps;
+	};
+	vector<Start> starts(numSprites);
+	for (Start& s : starts)
+	{
+		s.pos = Vector2(unit(rng) * 1920, unit(rng) * 1080);
+		s.vel = Vector2(unit(rng) - 0.5f, unit(rng) - 0.5f) * 200;
+		s.fps = 5 + unit(rng) * 20;
+	}
+	//uneven frame times like a real game
+	vector<float> dTimes(numFrames);
+	for (float& dt : dTimes)
+		dt = (1 / 60.f) * (0.5f + unit(rng));
+	typedef chrono::high_resolution_clock Clock;
+	typedef chrono::duration<double> Secs;
+	SpriteBatch batch(&d3d.GetDeviceCtx());
+
+	//the old way, an object each
+	double oldSecs, oldDrawSecs;
+	{
+		vector<Sprite> sprites(numSprites, Sprite(d3d));
+		for (int i = 0; i < numSprites; ++i)
+		{
+			Sprite& spr = sprites[i];
+			spr.SetTex(*pTex);
+			spr.GetAnim().Init(0, 7, starts[i].fps, true);
+			spr.GetAnim().Play(true);
+			spr.mPos = starts[i].pos;
+			spr.mVel = starts[i].vel;
+		}
+		Clock::time_point start = Clock::now();
+		for (float dt : dTimes)
+			for (Sprite& spr : sprites)
+			{
+				spr.mPos += spr.mVel * dt;
+				spr.GetAnim().Update(dt);
+			}
+		oldSecs = Secs(Clock::now() - start).count();
+		batch.Begin();
+		start = Clock::now();
+		for (Sprite& spr : sprites)
+			spr.Draw(batch);
+		oldDrawSecs = Secs(Clock::now() - start).count();
+		batch.End();
+	}
+
+	SpriteSystem system;
+	int tex = system.AddTexture(data);
+	for (int i = 0; i < numSprites; ++i)
+	{
+		SpriteHandle h = system.Add(tex, starts[i].pos);
+		system.SetVelocity(h, starts[i].vel);
+		system.Play(h, 0, 8, starts[i].fps, true);
+	}
+	//one core, plain then AVX2, then AVX2 on all of them. Calling UpdateAVX2 directly skips the cpu check.
+	const bool avx2 = Simd::HasAVX2();
+	double secs[3] = { 0, 0, 0 };
+	for (int pass = 0; pass < 3; ++pass)
+	{
+		if (pass == 1 && !avx2)
+			continue;
+		Clock::time_point start = Clock::now();
+		for (float dt : dTimes)
+			if (pass < 2)
+				(pass == 0) ? system.UpdatePlain(0, numSprites, dt) : system.UpdateAVX2(0, numSprites, dt);
+			else
+				system.Update(dt);
+		secs[pass] = Secs(Clock::now() - start).count();
+	}
+	batch.Begin();
+	Clock::time_point start = Clock::now();
+	system.Draw(batch);
+	double drawSecs = Secs(Clock::now() - start).count();
+	batch.End();
+	//the batch changed the pipeline
+	d3d.InvalidateInputAssembler();
+	d3d.GetFX().InvalidatePSO();
+
+	double updates = (double)numSprites * numFrames;
+	DBOUT("Sprite benchmark, " << numSprites << " moving animated sprites x " << numFrames << " frames (ns per sprite update):");
+	DBOUT("  Sprite objects " << oldSecs * 1e9 / updates << ", arrays " << secs[0] * 1e9 / updates << ", AVX2 "
+		<< (avx2 ? secs[1] * 1e9 / updates : 0) << (avx2 ? ", AVX2 all cores " : ", all cores (no AVX2) ") << secs[2] * 1e9 / updates);
+	DBOUT("  drawing them into a SpriteBatch - Sprite::Draw " << oldDrawSecs * 1000 << "ms, SpriteSystem::Draw " << drawSecs * 1000 << "ms");
+	return updates / secs[2];
+}
@@ -0,0 +1,166 @@
+#ifndef SPRITESYSTEM_H
+#define SPRITESYSTEM_H
+
+#include <vector>
+
+#include "SpriteBatch.h"
+#include "SlotMap.h"
+#include "TexCache.h"
+
+class SpriteSystem;
+class SpriteRenderer;
+//a sprite in a SpriteSystem
+typedef Handle<SpriteSystem> SpriteHandle;
+
+/*
+Lots of sprites, kept as separate arrays (all the x positions together, then all the
+y and so on) rather than one object each. Update moves them and flicks through their
+animation frames 8 at a time with AVX2, spread over the cores, and Draw hands them all
+to a SpriteBatch in one pass.
+Textures are registered first and sprites refer to them by number, each texture's atlas
+frames are looked up once then rather than on every frame change.
+Sprites are packed with no gaps, removing one moves the last into its place, so a handle
+goes through a slot like SlotMap's.
+*/
+class SpriteSystem
+{
+public:
+	/*
+	* a texture sprites can use, with its atlas frames (the whole texture is one frame if it has none)
+	* data - IN from the texture cache
+	* returns - its number
+	*/
+	int AddTexture(const TexCache::Data& data);
+	/*
+	* as above without the texture cache
+	* pTex - IN the texture, not released
+	* dim - IN width and height in texels
+	* frames - IN atlas frames, can be empty
+	*/
+	int AddTexture(ID3D11ShaderResourceView* pTex, const DirectX::SimpleMath::Vector2& dim, const std::vector<RECTF>& frames);
+	int GetNumFrames(int texture) const {
+		return mTextures.at(texture).numFrames;
+	}
+
+	/*
+	* a new sprite showing the first frame of a texture - white, unscaled, unrotated and still
+	* texture - IN see AddTexture
+	* pos - IN where it is, in pixels
+	* returns - a handle to it
+	*/
+	SpriteHandle Add(int texture, const DirectX::SimpleMath::Vector2& pos = DirectX::SimpleMath::Vector2(0, 0));
+	//get rid of it, any handles to it go stale. Returns false if it already had.
+	bool Remove(SpriteHandle h);
+	//does the handle still refer to something
+	bool IsValid(SpriteHandle h) const {
+		return h.index < mSlots.size() && mSlots[h.index].generation == h.generation && h.generation != 0;
+	}
+	//remove every sprite, the textures stay
+	void Clear();
+
+	//the handle must be valid
+	void SetPosition(SpriteHandle h, const DirectX::SimpleMath::Vector2& pos);
+	DirectX::SimpleMath::Vector2 GetPosition(SpriteHandle h) const;
+	//pixels per second
+	void SetVelocity(SpriteHandle h, const DirectX::SimpleMath::Vector2& vel);
+	DirectX::SimpleMath::Vector2 GetVelocity(SpriteHandle h) const;
+	//radians, and radians per second
+	void SetRotation(SpriteHandle h, float angle);
+	float GetRotation(SpriteHandle h) const;
+	void SetSpin(SpriteHandle h, float spin);
+	void SetScale(SpriteHandle h, const DirectX::SimpleMath::Vector2& scale);
+	void SetDepth(SpriteHandle h, float depth);
+	void SetColour(SpriteHandle h, const DirectX::SimpleMath::Vector4& colour);
+	//centre of rotation in texels, the top left is 0,0
+	void SetOrigin(SpriteHandle h, const DirectX::SimpleMath::Vector2& origin);
+	//change texture, it starts on the first frame and any animation stops
+	void SetTexture(SpriteHandle h, int texture);
+	//show one of the texture's frames, any animation stops
+	void SetFrame(SpriteHandle h, int frame);
+	//which of the texture's frames is showing, -1 after SetTexRect
+	int GetFrame(SpriteHandle h) const;
+	//show any part of the texture (in texels), any animation stops
+	void SetTexRect(SpriteHandle h, const RECTF& texRect);
+	/*
+	* flick through some of the texture's frames, from the first
+	* first, count - IN which frames
+	* fps - IN frames per second
+	* loop - IN start again at the end, otherwise stay on the last frame
+	*/
+	void Play(SpriteHandle h, int first, int count, float fps, bool loop);
+	//stay on the current frame
+	void Stop(SpriteHandle h);
+
+	/*
+	* move everything by its velocity and spin, and move animations on
+	* dTime - IN elapsed seconds
+	* allowAVX2 - IN false to force the plain version, e.g. to compare them
+	*/
+	void Update(float dTime, bool allowAVX2 = true);
+	//every sprite, between SpriteBatch Begin and End
+	void Draw(DirectX::SpriteBatch& batch);
+	//as above with SpriteRenderer, between its Begin and End. Our textures are added to it the first time.
+	void Draw(SpriteRenderer& renderer);
+
+	int GetNumSprites() const {
+		return (int)mSpriteSlots.size();
+	}
+
+	/*
+	* time updating lots of moving animated sprites - as Sprite objects, each animated with
+	* Animate, then Update plain, with AVX2, and with AVX2 on every core. Draw is timed against
+	* Sprite::Draw too. Needs the device. Results go to DBOUT.
+	* numSprites - IN how many
+	* numFrames - IN how many updates to time
+	* returns - sprites updated per second, AVX2 on every core
+	*/
+	static double Benchmark(int numSprites, int numFrames);
+
+private:
+	struct Texture
+	{
+		ID3D11ShaderResourceView* pTex;
+		DirectX::SimpleMath::Vector2 dim;
+		int firstFrame;				//into mFrames
+		int numFrames;
+	};
+	struct Slot
+	{
+		unsigned int sprite = 0;	//where it is in the arrays, or the next free slot
+		unsigned int generation = 1;
+	};
+	//per sprite animation flags
+	typedef enum { PLAYING = 1, LOOP = 2 } AnimFlags;
+
+	std::vector<Texture> mTextures;
+	std::vector<RECT> mFrames;			//every texture's frames
+	unsigned int mRendererGeneration = 0;	//texture generation of the last one we drew with, see SpriteRenderer::GetTextureGeneration
+	std::vector<int> mRendererTex;		//what it calls our textures
+
+	//everything below is one per sprite, packed
+	std::vector<float> mPos[2], mVel[2];
+	std::vector<float> mRotation, mSpin;
+	std::vector<DirectX::SimpleMath::Vector2> mScale, mOrigin;
+	std::vector<float> mDepth;
+	std::vector<DirectX::SimpleMath::Vector4> mColour;
+	std::vector<int> mTexture;
+	std::vector<RECT> mRects;			//the part of the texture showing
+	std::vector<int> mFrame;			//into mFrames, -1 for a rect from SetTexRect
+	std::vector<float> mPlayhead;		//how far through the animation, in frames
+	std::vector<float> mFPS;
+	std::vector<float> mNumAnimFrames;	//float so it's ready for the maths
+	std::vector<int> mAnimBase;			//mFrames index of the animation's first frame
+	std::vector<unsigned char> mAnimFlags;
+	std::vector<unsigned int> mSpriteSlots;	//which slot each sprite belongs to
+
+	std::vector<Slot> mSlots;
+	unsigned int mFreeSlot = SpriteHandle::NONE;
+
+	//check the handle and turn it into a position in the arrays
+	int GetSprite(SpriteHandle h) const;
+	//update a range of sprites
+	void UpdatePlain(int begin, int end, float dTime);
+	void UpdateAVX2(int begin, int end, float dTime);
+};
+
+#endif
@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "Terrain.h"
+#include "WindowUtils.h"
+#include "D3D.h"
+#include "FX.h"
+#include "D3DUtil.h"
+#include "MeshOptimiser.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+using namespace GeoMip;
+
+void Terrain::Initialise(const Heightmap& map, const Settings& settings, const Vector3& origin)
+{
+	Release();
+	static int sNextId = 0;
+	mId = sNextId++;
+	mMap = map;
+	mSettings = settings;
+	mOrigin = origin;
+	mChunksX = (map.GetWidth() - 1) / CHUNK_CELLS;
+	mChunksZ = (map.GetDepth() - 1) / CHUNK_CELLS;
+	assert(mChunksX > 0 && mChunksZ > 0);
+	assert(settings.unloadRadius > settings.loadRadius);
+	if (mChunksX * CHUNK_CELLS + 1 != map.GetWidth() || mChunksZ * CHUNK_CELLS + 1 != map.GetDepth())
+		DBOUT("Terrain heightmap " << map.GetWidth() << "x" << map.GetDepth() << " isn't a whole number of chunks, the far edges are ignored");
+
+	//chunk bounds so distances are to the nearest point, not the middle
+	mStreamer.Initialise(mChunksX, mChunksZ, settings.loadRadius, settings.unloadRadius, settings.lodDistance);
+	mModels.clear();
+	mModels.resize(mChunksX * mChunksZ);
+	for (int cz = 0; cz < mChunksZ; ++cz)
+		for (int cx = 0; cx < mChunksX; ++cx)
+		{
+			float lo = 1, hi = 0;
+			for (int z = 0; z < CHUNK_VERTS; ++z)
+				for (int x = 0; x < CHUNK_VERTS; ++x)
+				{
+					float h = mMap.Get(cx * CHUNK_CELLS + x, cz * CHUNK_CELLS + z);
+					lo = min(lo, h);
+					hi = max(hi, h);
+				}
+			const float size = CHUNK_CELLS * mSettings.cellSize;
+			Vector3 boundsMin = mOrigin + Vector3(cx * size, lo * mSettings.heightScale, cz * size);
+			Vector3 boundsMax = mOrigin + Vector3((cx + 1) * size, hi * mSettings.heightScale, (cz + 1) * size);
+			mStreamer.SetBounds(cz * mChunksX + cx, &boundsMin.x, &boundsMax.x);
+		}
+
+	//every chunk has the same layout, so the vertex cache work is only done once
+	vector<unsigned int> indices;
+	BuildIndices(indices, mParts);
+	mIndices.resize(indices.size());
+	const int numVerts = CHUNK_VERTS * CHUNK_VERTS;
+	for (int i = 0; i < MAX_PARTS; ++i)
+	{
+		const Part& part = mParts[i];
+		if (part.numIndices > 0)
+			MeshOpt::OptimiseVertexCache(indices.data() + part.startIndex, part.numIndices, numVerts, mIndices.data() + part.startIndex);
+		mSubMeshes[i].startIndex = part.startIndex;
+		mSubMeshes[i].numIndices = part.numIndices;
+		mSubMeshes[i].material = mSettings.material;
+	}
+	int numUsed = MeshOpt::OptimiseVertexFetch(mIndices.data(), (int)mIndices.size(), numVerts, mRemap);
+	assert(numUsed == numVerts);
+	DBOUT("Terrain " << mChunksX << "x" << mChunksZ << " chunks, " << mIndices.size() << " indices per chunk for "
+		<< NUM_LODS << " LODs, ACMR " << MeshOpt::AnalyseVertexCache(indices.data(), (int)indices.size(), numVerts).acmr
+		<< "->" << MeshOpt::AnalyseVertexCache(mIndices.data(), (int)mIndices.size(), numVerts).acmr);
+
+	mQuit = false;
+	mThread = thread(&Terrain::LoadingThread, this);
+}
+
+void Terrain::Release()
+{
+	if (mThread.joinable())
+	{
+		{
+			lock_guard<mutex> lock(mLock);
+			mQuit = true;
+		}
+		mWake.notify_all();
+		mThread.join();
+	}
+	mRequests.clear();
+	mReady.clear();
+	for (int i = 0; i < mStreamer.GetNumChunks(); ++i)
+		if (mStreamer.GetState(i) == Streamer::LOADED)
+			WinUtil::Get().GetD3D().GetMeshMgr().ReleaseMesh(mModels[i].GetMeshHandle());
+	mStreamer = Streamer();
+	mModels.clear();
+}
+
+string Terrain::ChunkName(int chunk) const
+{
+	stringstream ss;
+	ss << "terrain" << mId << "_" << chunk % mChunksX << "_" << chunk / mChunksX;
+	return ss.str();
+}
+
+void Terrain::LoadingThread()
+{
+	unique_lock<mutex> lock(mLock);
+	while (true)
+	{
+		mWake.wait(lock, [this] { return mQuit || !mRequests.empty(); });
+		if (mQuit)
+			return;
+		int chunk = mRequests.front();
+		mRequests.pop_front();
+		mBuilding = chunk;
+		//build without the lock so the main thread can keep changing its mind
+		lock.unlock();
+		unique_ptr<Built> pBuilt(new Built);
+		BuildChunk(chunk, *pBuilt);
+		lock.lock();
+		mReady.push_back(move(pBuilt));
+		mBuilding = -1;
+	}
+}
+
+void Terrain::BuildChunk(int chunk, Built& built) const
+{
+	const int gx0 = (chunk % mChunksX) * CHUNK_CELLS, gz0 = (chunk / mChunksX) * CHUNK_CELLS;
+	const float heightScale = mSettings.heightScale, cellSize = mSettings.cellSize;
+	vector<VertexPosNormTex> verts(CHUNK_VERTS * CHUNK_VERTS);
+	for (int z = 0; z < CHUNK_VERTS; ++z)
+		for (int x = 0; x < CHUNK_VERTS; ++x)
+		{
+			const int gx = gx0 + x, gz = gz0 + z;
+			VertexPosNormTex& v = verts[mRemap[z * CHUNK_VERTS + x]];
+			v.Pos = mOrigin + Vector3(gx * cellSize, mMap.Get(gx, gz) * heightScale, gz * cellSize);
+			//central differences over the whole map, so edge normals match the neighbour's
+			float dhdx = (mMap.Get(gx + 1, gz) - mMap.Get(gx - 1, gz)) * heightScale / (2 * cellSize);
+			float dhdz = (mMap.Get(gx, gz + 1) - mMap.Get(gx, gz - 1)) * heightScale / (2 * cellSize);
+			v.Norm = Vector3(-dhdx, 1, -dhdz);
+			v.Norm.Normalize();
+			v.Tex = Vector2(x * mSettings.uvPerCell, (CHUNK_CELLS - z) * mSettings.uvPerCell);
+		}
+	//full size vertices, compact ones are quantised per chunk and edges shared with a neighbour wouldn't match exactly
+	built.chunk = chunk;
+	Mesh::PrepareGeometry(ChunkName(chunk), verts.data(), (int)verts.size(), mIndices.data(), (int)mIndices.size(),
+		mSubMeshes, MAX_PARTS, VertexFormat::FULL, false, built.vertData, built.indexData, built.streams);
+}
+
+void Terrain::Update(const Vector3& camPos)
+{
+	MeshMgr& mgr = WinUtil::Get().GetD3D().GetMeshMgr();
+	vector<int> dropped;
+	mStreamer.Update(&camPos.x, dropped);
+	for (int i : dropped)
+		mgr.ReleaseMesh(mModels[i].GetMeshHandle());
+
+	//upload a few, chunks that were built but aren't wanted any more are thrown away
+	vector<unique_ptr<Built>> ready, later;
+	{
+		lock_guard<mutex> lock(mLock);
+		ready.swap(mReady);
+	}
+	int uploads = 0;
+	for (unique_ptr<Built>& pBuilt : ready)
+	{
+		const int chunk = pBuilt->chunk;
+		if (!mStreamer.IsWanted(chunk))
+			continue;
+		if (uploads == mSettings.maxUploadsPerFrame)
+		{
+			//keep it for next frame rather than building it again
+			mStreamer.SetBuilt(chunk);
+			later.push_back(move(pBuilt));
+			continue;
+		}
+		Mesh& mesh = mgr.CreateMesh(ChunkName(chunk), false);
+		mesh.CreateFrom(pBuilt->streams, mSubMeshes, MAX_PARTS);
+		mModels[chunk].Initialise(mesh);
+		mStreamer.SetLoaded(chunk);
+		++uploads;
+	}
+
+	//nearest first, anything that's no longer wanted just drops out of the queue
+	vector<int> wanted;
+	mStreamer.GetWanted(wanted);
+	{
+		lock_guard<mutex> lock(mLock);
+		mRequests.assign(wanted.begin(), wanted.end());
+		if (mBuilding != -1)
+			mRequests.erase(remove(mRequests.begin(), mRequests.end(), mBuilding), mRequests.end());
+		for (unique_ptr<Built>& pBuilt : later)
+			mReady.push_back(move(pBuilt));
+	}
+	if (!wanted.empty())
+		mWake.notify_one();
+}
+
+void Terrain::Submit(FX::MyFX& fx)
+{
+	const vector<int>& lods = mStreamer.GetLODs();
+	for (int cz = 0; cz < mChunksZ; ++cz)
+		for (int cx = 0; cx < mChunksX; ++cx)
+		{
+			const int i = cz * mChunksX + cx;
+			if (mStreamer.GetState(i) != Streamer::LOADED)
+				continue;
+			//an edge is stitched if the neighbour across it is one LOD coarser
+			const int lod = lods[i];
+			const int neighbours[Edge::MAX_EDGES] = {
+				(cz < mChunksZ - 1) ? lods[i + mChunksX] : lod,	//north
+				(cx < mChunksX - 1) ? lods[i + 1] : lod,			//east
+				(cz > 0) ? lods[i - mChunksX] : lod,				//south
+				(cx > 0) ? lods[i - 1] : lod						//west
+			};
+			int parts[1 + Edge::MAX_EDGES];
+			parts[0] = CentrePart(lod);
+			for (int e = 0; e < Edge::MAX_EDGES; ++e)
+				parts[1 + e] = EdgePart(lod, e, neighbours[e] > lod);
+			fx.Submit(mModels[i], parts, 1 + Edge::MAX_EDGES);
+		}
+}
+
+float Terrain::GetHeight(float x, float z) const
+{
+	return mOrigin.y + mMap.Sample((x - mOrigin.x) / mSettings.cellSize, (z - mOrigin.z) / mSettings.cellSize) * mSettings.heightScale;
+}
@@ -0,0 +1,103 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "Mesh.h"
+#include "Model.h"
+#include "Heightmap.h"
+#include "GeoMip.h"
+
+namespace FX { class MyFX; }
+
+/*
+A big heightmap cut into chunks (see GeoMip for how the LODs work). Only chunks near
+the camera exist, a background thread builds their vertices and the main thread copies
+a few a frame into the MeshMgr's buffers, so moving around doesn't stall.
+Each chunk is an ordinary Mesh with one submesh per index buffer part, the parts
+to draw are picked each frame.
+*/
+class Terrain
+{
+public:
+	struct Settings
+	{
+		float cellSize = 1;			//world units between height samples
+		float heightScale = 30;		//how high a height of 1 is
+		float uvPerCell = 0.125f;	//texture repeats, keep uvPerCell*CHUNK_CELLS whole so it lines up across chunks
+		float lodDistance = 64;		//full detail closer than this, see GeoMip::SelectLOD
+		float loadRadius = 256;		//chunks closer than this get built
+		float unloadRadius = 320;	//chunks further than this are thrown away, a gap stops border chunks flickering in and out
+		int maxUploadsPerFrame = 2;	//spread out the cost of copying to the gpu
+		Material material;
+	};
+
+	~Terrain() {
+		Release();
+	}
+	/*
+	* setup and start the loading thread, nothing is loaded until Update
+	* map - IN heights, copied
+	* settings - IN see Settings
+	* origin - IN world position of the heightmap's first sample
+	*/
+	void Initialise(const Heightmap& map, const Settings& settings, const DirectX::SimpleMath::Vector3& origin);
+	//stop the loading thread and free all the chunks
+	void Release();
+	//pick LODs, ask for chunks near the camera, upload ones that are ready and drop ones that are far away
+	void Update(const DirectX::SimpleMath::Vector3& camPos);
+	//queue the loaded chunks for drawing, see MyFX::Submit
+	void Submit(FX::MyFX& fx);
+	//world height at a world x,z, e.g. to stand something on the ground
+	float GetHeight(float x, float z) const;
+	int GetNumLoaded() const {
+		return mStreamer.GetNumLoaded();
+	}
+
+private:
+	//vertices built by the loading thread, ready to upload
+	struct Built
+	{
+		int chunk = -1;
+		std::vector<unsigned char> vertData;
+		std::vector<unsigned int> indexData;
+		MeshStreams streams;
+	};
+
+	//the loading thread, takes the nearest request, builds it, repeat
+	void LoadingThread();
+	//heights and normals for a chunk, in world space so neighbours match exactly
+	void BuildChunk(int chunk, Built& built) const;
+	std::string ChunkName(int chunk) const;
+
+	Heightmap mMap;
+	Settings mSettings;
+	DirectX::SimpleMath::Vector3 mOrigin;
+	int mChunksX = 0, mChunksZ = 0;
+	GeoMip::Streamer mStreamer;	//which chunks are wanted and their LODs
+	std::vector<Model> mModels;	//one per chunk, its mesh isn't named, it's only found by handle
+	int mId = 0;				//so more than one terrain can have meshes in the library
+
+	//every chunk shares one index layout, optimised for the vertex cache once
+	std::vector<unsigned int> mIndices;
+	std::vector<int> mRemap;	//grid vertex -> vertex buffer position
+	GeoMip::Part mParts[GeoMip::MAX_PARTS];
+	SubMeshDesc mSubMeshes[GeoMip::MAX_PARTS];
+
+	//shared with the loading thread, lock first
+	std::thread mThread;
+	std::mutex mLock;
+	std::condition_variable mWake;
+	std::deque<int> mRequests;						//nearest first
+	std::vector<std::unique_ptr<Built>> mReady;
+	int mBuilding = -1;								//the chunk being built right now
+	bool mQuit = false;
+};
+
+#endif
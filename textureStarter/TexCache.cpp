@@ -48,7 +48,7 @@ ID3D11ShaderResourceView* TexCache::LoadTexture(ID3D11Device*pDevice, const std:
 	}
 	//save it
 	assert(pT);
-	mCache.insert(MyMap::value_type(name,Data(fileName, pT, GetDimensions(pT), frames)));
+	mCache.insert(MyMap::value_type(name,Data(fileName, pT, GetDimensions(pT), frames, alpha)));
 	return pT;
 }
 
@@ -57,6 +57,13 @@ ID3D11ShaderResourceView* TexCache::LoadTexture(ID3D11Device*pDevice, const std:
 
 const TexCache::Data & TexCache::Get(ID3D11ShaderResourceView * pTex) {
 
+	const Data *p = Find(pTex);
+	assert(p);
+	return *p;
+}
+
+const TexCache::Data* TexCache::Find(ID3D11ShaderResourceView * pTex) {
+
 	MyMap::iterator it = mCache.begin();
 	Data *p = nullptr;
 	while (it != mCache.end() && !p)
@@ -65,8 +72,7 @@ const TexCache::Data & TexCache::Get(ID3D11ShaderResourceView * pTex) {
 			p = &(*it).second;
 		++it;
 	}
-	assert(p);
-	return *p;
+	return p;
 }
 
 Vector2 TexCache::GetDimensions(ID3D11ShaderResourceView* pTex)
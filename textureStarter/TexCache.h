@@ -3,6 +3,7 @@
 #include <vector>
 #include <unordered_map>
 #include <d3d11.h>
+#include <DDSTextureLoader.h>
 
 #include "D3DUtil.h"
 
@@ -30,8 +31,9 @@ public:
 		{
 			frames.clear();
 		}
-		Data(const std::string& fName, ID3D11ShaderResourceView*p, const DirectX::SimpleMath::Vector2& _dim, const std::vector<RECTF> *_frames)
-			:fileName(fName), pTex(p), dim(_dim)
+		Data(const std::string& fName, ID3D11ShaderResourceView*p, const DirectX::SimpleMath::Vector2& _dim, const std::vector<RECTF> *_frames,
+			DirectX::DDS_ALPHA_MODE _alphaMode = DirectX::DDS_ALPHA_MODE_UNKNOWN)
+			:fileName(fName), pTex(p), dim(_dim), alphaMode(_alphaMode)
 
 		{
 			if (_frames)
@@ -42,6 +44,7 @@ public:
 		ID3D11ShaderResourceView* pTex = nullptr;	//pointer to d3d texture object
 		DirectX::SimpleMath::Vector2 dim;			//width and height in texels
 		std::vector<RECTF> frames;					//optional array of sub-ractangles within the texture in texels
+		DirectX::DDS_ALPHA_MODE alphaMode = DirectX::DDS_ALPHA_MODE_UNKNOWN;	//what the alpha channel means, OPAQUE=ignore it
 	};
 
 	//tidy up at the end
@@ -61,6 +64,8 @@ public:
 	}
 	//slowly find a texture by handle
 	const Data& Get(ID3D11ShaderResourceView *pTex);
+	//as above, but returns nullptr if the texture isn't one of ours
+	const Data* Find(ID3D11ShaderResourceView *pTex);
 
 private:
 	/*
@@ -0,0 +1,626 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include "TextRenderer.h"
+#include "D3D.h"
+#include "D3DUtil.h"
+#include "FX.h"
+#include "WindowUtils.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+//squared distance to the nearest seed along one row or column, Felzenszwalb and Huttenlocher's lower envelope of parabolas
+static void DistanceTransform1D(const float f[], int n, float d[], int v[], float z[])
+{
+	int k = 0;
+	v[0] = 0;
+	z[0] = -1e20f;
+	z[1] = 1e20f;
+	for (int q = 1; q < n; ++q)
+	{
+		float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.f * q - 2.f * v[k]);
+		while (s <= z[k])
+		{
+			--k;
+			s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.f * q - 2.f * v[k]);
+		}
+		++k;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = 1e20f;
+	}
+	k = 0;
+	for (int q = 0; q < n; ++q)
+	{
+		while (z[k + 1] < q)
+			++k;
+		d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+	}
+}
+
+//squared distance from every pixel to the nearest one where seed is true, exact, columns then rows
+static void DistanceTransform2D(vector<float>& grid, int width, int height)
+{
+	int n = std::max(width, height);
+	vector<float> f(n), d(n), z(n + 1);
+	vector<int> v(n);
+	for (int x = 0; x < width; ++x)
+	{
+		for (int y = 0; y < height; ++y)
+			f[y] = grid[y * width + x];
+		DistanceTransform1D(f.data(), height, d.data(), v.data(), z.data());
+		for (int y = 0; y < height; ++y)
+			grid[y * width + x] = d[y];
+	}
+	for (int y = 0; y < height; ++y)
+	{
+		DistanceTransform1D(&grid[y * width], width, d.data(), v.data(), z.data());
+		memcpy(&grid[y * width], d.data(), width * sizeof(float));
+	}
+}
+
+void TextRenderer::MakeDistanceField(const unsigned char coverage[], int width, int height, int pitch, int maxCoverage,
+	int& outWidth, int& outHeight, vector<unsigned char>& out)
+{
+	//the big bitmap goes in the middle of a grid that's a whole number of field texels with the border round it
+	outWidth = (width + OVERSAMPLE - 1) / OVERSAMPLE + SDF_SPREAD * 2;
+	outHeight = (height + OVERSAMPLE - 1) / OVERSAMPLE + SDF_SPREAD * 2;
+	const int w = outWidth * OVERSAMPLE, h = outHeight * OVERSAMPLE, border = SDF_SPREAD * OVERSAMPLE;
+	vector<unsigned char> inside(w * h, 0);
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x)
+			inside[(y + border) * w + x + border] = coverage[y * pitch + x] * 2 >= maxCoverage;
+
+	//distance to the nearest inside pixel, and to the nearest outside one
+	const float far = 1e20f;
+	vector<float> toInside(w * h), toOutside(w * h);
+	for (int i = 0; i < w * h; ++i)
+	{
+		toInside[i] = inside[i] ? 0 : far;
+		toOutside[i] = inside[i] ? far : 0;
+	}
+	DistanceTransform2D(toInside, w, h);
+	DistanceTransform2D(toOutside, w, h);
+
+	//average the signed distance over each texel's block, in field texels, positive outside
+	out.resize(outWidth * outHeight);
+	const float toTexels = 1.f / (OVERSAMPLE * OVERSAMPLE * OVERSAMPLE);
+	for (int ty = 0; ty < outHeight; ++ty)
+		for (int tx = 0; tx < outWidth; ++tx)
+		{
+			float sum = 0;
+			for (int y = ty * OVERSAMPLE; y < (ty + 1) * OVERSAMPLE; ++y)
+				for (int x = tx * OVERSAMPLE; x < (tx + 1) * OVERSAMPLE; ++x)
+				{
+					int i = y * w + x;
+					//half a pixel puts the outline between inside and outside pixels
+					sum += inside[i] ? 0.5f - sqrtf(toOutside[i]) : sqrtf(toInside[i]) - 0.5f;
+				}
+			float dist = sum * toTexels;
+			float value = 127.5f - dist * (127.5f / SDF_SPREAD);
+			out[ty * outWidth + tx] = (unsigned char)std::max(0.f, std::min(value + 0.5f, 255.f));
+		}
+}
+
+void TextRenderer::Init(ID3D11Device& device, int maxInstances)
+{
+	assert(maxInstances > 0);
+	Release();
+	char* pBuff = nullptr;
+	unsigned int bytes = 0;
+	//everything is per instance, the vertex shader makes the corners from SV_VertexID
+	const D3D11_INPUT_ELEMENT_DESC desc[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "SCALE", 0, DXGI_FORMAT_R32_FLOAT, 0, 8, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "GLYPH", 0, DXGI_FORMAT_R32_UINT, 0, 12, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	};
+	pBuff = FX::ReadAndAllocate("../bin/data/TextVS.cso", bytes);
+	FX::CreateVertexShader(device, pBuff, bytes, mpVS);
+	FX::CreateInputLayout(device, desc, sizeof(desc) / sizeof(desc[0]), pBuff, bytes, &mpInputLayout);
+	delete[] pBuff;
+	pBuff = FX::ReadAndAllocate("../bin/data/TextPS.cso", bytes);
+	FX::CreatePixelShader(device, pBuff, bytes, mpPS);
+	delete[] pBuff;
+	FX::CreateConstantBuffer(device, sizeof(Vector4), &mpConsts);
+
+	//one channel, glyphs are copied in as they're made
+	D3D11_TEXTURE2D_DESC texDesc;
+	ZeroMemory(&texDesc, sizeof(texDesc));
+	texDesc.Width = texDesc.Height = ATLAS_SIZE;
+	texDesc.MipLevels = texDesc.ArraySize = 1;
+	texDesc.Format = DXGI_FORMAT_R8_UNORM;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	HR(device.CreateTexture2D(&texDesc, nullptr, &mpAtlas));
+	HR(device.CreateShaderResourceView(mpAtlas, nullptr, &mpAtlasSRV));
+	mBands.resize(NUM_BANDS);
+	for (int b = 0; b < NUM_BANDS; ++b)
+	{
+		mBands[b].packer.Init(ATLAS_SIZE, ATLAS_SIZE / NUM_BANDS);
+		mBands[b].top = b * ATLAS_SIZE / NUM_BANDS;
+	}
+
+	mRing.Init(device, sizeof(Instance), maxInstances);
+	//the same states SpriteBatch uses by default - premultiplied alpha, no depth, no culling, linear clamp
+	FX::CreatePremultipliedBlendState(device, mpBlend);
+	FX::Create2DStates(device, mpDepth, mpRaster, mpSampler);
+}
+
+void TextRenderer::Release()
+{
+	for (Font& f : mFonts)
+	{
+		SelectObject(f.dc, f.oldFont);
+		DeleteObject(f.font);
+		DeleteDC(f.dc);
+	}
+	mFonts.clear();
+	mGlyphs.clear();
+	mBands.clear();
+	mUploads.clear();
+	mTable.clear();
+	mInstances.clear();
+	mNumLayouts = 0;
+	ReleaseCOM(mpAtlasSRV);
+	ReleaseCOM(mpAtlas);
+	mTableGPU.Release();
+	mRing.Release();
+	ReleaseCOM(mpConsts);
+	ReleaseCOM(mpVS);
+	ReleaseCOM(mpPS);
+	ReleaseCOM(mpInputLayout);
+	ReleaseCOM(mpBlend);
+	ReleaseCOM(mpRaster);
+	ReleaseCOM(mpDepth);
+	ReleaseCOM(mpSampler);
+}
+
+int TextRenderer::AddFont(const wstring& face, int pixelSize, bool bold)
+{
+	assert(pixelSize > 0);
+	//every glyph has to fit in a band, tall ones with accents or descenders come out at about 1.3 times the size
+	//a field scales up well, so storing it smaller costs little
+	const int maxSize = (ATLAS_SIZE / NUM_BANDS - SDF_SPREAD * 2 - 1) * 3 / 4;
+	pixelSize = std::min(pixelSize, maxSize);
+	Font f;
+	f.dc = CreateCompatibleDC(nullptr);
+	//negative asks for the character height rather than the cell, so pixelSize is what the letters come out at
+	f.font = CreateFontW(-pixelSize * OVERSAMPLE, 0, 0, 0, bold ? FW_BOLD : FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
+		OUT_TT_PRECIS, CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY, DEFAULT_PITCH | FF_DONTCARE, face.c_str());
+	if (!f.dc || !f.font)
+	{
+		DBOUT("TextRenderer couldn't make font " << string(face.begin(), face.end()));
+		if (f.font)
+			DeleteObject(f.font);
+		if (f.dc)
+			DeleteDC(f.dc);
+		return -1;
+	}
+	f.oldFont = SelectObject(f.dc, f.font);
+	f.pixelSize = pixelSize;
+	TEXTMETRICW tm;
+	GetTextMetricsW(f.dc, &tm);
+	f.ascent = (float)tm.tmAscent / OVERSAMPLE;
+	f.lineHeight = (float)(tm.tmHeight + tm.tmExternalLeading) / OVERSAMPLE;
+	for (int& g : f.ascii)
+		g = -1;
+	//kerning pairs outside the first 64K characters can't be asked for anyway
+	DWORD numPairs = GetKerningPairsW(f.dc, 0, nullptr);
+	if (numPairs > 0)
+	{
+		vector<KERNINGPAIR> pairs(numPairs);
+		numPairs = GetKerningPairsW(f.dc, numPairs, pairs.data());
+		for (DWORD i = 0; i < numPairs; ++i)
+			if (pairs[i].iKernAmount != 0)
+				f.kerning[((unsigned int)pairs[i].wFirst << 16) | pairs[i].wSecond] = (float)pairs[i].iKernAmount / OVERSAMPLE;
+	}
+	mFonts.push_back(f);
+	return (int)mFonts.size() - 1;
+}
+
+int TextRenderer::MakeGlyph(Font& font, unsigned int codepoint)
+{
+	//windows only takes characters one UTF-16 unit long
+	if (codepoint > 0xffff)
+		return -1;
+	const MAT2 identity = { { 0, 1 }, { 0, 0 }, { 0, 0 }, { 0, 1 } };
+	GLYPHMETRICS gm;
+	DWORD bytes = GetGlyphOutlineW(font.dc, codepoint, GGO_GRAY8_BITMAP, &gm, 0, nullptr, &identity);
+	if (bytes == GDI_ERROR)
+		return -1;
+	Glyph g;
+	g.advance = (float)gm.gmCellIncX / OVERSAMPLE;
+	g.offset[0] = g.offset[1] = 0;
+	//nothing to draw, e.g. space, is 0 bytes
+	if (bytes > 0)
+	{
+		vector<unsigned char> coverage(bytes);
+		if (GetGlyphOutlineW(font.dc, codepoint, GGO_GRAY8_BITMAP, &gm, bytes, coverage.data(), &identity) == GDI_ERROR)
+			return -1;
+		//rows are padded to 4 bytes, 64 levels of grey
+		int pitch = (gm.gmBlackBoxX + 3) & ~3;
+		MakeDistanceField(coverage.data(), gm.gmBlackBoxX, gm.gmBlackBoxY, pitch, 64, g.width, g.height, g.sdf);
+		//the origin is the top left of the black box, up from the baseline
+		g.offset[0] = (float)gm.gmptGlyphOrigin.x / OVERSAMPLE - SDF_SPREAD;
+		g.offset[1] = -(float)gm.gmptGlyphOrigin.y / OVERSAMPLE - SDF_SPREAD;
+	}
+	mGlyphs.push_back(g);
+	GlyphGPU entry;
+	memset(&entry, 0, sizeof(entry));
+	entry.offset[0] = g.offset[0];
+	entry.offset[1] = g.offset[1];
+	entry.size[0] = (float)g.width;
+	entry.size[1] = (float)g.height;
+	mTable.push_back(entry);
+	mTableDirty = true;
+	++mNumMade;
+	return (int)mGlyphs.size() - 1;
+}
+
+int TextRenderer::FindGlyph(Font& font, unsigned int codepoint)
+{
+	if (codepoint < 128)
+	{
+		int& g = font.ascii[codepoint];
+		if (g < 0)
+			g = MakeGlyph(font, codepoint);
+		return g;
+	}
+	unordered_map<unsigned int, int>::iterator it = font.others.find(codepoint);
+	if (it != font.others.end())
+		return it->second;
+	//missing characters remember they're missing so windows isn't asked every time
+	int g = MakeGlyph(font, codepoint);
+	font.others[codepoint] = g;
+	return g;
+}
+
+TextRenderer::Layout& TextRenderer::GetLayout(Font& font, const string& text)
+{
+	unordered_map<string, Layout>::iterator it = font.layouts.find(text);
+	if (it != font.layouts.end())
+		return it->second;
+
+	Layout& layout = font.layouts[text];
+	++mNumLayouts;
+	++mNumLaidOut;
+	float x = 0, y = font.ascent, width = 0;
+	unsigned int prev = 0;
+	const unsigned char* p = (const unsigned char*)text.c_str();
+	while (*p)
+	{
+		//UTF-8, anything malformed comes out as '?'
+		unsigned int c = *p++;
+		int extra = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : 0;
+		if (extra)
+			c &= 0x3f >> extra;
+		else if (c >= 0x80)
+			c = '?';
+		for (; extra > 0; --extra)
+		{
+			if ((*p & 0xc0) != 0x80)
+			{
+				c = '?';
+				break;
+			}
+			c = (c << 6) | (*p++ & 0x3f);
+		}
+
+		if (c == '\n')
+		{
+			x = 0;
+			y += font.lineHeight;
+			prev = 0;
+			continue;
+		}
+		if (c == '\r')
+			continue;
+		int g = FindGlyph(font, c);
+		if (g < 0)
+		{
+			c = '?';
+			g = FindGlyph(font, c);
+			if (g < 0)
+				continue;
+		}
+		if (prev && !font.kerning.empty())
+		{
+			unordered_map<unsigned int, float>::const_iterator k = font.kerning.find((prev << 16) | c);
+			if (k != font.kerning.end())
+				x += k->second;
+		}
+		if (mGlyphs[g].width > 0)
+			layout.pens.push_back(Layout::Pen{ g, x, y });
+		x += mGlyphs[g].advance;
+		width = std::max(width, x);
+		prev = c <= 0xffff ? c : 0;
+	}
+	layout.size = Vector2(width, y - font.ascent + font.lineHeight);
+	return layout;
+}
+
+bool TextRenderer::Place(int glyph)
+{
+	Glyph& g = mGlyphs[glyph];
+	//a texel of gap so filtering never reaches the next glyph
+	int w = g.width + 1, h = g.height + 1, x, y;
+	int band = -1;
+	for (int b = 0; b < (int)mBands.size() && band < 0; ++b)
+		if (mBands[b].packer.Add(w, h, x, y))
+			band = b;
+	if (band < 0)
+	{
+		//empty the band drawn longest ago, as long as nothing in it is being drawn this frame
+		for (int b = 0; b < (int)mBands.size(); ++b)
+			if (mBands[b].lastUsed != mFrame && (band < 0 || mBands[b].lastUsed < mBands[band].lastUsed))
+				band = b;
+		if (band < 0)
+			return false;
+		Band& evict = mBands[band];
+		for (int other : evict.glyphs)
+			mGlyphs[other].band = -1;
+		evict.glyphs.clear();
+		evict.packer.Clear();
+		++mNumEvicted;
+		if (!evict.packer.Add(w, h, x, y))
+			return false;
+	}
+	Band& b = mBands[band];
+	b.glyphs.push_back(glyph);
+	g.band = band;
+	g.atlasX = x;
+	g.atlasY = b.top + y;
+	GlyphGPU& entry = mTable[glyph];
+	entry.rect[0] = (float)g.atlasX / ATLAS_SIZE;
+	entry.rect[1] = (float)g.atlasY / ATLAS_SIZE;
+	entry.rect[2] = (float)(g.atlasX + g.width) / ATLAS_SIZE;
+	entry.rect[3] = (float)(g.atlasY + g.height) / ATLAS_SIZE;
+	mTableDirty = true;
+	mUploads.push_back(glyph);
+	return true;
+}
+
+void TextRenderer::Begin()
+{
+	++mFrame;
+	mInstances.clear();
+	mNumDrawn = mNumMade = mNumLaidOut = mNumEvicted = 0;
+}
+
+void TextRenderer::DrawString(int font, const string& text, const Vector2& pos, float size, const Vector4& colour)
+{
+	Font& f = mFonts.at(font);
+	Layout& layout = GetLayout(f, text);
+	layout.lastUsed = mFrame;
+	const float scale = size / f.pixelSize;
+	//premultiplied, as the blend state expects
+	const float c[4] = { colour.x * colour.w, colour.y * colour.w, colour.z * colour.w, colour.w };
+	unsigned int packed = 0;
+	for (int i = 0; i < 4; ++i)
+		packed |= (unsigned int)(std::max(0.f, std::min(c[i], 1.f)) * 255 + 0.5f) << (i * 8);
+
+	for (const Layout::Pen& pen : layout.pens)
+	{
+		Glyph& g = mGlyphs[pen.glyph];
+		//the first time this frame, make sure it's in the atlas and keep its band from being emptied
+		if (g.lastUsed != mFrame)
+		{
+			g.lastUsed = mFrame;
+			if (g.band < 0)
+				Place(pen.glyph);
+			if (g.band >= 0)
+				mBands[g.band].lastUsed = mFrame;
+		}
+		//the atlas is full of glyphs on screen, this one will have to wait
+		if (g.band < 0)
+			continue;
+		Instance inst;
+		inst.pos[0] = pos.x + pen.x * scale;
+		inst.pos[1] = pos.y + pen.y * scale;
+		inst.scale = scale;
+		inst.glyph = (unsigned int)pen.glyph;
+		inst.colour = packed;
+		mInstances.push_back(inst);
+	}
+}
+
+Vector2 TextRenderer::MeasureString(int font, const string& text, float size)
+{
+	Font& f = mFonts.at(font);
+	return GetLayout(f, text).size * (size / f.pixelSize);
+}
+
+void TextRenderer::Upload(ID3D11DeviceContext& ctx)
+{
+	for (int glyph : mUploads)
+	{
+		const Glyph& g = mGlyphs[glyph];
+		//it may have been moved again since, the last place wins
+		if (g.band < 0)
+			continue;
+		D3D11_BOX box;
+		box.left = g.atlasX;
+		box.right = g.atlasX + g.width;
+		box.top = g.atlasY;
+		box.bottom = g.atlasY + g.height;
+		box.front = 0;
+		box.back = 1;
+		ctx.UpdateSubresource(mpAtlas, 0, &box, g.sdf.data(), g.width, 0);
+	}
+	mUploads.clear();
+
+	if (!mTableDirty)
+		return;
+	void* pDst = mTableGPU.Map(ctx, (int)mTable.size(), sizeof(GlyphGPU));
+	memcpy(pDst, mTable.data(), mTable.size() * sizeof(GlyphGPU));
+	mTableGPU.Unmap(ctx);
+	mTableDirty = false;
+}
+
+void TextRenderer::TrimLayouts()
+{
+	for (Font& f : mFonts)
+		for (unordered_map<string, Layout>::iterator it = f.layouts.begin(); it != f.layouts.end(); )
+		{
+			if (it->second.lastUsed != mFrame)
+			{
+				it = f.layouts.erase(it);
+				--mNumLayouts;
+			}
+			else
+				++it;
+		}
+}
+
+void TextRenderer::End(ID3D11DeviceContext& ctx)
+{
+	assert(mRing.GetMaxInstances() > 0);
+	if (mNumLayouts > MAX_LAYOUTS)
+		TrimLayouts();
+	Upload(ctx);
+	const int n = (int)mInstances.size();
+	mNumDrawn = n;
+	if (n == 0)
+		return;
+
+	//pixels to clip space for the viewport that's set, like SpriteBatch
+	D3D11_VIEWPORT vp;
+	UINT numViewports = 1;
+	ctx.RSGetViewports(&numViewports, &vp);
+	assert(numViewports == 1 && vp.Width > 0 && vp.Height > 0);
+	Vector4 consts(2 / vp.Width, -2 / vp.Height, -1, 1);
+	ctx.UpdateSubresource(mpConsts, 0, nullptr, &consts, 0, 0);
+
+	mRing.Bind(ctx);
+	ctx.IASetInputLayout(mpInputLayout);
+	ctx.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	ctx.VSSetShader(mpVS, nullptr, 0);
+	ctx.VSSetConstantBuffers(0, 1, &mpConsts);
+	ID3D11ShaderResourceView* pTable = mTableGPU.GetSRV();
+	ctx.VSSetShaderResources(1, 1, &pTable);
+	ctx.PSSetShader(mpPS, nullptr, 0);
+	ctx.PSSetShaderResources(0, 1, &mpAtlasSRV);
+	ctx.PSSetSamplers(0, 1, &mpSampler);
+	const float blendFactors[4] = { 0, 0, 0, 0 };
+	ctx.OMSetBlendState(mpBlend, blendFactors, 0xffffffff);
+	ctx.OMSetDepthStencilState(mpDepth, 0);
+	ctx.RSSetState(mpRaster);
+
+	//more than the ring buffer holds goes in pieces
+	mRing.Draw(ctx, mInstances.data(), n, 4);
+
+	//don't leave the glyph table bound where the 3D vertex shaders might trip over it
+	ID3D11ShaderResourceView* pNull = nullptr;
+	ctx.VSSetShaderResources(1, 1, &pNull);
+}
+
+double TextRenderer::Benchmark(int numLabels, int numFrames)
+{
+	MyD3D& d3d = WinUtil::Get().GetD3D();
+	ID3D11DeviceContext& ctx = d3d.GetDeviceCtx();
+	TextRenderer text;
+	text.Init(d3d.GetDevice());
+	int font = text.AddFont(L"Arial", 32);
+	if (font < 0)
+	{
+		DBOUT("Text benchmark needs Arial");
+		return 0;
+	}
+
+	//name plates over units - a name and hit points, a few get hit each frame
+	mt19937 rng(1234);
+	uniform_real_distribution<float> unit(0, 1);
+	const char* names[] = { "Archer", "Knight", "Peasant", "Wizard", "Catapult", "Dragon", "Scout", "Healer" };
+	struct Label
+	{
+		Vector2 pos;
+		string name;
+		int hp;
+		string text;
+	};
+	vector<Label> labels(numLabels);
+	for (int i = 0; i < numLabels; ++i)
+	{
+		Label& l = labels[i];
+		l.pos = Vector2(unit(rng) * 1800, unit(rng) * 1040);
+		l.name = string(names[i % 8]) + " " + to_string(i);
+		l.hp = 100;
+		l.text = l.name + "  HP " + to_string(l.hp);
+	}
+	typedef chrono::high_resolution_clock Clock;
+	typedef chrono::duration<double> Secs;
+
+	//the first frame makes every glyph and layout
+	Clock::time_point start = Clock::now();
+	text.Begin();
+	for (const Label& l : labels)
+		text.DrawString(font, l.text, l.pos, 16);
+	text.End(ctx);
+	double coldSecs = Secs(Clock::now() - start).count();
+	int coldGlyphs = text.GetNumGlyphsMade();
+
+	//1% change a frame, with layouts kept and then thrown away every frame
+	double secs[2];
+	int glyphsDrawn = 0;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		start = Clock::now();
+		for (int f = 0; f < numFrames; ++f)
+		{
+			for (int i = 0; i < numLabels / 100; ++i)
+			{
+				Label& l = labels[(int)(unit(rng) * numLabels) % numLabels];
+				l.hp = l.hp > 1 ? l.hp - 1 : 100;
+				l.text = l.name + "  HP " + to_string(l.hp);
+			}
+			if (pass == 1)
+				for (Font& fnt : text.mFonts)
+				{
+					fnt.layouts.clear();
+					text.mNumLayouts = 0;
+				}
+			text.Begin();
+			for (const Label& l : labels)
+				text.DrawString(font, l.text, l.pos, 16);
+			text.End(ctx);
+			glyphsDrawn = text.GetNumGlyphsDrawn();
+		}
+		secs[pass] = Secs(Clock::now() - start).count() / numFrames;
+	}
+
+	//four big fonts taking turns, each one's printable ASCII is more than the atlas holds with the others
+	int fonts[4] = { text.AddFont(L"Arial", 96), text.AddFont(L"Times New Roman", 96), text.AddFont(L"Courier New", 96), text.AddFont(L"Arial", 96, true) };
+	string alphabet;
+	for (char c = 33; c < 127; ++c)
+		alphabet += c;
+	int made = 0, evicted = 0;
+	start = Clock::now();
+	const int churnFrames = 16;
+	for (int f = 0; f < churnFrames; ++f)
+	{
+		text.Begin();
+		if (fonts[f % 4] >= 0)
+			text.DrawString(fonts[f % 4], alphabet, Vector2(0, 0), 32);
+		text.End(ctx);
+		made += text.GetNumGlyphsMade();
+		evicted += text.GetNumBandsEmptied();
+	}
+	double churnSecs = Secs(Clock::now() - start).count() / churnFrames;
+	//everything here changed the pipeline
+	d3d.InvalidateInputAssembler();
+	d3d.GetFX().InvalidatePSO();
+
+	DBOUT("Text benchmark, " << numLabels << " labels a frame, " << glyphsDrawn << " glyphs, " << numLabels / 100 << " changing a frame:");
+	DBOUT("  first frame " << coldSecs * 1000 << "ms (" << coldGlyphs << " glyphs made), then " << secs[0] * 1000
+		<< "ms per frame keeping layouts, " << secs[1] * 1000 << "ms laying everything out every frame");
+	DBOUT("  4 big fonts fighting over the atlas " << churnSecs * 1000 << "ms per frame, " << (float)made / churnFrames
+		<< " glyphs made and " << (float)evicted / churnFrames << " bands emptied per frame");
+	return secs[0] * 1000;
+}
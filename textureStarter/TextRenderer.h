@@ -0,0 +1,215 @@
+#ifndef TEXTRENDERER_H
+#define TEXTRENDERER_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <d3d11.h>
+
+#include "SimpleMath.h"
+#include "SkylinePacker.h"
+#include "DynamicBuffers.h"
+
+/*
+Text from any installed font without baking a SpriteFont first. Glyphs are made the
+first time a string needs them - windows draws the character big, a distance transform
+turns that into a signed distance field (how far each texel is from the outline) and
+it's packed into one atlas texture. A distance field stays sharp scaled up or down, so
+one copy of a glyph does for every size.
+The atlas is cut into bands, each packed with a skyline. When it's full the band whose
+glyphs were drawn longest ago is emptied and its glyphs made again if they come back
+(from a copy kept on the CPU).
+A string is laid out once (glyphs, kerning, new lines) and the layout is kept, drawing
+the same string again just copies one instance per glyph. Everything queued between
+Begin and End goes in a ring buffer and is drawn with one instanced call, the vertex
+shader (TextVS) builds each quad from the instance and a glyph table on the GPU.
+Like SpriteBatch it changes the pipeline, tell anything that tracks state afterwards
+(MyFX::InvalidatePSO, MyD3D::InvalidateInputAssembler).
+*/
+class TextRenderer
+{
+public:
+	//width and height of the atlas texture
+	static constexpr int ATLAS_SIZE = 1024;
+	//the atlas is this many bands across its height, one band is emptied at a time
+	static constexpr int NUM_BANDS = 8;
+	//glyphs are drawn by windows this many times bigger than they're stored
+	static constexpr int OVERSAMPLE = 4;
+	//texels of distance stored either side of the outline, also the border round each glyph
+	static constexpr int SDF_SPREAD = 4;
+	//when there are more layouts than this, the ones not drawn this frame are thrown away
+	static constexpr int MAX_LAYOUTS = 8192;
+
+	~TextRenderer() {
+		Release();
+	}
+	/*
+	* load the shaders and create the atlas, buffers and states
+	* device - IN the gpu
+	* maxInstances - IN size of the ring buffer in glyphs, End draws more than this in pieces
+	*/
+	void Init(ID3D11Device& device, int maxInstances = 65536);
+	void Release();
+
+	/*
+	* a font to draw with, its glyphs are made as strings need them
+	* face - IN an installed font, e.g. L"Arial"
+	* pixelSize - IN height its glyphs are stored at, they look right a few times bigger or smaller.
+	*   Capped so the tallest glyph fits in a band (89 with the sizes above)
+	* bold - IN heavier
+	* returns - its number, -1 if windows couldn't make it
+	*/
+	int AddFont(const std::wstring& face, int pixelSize = 32, bool bold = false);
+
+	//start queueing strings
+	void Begin();
+	/*
+	* queue a string
+	* font - IN see AddFont
+	* text - IN UTF-8, '\n' starts a new line
+	* pos - IN top left in pixels
+	* size - IN height of the letters in pixels, the font's pixelSize draws it as stored
+	* colour - IN of the text, alpha fades it
+	*/
+	void DrawString(int font, const std::string& text, const DirectX::SimpleMath::Vector2& pos, float size,
+		const DirectX::SimpleMath::Vector4& colour = DirectX::SimpleMath::Vector4(1, 1, 1, 1));
+	//width and height of a string drawn at this size, it's laid out and kept if it hasn't been already
+	DirectX::SimpleMath::Vector2 MeasureString(int font, const std::string& text, float size);
+	//draw everything queued, into whatever render target and viewport are set
+	void End(ID3D11DeviceContext& ctx);
+
+	//what the last Begin/End did
+	int GetNumGlyphsDrawn() const {
+		return mNumDrawn;
+	}
+	int GetNumGlyphsMade() const {
+		return mNumMade;
+	}
+	int GetNumLayoutsMade() const {
+		return mNumLaidOut;
+	}
+	int GetNumBandsEmptied() const {
+		return mNumEvicted;
+	}
+
+	/*
+	* time drawing thousands of labels a frame, most the same as last frame and a few changed,
+	* with and without keeping layouts, then how fast glyphs are made when several fonts are
+	* fighting over the atlas. Needs the device. Results go to DBOUT.
+	* numLabels - IN how many strings a frame
+	* numFrames - IN how many frames to time
+	* returns - CPU milliseconds per frame to queue and draw the labels, with layouts kept
+	*/
+	static double Benchmark(int numLabels, int numFrames);
+
+	/*
+	* turn a big coverage bitmap of a glyph into a signed distance field OVERSAMPLE times smaller,
+	* with SDF_SPREAD texels of border. 128 is on the outline, bigger is inside.
+	* coverage - IN a byte per pixel, pitch bytes per row
+	* maxCoverage - IN value meaning fully inside
+	* outWidth, outHeight - OUT size of the field
+	* out - OUT the field
+	*/
+	static void MakeDistanceField(const unsigned char coverage[], int width, int height, int pitch, int maxCoverage,
+		int& outWidth, int& outHeight, std::vector<unsigned char>& out);
+
+private:
+	//a character of one of the fonts
+	struct Glyph
+	{
+		float offset[2];				//top left of the quad from the pen position on the baseline, font pixels
+		float advance;					//pen moves on this far
+		int width = 0, height = 0;		//size of the field, 0 for nothing to draw (e.g. space)
+		std::vector<unsigned char> sdf;	//kept so an evicted glyph can go back quickly
+		int band = -1;					//where it is in the atlas, -1 if it isn't
+		int atlasX = 0, atlasY = 0;
+		unsigned int lastUsed = 0;		//frame it was last drawn
+	};
+	//one entry in the glyph table on the GPU, see TextConstants.hlsl
+	struct GlyphGPU
+	{
+		float rect[4];					//uv left, top, right, bottom
+		float offset[2];				//font pixels
+		float size[2];					//font pixels
+	};
+	//what the vertex shader gets per glyph
+	struct Instance
+	{
+		float pos[2];					//pen position on the screen, pixels
+		float scale;					//screen pixels per font pixel
+		unsigned int glyph;				//into the glyph table
+		unsigned int colour;			//RGBA8, premultiplied
+	};
+	//a string ready to draw
+	struct Layout
+	{
+		struct Pen
+		{
+			int glyph;					//into mGlyphs
+			float x, y;					//font pixels from the top left
+		};
+		std::vector<Pen> pens;			//only glyphs with something to draw
+		DirectX::SimpleMath::Vector2 size;
+		unsigned int lastUsed = 0;
+	};
+	struct Font
+	{
+		HDC dc = nullptr;				//windows draws glyphs with this
+		HFONT font = nullptr;
+		HGDIOBJ oldFont = nullptr;
+		int pixelSize = 0;
+		float ascent = 0, lineHeight = 0;	//font pixels
+		int ascii[128];					//mGlyphs index, -1 if not made yet
+		std::unordered_map<unsigned int, int> others;		//the rest of unicode
+		std::unordered_map<unsigned int, float> kerning;	//first << 16 | second to font pixels
+		std::unordered_map<std::string, Layout> layouts;
+	};
+	struct Band
+	{
+		SkylinePacker packer;
+		int top = 0;					//texels from the top of the atlas
+		std::vector<int> glyphs;		//packed into it
+		unsigned int lastUsed = 0;		//frame one of its glyphs was last drawn
+	};
+
+	std::vector<Font> mFonts;
+	std::vector<Glyph> mGlyphs;			//every font's, never removed
+	std::vector<Band> mBands;
+	std::vector<int> mUploads;			//glyphs placed since the last End, their fields need copying to the atlas
+	bool mTableDirty = false;			//the GPU glyph table needs updating
+	std::vector<GlyphGPU> mTable;
+	unsigned int mFrame = 0;
+	int mNumLayouts = 0;
+
+	std::vector<Instance> mInstances;	//queued since Begin
+	int mNumDrawn = 0, mNumMade = 0, mNumLaidOut = 0, mNumEvicted = 0;
+
+	//gpu
+	ID3D11Texture2D* mpAtlas = nullptr;
+	ID3D11ShaderResourceView* mpAtlasSRV = nullptr;
+	StructuredTable mTableGPU;			//mTable for the vertex shader
+	InstanceRing mRing;
+	ID3D11Buffer* mpConsts = nullptr;
+	ID3D11VertexShader* mpVS = nullptr;
+	ID3D11PixelShader* mpPS = nullptr;
+	ID3D11InputLayout* mpInputLayout = nullptr;
+	ID3D11BlendState* mpBlend = nullptr;
+	ID3D11RasterizerState* mpRaster = nullptr;
+	ID3D11DepthStencilState* mpDepth = nullptr;
+	ID3D11SamplerState* mpSampler = nullptr;
+
+	//the glyph for a character, made if it's new, -1 if the font hasn't got it
+	int FindGlyph(Font& font, unsigned int codepoint);
+	//draw a character with windows and make its field
+	int MakeGlyph(Font& font, unsigned int codepoint);
+	//the cached layout of a string, laid out if it's new
+	Layout& GetLayout(Font& font, const std::string& text);
+	//find room in the atlas, emptying the least recently drawn band if need be, false if everything is in use
+	bool Place(int glyph);
+	//copy new glyphs into the atlas and the table to the GPU
+	void Upload(ID3D11DeviceContext& ctx);
+	//throw away layouts not drawn this frame
+	void TrimLayouts();
+};
+
+#endif
@@ -0,0 +1,399 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <DirectXPackedVector.h>
+
+#include "Tilemap.h"
+#include "D3D.h"
+#include "D3DUtil.h"
+#include "FX.h"
+#include "SpriteRenderer.h"
+#include "WindowUtils.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+void Tilemap::Init(ID3D11Device& device, ID3D11ShaderResourceView* pTex, const Vector2& texDim, int tileSize, int width, int height, int numLayers, int maxChunks)
+{
+	assert(pTex && tileSize > 0 && width > 0 && height > 0 && numLayers > 0 && maxChunks > 0);
+	Release();
+	mpTex = pTex;
+	mTexDim = texDim;
+	mTileSize = tileSize;
+	mAtlasColumns = (int)texDim.x / tileSize;
+	assert(mAtlasColumns > 0 && mAtlasColumns * ((int)texDim.y / tileSize) <= EMPTY);
+	mAnims.assign(mAtlasColumns * ((int)texDim.y / tileSize) * 2, 0);
+	mWidth = width;
+	mHeight = height;
+	mChunksX = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	mChunksY = (height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	mLayers.resize(numLayers);
+	for (Layer& layer : mLayers)
+	{
+		layer.tiles.assign(width * height, EMPTY);
+		layer.chunks.assign(mChunksX * mChunksY, Chunk());
+	}
+	//buffers are made as they're needed, up to the budget
+	mBuffers.reserve(maxChunks);
+	mBuffers.resize(0);
+	mMaxBuffers = maxChunks;
+	mTime = 0;
+	mDrawCount = 0;
+
+	char* pBuff = nullptr;
+	unsigned int bytes = 0;
+	const D3D11_INPUT_ELEMENT_DESC desc[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 8, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "ANIM", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 16, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	};
+	pBuff = FX::ReadAndAllocate("../bin/data/TileVS.cso", bytes);
+	FX::CreateVertexShader(device, pBuff, bytes, mpVS);
+	FX::CreateInputLayout(device, desc, sizeof(desc) / sizeof(desc[0]), pBuff, bytes, &mpInputLayout);
+	delete[] pBuff;
+	pBuff = FX::ReadAndAllocate("../bin/data/TilePS.cso", bytes);
+	FX::CreatePixelShader(device, pBuff, bytes, mpPS);
+	delete[] pBuff;
+	FX::CreateConstantBuffer(device, sizeof(Constants), &mpConsts);
+
+	//every chunk draws the first numTiles*6 of these, 16 bit is plenty for one chunk
+	static_assert(CHUNK_SIZE * CHUNK_SIZE * 4 <= 0x10000, "chunk too big for 16 bit indices");
+	vector<unsigned short> indices;
+	indices.reserve(CHUNK_SIZE * CHUNK_SIZE * 6);
+	for (int q = 0; q < CHUNK_SIZE * CHUNK_SIZE; ++q)
+	{
+		unsigned short v = (unsigned short)(q * 4);
+		const unsigned short quad[6] = { v, (unsigned short)(v + 1), (unsigned short)(v + 2), (unsigned short)(v + 2), (unsigned short)(v + 1), (unsigned short)(v + 3) };
+		indices.insert(indices.end(), quad, quad + 6);
+	}
+	CreateIndexBuffer(device, (UINT)(indices.size() * sizeof(unsigned short)), indices.data(), mpIB);
+
+	//layers above have holes in, normal alpha blending, no depth, no culling, and no filtering so neighbouring tiles don't bleed in
+	FX::CreateAlphaTransparentBlendState(device, mpBlend);
+	FX::Create2DStates(device, mpDepth, mpRaster, mpSampler, true);
+}
+
+void Tilemap::Release()
+{
+	for (Buffer& b : mBuffers)
+		ReleaseCOM(b.pVB);
+	mBuffers.clear();
+	mLayers.clear();
+	ReleaseCOM(mpIB);
+	ReleaseCOM(mpConsts);
+	ReleaseCOM(mpVS);
+	ReleaseCOM(mpPS);
+	ReleaseCOM(mpInputLayout);
+	ReleaseCOM(mpBlend);
+	ReleaseCOM(mpRaster);
+	ReleaseCOM(mpDepth);
+	ReleaseCOM(mpSampler);
+	mpTex = nullptr;
+}
+
+void Tilemap::SetTile(int layer, int x, int y, unsigned short tile)
+{
+	assert(x >= 0 && x < mWidth && y >= 0 && y < mHeight);
+	assert(tile == EMPTY || tile < mAnims.size() / 2);
+	Layer& l = mLayers.at(layer);
+	unsigned short& t = l.tiles[y * mWidth + x];
+	if (t == tile)
+		return;
+	t = tile;
+	l.chunks[(y / CHUNK_SIZE) * mChunksX + x / CHUNK_SIZE].dirty = true;
+}
+
+void Tilemap::SetTiles(int layer, const unsigned short tiles[])
+{
+	Layer& l = mLayers.at(layer);
+	l.tiles.assign(tiles, tiles + mWidth * mHeight);
+	for (Chunk& c : l.chunks)
+		c.dirty = true;
+}
+
+void Tilemap::SetAnimation(unsigned short tile, int numFrames, float fps)
+{
+	assert(tile < mAnims.size() / 2 && numFrames > 0 && (tile % mAtlasColumns) + numFrames <= mAtlasColumns);
+	mAnims[tile * 2] = PackedVector::XMConvertFloatToHalf(numFrames > 1 ? (float)numFrames : 0.f);
+	mAnims[tile * 2 + 1] = PackedVector::XMConvertFloatToHalf(numFrames > 1 ? fps : 0.f);
+	DirtyAll();
+}
+
+void Tilemap::DirtyAll()
+{
+	for (Layer& l : mLayers)
+		for (Chunk& c : l.chunks)
+			c.dirty = true;
+}
+
+int Tilemap::FindBuffer(ID3D11DeviceContext& ctx)
+{
+	int oldest = -1;
+	unsigned int oldestDrawn = mDrawCount;
+	for (int i = 0; i < (int)mBuffers.size(); ++i)
+	{
+		const Buffer& b = mBuffers[i];
+		if (b.chunk < 0)
+			return i;
+		unsigned int drawn = mLayers[b.layer].chunks[b.chunk].lastDrawn;
+		if (drawn < oldestDrawn)
+		{
+			oldestDrawn = drawn;
+			oldest = i;
+		}
+	}
+	//make another while there's budget, rather than throwing away something that might come back
+	if ((int)mBuffers.size() < mMaxBuffers)
+	{
+		ID3D11Device* pDevice = nullptr;
+		ctx.GetDevice(&pDevice);
+		Buffer b;
+		CreateDefaultBuffer(*pDevice, CHUNK_SIZE * CHUNK_SIZE * 4 * sizeof(Vertex), D3D11_BIND_VERTEX_BUFFER, b.pVB);
+		pDevice->Release();
+		mBuffers.push_back(b);
+		return (int)mBuffers.size() - 1;
+	}
+	if (oldest >= 0)
+	{
+		Buffer& b = mBuffers[oldest];
+		mLayers[b.layer].chunks[b.chunk].buffer = -1;
+		b.layer = b.chunk = -1;
+	}
+	return oldest;
+}
+
+void Tilemap::Build(ID3D11DeviceContext& ctx, int layer, int chunk)
+{
+	Layer& l = mLayers[layer];
+	Chunk& c = l.chunks[chunk];
+	const int x0 = (chunk % mChunksX) * CHUNK_SIZE, y0 = (chunk / mChunksX) * CHUNK_SIZE;
+	const int x1 = std::min(x0 + CHUNK_SIZE, mWidth), y1 = std::min(y0 + CHUNK_SIZE, mHeight);
+	//a sliver in from the edges so point sampling never picks up the next tile
+	const float inset = 1 / 64.f;
+	const float tileU = mTileSize / mTexDim.x, tileV = mTileSize / mTexDim.y;
+	const float insetU = inset / mTexDim.x, insetV = inset / mTexDim.y;
+	mScratch.clear();
+	for (int y = y0; y < y1; ++y)
+	{
+		const unsigned short* pRow = &l.tiles[y * mWidth];
+		for (int x = x0; x < x1; ++x)
+		{
+			unsigned short tile = pRow[x];
+			if (tile == EMPTY)
+				continue;
+			float u = (tile % mAtlasColumns) * tileU, v = (tile / mAtlasColumns) * tileV;
+			const unsigned short* pAnim = &mAnims[tile * 2];
+			//top left, top right, bottom left, bottom right
+			for (int corner = 0; corner < 4; ++corner)
+			{
+				int cx = corner & 1, cy = corner >> 1;
+				Vertex vert;
+				vert.pos[0] = (float)(x + cx);
+				vert.pos[1] = (float)(y + cy);
+				vert.uv[0] = u + (cx ? tileU - insetU : insetU);
+				vert.uv[1] = v + (cy ? tileV - insetV : insetV);
+				vert.anim[0] = pAnim[0];
+				vert.anim[1] = pAnim[1];
+				mScratch.push_back(vert);
+			}
+		}
+	}
+	c.numTiles = (int)mScratch.size() / 4;
+	c.dirty = false;
+	if (c.numTiles == 0)
+	{
+		//nothing to draw, let someone else have the buffer
+		if (c.buffer >= 0)
+		{
+			mBuffers[c.buffer].layer = mBuffers[c.buffer].chunk = -1;
+			c.buffer = -1;
+		}
+		return;
+	}
+	if (c.buffer < 0)
+	{
+		int b = FindBuffer(ctx);
+		if (b < 0)
+		{
+			//more on screen than the budget, try again next time
+			c.dirty = true;
+			return;
+		}
+		mBuffers[b].layer = layer;
+		mBuffers[b].chunk = chunk;
+		c.buffer = b;
+	}
+	D3D11_BOX box;
+	box.left = 0;
+	box.right = (UINT)(mScratch.size() * sizeof(Vertex));
+	box.top = box.front = 0;
+	box.bottom = box.back = 1;
+	ctx.UpdateSubresource(mBuffers[c.buffer].pVB, 0, &box, mScratch.data(), 0, 0);
+	++mNumBuilt;
+}
+
+void Tilemap::Draw(ID3D11DeviceContext& ctx, const Vector2& scroll, float zoom)
+{
+	assert(mpVS && zoom > 0);
+	++mDrawCount;
+	mNumDrawn = mNumBuilt = 0;
+
+	D3D11_VIEWPORT vp;
+	UINT numViewports = 1;
+	ctx.RSGetViewports(&numViewports, &vp);
+	assert(numViewports == 1 && vp.Width > 0 && vp.Height > 0);
+	Constants consts;
+	consts.viewport = Vector4(2 / vp.Width, -2 / vp.Height, -1, 1);
+	consts.scroll = scroll;
+	consts.tilePixels = (float)mTileSize;
+	consts.zoom = zoom;
+	consts.time = mTime;
+	consts.tileU = mTileSize / mTexDim.x;
+	consts.pad[0] = consts.pad[1] = 0;
+	ctx.UpdateSubresource(mpConsts, 0, nullptr, &consts, 0, 0);
+
+	ctx.IASetInputLayout(mpInputLayout);
+	ctx.IASetIndexBuffer(mpIB, DXGI_FORMAT_R16_UINT, 0);
+	ctx.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	ctx.VSSetShader(mpVS, nullptr, 0);
+	ctx.VSSetConstantBuffers(0, 1, &mpConsts);
+	ctx.PSSetShader(mpPS, nullptr, 0);
+	ctx.PSSetShaderResources(0, 1, &mpTex);
+	ctx.PSSetSamplers(0, 1, &mpSampler);
+	const float blendFactors[4] = { 0, 0, 0, 0 };
+	ctx.OMSetBlendState(mpBlend, blendFactors, 0xffffffff);
+	ctx.OMSetDepthStencilState(mpDepth, 0);
+	ctx.RSSetState(mpRaster);
+
+	//the chunks under the viewport are the only ones that can be seen
+	const float chunkPixels = (float)(mTileSize * CHUNK_SIZE);
+	int cx0 = std::max(0, (int)floorf(scroll.x / chunkPixels));
+	int cy0 = std::max(0, (int)floorf(scroll.y / chunkPixels));
+	int cx1 = std::min(mChunksX - 1, (int)floorf((scroll.x + vp.Width / zoom) / chunkPixels));
+	int cy1 = std::min(mChunksY - 1, (int)floorf((scroll.y + vp.Height / zoom) / chunkPixels));
+
+	UINT stride = sizeof(Vertex), offset = 0;
+	for (int layer = 0; layer < (int)mLayers.size(); ++layer)
+	{
+		Layer& l = mLayers[layer];
+		for (int cy = cy0; cy <= cy1; ++cy)
+			for (int cx = cx0; cx <= cx1; ++cx)
+			{
+				int chunk = cy * mChunksX + cx;
+				Chunk& c = l.chunks[chunk];
+				c.lastDrawn = mDrawCount;
+				if (c.dirty || (c.numTiles > 0 && c.buffer < 0))
+					Build(ctx, layer, chunk);
+				if (c.buffer < 0)
+					continue;
+				ctx.IASetVertexBuffers(0, 1, &mBuffers[c.buffer].pVB, &stride, &offset);
+				ctx.DrawIndexed(c.numTiles * 6, 0, 0);
+				++mNumDrawn;
+			}
+	}
+}
+
+double Tilemap::Benchmark(int size, int numFrames)
+{
+	MyD3D& d3d = WinUtil::Get().GetD3D();
+	ID3D11DeviceContext& ctx = d3d.GetDeviceCtx();
+	//tiles.dds as 34 pixel tiles, 6x6 of them
+	const int tileSize = 34;
+	ID3D11ShaderResourceView* pTex = d3d.GetCache().LoadTexture(&d3d.GetDevice(), "tiles.dds");
+	const TexCache::Data& data = d3d.GetCache().Get(pTex);
+	const int columns = (int)data.dim.x / tileSize, numAtlasTiles = columns * ((int)data.dim.y / tileSize);
+
+	typedef chrono::high_resolution_clock Clock;
+	typedef chrono::duration<double> Secs;
+	Clock::time_point start = Clock::now();
+	Tilemap map;
+	map.Init(d3d.GetDevice(), pTex, data.dim, tileSize, size, size, 2);
+	//the last row of the atlas flickers through 3 frames in the top layer
+	const unsigned short animTile = (unsigned short)(numAtlasTiles - columns);
+	map.SetAnimation(animTile, 3, 8);
+	mt19937 rng(1234);
+	uniform_int_distribution<int> ground(0, numAtlasTiles - columns - 1);
+	uniform_real_distribution<float> unit(0, 1);
+	vector<unsigned short> tiles((size_t)size * size);
+	for (unsigned short& t : tiles)
+		t = (unsigned short)ground(rng);
+	map.SetTiles(0, tiles.data());
+	for (unsigned short& t : tiles)
+		t = unit(rng) < 0.05f ? animTile : EMPTY;
+	map.SetTiles(1, tiles.data());
+	tiles.clear();
+	tiles.shrink_to_fit();
+	double fillSecs = Secs(Clock::now() - start).count();
+
+	//a chunk a frame diagonally, bouncing off the far side, so new chunks come in every frame
+	D3D11_VIEWPORT vp;
+	UINT numViewports = 1;
+	ctx.RSGetViewports(&numViewports, &vp);
+	const float chunkPixels = (float)(tileSize * CHUNK_SIZE);
+	const Vector2 range(std::max(1.f, size * tileSize - vp.Width), std::max(1.f, size * tileSize - vp.Height));
+	vector<Vector2> scrolls(numFrames);
+	for (int f = 0; f < numFrames; ++f)
+	{
+		Vector2 s(f * chunkPixels, f * chunkPixels * 0.6f);
+		s.x = fmodf(s.x, 2 * range.x);
+		s.y = fmodf(s.y, 2 * range.y);
+		scrolls[f] = Vector2(s.x > range.x ? 2 * range.x - s.x : s.x, s.y > range.y ? 2 * range.y - s.y : s.y);
+	}
+
+	int built = 0, drawn = 0;
+	start = Clock::now();
+	for (int f = 0; f < numFrames; ++f)
+	{
+		map.Update(1 / 60.f);
+		map.Draw(ctx, scrolls[f]);
+		built += map.GetNumChunksBuilt();
+		drawn += map.GetNumChunksDrawn();
+	}
+	double scrollSecs = Secs(Clock::now() - start).count() / numFrames;
+	//sitting still, nothing to build
+	start = Clock::now();
+	for (int f = 0; f < numFrames; ++f)
+		map.Draw(ctx, scrolls.back());
+	double stillSecs = Secs(Clock::now() - start).count() / numFrames;
+
+	//the other way, a sprite for every tile on screen every frame
+	SpriteRenderer sprites;
+	sprites.Init(d3d.GetDevice());
+	vector<RECTF> frames;
+	for (int t = 0; t < numAtlasTiles; ++t)
+		frames.push_back(RECTF{ (float)(t % columns) * tileSize, (float)(t / columns) * tileSize, (float)(t % columns + 1) * tileSize, (float)(t / columns + 1) * tileSize });
+	int spriteTex = sprites.AddTexture(pTex, data.dim, frames);
+	int numSprites = 0;
+	start = Clock::now();
+	for (int f = 0; f < numFrames; ++f)
+	{
+		const Vector2& s = scrolls[f];
+		int x0 = (int)(s.x / tileSize), y0 = (int)(s.y / tileSize);
+		int x1 = std::min(size - 1, (int)((s.x + vp.Width) / tileSize)), y1 = std::min(size - 1, (int)((s.y + vp.Height) / tileSize));
+		sprites.Begin(SpriteRenderer::TEXTURE);
+		for (int layer = 0; layer < 2; ++layer)
+			for (int y = y0; y <= y1; ++y)
+				for (int x = x0; x <= x1; ++x)
+				{
+					unsigned short t = map.GetTile(layer, x, y);
+					if (t == EMPTY)
+						continue;
+					sprites.Draw(spriteTex, t, Vector2(x * tileSize - s.x, y * tileSize - s.y));
+					++numSprites;
+				}
+		sprites.End(ctx);
+	}
+	double spriteSecs = Secs(Clock::now() - start).count() / numFrames;
+	//everything here changed the pipeline
+	d3d.InvalidateInputAssembler();
+	d3d.GetFX().InvalidatePSO();
+
+	DBOUT("Tilemap benchmark, " << size << "x" << size << " tiles, 2 layers, filled in " << fillSecs * 1000 << "ms");
+	DBOUT("  scrolling a chunk a frame " << scrollSecs * 1000 << "ms per frame, " << (float)drawn / numFrames << " chunks drawn and "
+		<< (float)built / numFrames << " built per frame, " << map.mBuffers.size() << " chunk buffers");
+	DBOUT("  still " << stillSecs * 1000 << "ms per frame, a sprite per tile " << spriteSecs * 1000 << "ms per frame ("
+		<< numSprites / numFrames << " sprites)");
+	return scrollSecs * 1000;
+}
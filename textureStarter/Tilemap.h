@@ -0,0 +1,161 @@
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+#include <vector>
+#include <d3d11.h>
+
+#include "SimpleMath.h"
+
+/*
+A tile based level - a few layers drawn in order (e.g. the ground, then walls with holes
+in), each a grid of tile numbers into one atlas texture, numbered left to right and top
+to bottom. Layers are cut into square chunks and a chunk's quads are built once into a
+vertex buffer, then only rebuilt if one of its tiles changes. Drawing only goes near the
+chunks the camera can see, so it costs the same however big the map is.
+A big map would need far more vertex memory than is sensible if every chunk was built,
+so there's a budget of chunk buffers and the chunks seen least recently give theirs up.
+Animated tiles are a run of atlas tiles along one row, the vertex shader slides the
+texture coordinates along to the current frame so animating doesn't rebuild anything.
+*/
+class Tilemap
+{
+public:
+	//tiles along each side of a chunk
+	static constexpr int CHUNK_SIZE = 32;
+	//no tile here
+	static constexpr unsigned short EMPTY = 0xffff;
+
+	~Tilemap() {
+		Release();
+	}
+	/*
+	* an empty map
+	* device - IN the gpu
+	* pTex - IN the atlas, not released
+	* texDim - IN its size in texels
+	* tileSize - IN width and height of a tile in texels, also its size in pixels at zoom 1
+	* width, height - IN in tiles
+	* numLayers - IN drawn from 0 up
+	* maxChunks - IN how many chunks can have a vertex buffer at once, more than will ever be on screen
+	*/
+	void Init(ID3D11Device& device, ID3D11ShaderResourceView* pTex, const DirectX::SimpleMath::Vector2& texDim, int tileSize,
+		int width, int height, int numLayers, int maxChunks = 512);
+	void Release();
+
+	//change a tile, its chunk is rebuilt next time it's drawn
+	void SetTile(int layer, int x, int y, unsigned short tile);
+	unsigned short GetTile(int layer, int x, int y) const {
+		return mLayers.at(layer).tiles[y * mWidth + x];
+	}
+	//fill a whole layer, width*height tiles a row at a time
+	void SetTiles(int layer, const unsigned short tiles[]);
+	/*
+	* make a tile animate, best done before the map is filled as every chunk gets rebuilt
+	* tile - IN the first frame
+	* numFrames - IN how many tiles along the atlas row it plays, 1 to stop it animating
+	* fps - IN frames per second
+	*/
+	void SetAnimation(unsigned short tile, int numFrames, float fps);
+	//move the animations on
+	void Update(float dTime) {
+		mTime += dTime;
+	}
+	/*
+	* draw every layer into whatever render target and viewport are set. Changes the
+	* pipeline like SpriteBatch, see SpriteRenderer.
+	* scroll - IN world position in pixels of the top left of the viewport
+	* zoom - IN 2 makes the tiles twice as big
+	*/
+	void Draw(ID3D11DeviceContext& ctx, const DirectX::SimpleMath::Vector2& scroll, float zoom = 1);
+
+	int GetWidth() const {
+		return mWidth;
+	}
+	int GetHeight() const {
+		return mHeight;
+	}
+	//what the last Draw did
+	int GetNumChunksDrawn() const {
+		return mNumDrawn;
+	}
+	int GetNumChunksBuilt() const {
+		return mNumBuilt;
+	}
+
+	/*
+	* scroll across a big two layer map of tiles.dds as fast as chunks can come into view,
+	* timing Draw against queueing a SpriteRenderer sprite per visible tile every frame.
+	* Needs the device. Results go to DBOUT.
+	* size - IN width and height in tiles
+	* numFrames - IN how many frames to time
+	* returns - CPU milliseconds per frame for the tilemap
+	*/
+	static double Benchmark(int size, int numFrames);
+
+private:
+	//see TileConstants.hlsl
+	struct Vertex
+	{
+		float pos[2];				//world position in tiles
+		float uv[2];				//first frame
+		unsigned short anim[2];		//half floats, frames and frames per second
+	};
+	struct Constants
+	{
+		DirectX::SimpleMath::Vector4 viewport;
+		DirectX::SimpleMath::Vector2 scroll;
+		float tilePixels, zoom, time, tileU;
+		float pad[2];
+	};
+	struct Chunk
+	{
+		int buffer = -1;			//into mBuffers, -1 if it hasn't got one
+		int numTiles = 0;			//not empty
+		bool dirty = true;			//tiles changed since it was built
+		unsigned int lastDrawn = 0;	//Draw count when it was last on screen
+	};
+	struct Layer
+	{
+		std::vector<unsigned short> tiles;
+		std::vector<Chunk> chunks;
+	};
+	struct Buffer
+	{
+		ID3D11Buffer* pVB = nullptr;
+		int layer = -1, chunk = -1;	//whose it is, -1 for nobody's
+	};
+
+	int mWidth = 0, mHeight = 0;
+	int mChunksX = 0, mChunksY = 0;
+	std::vector<Layer> mLayers;
+	std::vector<unsigned short> mAnims;		//two halfs per atlas tile, see Vertex
+	std::vector<Buffer> mBuffers;
+	int mMaxBuffers = 0;
+	std::vector<Vertex> mScratch;			//a chunk's vertices while building it
+	ID3D11ShaderResourceView* mpTex = nullptr;
+	DirectX::SimpleMath::Vector2 mTexDim;
+	int mTileSize = 0, mAtlasColumns = 0;
+	float mTime = 0;
+	unsigned int mDrawCount = 0;
+	int mNumDrawn = 0, mNumBuilt = 0;
+
+	//gpu
+	ID3D11Buffer* mpIB = nullptr;			//the same quads for every chunk
+	ID3D11Buffer* mpConsts = nullptr;
+	ID3D11VertexShader* mpVS = nullptr;
+	ID3D11PixelShader* mpPS = nullptr;
+	ID3D11InputLayout* mpInputLayout = nullptr;
+	ID3D11BlendState* mpBlend = nullptr;
+	ID3D11RasterizerState* mpRaster = nullptr;
+	ID3D11DepthStencilState* mpDepth = nullptr;
+	ID3D11SamplerState* mpSampler = nullptr;
+
+	//every chunk of every layer needs rebuilding
+	void DirtyAll();
+	//a buffer nobody's using or the one whose chunk was seen longest ago, -1 if they're all on screen
+	int FindBuffer(ID3D11DeviceContext& ctx);
+	//fill the chunk's buffer from its tiles
+	void Build(ID3D11DeviceContext& ctx, int layer, int chunk);
+};
+
+#endif
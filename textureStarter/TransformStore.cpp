@@ -0,0 +1,418 @@
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include "TransformStore.h"
+#include "D3DUtil.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+Quaternion TransformStore::FromEuler(const Vector3& angles)
+{
+	return Quaternion::CreateFromAxisAngle(Vector3(1, 0, 0), angles.x) *
+		Quaternion::CreateFromAxisAngle(Vector3(0, 1, 0), angles.y) *
+		Quaternion::CreateFromAxisAngle(Vector3(0, 0, 1), angles.z);
+}
+
+TransformHandle TransformStore::Add(const Vector3& pos, const Quaternion& rot, const Vector3& scale)
+{
+	if (mFree.empty())
+	{
+		//grow by a whole batch, the spare ones go on the free list lowest first
+		unsigned int first = (unsigned int)mFlags.size();
+		for (int c = 0; c < 3; ++c)
+		{
+			mPos[c].resize(first + BATCH, 0);
+			mScale[c].resize(first + BATCH, 1);
+		}
+		for (int c = 0; c < 4; ++c)
+			mRot[c].resize(first + BATCH, (c == 3) ? 1.f : 0.f);
+		mFlags.resize(first + BATCH, 0);
+		mGenerations.resize(first + BATCH, 1);
+		mMatrices.resize(first + BATCH);
+		for (unsigned int i = first + BATCH; i > first; --i)
+			mFree.push_back(i - 1);
+	}
+	TransformHandle h;
+	h.index = mFree.back();
+	h.generation = mGenerations[h.index];
+	mFree.pop_back();
+	mFlags[h.index] = LIVE;
+	++mNumLive;
+	SetPosition(h, pos);
+	SetRotation(h, rot);
+	SetScale(h, scale);
+	return h;
+}
+
+void TransformStore::Add(int count, TransformHandle handles[])
+{
+	assert(count >= 0);
+	int numReused = std::min(count, (int)mFree.size());
+	for (int n = 0; n < numReused; ++n)
+	{
+		unsigned int i = mFree.back();
+		mFree.pop_back();
+		//old values could still be there
+		for (int c = 0; c < 3; ++c)
+		{
+			mPos[c][i] = 0;
+			mScale[c][i] = 1;
+		}
+		for (int c = 0; c < 4; ++c)
+			mRot[c][i] = (c == 3) ? 1.f : 0.f;
+		mFlags[i] = LIVE | DIRTY;
+		handles[n].index = i;
+		handles[n].generation = mGenerations[i];
+	}
+	if (numReused < count)
+	{
+		//grow once to a whole number of batches, any left over go on the free list lowest first
+		unsigned int first = (unsigned int)mFlags.size();
+		unsigned int needed = count - numReused;
+		unsigned int size = (first + needed + BATCH - 1) / BATCH * BATCH;
+		for (int c = 0; c < 3; ++c)
+		{
+			mPos[c].resize(size, 0);
+			mScale[c].resize(size, 1);
+		}
+		for (int c = 0; c < 4; ++c)
+			mRot[c].resize(size, (c == 3) ? 1.f : 0.f);
+		mFlags.resize(size, 0);
+		mGenerations.resize(size, 1);
+		mMatrices.resize(size);
+		for (unsigned int n = 0; n < needed; ++n)
+		{
+			mFlags[first + n] = LIVE | DIRTY;
+			handles[numReused + n].index = first + n;
+			handles[numReused + n].generation = mGenerations[first + n];
+		}
+		for (unsigned int i = size; i > first + needed; --i)
+			mFree.push_back(i - 1);
+	}
+	mNumLive += count;
+}
+
+bool TransformStore::Remove(TransformHandle h)
+{
+	if (!IsValid(h))
+		return false;
+	mFlags[h.index] = 0;
+	//new generation so the old handles go stale, skipping 0 if it wraps
+	if (++mGenerations[h.index] == 0)
+		mGenerations[h.index] = 1;
+	mFree.push_back(h.index);
+	--mNumLive;
+	return true;
+}
+
+unsigned int TransformStore::GetSlot(TransformHandle h) const
+{
+	assert(IsValid(h));
+	return h.index;
+}
+
+void TransformStore::SetPosition(TransformHandle h, const Vector3& pos)
+{
+	unsigned int i = GetSlot(h);
+	mPos[0][i] = pos.x;
+	mPos[1][i] = pos.y;
+	mPos[2][i] = pos.z;
+	mFlags[i] |= DIRTY;
+}
+
+void TransformStore::SetRotation(TransformHandle h, const Quaternion& rot)
+{
+	unsigned int i = GetSlot(h);
+	Quaternion q = rot;
+	q.Normalize();
+	mRot[0][i] = q.x;
+	mRot[1][i] = q.y;
+	mRot[2][i] = q.z;
+	mRot[3][i] = q.w;
+	mFlags[i] |= DIRTY;
+}
+
+void TransformStore::SetScale(TransformHandle h, const Vector3& scale)
+{
+	unsigned int i = GetSlot(h);
+	mScale[0][i] = scale.x;
+	mScale[1][i] = scale.y;
+	mScale[2][i] = scale.z;
+	mFlags[i] |= DIRTY;
+}
+
+Vector3 TransformStore::GetPosition(TransformHandle h) const
+{
+	unsigned int i = GetSlot(h);
+	return Vector3(mPos[0][i], mPos[1][i], mPos[2][i]);
+}
+
+Quaternion TransformStore::GetRotation(TransformHandle h) const
+{
+	unsigned int i = GetSlot(h);
+	return Quaternion(mRot[0][i], mRot[1][i], mRot[2][i], mRot[3][i]);
+}
+
+Vector3 TransformStore::GetScale(TransformHandle h) const
+{
+	unsigned int i = GetSlot(h);
+	return Vector3(mScale[0][i], mScale[1][i], mScale[2][i]);
+}
+
+const GfxParamsPerObj& TransformStore::GetMatrices(TransformHandle h)
+{
+	unsigned int i = GetSlot(h);
+	if (mFlags[i] & DIRTY)
+	{
+		BuildOne(i);
+		mFlags[i] &= ~DIRTY;
+	}
+	return mMatrices[i];
+}
+
+/*
+World = scale * rotation * translation, so each of the first 3 rows is a row of the
+rotation matrix times that axis' scale. The inverse transpose of the 3x3 part is the
+same rotation rows divided by the scale instead, and like InverseTranspose() it has
+no translation. Neither needs a general inverse.
+*/
+void TransformStore::BuildOne(unsigned int i)
+{
+	float x = mRot[0][i], y = mRot[1][i], z = mRot[2][i], w = mRot[3][i];
+	float xx = 2 * x * x, yy = 2 * y * y, zz = 2 * z * z;
+	float xy = 2 * x * y, xz = 2 * x * z, yz = 2 * y * z;
+	float wx = 2 * w * x, wy = 2 * w * y, wz = 2 * w * z;
+	const float r[3][3] = {
+		{ 1 - (yy + zz), xy + wz, xz - wy },
+		{ xy - wz, 1 - (xx + zz), yz + wx },
+		{ xz + wy, yz - wx, 1 - (xx + yy) }
+	};
+	GfxParamsPerObj& m = mMatrices[i];
+	for (int row = 0; row < 3; ++row)
+	{
+		float s = mScale[row][i], inv = 1 / s;
+		for (int col = 0; col < 3; ++col)
+		{
+			m.world.m[row][col] = r[row][col] * s;
+			m.worldInvT.m[row][col] = r[row][col] * inv;
+		}
+		m.world.m[row][3] = m.worldInvT.m[row][3] = 0;
+		m.world.m[3][row] = mPos[row][i];
+		m.worldInvT.m[3][row] = 0;
+	}
+	m.world.m[3][3] = m.worldInvT.m[3][3] = 1;
+	m.worldViewProj = m.world * mViewProj;
+}
+
+//8 registers of 8 floats become their transpose, so 8 values for 8 transforms become 8 values of each transform
+SIMD_AVX2 static inline void Transpose8(__m256 r[8])
+{
+	__m256 t0 = _mm256_unpacklo_ps(r[0], r[1]), t1 = _mm256_unpackhi_ps(r[0], r[1]);
+	__m256 t2 = _mm256_unpacklo_ps(r[2], r[3]), t3 = _mm256_unpackhi_ps(r[2], r[3]);
+	__m256 t4 = _mm256_unpacklo_ps(r[4], r[5]), t5 = _mm256_unpackhi_ps(r[4], r[5]);
+	__m256 t6 = _mm256_unpacklo_ps(r[6], r[7]), t7 = _mm256_unpackhi_ps(r[6], r[7]);
+	__m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)), s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+	__m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)), s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+	__m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0)), s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+	__m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0)), s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+	r[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+	r[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+	r[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+	r[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+	r[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+	r[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+	r[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+	r[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+//same maths as BuildOne, each register holds one matrix element for all 8 transforms
+SIMD_AVX2 void TransformStore::BuildBatchAVX2(unsigned int first)
+{
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1);
+	__m256 x = _mm256_loadu_ps(&mRot[0][first]), y = _mm256_loadu_ps(&mRot[1][first]);
+	__m256 z = _mm256_loadu_ps(&mRot[2][first]), w = _mm256_loadu_ps(&mRot[3][first]);
+	__m256 x2 = _mm256_add_ps(x, x), y2 = _mm256_add_ps(y, y), z2 = _mm256_add_ps(z, z);
+	__m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+	__m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+	__m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+	const __m256 r[3][3] = {
+		{ _mm256_sub_ps(one, _mm256_add_ps(yy, zz)), _mm256_add_ps(xy, wz), _mm256_sub_ps(xz, wy) },
+		{ _mm256_sub_ps(xy, wz), _mm256_sub_ps(one, _mm256_add_ps(xx, zz)), _mm256_add_ps(yz, wx) },
+		{ _mm256_add_ps(xz, wy), _mm256_sub_ps(yz, wx), _mm256_sub_ps(one, _mm256_add_ps(xx, yy)) }
+	};
+
+	//the 48 floats of GfxParamsPerObj in order - world, inverse transpose, world*view*proj
+	__m256 e[48];
+	__m256* pWorld = e, *pInvT = e + 16, *pWVP = e + 32;
+	for (int row = 0; row < 3; ++row)
+	{
+		__m256 s = _mm256_loadu_ps(&mScale[row][first]);
+		__m256 inv = _mm256_div_ps(one, s);
+		for (int col = 0; col < 3; ++col)
+		{
+			pWorld[row * 4 + col] = _mm256_mul_ps(r[row][col], s);
+			pInvT[row * 4 + col] = _mm256_mul_ps(r[row][col], inv);
+		}
+		pWorld[row * 4 + 3] = pInvT[row * 4 + 3] = zero;
+		pWorld[12 + row] = _mm256_loadu_ps(&mPos[row][first]);
+		pInvT[12 + row] = zero;
+	}
+	pWorld[15] = pInvT[15] = one;
+	//world * viewProj, the world matrix's last column is always 0,0,0,1
+	const Matrix& vp = mViewProj;
+	for (int col = 0; col < 4; ++col)
+	{
+		__m256 vp0 = _mm256_set1_ps(vp.m[0][col]), vp1 = _mm256_set1_ps(vp.m[1][col]);
+		__m256 vp2 = _mm256_set1_ps(vp.m[2][col]), vp3 = _mm256_set1_ps(vp.m[3][col]);
+		for (int row = 0; row < 4; ++row)
+		{
+			const __m256* pW = pWorld + row * 4;
+			__m256 sum = (row == 3) ? vp3 : zero;
+			sum = _mm256_fmadd_ps(pW[0], vp0, sum);
+			sum = _mm256_fmadd_ps(pW[1], vp1, sum);
+			pWVP[row * 4 + col] = _mm256_fmadd_ps(pW[2], vp2, sum);
+		}
+	}
+
+	//8 floats of each transform at a time
+	for (int g = 0; g < 6; ++g)
+	{
+		Transpose8(e + g * 8);
+		for (int lane = 0; lane < BATCH; ++lane)
+			_mm256_storeu_ps(reinterpret_cast<float*>(&mMatrices[first + lane]) + g * 8, e[g * 8 + lane]);
+	}
+}
+
+void TransformStore::Update(const Matrix& viewProj, bool allowAVX2)
+{
+	bool cameraMoved = memcmp(&viewProj, &mViewProj, sizeof(Matrix)) != 0;
+	mViewProj = viewProj;
+
+	//find the batches that need rebuilding, checking 8 flags at a time
+	const unsigned long long live = 0x0101010101010101ull * LIVE, dirty = 0x0101010101010101ull * DIRTY;
+	static_assert(BATCH == sizeof(unsigned long long), "a batch's flags are read as one number");
+	mBatches.clear();
+	mNumUpdated = 0;
+	int numBatches = (int)mFlags.size() / BATCH;
+	for (int b = 0; b < numBatches; ++b)
+	{
+		unsigned long long flags;
+		memcpy(&flags, &mFlags[b * BATCH], sizeof(flags));
+		unsigned long long todo = flags & (cameraMoved ? live : dirty);
+		if (!todo)
+			continue;
+		Batch batch;
+		batch.first = b * BATCH;
+		batch.lanes = 0;
+		for (int lane = 0; lane < BATCH; ++lane)
+			if ((todo >> (lane * 8)) & 0xff)
+				batch.lanes |= 1 << lane;
+		mBatches.push_back(batch);
+		mNumUpdated += (int)std::bitset<BATCH>(batch.lanes).count();
+		flags &= ~dirty;
+		memcpy(&mFlags[b * BATCH], &flags, sizeof(flags));
+	}
+
+	//a whole batch costs about the same as 4 on their own, so only a few moving are done one at a time
+	bool avx2 = allowAVX2 && Simd::HasAVX2();
+	ParallelFor((int)mBatches.size(), 64, [&](int begin, int end) {
+		for (int b = begin; b < end; ++b)
+		{
+			const Batch& batch = mBatches[b];
+			if (avx2 && std::bitset<BATCH>(batch.lanes).count() >= 4)
+				BuildBatchAVX2(batch.first);
+			else
+				for (int lane = 0; lane < BATCH; ++lane)
+					if (batch.lanes & (1 << lane))
+						BuildOne(batch.first + lane);
+		}
+	});
+}
+
+double TransformStore::Benchmark(int numTransforms, int numFrames)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> unit(-1, 1);
+
+	//a crowd of things spinning about, the camera slides sideways every frame
+	std::vector<Vector3> pos(numTransforms), angles(numTransforms), scale(numTransforms);
+	TransformStore store;
+	std::vector<TransformHandle> handles(numTransforms);
+	for (int i = 0; i < numTransforms; ++i)
+	{
+		pos[i] = Vector3(unit(rng), unit(rng), unit(rng)) * 100;
+		angles[i] = Vector3(unit(rng), unit(rng), unit(rng)) * PI;
+		scale[i] = Vector3(1.5f + unit(rng), 1.5f + unit(rng), 1.5f + unit(rng));
+		handles[i] = store.Add(pos[i], FromEuler(angles[i]), scale[i]);
+	}
+	Matrix proj = Matrix::CreatePerspectiveFieldOfView(0.25f * PI, 4 / 3.f, 1, 1000);
+	auto view = [](int frame) {
+		return Matrix::CreateTranslation(frame * -0.01f, -2, 150);
+	};
+
+	//how a model used to do it, every object every frame
+	std::vector<GfxParamsPerObj> perObj(numTransforms);
+	Clock::time_point t0 = Clock::now();
+	for (int f = 0; f < numFrames; ++f)
+	{
+		Matrix v = view(f);
+		for (int i = 0; i < numTransforms; ++i)
+		{
+			GfxParamsPerObj& m = perObj[i];
+			m.world = Matrix::CreateScale(scale[i]) * Matrix::CreateRotationX(angles[i].x) *
+				Matrix::CreateRotationY(angles[i].y) * Matrix::CreateRotationZ(angles[i].z) *
+				Matrix::CreateTranslation(pos[i]);
+			m.worldInvT = InverseTranspose(m.world);
+			m.worldViewProj = m.world * v * proj;
+		}
+	}
+	Clock::time_point t1 = Clock::now();
+	for (int f = 0; f < numFrames; ++f)
+		store.Update(view(f) * proj, false);
+	Clock::time_point t2 = Clock::now();
+	std::vector<GfxParamsPerObj> plain(numTransforms);
+	for (int i = 0; i < numTransforms; ++i)
+		plain[i] = store.GetMatrices(handles[i]);
+	for (int f = 0; f < numFrames; ++f)
+		store.Update(view(f) * proj);
+	Clock::time_point t3 = Clock::now();
+	//camera still, a tenth of them moving each frame
+	int numMoved = 0;
+	for (int f = 0; f < numFrames; ++f)
+	{
+		for (int i = f % 10; i < numTransforms; i += 10)
+			store.SetPosition(handles[i], pos[i]);
+		store.Update(view(numFrames - 1) * proj);
+		numMoved += store.GetNumUpdated();
+	}
+	Clock::time_point t4 = Clock::now();
+
+	//all three should only differ by rounding, relative to the size of the numbers
+	float maxDiff = 0;
+	for (int i = 0; i < numTransforms; ++i)
+	{
+		const float* pA = reinterpret_cast<const float*>(&store.GetMatrices(handles[i]));
+		const float* pB = reinterpret_cast<const float*>(&plain[i]);
+		const float* pC = reinterpret_cast<const float*>(&perObj[i]);
+		for (int j = 0; j < 48; ++j)
+			maxDiff = std::max(maxDiff, std::max(fabsf(pA[j] - pB[j]), fabsf(pA[j] - pC[j])) / std::max(1.f, fabsf(pC[j])));
+	}
+
+	std::chrono::duration<double> old = t1 - t0, scalar = t2 - t1, simd = t3 - t2, still = t4 - t3;
+	double total = (double)numTransforms * numFrames;
+	double perSec = total / std::max(simd.count(), 1e-9);
+	DBOUT("Transforms, " << numTransforms << " objects x " << numFrames << " frames" << (Simd::HasAVX2() ? "" : " (no AVX2)")
+		<< ": one at a time " << old.count() * 1e9 / total << "ns each, plain " << scalar.count() * 1e9 / total
+		<< "ns, AVX2 on " << std::max(1u, std::thread::hardware_concurrency()) << " threads " << simd.count() * 1e9 / total
+		<< "ns, camera still and a tenth moving " << still.count() * 1e9 / total << "ns (" << numMoved / std::max(1, numFrames)
+		<< " rebuilt a frame), max difference " << maxDiff);
+	return perSec;
+}
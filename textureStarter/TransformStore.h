@@ -0,0 +1,123 @@
+#ifndef TRANSFORMSTORE_H
+#define TRANSFORMSTORE_H
+
+#include <vector>
+
+#include "SimpleMath.h"
+#include "ShaderTypes.h"
+#include "SlotMap.h"
+
+class TransformStore;
+//how models refer to where they are, see TransformStore
+typedef Handle<TransformStore> TransformHandle;
+
+/*
+Position, rotation and scale for every model, kept as separate arrays of floats
+(all the x positions together, then all the y and so on) so 8 transforms fill
+an AVX2 register. Moving something just marks it dirty, Update then rebuilds
+the world, inverse transpose and world*view*proj matrices of everything that
+moved in one pass, 8 at a time and spread over the cores. If the camera moved
+every world*view*proj is redone. The matrices are kept in the per object
+constant buffer's layout, so they can go straight to the gpu.
+Transforms don't move around, a handle is a slot number and generation like
+SlotMap's, removed slots get reused.
+*/
+class TransformStore
+{
+public:
+	/*
+	* a new transform, dirty until the next Update
+	* pos, rot, scale - IN where it starts, the rotation is normalised
+	* returns - a handle to it
+	*/
+	TransformHandle Add(const DirectX::SimpleMath::Vector3& pos = DirectX::SimpleMath::Vector3(0, 0, 0),
+		const DirectX::SimpleMath::Quaternion& rot = DirectX::SimpleMath::Quaternion(),
+		const DirectX::SimpleMath::Vector3& scale = DirectX::SimpleMath::Vector3(1, 1, 1));
+	/*
+	* lots of new transforms at once, all at the origin and unrotated. Free slots are used first,
+	* the rest come from growing the arrays once, so they end up next to each other.
+	* count - IN how many
+	* handles - OUT one for each, setting them up on different threads is fine
+	*/
+	void Add(int count, TransformHandle handles[]);
+	//free it up, any handles to it go stale. Returns false if it already had.
+	bool Remove(TransformHandle h);
+	//does the handle still refer to something
+	bool IsValid(TransformHandle h) const {
+		return h.index < mGenerations.size() && mGenerations[h.index] == h.generation && (mFlags[h.index] & LIVE);
+	}
+
+	//setters mark it dirty, the handle must be valid
+	void SetPosition(TransformHandle h, const DirectX::SimpleMath::Vector3& pos);
+	void SetRotation(TransformHandle h, const DirectX::SimpleMath::Quaternion& rot);
+	void SetScale(TransformHandle h, const DirectX::SimpleMath::Vector3& scale);
+	DirectX::SimpleMath::Vector3 GetPosition(TransformHandle h) const;
+	DirectX::SimpleMath::Quaternion GetRotation(TransformHandle h) const;
+	DirectX::SimpleMath::Vector3 GetScale(TransformHandle h) const;
+	/*
+	* world, inverse transpose (for normals) and world*view*proj (with the camera from
+	* the last Update). If it's moved since then it's rebuilt now, on its own.
+	* returns - valid until the next Add
+	*/
+	const GfxParamsPerObj& GetMatrices(TransformHandle h);
+
+	/*
+	* rebuild the matrices of everything that's moved, or everything if the camera has.
+	* Call once a frame after moving things and setting up the camera.
+	* viewProj - IN the camera's view * projection
+	* allowAVX2 - IN false to force the plain version, e.g. to compare them
+	*/
+	void Update(const DirectX::SimpleMath::Matrix& viewProj, bool allowAVX2 = true);
+
+	//rotation about x, then y, then z, in radians
+	static DirectX::SimpleMath::Quaternion FromEuler(const DirectX::SimpleMath::Vector3& angles);
+
+	//getters
+	int GetNumTransforms() const {
+		return mNumLive;
+	}
+	//how many were rebuilt by the last Update
+	int GetNumUpdated() const {
+		return mNumUpdated;
+	}
+
+	/*
+	* time building matrices for lots of objects - one at a time from euler angles like
+	* models used to, then Update plain and with AVX2 while the camera moves, then with
+	* the camera still and a few objects moving. Doesn't need a device. Results go to DBOUT.
+	* numTransforms - IN how many objects
+	* numFrames - IN how many times to update them all
+	* returns - transforms per second, AVX2 on every thread with the camera moving
+	*/
+	static double Benchmark(int numTransforms, int numFrames);
+
+private:
+	//transforms are updated in batches, the arrays are padded to a whole one
+	enum { BATCH = 8 };
+	//per transform
+	typedef enum { LIVE = 1, DIRTY = 2 } Flags;
+
+	std::vector<float> mPos[3], mRot[4], mScale[3];		//one array per component
+	std::vector<unsigned char> mFlags;
+	std::vector<unsigned int> mGenerations;	//0 is never valid, like SlotMap
+	std::vector<unsigned int> mFree;		//slots to reuse
+	std::vector<GfxParamsPerObj> mMatrices;
+	//a batch Update is rebuilding
+	struct Batch
+	{
+		unsigned int first;		//slot
+		unsigned int lanes;		//a bit for each transform in it that needs rebuilding
+	};
+	std::vector<Batch> mBatches;
+	DirectX::SimpleMath::Matrix mViewProj;
+	int mNumLive = 0, mNumUpdated = 0;
+
+	//check the handle and turn it into a slot
+	unsigned int GetSlot(TransformHandle h) const;
+	//rebuild the matrices of one transform
+	void BuildOne(unsigned int i);
+	//as BuildOne for a whole batch at once
+	void BuildBatchAVX2(unsigned int first);
+};
+
+#endif
@@ -222,7 +222,7 @@ bool WinUtil::BeginLoop(bool& canUpdateRender)
 
 	if (!mWinData.appPaused)
 	{
-		//QueryPerformanceCounter((LARGE_INTEGER*)&sTime1);
+		mPacer.BeginFrame();
 		canUpdateRender = true;
 	}
 
@@ -233,27 +233,16 @@ bool WinUtil::BeginLoop(bool& canUpdateRender)
 float WinUtil::EndLoop(bool didUpdateRender)
 {
 	if (!didUpdateRender)
-		return 0;
-	float deltaTime = 0;
-	if (!mWinData.appPaused)
-	{
-		__int64 countsPerSec;
-		QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
-		double secondsPerCount = 1.0 / (double)countsPerSec;
-		static __int64 sTime1 = 0;
-		__int64 time2;
-		QueryPerformanceCounter((LARGE_INTEGER*)&time2);
-		if (sTime1 != 0)
-			deltaTime = (float)((time2 - sTime1)*secondsPerCount);
-		sTime1 = time2;
-		AddSecToClock(deltaTime);
-
-	}
-	else
 	{
-		Sleep(100);
+		//paused, sleep until something happens rather than going round and round, and don't
+		//count the time paused when it starts again
+		mPacer.Reset();
+		WaitMessage();
+		return 0;
 	}
-	return deltaTime;
+	mPacer.EndFrame();
+	AddSecToClock(mPacer.GetRawDelta());
+	return mPacer.GetSmoothDelta();
 }
 
 int WinUtil::Run(void(*pUpdate)(float), void(*pRender)(float))
@@ -261,11 +250,6 @@ int WinUtil::Run(void(*pUpdate)(float), void(*pRender)(float))
 	MSG msg = { 0 };
 	assert(pUpdate && pRender);
 
-	__int64 countsPerSec;
-	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
-	double secondsPerCount = 1.0 / (double)countsPerSec;
-
-	float deltaTime = 0;
 	while (msg.message != WM_QUIT)
 	{
 		// If there are Window messages then process them.
@@ -279,22 +263,17 @@ int WinUtil::Run(void(*pUpdate)(float), void(*pRender)(float))
 		{
 			if (!mWinData.appPaused)
 			{
-
-				if (!mWinData.appPaused)
-					pUpdate(deltaTime);
-				pRender(deltaTime);
-
-				static __int64 sTime1=0;
-				__int64 time2;
-				QueryPerformanceCounter((LARGE_INTEGER*)&time2);
-				if(sTime1!=0)
-					deltaTime = (float)((time2 - sTime1)*secondsPerCount);
-				sTime1 = time2;
-				AddSecToClock(deltaTime);
+				mPacer.BeginFrame();
+				while (mPacer.Step())
+					pUpdate(mPacer.GetStep());
+				pRender(mPacer.GetAlpha());
+				mPacer.EndFrame();
+				AddSecToClock(mPacer.GetRawDelta());
 			}
 			else
 			{
-				Sleep(100);
+				mPacer.Reset();
+				WaitMessage();
 			}
 		}
 	}
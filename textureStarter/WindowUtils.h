@@ -6,6 +6,8 @@
 #include <string>
 #include <sstream>
 #include <assert.h>
+
+#include "FramePacer.h"
  
 class MyD3D;
 
@@ -57,8 +59,8 @@ public:
 	/*wrap your game in one function call if using basic functions
 	* Easy, but awkward to have free functions for update/render
 	  or even rework the Run function using std::function and lamdas to wrap the member function with a this pointer - advanced
-	* pUpdate - IN pointer to your own update function, gives elapsed time as a parameter
-	* pRender - IN same but for rendering
+	* pUpdate - IN pointer to your own update function, called in fixed steps and given the step as a parameter
+	* pRender - IN same but for rendering, given how far between the last two updates it is (see FramePacer::GetAlpha)
 	*/
 	int Run(void(*pUpdate)(float), void(*pRender)(float));
 	
@@ -69,11 +71,16 @@ public:
 	*/
 	bool BeginLoop(bool& canUpdateRender);
 	/*
-	* EndLoop - use after BeginLoop when the update is complete
+	* EndLoop - use after BeginLoop when the update is complete, waits out the frame if it's capped
+	* and waits for a message if paused
 	* didUpdateRender - IN if we did run and update/render then let this function know
-	* returns - how long one update/render took
+	* returns - how long one update/render took, averaged over a few frames
 	*/
 	float EndLoop(bool didUpdateRender);
+	//the loop's timing - fixed update steps and the frame cap, see FramePacer
+	FramePacer& GetPacer() {
+		return mPacer;
+	}
 
 
 	//getters
@@ -117,6 +124,7 @@ private:
 	};
 	WinData mWinData;	//data describing what's going on
 	MyD3D *mpMyD3D;		//handle to the local d3d object
+	FramePacer mPacer;	//times the loop
 	
 	//signleton so constructor is private
 	WinUtil() 
@@ -1,6 +1,9 @@
 #include "WindowUtils.h"
+#include <mmsystem.h>
+#include <cstring>
 #include "D3D.h"
 #include "Game.h"
+#include "JobSystem.h"
 
 using namespace std;
 using namespace DirectX;
@@ -27,6 +30,8 @@ LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 	PSTR cmdLine, int showCmd)
 {
+	//start the workers now so this is the main thread as far as jobs are concerned
+	JobSystem::Get();
 
 	int w(1024), h(768);
 	if (!WinUtil::Get().InitMainWindow(w, h, hInstance, "Fezzy", MainWndProc, true))
@@ -40,18 +45,38 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 
 	Game game;
 	game.Initialise();
+	//just measure and go
+	if (strstr(cmdLine, "-benchmark"))
+	{
+		Game::RunBenchmarks();
+		game.Release();
+		d3d.ReleaseD3D(true);
+		return 0;
+	}
+
+	//update 60 times a second whatever the frame rate, and don't draw frames faster than the monitor
+	//can show them (Present doesn't wait for vsync). A 1ms timer lets the cap sleep most of the wait.
+	DEVMODE mode = {};
+	mode.dmSize = sizeof(mode);
+	float refresh = 60;
+	if (EnumDisplaySettings(nullptr, ENUM_CURRENT_SETTINGS, &mode) && mode.dmDisplayFrequency > 1)
+		refresh = (float)mode.dmDisplayFrequency;
+	FramePacer& pacer = WinUtil::Get().GetPacer();
+	pacer.Init(1 / 60.f, refresh);
+	timeBeginPeriod(1);
 
 	bool canUpdateRender;
-	float dTime = 0;
 	while (WinUtil::Get().BeginLoop(canUpdateRender))
 	{
-		if (canUpdateRender && dTime > 0)
+		if (canUpdateRender && pacer.GetRawDelta() > 0)
 		{
-			game.Update(dTime);
-			game.Render(dTime);
+			while (pacer.Step())
+				game.Update(pacer.GetStep());
+			game.Render(pacer.GetAlpha());
 		}
-		dTime = WinUtil::Get().EndLoop(canUpdateRender);
+		WinUtil::Get().EndLoop(canUpdateRender);
 	}
+	timeEndPeriod(1);
 	game.Release();
 	d3d.ReleaseD3D(true);
 	return 0;